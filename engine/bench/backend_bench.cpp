@@ -0,0 +1,407 @@
+/**
+ * epoll与io_uring作为backend的性能测试(仅linux)
+ * 两者都按EVBackend的就绪通知模型使用：epoll为LT模式，io_uring为oneshot的
+ * IORING_OP_POLL_ADD，触发后重新提交，和等待事件在同一次io_uring_enter中完成
+ * 读写都由调用方执行，对比的是等待事件的开销及backend自身的系统调用次数
+ *
+ * 每一轮往active个socketpair各写1字节，然后等待这些fd的读事件并读出数据
+ *
+ * 编译: cmake -DBUILD_BENCH=ON，运行: ./backend_bench [rounds] [conns] [active]
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/// 测试参数及socketpair，_fds[i * 2]读，_fds[i * 2 + 1]写
+struct Context
+{
+    int64_t _rounds;
+    int32_t _conns;
+    int32_t _active;
+    std::vector<int> _fds;
+};
+
+/// 测试结果
+struct Result
+{
+    double _ms;        // 总耗时，毫秒
+    int64_t _events;   // 处理的事件数
+    int64_t _syscalls; // backend自身的系统调用次数(不包括读写)
+};
+
+static void print_result(const char *name, const Context &ctx, const Result &r)
+{
+    printf("%-10s %10.2f ms %8.1f ns/event %6.2f syscalls/round\n", name,
+           r._ms, r._ms * 1000000.0 / (double)r._events,
+           (double)r._syscalls / (double)ctx._rounds);
+}
+
+/// 本轮第k个活跃的连接，每轮轮换，保证所有连接都会被用到
+static int32_t active_conn(const Context &ctx, int64_t round, int32_t k)
+{
+    return (int32_t)((round * ctx._active + k) % ctx._conns);
+}
+
+static bool write_round(const Context &ctx, int64_t round)
+{
+    for (int32_t k = 0; k < ctx._active; k++)
+    {
+        int32_t i = active_conn(ctx, round, k);
+        char c    = (char)i;
+        if (1 != ::write(ctx._fds[i * 2 + 1], &c, 1))
+        {
+            printf("write fail: %s\n", strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+/// 读出一个连接的数据并校验，返回读到的字节数
+static int32_t read_conn(const Context &ctx, int32_t i)
+{
+    char buf[64];
+    int32_t total = 0;
+    while (true)
+    {
+        ssize_t n = ::read(ctx._fds[i * 2], buf, sizeof(buf));
+        if (n <= 0) break;
+
+        for (ssize_t j = 0; j < n; j++)
+        {
+            if (buf[j] != (char)i) return -1;
+        }
+        total += (int32_t)n;
+    }
+    return total;
+}
+
+static bool bench_epoll(const Context &ctx, Result &r)
+{
+    int32_t ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0)
+    {
+        printf("epoll_create1 fail: %s\n", strerror(errno));
+        return false;
+    }
+
+    for (int32_t i = 0; i < ctx._conns; i++)
+    {
+        epoll_event ev;
+        ev.events  = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, ctx._fds[i * 2], &ev);
+    }
+
+    std::vector<epoll_event> events(ctx._active);
+
+    bool ok     = true;
+    r._events   = 0;
+    r._syscalls = 0;
+
+    int64_t beg = now_ns();
+    for (int64_t round = 0; ok && round < ctx._rounds; round++)
+    {
+        if (!write_round(ctx, round))
+        {
+            ok = false;
+            break;
+        }
+
+        int32_t remain = ctx._active;
+        while (remain > 0)
+        {
+            int32_t n = epoll_wait(ep, events.data(), ctx._active, -1);
+            r._syscalls++;
+            if (n < 0)
+            {
+                if (EINTR == errno) continue;
+                ok = false;
+                break;
+            }
+            for (int32_t j = 0; j < n; j++)
+            {
+                if (1 != read_conn(ctx, (int32_t)events[j].data.u32))
+                {
+                    ok = false;
+                    break;
+                }
+            }
+            remain -= n;
+            r._events += n;
+        }
+    }
+    r._ms = (double)(now_ns() - beg) / 1000000.0;
+
+    ::close(ep);
+    if (!ok) printf("epoll verify fail\n");
+    return ok;
+}
+
+/// 只实现测试需要的部分，和IOUringBackend一样直接使用syscall
+class Ring
+{
+public:
+    Ring()
+    {
+        _fd     = -1;
+        _sq_ptr = MAP_FAILED;
+        _cq_ptr = MAP_FAILED;
+        _sqes   = (io_uring_sqe *)MAP_FAILED;
+    }
+    ~Ring()
+    {
+        if (MAP_FAILED != (void *)_sqes) munmap(_sqes, _sqes_sz);
+        if (MAP_FAILED != _cq_ptr && _cq_ptr != _sq_ptr)
+        {
+            munmap(_cq_ptr, _cq_sz);
+        }
+        if (MAP_FAILED != _sq_ptr) munmap(_sq_ptr, _sq_sz);
+        if (_fd >= 0) ::close(_fd);
+    }
+
+    bool setup(uint32_t entries)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+
+        _fd = (int32_t)syscall(__NR_io_uring_setup, entries, &p);
+        if (_fd < 0) return false;
+
+        _sq_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        _cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single && _cq_sz > _sq_sz) _sq_sz = _cq_sz;
+
+        _sq_ptr = mmap(nullptr, _sq_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+        if (MAP_FAILED == _sq_ptr) return false;
+
+        _cq_ptr = single ? _sq_ptr
+                         : mmap(nullptr, _cq_sz, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, _fd,
+                                IORING_OFF_CQ_RING);
+        if (MAP_FAILED == _cq_ptr) return false;
+
+        _sqes_sz = p.sq_entries * sizeof(io_uring_sqe);
+        _sqes    = (io_uring_sqe *)mmap(nullptr, _sqes_sz,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, _fd,
+                                     IORING_OFF_SQES);
+        if (MAP_FAILED == (void *)_sqes) return false;
+
+        char *sq = (char *)_sq_ptr;
+        char *cq = (char *)_cq_ptr;
+
+        _sq_head    = (uint32_t *)(sq + p.sq_off.head);
+        _sq_tail    = (uint32_t *)(sq + p.sq_off.tail);
+        _sq_array   = (uint32_t *)(sq + p.sq_off.array);
+        _sq_mask    = *(uint32_t *)(sq + p.sq_off.ring_mask);
+        _sq_entries = p.sq_entries;
+        _local_tail = *_sq_tail;
+        _pending    = 0;
+
+        _cq_head = (uint32_t *)(cq + p.cq_off.head);
+        _cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+        _cqes    = (io_uring_cqe *)(cq + p.cq_off.cqes);
+        _cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+
+        return true;
+    }
+
+    /// 提交一个oneshot的poll请求，SQ的大小保证不会满
+    void poll_add(int32_t fd, uint64_t data)
+    {
+        uint32_t index    = _local_tail & _sq_mask;
+        io_uring_sqe *sqe = _sqes + index;
+        memset(sqe, 0, sizeof(*sqe));
+
+        sqe->opcode        = IORING_OP_POLL_ADD;
+        sqe->fd            = fd;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data     = data;
+
+        _sq_array[index] = index;
+        _local_tail++;
+        _pending++;
+    }
+
+    /// 提交所有待提交的请求并等待至少min_complete个完成事件
+    int32_t enter(uint32_t min_complete)
+    {
+        __atomic_store_n(_sq_tail, _local_tail, __ATOMIC_RELEASE);
+
+        uint32_t flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        int32_t ret    = (int32_t)syscall(__NR_io_uring_enter, _fd, _pending,
+                                       min_complete, flags, nullptr, 0);
+        if (ret >= 0) _pending -= (uint32_t)ret;
+
+        return ret;
+    }
+
+    /// 取出所有完成事件，返回处理的数量
+    template <class F> int32_t reap(F &&f)
+    {
+        uint32_t head = *_cq_head;
+        uint32_t tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+
+        int32_t n = 0;
+        for (; head != tail; head++, n++)
+        {
+            const io_uring_cqe *cqe = _cqes + (head & _cq_mask);
+            f(cqe->user_data, cqe->res);
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+
+        return n;
+    }
+
+private:
+    int32_t _fd;
+    void *_sq_ptr;
+    void *_cq_ptr;
+    io_uring_sqe *_sqes;
+    size_t _sq_sz;
+    size_t _cq_sz;
+    size_t _sqes_sz;
+
+    uint32_t *_sq_head;
+    uint32_t *_sq_tail;
+    uint32_t *_sq_array;
+    uint32_t _sq_mask;
+    uint32_t _sq_entries;
+    uint32_t _local_tail;
+    uint32_t _pending;
+
+    uint32_t *_cq_head;
+    uint32_t *_cq_tail;
+    io_uring_cqe *_cqes;
+    uint32_t _cq_mask;
+};
+
+/// 返回-1表示内核不支持，跳过测试
+static int32_t bench_iouring(const Context &ctx, Result &r)
+{
+    // 所有连接的poll请求都要能一次放进SQ
+    uint32_t entries = 1;
+    while (entries < (uint32_t)ctx._conns) entries <<= 1;
+
+    Ring ring;
+    if (!ring.setup(entries))
+    {
+        printf("io_uring not supported: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (int32_t i = 0; i < ctx._conns; i++)
+    {
+        ring.poll_add(ctx._fds[i * 2], (uint64_t)i);
+    }
+
+    bool ok     = true;
+    r._events   = 0;
+    r._syscalls = 0;
+
+    int64_t beg = now_ns();
+    for (int64_t round = 0; ok && round < ctx._rounds; round++)
+    {
+        if (!write_round(ctx, round))
+        {
+            ok = false;
+            break;
+        }
+
+        int32_t remain = ctx._active;
+        while (remain > 0)
+        {
+            // 上一次触发后重新提交的poll请求和等待事件在同一次系统调用中完成
+            int32_t ret = ring.enter((uint32_t)remain);
+            r._syscalls++;
+            if (ret < 0)
+            {
+                if (EINTR == errno) continue;
+                ok = false;
+                break;
+            }
+
+            int32_t n = ring.reap([&ctx, &ring, &ok](uint64_t data, int32_t res) {
+                int32_t i = (int32_t)data;
+                if (res < 0 || 1 != read_conn(ctx, i)) ok = false;
+                ring.poll_add(ctx._fds[i * 2], data);
+            });
+            remain -= n;
+            r._events += n;
+        }
+    }
+    r._ms = (double)(now_ns() - beg) / 1000000.0;
+
+    if (!ok) printf("io_uring verify fail\n");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    Context ctx;
+    ctx._rounds = argc > 1 ? atoll(argv[1]) : 100000;
+    ctx._conns  = argc > 2 ? atoi(argv[2]) : 1000;
+    ctx._active = argc > 3 ? atoi(argv[3]) : 16;
+    if (ctx._rounds <= 0) ctx._rounds = 100000;
+    if (ctx._conns <= 0) ctx._conns = 1000;
+    if (ctx._active <= 0 || ctx._active > ctx._conns) ctx._active = ctx._conns;
+
+    ctx._fds.resize((size_t)ctx._conns * 2);
+    for (int32_t i = 0; i < ctx._conns; i++)
+    {
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+                       &ctx._fds[i * 2]))
+        {
+            printf("socketpair fail(ulimit -n ?): %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    printf("backend %" PRId64 " rounds, %d conns, %d active\n", ctx._rounds,
+           ctx._conns, ctx._active);
+
+    int32_t code = 0;
+    Result r;
+    if (bench_epoll(ctx, r))
+    {
+        print_result("epoll", ctx, r);
+    }
+    else
+    {
+        code = 1;
+    }
+
+    // 内核不支持(低于5.1、被seccomp禁止等)时只跳过，不算失败
+    int32_t e = bench_iouring(ctx, r);
+    if (0 == e) print_result("io_uring", ctx, r);
+    if (1 == e) code = 1;
+
+    for (auto fd : ctx._fds) ::close(fd);
+
+    return code;
+}
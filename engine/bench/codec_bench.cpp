@@ -0,0 +1,462 @@
+/**
+ * LuaBin、Protobuf、FlatBuffers三种编码方式的性能测试
+ * 加载server/pb、server/fbs中的协议描述文件，构造几种典型的lua table(移动包、
+ * 大背包列表、嵌套的邮件列表等)，统计每种编码方式编码、解码的耗时、编码后的字节数、
+ * 内存分配次数及lua gc压力。不需要启动服务器，可以直接在CI中运行。flatbuffers额外
+ * 测试解码为只读视图的耗时，分为直接引用接收缓冲区(view)及需要先拷贝(view_copy)
+ *
+ * 内存分配只统计lua(lua_Alloc)及C++(operator new)，pbc内部使用malloc，不在统计之内
+ *
+ * 编译: cmake -DBUILD_BENCH=ON，在server/bin目录下运行:
+ * ./codec_bench [count] [pb_path] [fbs_path]
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <lua.hpp>
+
+#include "../src/net/codec/flatbuffers_codec.hpp"
+#include "../src/net/codec/luabin_codec.hpp"
+#include "../src/net/codec/protobuf_codec.hpp"
+#include "../src/net/net_header.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// 编码器里出错时会写日志，这里没有日志线程，直接输出到stderr
+static char error_path[] = "error";
+const char *get_error_path()
+{
+    return error_path;
+}
+
+void __async_log(const char *path, LogType type, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 内存分配统计，只计数不影响分配本身
+struct AllocStat
+{
+    int64_t _count; ///< 分配次数
+    int64_t _bytes; ///< 分配的字节数
+};
+
+static AllocStat lua_alloc_stat = {0, 0};
+static AllocStat cpp_alloc_stat = {0, 0};
+
+static void *cpp_alloc(size_t size)
+{
+    cpp_alloc_stat._count++;
+    cpp_alloc_stat._bytes += (int64_t)size;
+
+    void *ptr = ::malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+
+    return ptr;
+}
+
+void *operator new(size_t size)
+{
+    return cpp_alloc(size);
+}
+
+void *operator new[](size_t size)
+{
+    return cpp_alloc(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    ::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    ::free(ptr);
+}
+
+void operator delete(void *ptr, size_t size) noexcept
+{
+    ::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t size) noexcept
+{
+    ::free(ptr);
+}
+
+/// 与luaL_newstate中的分配函数一致，额外统计分配次数
+static void *lua_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    if (0 == nsize)
+    {
+        ::free(ptr);
+        return nullptr;
+    }
+
+    // 原地缩小不算分配，扩大按新分配计算(realloc可能需要拷贝)
+    if (!ptr || nsize > osize)
+    {
+        lua_alloc_stat._count++;
+        lua_alloc_stat._bytes += (int64_t)nsize;
+    }
+    return ::realloc(ptr, nsize);
+}
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 测试数据，用lua脚本生成，返回一个table
+
+// 实体移动，场景中最频繁的小包
+static const char *MOVE_PKT = R"(
+return { handle = 4294967297, way = 1, pix_x = 6400, pix_y = 3200 }
+)";
+
+// flatbuffers中没有移动协议，用字段相近的CPing代替
+static const char *PING_PKT = R"(
+return { x = 6400, y = 3200, z = 0, way = 1, target = { 1, 2, 3 }, say = "" }
+)";
+
+// 登录时下发的整个背包，道具数量较多
+static const char *BAG_PKT = R"(
+local items = {}
+for i = 1, 200 do
+    items[i] = {
+        uuid = string.format("1000%08d", i),
+        id = 10000 + i,
+        count = i % 99 + 1,
+        grid = i,
+        level = i % 3 == 0 and 10 + i % 50 or nil,
+        stage = i % 3 == 0 and i % 10 or nil,
+    }
+end
+return { items = items }
+)";
+
+// 邮件列表，邮件中嵌套附件数组
+static const char *MAIL_PKT = R"(
+local mails = {}
+for i = 1, 30 do
+    local attachments = {}
+    for k = 1, i % 4 do
+        attachments[k] = {
+            uuid = string.format("2000%08d", i * 10 + k),
+            id = 20000 + k,
+            count = k * 10,
+        }
+    end
+    mails[i] = {
+        id = i,
+        title = "系统邮件" .. i,
+        ctx = string.rep("恭喜您获得活动奖励，请及时领取附件。", 3),
+        new = i % 2 == 0,
+        attachments = attachments,
+    }
+end
+return { mails = mails }
+)";
+
+// 包含所有数据类型及嵌套数组，protobuf、flatbuffers中都有这个协议
+static const char *TEST_PKT = R"(
+local function sub()
+    return {
+        d1 = -99999999999999.55555, d2 = 99999999999999.55555,
+        f1 = 0.5, f2 = -0.5,
+        i1 = -2147483648, i2 = 2147483647,
+        i641 = math.mininteger, i642 = math.maxinteger,
+        b1 = true, b2 = false,
+        s1 = "s", s2 = string.rep("ssssssssss", 8),
+        by1 = "s", by2 = string.rep("bbbbbbbbbb", 8),
+        ui1 = 1, ui2 = 4294967295,
+        ui641 = 1, ui642 = math.maxinteger,
+        f321 = 2147483648, f322 = 2147483647,
+        f641 = 1, f642 = math.maxinteger,
+    }
+end
+local pkt = sub()
+pkt.index = 1
+pkt.context = "test"
+pkt.msg1 = sub()
+pkt.i_list = { 1, 2, 3, 4, 5, 99999, 55555, 111111111 }
+pkt.msg_list = {}
+for i = 1, 16 do pkt.msg_list[i] = sub() end
+return pkt
+)";
+
+struct BenchCase
+{
+    const char *_name;   ///< 测试数据名
+    int32_t _codec;      ///< 编码方式，见Codec::CodecType
+    const char *_schema; ///< 同CmdCfg::_schema
+    const char *_object; ///< 同CmdCfg::_object
+    const char *_script; ///< 生成测试数据的lua脚本
+};
+
+static const BenchCase bench_cases[] = {
+    {"move", Codec::CT_LUABIN, "", "", MOVE_PKT},
+    {"move", Codec::CT_PROTOBUF, "entity", "entity.SMove", MOVE_PKT},
+    {"move", Codec::CT_FLATBUF, "player.bfbs", "CPing", PING_PKT},
+    {"bag", Codec::CT_LUABIN, "", "", BAG_PKT},
+    {"bag", Codec::CT_PROTOBUF, "bag", "bag.SBagInfo", BAG_PKT},
+    {"mail", Codec::CT_LUABIN, "", "", MAIL_PKT},
+    {"mail", Codec::CT_PROTOBUF, "mail", "mail.SMailInfo", MAIL_PKT},
+    {"test", Codec::CT_LUABIN, "", "", TEST_PKT},
+    {"test", Codec::CT_PROTOBUF, "system", "system.TestBase", TEST_PKT},
+    {"test", Codec::CT_FLATBUF, "system.bfbs", "TestBase", TEST_PKT},
+};
+
+static const char *codec_name(int32_t codec)
+{
+    switch (codec)
+    {
+    case Codec::CT_LUABIN: return "luabin";
+    case Codec::CT_PROTOBUF: return "protobuf";
+    case Codec::CT_FLATBUF: return "flatbuffers";
+    default: return "unknow";
+    }
+}
+
+/// 一种编码方式对一个测试数据的结果，均为单次操作的平均值
+struct BenchResult
+{
+    int32_t _bytes;     ///< 编码后的字节数
+    double _ns;         ///< 耗时
+    double _lua_allocs; ///< lua内存分配次数
+    double _lua_bytes;  ///< lua分配的字节数，即gc需要回收的量
+    double _cpp_allocs; ///< C++ operator new次数
+};
+
+/**
+ * 执行count次操作并统计平均值
+ * @param op 单次操作，返回<0表示出错
+ */
+template <typename Op>
+static bool run(int64_t count, BenchResult &result, Op &&op)
+{
+    AllocStat lua_beg = lua_alloc_stat;
+    AllocStat cpp_beg = cpp_alloc_stat;
+
+    int64_t beg = now_ns();
+    for (int64_t i = 0; i < count; i++)
+    {
+        if (op() < 0) return false;
+    }
+    int64_t ns = now_ns() - beg;
+
+    double n           = (double)count;
+    result._ns         = (double)ns / n;
+    result._lua_allocs = (double)(lua_alloc_stat._count - lua_beg._count) / n;
+    result._lua_bytes  = (double)(lua_alloc_stat._bytes - lua_beg._bytes) / n;
+    result._cpp_allocs = (double)(cpp_alloc_stat._count - cpp_beg._count) / n;
+
+    return true;
+}
+
+static void print_result(const BenchCase &bc, const char *op,
+                         const BenchResult &result)
+{
+    printf("%-6s %-12s %-18s %-10s %8d %12.1f %10.1f %10.1f %10.1f\n",
+           bc._name, codec_name(bc._codec), bc._object[0] ? bc._object : "-",
+           op, result._bytes, result._ns, result._lua_allocs,
+           result._lua_bytes / 1024, result._cpp_allocs);
+}
+
+/**
+ * 测试一种编码方式编码、解码一个测试数据
+ * @return 是否成功，编码、解码出错或者结果校验不通过均为失败
+ */
+static bool bench(lua_State *L, Codec *codec, const BenchCase &bc,
+                  int64_t count)
+{
+    CmdCfg cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    snprintf(cfg._schema, sizeof(cfg._schema), "%s", bc._schema);
+    snprintf(cfg._object, sizeof(cfg._object), "%s", bc._object);
+
+    if (LUA_OK != luaL_dostring(L, bc._script))
+    {
+        printf("%s script error: %s\n", bc._name, lua_tostring(L, -1));
+        return false;
+    }
+    const int32_t index = lua_gettop(L);
+
+    // 编码的结果在下一次编码前有效，先复制一份用于解码
+    const char *buffer = nullptr;
+    int32_t len        = codec->encode(L, index, &buffer, &cfg);
+    if (len < 0)
+    {
+        printf("%s %s encode fail\n", bc._name, codec_name(bc._codec));
+        return false;
+    }
+    std::string encoded(buffer, (size_t)len);
+    codec->finalize();
+
+    BenchResult result;
+    result._bytes = len;
+    bool ok       = run(count, result, [&]() {
+        int32_t size = codec->encode(L, index, &buffer, &cfg);
+        codec->finalize();
+        return size;
+    });
+    if (!ok)
+    {
+        printf("%s %s encode fail\n", bc._name, codec_name(bc._codec));
+        return false;
+    }
+    print_result(bc, "encode", result);
+
+    ok = run(count, result, [&]() {
+        int32_t cnt = codec->decode(L, encoded.c_str(), encoded.size(), &cfg);
+        lua_settop(L, index);
+        return cnt;
+    });
+    if (!ok)
+    {
+        printf("%s %s decode fail\n", bc._name, codec_name(bc._codec));
+        return false;
+    }
+    print_result(bc, "decode", result);
+
+    // protobuf关闭编码计划，对比pbc的编码、解码。pbc的字段顺序取决于table的
+    // 遍历顺序，内容不一定相同，但长度必须一致
+    if (Codec::CT_PROTOBUF == bc._codec)
+    {
+        ProtobufCodec *pb = static_cast<ProtobufCodec *>(codec);
+        pb->set_plan(false);
+        ok = run(count, result, [&]() {
+            int32_t size = codec->encode(L, index, &buffer, &cfg);
+            codec->finalize();
+            if (size >= 0) result._bytes = size;
+            return size;
+        });
+        if (ok) print_result(bc, "pbc_encode", result);
+        if (ok && result._bytes != (int32_t)encoded.size())
+        {
+            printf("%s pbc length not match, %d != %zu\n", bc._name,
+                   result._bytes, encoded.size());
+            ok = false;
+        }
+
+        if (ok)
+        {
+            ok = run(count, result, [&]() {
+                int32_t cnt =
+                    codec->decode(L, encoded.c_str(), encoded.size(), &cfg);
+                lua_settop(L, index);
+                return cnt;
+            });
+        }
+        if (ok) print_result(bc, "pbc_decode", result);
+        pb->set_plan(true);
+        if (!ok)
+        {
+            printf("%s %s pbc fail\n", bc._name, codec_name(bc._codec));
+            return false;
+        }
+    }
+
+    // flatbuffers解码为只读视图，只校验数据并创建一个userdata
+    // 数据在接收缓冲区chunk中时直接引用(view)，否则先拷贝一份(view_copy)
+    for (int32_t i = 0; Codec::CT_FLATBUF == bc._codec && i < 2; i++)
+    {
+        const char *op = 0 == i ? "view" : "view_copy";
+
+        cfg._mask = CmdCfg::MK_VIEW;
+        codec->set_stable(0 == i);
+        ok = run(count, result, [&]() {
+            int32_t cnt =
+                codec->decode(L, encoded.c_str(), encoded.size(), &cfg);
+            lua_settop(L, index);
+            codec->decode_done();
+            return cnt;
+        });
+        codec->set_stable(false);
+        cfg._mask = 0;
+        if (!ok)
+        {
+            printf("%s %s %s fail\n", bc._name, codec_name(bc._codec), op);
+            return false;
+        }
+        print_result(bc, op, result);
+    }
+
+    // 解码出来的数据再编码一次，长度应该与原来的一致(table的遍历顺序可能不同，
+    // 因此不比较内容)
+    if (codec->decode(L, encoded.c_str(), encoded.size(), &cfg) < 0)
+    {
+        printf("%s %s decode fail\n", bc._name, codec_name(bc._codec));
+        return false;
+    }
+    len = codec->encode(L, index + 1, &buffer, &cfg);
+    codec->finalize();
+    lua_settop(L, index - 1);
+    if (len != (int32_t)encoded.size())
+    {
+        printf("%s %s result not match, %d != %zu\n", bc._name,
+               codec_name(bc._codec), len, encoded.size());
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int64_t count = argc > 1 ? atoll(argv[1]) : 10000;
+    if (count <= 0) count = 10000;
+
+    const char *pb_path  = argc > 2 ? argv[2] : "../pb";
+    const char *fbs_path = argc > 3 ? argv[3] : "../fbs";
+
+    Codec *codecs[Codec::CT_MAX] = {nullptr};
+    codecs[Codec::CT_LUABIN]     = new LuaBinCodec();
+    codecs[Codec::CT_PROTOBUF]   = new ProtobufCodec();
+    codecs[Codec::CT_FLATBUF]    = new FlatbuffersCodec();
+
+    int32_t ecode = 0;
+    if (codecs[Codec::CT_PROTOBUF]->load_path(pb_path) < 0)
+    {
+        printf("load protobuf schema fail: %s\n", pb_path);
+        ecode = 1;
+    }
+    if (codecs[Codec::CT_FLATBUF]->load_path(fbs_path) < 0)
+    {
+        printf("load flatbuffers schema fail: %s\n", fbs_path);
+        ecode = 1;
+    }
+
+    lua_State *L = lua_newstate(lua_alloc, nullptr);
+    luaL_openlibs(L);
+
+    printf("codec bench %" PRId64 " times per case, %s\n", count,
+           LUA_RELEASE);
+    printf("%-6s %-12s %-18s %-10s %8s %12s %10s %10s %10s\n", "case", "codec",
+           "object", "op", "bytes", "ns/op", "lua alloc", "lua KB", "new");
+
+    for (const BenchCase &bc : bench_cases)
+    {
+        if (0 != ecode) break;
+        if (!bench(L, codecs[bc._codec], bc, count)) ecode = 1;
+    }
+
+    lua_close(L);
+    for (Codec *codec : codecs) delete codec;
+
+    return ecode;
+}
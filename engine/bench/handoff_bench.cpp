@@ -0,0 +1,164 @@
+/**
+ * 主线程与backend线程之间传递io事件的性能测试
+ * 对比加锁的数组(std::mutex、SpinLock + std::vector交换)与SPSC无锁队列
+ * 的吞吐量及单个事件从生产者到消费者的延迟
+ *
+ * 编译: cmake -DBUILD_BENCH=ON，运行: ./handoff_bench [count]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../src/thread/spin_lock.hpp"
+#include "../src/thread/spsc_queue.hpp"
+
+/// 模拟EVBackend::IOEvent，额外带上生产时间用于计算延迟
+struct Event
+{
+    int64_t _time;
+    int32_t _events;
+};
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/// 测试结果
+struct Result
+{
+    double _ms;      // 总耗时，毫秒
+    int64_t _avg;    // 平均延迟，纳秒
+    int64_t _p99;    // 99%延迟，纳秒
+    int64_t _max;    // 最大延迟，纳秒
+};
+
+static Result make_result(int64_t beg, std::vector<int64_t> &latency)
+{
+    Result r;
+    r._ms = (double)(now_ns() - beg) / 1000000.0;
+
+    int64_t total = 0;
+    for (auto v : latency) total += v;
+
+    std::sort(latency.begin(), latency.end());
+    r._avg = total / (int64_t)latency.size();
+    r._p99 = latency[latency.size() * 99 / 100];
+    r._max = latency.back();
+
+    return r;
+}
+
+/// 与原来的实现一致：生产者加锁push_back，消费者加锁后交换整个数组
+template <class Lock> static Result bench_lock(int64_t count)
+{
+    Lock lock;
+    std::vector<Event> queue;
+    queue.reserve(1024);
+
+    std::vector<int64_t> latency;
+    latency.reserve((size_t)count);
+
+    int64_t beg = now_ns();
+    std::thread consumer(
+        [&]()
+        {
+            std::vector<Event> events;
+            events.reserve(1024);
+            while ((int64_t)latency.size() < count)
+            {
+                {
+                    std::lock_guard<Lock> guard(lock);
+                    events.swap(queue);
+                }
+                // 没有数据时让出cpu，避免核数较少时消费者占满cpu
+                if (events.empty())
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                int64_t now = now_ns();
+                for (auto &e : events) latency.push_back(now - e._time);
+                events.clear();
+            }
+        });
+
+    for (int64_t i = 0; i < count; i++)
+    {
+        std::lock_guard<Lock> guard(lock);
+        queue.push_back({now_ns(), 1});
+    }
+    consumer.join();
+
+    return make_result(beg, latency);
+}
+
+/// 无锁队列，满了生产者让出cpu等待(实际使用中是回退到加锁的数组)
+static Result bench_spsc(int64_t count)
+{
+    static SPSCQueue<Event, 4096> queue;
+
+    std::vector<int64_t> latency;
+    latency.reserve((size_t)count);
+
+    int64_t beg = now_ns();
+    std::thread consumer(
+        [&]()
+        {
+            // 与加锁的方式一样，每批事件只取一次时间
+            Event e;
+            std::vector<Event> events;
+            events.reserve(4096);
+            while ((int64_t)latency.size() < count)
+            {
+                while (queue.pop(e)) events.push_back(e);
+                if (events.empty())
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                int64_t now = now_ns();
+                for (auto &ev : events) latency.push_back(now - ev._time);
+                events.clear();
+            }
+        });
+
+    for (int64_t i = 0; i < count; i++)
+    {
+        Event e{now_ns(), 1};
+        while (!queue.push(e)) std::this_thread::yield();
+    }
+    consumer.join();
+
+    return make_result(beg, latency);
+}
+
+static void print_result(const char *name, int64_t count, const Result &r)
+{
+    printf("%-12s %10.2f ms %12.0f ev/s  avg %8" PRId64 " ns  p99 %8" PRId64
+           " ns  max %10" PRId64 " ns\n",
+           name, r._ms, (double)count * 1000.0 / r._ms, r._avg, r._p99,
+           r._max);
+}
+
+int main(int argc, char **argv)
+{
+    int64_t count = argc > 1 ? atoll(argv[1]) : 1000000;
+    if (count <= 0) count = 1000000;
+
+    printf("handoff %" PRId64 " events\n", count);
+    print_result("std::mutex", count, bench_lock<std::mutex>(count));
+    print_result("SpinLock", count, bench_lock<SpinLock>(count));
+    print_result("SPSCQueue", count, bench_spsc(count));
+
+    return 0;
+}
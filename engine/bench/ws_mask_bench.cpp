@@ -0,0 +1,90 @@
+/**
+ * websocket掩码编码、解码的性能测试
+ * 对比websocket_parser逐个字节的实现与WSMask(SIMD)的吞吐量，并校验结果一致
+ *
+ * 编译: cmake -DBUILD_BENCH=ON，运行: ./ws_mask_bench [total_mb]
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../src/net/packet/ws_mask.hpp"
+
+typedef uint8_t (*MaskFunc)(char *, const char *, size_t, const char[4],
+                            uint8_t);
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * 模拟收包时的用法：每个帧的数据分两段解码(第一段长度不是4的倍数)，
+ * 写到另一块缓冲区
+ * @return 吞吐量，GB/s
+ */
+static double bench(MaskFunc func, size_t size, size_t total,
+                    std::vector<char> &src, std::vector<char> &dst)
+{
+    static const char key[4] = {0x12, 0x34, 0x56, 0x78};
+
+    size_t loop   = total / size + 1;
+    size_t split  = size / 3;
+    int64_t beg   = now_ns();
+    for (size_t i = 0; i < loop; i++)
+    {
+        uint8_t offset = func(dst.data(), src.data(), split, key, 0);
+        func(dst.data() + split, src.data() + split, size - split, key, offset);
+    }
+    int64_t ns = now_ns() - beg;
+
+    return (double)(loop * size) / (double)(ns > 0 ? ns : 1);
+}
+
+int main(int argc, char **argv)
+{
+    int64_t total_mb = argc > 1 ? atoll(argv[1]) : 1024;
+    if (total_mb <= 0) total_mb = 1024;
+
+    const size_t total   = (size_t)total_mb * 1024 * 1024;
+    const size_t sizes[] = {16, 64, 256, 1024, 4096, 65536, 1024 * 1024};
+
+    printf("ws mask %" PRId64 " MB per size, impl = %s\n", total_mb,
+           WSMask::impl_name());
+    printf("%10s %12s %12s %8s\n", "size", "bytes GB/s", "simd GB/s", "x");
+
+    for (size_t size : sizes)
+    {
+        std::vector<char> src(size), dst(size), expect(size);
+        for (size_t i = 0; i < size; i++) src[i] = (char)(rand() & 0xFF);
+
+        double bytes = bench(WSMask::mask_bytes, size, total, src, expect);
+        double simd  = bench(WSMask::mask, size, total, src, dst);
+        if (0 != memcmp(dst.data(), expect.data(), size))
+        {
+            printf("result not match at size %zu\n", size);
+            return 1;
+        }
+
+        // 原地处理两次应该还原数据
+        std::vector<char> inplace(src);
+        static const char key[4] = {0x01, 0x02, 0x03, 0x04};
+        WSMask::mask(inplace.data(), inplace.data(), size, key, 3);
+        WSMask::mask(inplace.data(), inplace.data(), size, key, 3);
+        if (inplace != src)
+        {
+            printf("inplace not match at size %zu\n", size);
+            return 1;
+        }
+
+        printf("%10zu %12.2f %12.2f %8.1f\n", size, bytes, simd, simd / bytes);
+    }
+
+    return 0;
+}
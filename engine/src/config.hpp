@@ -11,6 +11,14 @@
 //#define NDEBUG
 
 
+/* 默认io线程(backend)数量，每个线程独立epoll，可在脚本启动主循环前修改 */
+#define EV_BACKEND_NUM 1
+
+/* linux下是否编译io_uring作为io后台(需要内核5.1以上)，默认仍使用epoll
+ * 也可以通过cmake -DIO_URING=ON开启，运行时需ev:set_backend指定BT_IO_URING才会使用
+ */
+// #define CONF_IO_URING
+
 /* 单个包最大长度，与包头数据类型定义有关 */
 #define MAX_PACKET_LEN 65535
 
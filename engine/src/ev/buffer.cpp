@@ -12,6 +12,8 @@ Buffer::LargeBuffer::LargeBuffer()
 Buffer::LargeBuffer::~LargeBuffer()
 {
     if (_ctx) delete[] _ctx;
+
+    CtxPool::add_extra(-static_cast<int64_t>(_len));
 }
 
 char *Buffer::LargeBuffer::get(size_t len)
@@ -21,19 +23,75 @@ char *Buffer::LargeBuffer::get(size_t len)
     if (_ctx) delete[] _ctx;
 
     // 以1M为基数，每次翻倍，只增不减
+    size_t old_len = _len;
     if (0 == _len) _len = 1024 * 1024;
     while (_len < len) _len *= 2;
 
+    CtxPool::add_extra(static_cast<int64_t>(_len - old_len));
+
     _ctx = new char[_len];
 
     return _ctx;
 }
 ////////////////////////////////////////////////////////////////////////////////
+std::atomic<int64_t> Buffer::CtxPool::_extra(0);
+
+Buffer::CtxPool::CtxPool()
+    : _ctx_pool0("buffer_ctx_512"), _ctx_pool1("buffer_ctx_2k"),
+      _ctx_pool2("buffer_ctx_8k"), _ctx_pool3("buffer_ctx_64k")
+{
+    _used.store(0, std::memory_order_relaxed);
+}
+
+char *Buffer::CtxPool::construct(int32_t cls)
+{
+    _used.fetch_add(CTX_SIZE[cls], std::memory_order_relaxed);
+    switch (cls)
+    {
+    case 0: return _ctx_pool0.construct()->_ctx;
+    case 1: return _ctx_pool1.construct()->_ctx;
+    case 2: return _ctx_pool2.construct()->_ctx;
+    case 3: return _ctx_pool3.construct()->_ctx;
+    default: assert(false); return nullptr;
+    }
+}
+
+void Buffer::CtxPool::destroy(char *ctx, int32_t cls)
+{
+    _used.fetch_sub(CTX_SIZE[cls], std::memory_order_relaxed);
+
+    // _ctx是Ctx的唯一成员，地址相同
+    switch (cls)
+    {
+    case 0: _ctx_pool0.destroy(reinterpret_cast<Ctx<CTX_SIZE[0]> *>(ctx)); break;
+    case 1: _ctx_pool1.destroy(reinterpret_cast<Ctx<CTX_SIZE[1]> *>(ctx)); break;
+    case 2: _ctx_pool2.destroy(reinterpret_cast<Ctx<CTX_SIZE[2]> *>(ctx)); break;
+    case 3: _ctx_pool3.destroy(reinterpret_cast<Ctx<CTX_SIZE[3]> *>(ctx)); break;
+    default: assert(false); break;
+    }
+}
+
+char *Buffer::CtxPool::construct_large(size_t len)
+{
+    _used.fetch_add(len, std::memory_order_relaxed);
+    return new char[len];
+}
+
+void Buffer::CtxPool::destroy_large(char *ctx, size_t len)
+{
+    _used.fetch_sub(len, std::memory_order_relaxed);
+    delete[] ctx;
+}
+////////////////////////////////////////////////////////////////////////////////
 
 Buffer::Buffer()
 {
-    _chunk_size = 0;
-    _chunk_max = 1;
+    _chunk_size  = 0;
+    _chunk_max   = 1;
+    _ctx_class   = 0;
+    _ctx_size    = 0;
+    _shared_size = 0;
+    _active      = false;
     _front = _back = nullptr;
 }
 
@@ -50,35 +108,63 @@ Buffer::~Buffer()
     _front = _back = nullptr;
 }
 
-size_t Buffer::reserve()
+Buffer::Chunk *Buffer::new_chunk(size_t len)
+{
+    // 一个chunk放不下数据，说明这个连接的数据量比较大，升一级
+    // 引用共享数据的chunk本身没有空闲空间，不算
+    if (_back && !_back->_shared && _ctx_class < CTX_CLASS - 1) ++_ctx_class;
+
+    int32_t cls = _ctx_class;
+    while (cls < CTX_CLASS - 1 && CTX_SIZE[cls] < len) ++cls;
+
+    // 不超过缓冲区的上限，否则分配一个chunk就溢出了
+    size_t limit = (size_t)_chunk_max * CHUNK_UNIT;
+    while (cls > 0 && CTX_SIZE[cls] > limit) --cls;
+
+    _chunk_size++;
+    _ctx_size += CTX_SIZE[cls];
+
+    Chunk *chunk  = get_chunk_pool()->construct();
+    chunk->_ctx   = get_ctx_pool()->construct(cls);
+    chunk->_max   = CTX_SIZE[cls];
+    chunk->_class = cls;
+
+    return chunk;
+}
+
+size_t Buffer::reserve(size_t len)
 {
-    size_t len = 0;
-    if (EXPECT_FALSE(!_back || 0 == (len = _back->get_free_size())))
+    _active = true;
+
+    size_t free_sz = 0;
+    if (EXPECT_FALSE(!_back || 0 == (free_sz = _back->get_free_size())))
     {
-        Chunk *tmp = new_chunk();
-        if (_back)
-        {
-            _back->_next = tmp;
-            _back        = tmp;
-        }
-        else
-        {
-            _back = _front = tmp;
-        }
-        len = tmp->get_free_size();
+        Chunk *tmp = new_chunk(len);
+        link_chunk(tmp);
+        free_sz = tmp->get_free_size();
     }
 
-    return len;
+    return free_sz;
 }
 
-char *Buffer::get_large_buffer(size_t len)
+static Buffer::LargeBuffer &thread_large_buffer()
 {
     // 原本想在LargeBuffer里加个锁，所有线程共用缓冲区
     // 但缓冲区通常要持有一段时间，这导致这个锁非常难管理，需要手动加锁解锁
     // 那干脆用thread_local，多耗点内存，但不用考虑锁的问题
-    thread_local LargeBuffer buffer;
+    thread_local Buffer::LargeBuffer buffer;
+
+    return buffer;
+}
+
+char *Buffer::get_large_buffer(size_t len)
+{
+    return thread_large_buffer().get(len);
+}
 
-    return buffer.get(len);
+bool Buffer::is_large_buffer(const char *ctx)
+{
+    return thread_large_buffer().contain(ctx);
 }
 
 Buffer::ChunkPool *Buffer::get_chunk_pool()
@@ -86,6 +172,11 @@ Buffer::ChunkPool *Buffer::get_chunk_pool()
     return StaticGlobal::buffer_chunk_pool();
 }
 
+Buffer::CtxPool *Buffer::get_ctx_pool()
+{
+    return StaticGlobal::buffer_ctx_pool();
+}
+
 void Buffer::clear()
 {
     std::lock_guard<SpinLock> guard(_lock);
@@ -101,8 +192,15 @@ void Buffer::clear()
     }
 
     // 默认保留一个缓冲区 TODO: 是否有必要保留??
-    _front->clear();
+    // 引用共享数据的chunk没有自己的缓冲区，大包的chunk太大，都不保留
     assert(_back == _front);
+    if (_front->_shared || CTX_CLASS == _front->_class)
+    {
+        del_chunk(_front);
+        _front = _back = nullptr;
+        return;
+    }
+    _front->clear();
 }
 
 void Buffer::__append(const void *data, const size_t len)
@@ -113,7 +211,7 @@ void Buffer::__append(const void *data, const size_t len)
 
     do
     {
-        size_t free_sz = reserve();
+        size_t free_sz = reserve(len - append_sz);
 
         size_t size = std::min(free_sz, len - append_sz);
         // void *类型不能和数字运算，要转成char *
@@ -131,13 +229,47 @@ int32_t Buffer::append(const void *data, const size_t len)
     std::lock_guard<SpinLock> guard(_lock);
     __append(data, len);
 
-    return _chunk_size > _chunk_max ? 1 : 0;
+    return overflow() ? 1 : 0;
+}
+
+int32_t Buffer::append_shared(Shared *shared)
+{
+    std::lock_guard<SpinLock> guard(_lock);
+
+    _active = true;
+    link_chunk(new_shared_chunk(shared));
+
+    return overflow() ? 1 : 0;
+}
+
+bool Buffer::shrink()
+{
+    std::lock_guard<SpinLock> guard(_lock);
+
+    if (_active)
+    {
+        _active = false;
+        return false;
+    }
+
+    // 有数据未处理完，或者有多个chunk(说明还有数据)，不能释放
+    if (!_front || _front->_next || _front->get_used_size()) return false;
+
+    del_chunk(_front);
+    _front = _back = nullptr;
+
+    if (_ctx_class > 0) --_ctx_class;
+
+    return true;
 }
 
 bool Buffer::remove(size_t len)
 {
     bool next_used = false;
     std::lock_guard<SpinLock> guard(_lock);
+    // clear或者共享数据发送完后，_front可能为nullptr
+    if (EXPECT_FALSE(!_front)) return false;
+
     do
     {
         size_t used = _front->get_used_size();
@@ -160,6 +292,12 @@ bool Buffer::remove(size_t len)
                 del_chunk(_front);
                 _front = next;
             }
+            else if (_front->_shared || CTX_CLASS == _front->_class)
+            {
+                // 共享数据及大包的chunk不保留
+                del_chunk(_front);
+                _front = _back = nullptr;
+            }
             else
             {
                 _front->clear(); // 在无数据的时候重重置缓冲区
@@ -180,8 +318,9 @@ bool Buffer::remove(size_t len)
     } while (len > 0);
 
     // 冗余校验：只有一个缓冲区，或者有多个缓冲区但第一个已用完
-    // 否则就是链表管理出错了
-    assert(_front == _back || 0 == _front->get_free_size());
+    // (后面链接了共享数据的，第一个可以未用完)，否则就是链表管理出错了
+    assert(_front == _back || 0 == _front->get_free_size()
+           || _front->_next->_shared);
 
     return next_used;
 }
@@ -190,7 +329,7 @@ Buffer::Transaction Buffer::any_seserve(bool no_overflow)
 {
     Transaction ts(_lock);
 
-    if (EXPECT_TRUE(!no_overflow || _chunk_size <= _chunk_max))
+    if (EXPECT_TRUE(!no_overflow || !overflow()))
     {
         ts._internal = true;
         ts._len = (int)reserve();
@@ -212,7 +351,7 @@ Buffer::Transaction Buffer::flat_reserve(size_t len)
 
     Transaction ts(_lock);
 
-    size_t free_size = reserve();
+    size_t free_size = reserve(len);
     if (free_size >= len)
     {
         ts._internal = true;
@@ -231,12 +370,56 @@ Buffer::Transaction Buffer::flat_reserve(size_t len)
     return ts;
 }
 
+void Buffer::reserve_flat(size_t len)
+{
+    std::lock_guard<SpinLock> guard(_lock);
+
+    if (!_front || _front->_max - _front->_used_pos >= len) return;
+
+    // 接收缓冲区不会引用共享数据
+    assert(!_front->_shared);
+
+    _active = true;
+
+    int32_t cls = 0;
+    while (cls < CTX_CLASS && CTX_SIZE[cls] < len) ++cls;
+
+    Chunk *chunk  = get_chunk_pool()->construct();
+    chunk->_class = cls;
+    if (CTX_CLASS == cls)
+    {
+        chunk->_ctx = get_ctx_pool()->construct_large(len);
+        chunk->_max = len;
+    }
+    else
+    {
+        chunk->_ctx = get_ctx_pool()->construct(cls);
+        chunk->_max = CTX_SIZE[cls];
+    }
+    _chunk_size++;
+    _ctx_size += chunk->_max;
+
+    // 包还不完整，现有的数据肯定能放得下
+    while (_front)
+    {
+        Chunk *tmp = _front;
+        _front     = _front->_next;
+
+        chunk->append(tmp->get_used_ctx(), tmp->get_used_size());
+        del_chunk(tmp);
+    }
+
+    _front = _back = chunk;
+}
+
 const char *Buffer::to_flat_ctx(size_t len)
 {
     std::lock_guard<SpinLock> guard(_lock);
 
     // 解析数据时，要求在同一个chunk才能解析。大多数情况下，是在同一个chunk的。
     // 如果不是，建议调整下chunk定义的缓冲区大小，否则影响效率
+    if (EXPECT_FALSE(!_front)) return nullptr;
+
     size_t used = _front->get_used_size();
     if (0 == used) return nullptr;
 
@@ -293,7 +476,7 @@ const char *Buffer::all_to_flat_ctx(size_t &len)
     const Chunk *next = _front;
 
     // 用get_all_used_size效率有点底，这里粗略估计下大小即可
-    size_t max_ctx = _chunk_size * Chunk::MAX_CTX;
+    size_t max_ctx = _ctx_size + _shared_size;
     char *buf = get_large_buffer(max_ctx);
     do
     {
@@ -356,16 +539,46 @@ bool Buffer::check_used_size(size_t len) const
 const char *Buffer::get_front_used(size_t &size, bool &next) const
 {
     std::lock_guard<SpinLock> guard(_lock);
-    if (!_front)
+
+    // 跳过开头的空chunk，后面链接了共享数据时，第一个chunk可能是空的
+    const Chunk *chunk = _front;
+    while (chunk && 0 == chunk->get_used_size() && chunk->_next)
+    {
+        chunk = chunk->_next;
+    }
+    if (!chunk)
     {
         size = 0;
         next = false;
         return nullptr;
     }
 
-    next = _chunk_size > 1 ? true : false;
-    size = _front->get_used_size();
-    return _front->get_used_ctx();
+    next = chunk->_next ? true : false;
+    size = chunk->get_used_size();
+    return chunk->get_used_ctx();
+}
+
+int32_t Buffer::get_front_used_vec(UsedCtx *vec, int32_t max,
+                                   bool &next) const
+{
+    std::lock_guard<SpinLock> guard(_lock);
+
+    int32_t cnt        = 0;
+    const Chunk *chunk = _front;
+    while (chunk && cnt < max)
+    {
+        size_t size = chunk->get_used_size();
+        if (size)
+        {
+            vec[cnt]._ctx = chunk->get_used_ctx();
+            vec[cnt]._len = size;
+            ++cnt;
+        }
+        chunk = chunk->_next;
+    }
+
+    next = chunk ? true : false;
+    return cnt;
 }
 
 size_t Buffer::get_all_used_size() const
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "../pool/object_pool.hpp"
 #include "../thread/spin_lock.hpp"
 
@@ -18,13 +20,20 @@
  * 1. 游戏的数据包一般是小包，因此这里都是按小包来设计和优化的
  *    频繁发送大包(缓冲区超过8k)会导致链表操作，有一定的效率损失
  * 
- * 2. 每条连接默认分配一个8k的收缓冲区和一个8k的发缓冲区。
- *    数据量超过时，后续的包以链表形式链在一起
- *    10240条链接，收最大64k，发64k，那最差的情况是1280M内存
+ * 2. 缓冲区在第一次使用时才分配chunk，chunk大小分为512、2k、8k、64k几个等级。
+ *    从最小的等级开始，数据量超过一个chunk时，后续的chunk升一级并以链表形式链在
+ *    一起。连接空闲一段时间后(见shrink)，释放所有chunk并降一级
+ *    大量空闲连接时，只占用很少的内存
  * 
  * 3. 有时候为了优化拷贝，会直接从缓冲区中预分配一块内存，把收发的数据直接写入
  *    缓冲区。这时候预分配的缓冲区必须是连续的，但缓冲区可能只能以链表提供
  *    这时候只能临时分配一块内存，再拷贝到缓冲区，效率不高
+ *
+ * 4. 广播时同一个数据包要发给很多连接，数据包编码一次后作为共享数据，每个连接
+ *    的缓冲区只拷贝自己的包头，数据部分以引用计数的chunk链接到链表中
+ *
+ * 5. 接收超过64k的大包时(见reserve_flat)，会单独分配一个能容纳整个包的chunk，
+ *    后续数据直接接收到这个chunk，包处理完后立即释放
  */
 
 /**
@@ -33,17 +42,80 @@
 class Buffer final
 {
 public:
+    /**
+     * @brief 多个缓冲区共享的只读数据，如广播时编码好的数据包
+     * 数据紧跟在对象后面，一次分配。引用计数为0时由最后一个持有者释放，
+     * 可能是在io线程中释放
+     */
+    class Shared final
+    {
+    public:
+        /**
+         * @brief 创建共享数据，引用计数为1，由创建者负责release
+         * @param data 需要共享的数据
+         * @param len 数据的长度
+         */
+        static Shared *create(const void *data, size_t len)
+        {
+            char *mem    = new char[sizeof(Shared) + len];
+            Shared *self = new (mem) Shared(len);
+            memcpy(mem + sizeof(Shared), data, len);
+
+            CtxPool::add_extra(static_cast<int64_t>(sizeof(Shared) + len));
+            return self;
+        }
+
+        /// 增加引用计数
+        inline void grab()
+        {
+            _ref.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /// 减少引用计数，为0时释放
+        inline void release()
+        {
+            if (1 != _ref.fetch_sub(1, std::memory_order_acq_rel)) return;
+
+            CtxPool::add_extra(-static_cast<int64_t>(sizeof(Shared) + _len));
+            this->~Shared();
+            delete[] reinterpret_cast<char *>(this);
+        }
+
+        /// 获取数据指针
+        inline const char *get_ctx() const
+        {
+            return reinterpret_cast<const char *>(this + 1);
+        }
+
+        /// 获取数据长度
+        inline size_t size() const
+        {
+            return _len;
+        }
+
+    private:
+        explicit Shared(size_t len) : _ref(1), _len(len)
+        {
+        }
+        ~Shared() = default;
+
+        std::atomic<int32_t> _ref; // 引用计数
+        size_t _len;               // 数据长度
+    };
+
     /**
      * @brief 单个缓冲区块，多个块以链表形式组成一个完整的缓冲区
+     * 块本身只包含链表节点信息，数据区按大小等级单独从内存池分配，或者指向一个共享数据
     */
     class Chunk final
     {
-    public:
-        static const size_t MAX_CTX = 8192; //8k
     public:
         Chunk()
         {
-            _ctx[0]   = 0; // avoid C26495 warning
+            _ctx      = nullptr;
+            _max      = 0;
+            _class    = -1;
+            _shared   = nullptr;
             _next     = nullptr;
             _used_pos = _free_pos = 0;
         }
@@ -67,7 +139,7 @@ public:
         inline void add_used(size_t len)
         {
             _free_pos += len;
-            assert(MAX_CTX >= _free_pos);
+            assert(_max >= _free_pos);
         }
 
         /**
@@ -116,20 +188,23 @@ public:
         }
 
         /**
-         * @brief 获取空闲缓冲区大小
+         * @brief 获取空闲缓冲区大小，共享数据的块总是返回0
          * @return 
         */
         inline size_t get_free_size() const
         {
-            return MAX_CTX - _free_pos;
+            return _max - _free_pos;
         }
     public:
-        char _ctx[MAX_CTX]; // 缓冲区指针
+        char *_ctx;     // 缓冲区指针
+        size_t _max;    // 缓冲区大小
+        int32_t _class; // 缓冲区大小等级，引用共享数据时为-1，大包为CTX_CLASS
 
         size_t _used_pos; // 已使用缓冲区开始位置
         size_t _free_pos; // 空闲缓冲区开始位置
 
-        Chunk *_next; // 链表下一节点
+        Shared *_shared; // 引用的共享数据，不为nullptr时_ctx指向共享数据
+        Chunk *_next;    // 链表下一节点
     };
 
     /**
@@ -148,6 +223,14 @@ public:
         */
         char *get(size_t len);
 
+        /**
+         * @brief 指针是否在缓冲区内
+         */
+        bool contain(const char *ctx) const
+        {
+            return _ctx && ctx >= _ctx && ctx < _ctx + _len;
+        }
+
     private:
         char *_ctx;  // 缓冲区指针
         size_t _len; // 缓冲区长度
@@ -204,8 +287,106 @@ public:
         std::unique_lock<SpinLock> _ul;
     };
 
-    /// 小块缓冲区对象池
+    /**
+     * @brief 一块已使用缓冲区的数据指针及长度，用于writev这种批量发送
+    */
+    struct UsedCtx
+    {
+        const char *_ctx; // 数据指针
+        size_t _len;      // 数据长度
+    };
+
+    /// chunk数据区大小等级的数量
+    static const int32_t CTX_CLASS = 4;
+    /// 各等级chunk数据区的大小
+    static constexpr size_t CTX_SIZE[CTX_CLASS] = {512, 2048, 8192, 65536};
+    /// 计算缓冲区上限(set_chunk_size)时一个chunk的大小
+    static const size_t CHUNK_UNIT = 8192;
+
+    /// 缓冲区块对象池
     using ChunkPool = ObjectPoolLock<Chunk, 1024, 64>;
+
+    /**
+     * @brief chunk数据区的内存池，每个大小等级一个对象池
+     */
+    class CtxPool final
+    {
+    public:
+        CtxPool();
+        ~CtxPool() = default;
+
+        /**
+         * @brief 分配一块数据区
+         * @param cls 大小等级
+         * @return 数据区指针
+         */
+        char *construct(int32_t cls);
+        /**
+         * @brief 回收一块数据区
+         * @param ctx 数据区指针
+         * @param cls 大小等级，必须和分配时一致
+         */
+        void destroy(char *ctx, int32_t cls);
+
+        /**
+         * @brief 分配一块超过所有等级的数据区，直接从系统分配，不缓存
+         * @param len 数据区大小
+         * @return 数据区指针
+         */
+        char *construct_large(size_t len);
+        /**
+         * @brief 回收construct_large分配的数据区
+         * @param ctx 数据区指针
+         * @param len 数据区大小，必须和分配时一致
+         */
+        void destroy_large(char *ctx, size_t len);
+
+        /**
+         * @brief 记录不从内存池分配，但同样用于网络收发的内存
+         * 包括共享数据、LargeBuffer、数据包压缩及websocket压缩的上下文和缓冲区。
+         * 这些内存可能在内存池销毁后才释放，因此用静态变量记录
+         * @param len 增加的大小，释放时为负数
+         */
+        static void add_extra(int64_t len)
+        {
+            _extra.fetch_add(len, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 获取add_extra记录的内存大小
+         */
+        static size_t get_extra()
+        {
+            int64_t extra = _extra.load(std::memory_order_relaxed);
+            return extra > 0 ? static_cast<size_t>(extra) : 0;
+        }
+
+        /**
+         * @brief 获取网络收发使用的内存总大小，所有线程的缓冲区共用
+         * 包括已分配出去的数据区及get_extra，缓冲区内存预算按这个值检查
+         */
+        size_t get_used() const
+        {
+            return _used.load(std::memory_order_relaxed) + get_extra();
+        }
+
+    private:
+        template <size_t N> struct Ctx
+        {
+            char _ctx[N];
+        };
+
+        ObjectPoolLock<Ctx<CTX_SIZE[0]>, 4096, 256> _ctx_pool0;
+        ObjectPoolLock<Ctx<CTX_SIZE[1]>, 2048, 128> _ctx_pool1;
+        ObjectPoolLock<Ctx<CTX_SIZE[2]>, 1024, 64> _ctx_pool2;
+        ObjectPoolLock<Ctx<CTX_SIZE[3]>, 64, 4> _ctx_pool3;
+
+        std::atomic<size_t> _used;           // 已分配出去的数据区总大小
+        static std::atomic<int64_t> _extra; // 见add_extra
+    };
+
+    /// 数据小于此长度时，直接拷贝比引用共享数据更划算
+    static const size_t SHARED_MIN = 512;
 public:
     Buffer();
     ~Buffer();
@@ -230,6 +411,21 @@ public:
     */
     int32_t append(const void *data, const size_t len);
 
+    /**
+     * @brief 添加共享数据到缓冲区，不拷贝数据，只增加引用计数
+     * @param shared 共享数据
+     * @return 0成功， 1溢出
+    */
+    int32_t append_shared(Shared *shared);
+
+    /**
+     * @brief 回收空闲的缓冲区，需要定时调用
+     * 两次调用之间没有分配过缓冲区，并且当前没有数据时，释放所有chunk并把
+     * chunk大小降一级
+     * @return 是否释放了chunk
+    */
+    bool shrink();
+
     /**
      * @brief 预分配任意空间
      * @param no_overflow 为true表示如果当前分配空间超出则不再分配
@@ -244,6 +440,14 @@ public:
     */
     Transaction flat_reserve(size_t len);
 
+    /**
+     * @brief 保证第一个chunk从有效数据开始有指定长度的连续空间，用于接收大包
+     * 空间不足时分配一个足够大的chunk，把现有数据移过去，后续数据直接接收到
+     * 这个chunk，包完整后不需要再从多个chunk拷贝
+     * @param len 需要的连续空间长度
+     */
+    void reserve_flat(size_t len);
+
     /**
      * @brief 把指定长度的缓存放到连续的缓冲区
      * @param len 缓存的长度
@@ -281,13 +485,33 @@ public:
      const char *get_front_used(size_t &size, bool &next) const;
 
     /**
-      * @brief 只获取第一个chunk的有效数据大小
+     * @brief 数据是否在当前线程的LargeBuffer中
+     * to_flat_ctx、all_to_flat_ctx跨chunk拼接的数据都在这里，下次拼接时会被覆盖，
+     * 需要在回调脚本期间一直引用的数据(如flatbuffers视图)要先拷贝
+     */
+    static bool is_large_buffer(const char *ctx);
+
+    /**
+      * @brief 获取前面多个chunk的数据指针及数据大小
+      * @param vec 用于存放数据块的数组
+      * @param max 数组的最大长度
+      * @param next 数组放满后是否还有下一个数据块
+      * @return 放到数组中的数据块数量
+      */
+     int32_t get_front_used_vec(UsedCtx *vec, int32_t max, bool &next) const;
+
+    /**
+      * @brief 只获取第一个有数据的chunk的有效数据大小
       * @return
       */
      inline size_t get_front_used_size() const
      {
          std::lock_guard<SpinLock> guard(_lock);
-         return _front ? _front->get_used_size() : 0;
+
+         const Chunk *chunk = _front;
+         while (chunk && 0 == chunk->get_used_size()) chunk = chunk->_next;
+
+         return chunk ? chunk->get_used_size() : 0;
      }
 
     /**
@@ -301,13 +525,13 @@ public:
      }
 
      /**
-      * @brief 获取所有已分配chunk的大小，用于统计
+      * @brief 获取所有已分配chunk的大小，用于统计。不包含共享数据
       * @return
       */
      inline size_t get_chunk_mem_size() const
      {
          std::lock_guard<SpinLock> guard(_lock);
-         return _chunk_size * sizeof(Chunk);
+         return _ctx_size;
      }
 
     /**
@@ -318,6 +542,7 @@ public:
 
     /**
       * @brief 设置chunk的最大数量，超过此数量视为溢出
+      * chunk的大小是可变的，这里按CHUNK_UNIT计算总大小
       * @param max 允许的chunk最大数量
       */
      void set_chunk_size(int32_t max);
@@ -326,38 +551,98 @@ public:
      inline bool is_overflow() const
      {
          std::lock_guard<SpinLock> guard(_lock);
-         return _chunk_size > _chunk_max;
+         return overflow();
      }
 
 private:
     ChunkPool *get_chunk_pool();
+    CtxPool *get_ctx_pool();
+
+    /**
+     * @brief 是否溢出，包括引用的共享数据，不加锁
+     */
+    inline bool overflow() const
+    {
+        return _ctx_size + _shared_size > (size_t)_chunk_max * CHUNK_UNIT;
+    }
+
+    /**
+     * @brief 分配一个chunk
+     * @param len 需要的连续空间，优先使用能容纳该长度的等级
+     */
+    Chunk *new_chunk(size_t len);
 
-    inline Chunk *new_chunk()
+    inline Chunk *new_shared_chunk(Shared *shared)
     {
-        _chunk_size++;
-        return get_chunk_pool()->construct();
+        shared->grab();
+        _shared_size += shared->size();
+
+        Chunk *chunk     = get_chunk_pool()->construct();
+        chunk->_class    = -1;
+        chunk->_shared   = shared;
+        chunk->_ctx      = const_cast<char *>(shared->get_ctx());
+        chunk->_max      = shared->size();
+        chunk->_free_pos = shared->size();
+
+        return chunk;
     }
 
     inline void del_chunk(Chunk *chunk)
     {
-        assert(_chunk_size > 0);
+        if (chunk->_shared)
+        {
+            assert(_shared_size >= chunk->_shared->size());
 
-        _chunk_size--;
+            _shared_size -= chunk->_shared->size();
+            chunk->_shared->release();
+        }
+        else
+        {
+            assert(_chunk_size > 0 && _ctx_size >= chunk->_max);
+
+            _chunk_size--;
+            _ctx_size -= chunk->_max;
+            if (EXPECT_FALSE(CTX_CLASS == chunk->_class))
+            {
+                get_ctx_pool()->destroy_large(chunk->_ctx, chunk->_max);
+            }
+            else
+            {
+                get_ctx_pool()->destroy(chunk->_ctx, chunk->_class);
+            }
+        }
         get_chunk_pool()->destroy(chunk);
     }
 
+    /**
+     * @brief 把一个chunk链接到链表尾部
+     */
+    inline void link_chunk(Chunk *chunk)
+    {
+        if (_back)
+        {
+            _back->_next = chunk;
+            _back        = chunk;
+        }
+        else
+        {
+            _back = _front = chunk;
+        }
+    }
+
     /**
      * @brief 预分配缓冲区空间，如果当前空间为空则分配一个新的chunk
+     * @param len 需要的连续空间，仅在分配新chunk时用于选择大小等级
      * @return 返回当前可用缓冲区大小
     */
-    size_t reserve();
+    size_t reserve(size_t len = 0);
 
     /**
      * @brief 获取连续的缓冲区
      * @param len 缓冲区的长度
      * @return 
     */
-    char *get_large_buffer(size_t len);
+    static char *get_large_buffer(size_t len);
 
     /**
      * @brief 同append，但不加锁，仅内部使用
@@ -371,8 +656,16 @@ private:
     Chunk *_front;      // 数据包链表头
     Chunk *_back;       // 数据包链表尾
 
-    // 已申请chunk数量
+    // 已申请chunk数量，不包含引用共享数据的chunk
     int32_t _chunk_size;
+    // 下一个新chunk的大小等级
+    int32_t _ctx_class;
+    // 已申请chunk数据区总大小
+    size_t _ctx_size;
+    // 引用的共享数据总长度
+    size_t _shared_size;
+    // 上次调用shrink之后是否分配过缓冲区
+    bool _active;
     // 该缓冲区允许申请chunk的最大数量，超过此数量视为缓冲区溢出
     int32_t _chunk_max;
 };
@@ -22,8 +22,8 @@ EV::EV()
     _pendings.reserve(1024);
     _timers.reserve(1024);
     _periodics.reserve(1024);
-    _io_fevents.reserve(1024);
     _io_revents.reserve(1024);
+    _io_flushes.reserve(1024);
 
     _has_job = false;
 
@@ -41,10 +41,19 @@ EV::EV()
     _last_system_clock_update = INT_MIN;
     time_update();
 
+    _timer_wheel.reset(_steady_clock);
+    _periodic_wheel.reset(_system_clock);
+    _wheel_expired.reserve(1024);
+
+    _timer_batch = false;
+    _timer_fired.reserve(1024);
+
     _busy_time         = 0;
     _next_backend_time = 0;
 
-    _backend = EVBackend::instance();
+    _backend_num    = EV_BACKEND_NUM;
+    _backend_policy = BP_LEAST;
+    _backend_type   = BT_DEFAULT;
 }
 
 EV::~EV()
@@ -52,8 +61,24 @@ EV::~EV()
     _timer_mgr.clear();
     _periodic_mgr.clear();
 
-    EVBackend::uninstance(_backend);
-    _backend = nullptr;
+    for (auto backend : _backends) EVBackend::uninstance(backend);
+    _backends.clear();
+}
+
+int32_t EV::set_backend(int32_t num, int32_t policy, int32_t type)
+{
+    // backend线程已启动，io也已分配，不能再修改
+    if (!_backends.empty()) return -1;
+    if (num < 1 || (BP_LEAST != policy && BP_HASH != policy)) return -1;
+    if (!EVBackend::is_supported(type)) return -1;
+
+    _backend_num    = num;
+    _backend_policy = policy;
+    _backend_type   = type;
+
+    __BACKEND__ = EVBackend::name(type);
+
+    return 0;
 }
 
 int32_t EV::loop()
@@ -72,7 +97,14 @@ int32_t EV::loop()
     _done           = false;
     int64_t last_ms = _steady_clock;
 
-    if (!_backend->start(this)) return -1;
+    for (int32_t i = 0; i < _backend_num; i++)
+    {
+        _backends.push_back(EVBackend::instance(_backend_type));
+    }
+    for (auto backend : _backends)
+    {
+        if (!backend->start(this)) return -1;
+    }
 
     static const int64_t min_wait = 1;     // 最小等待时间，毫秒
     static const int64_t max_wait = 60000; // 最大等待时间，毫秒
@@ -82,8 +114,15 @@ int32_t EV::loop()
         // 这里可能会出现spurious wakeup(例如收到一个信号)，但不需要额外处理
         // 目前所有的子线程唤醒多次都没有问题，以后有需求再改
 
+        int64_t stat_tm = LoopStat::now_us();
+
+        // 上一帧逻辑中发送的数据，统一唤醒backend线程发送
+        // 必须在io_reify之前，保证被删除的watcher已从_io_flushes中移除
+        io_flush_reify();
+
         // 把fd变更设置到backend中去
         io_reify();
+        stat_tm = _loop_stat.add(LoopStat::LP_REIFY, stat_tm);
 
         time_update();
         _busy_time = _steady_clock - last_ms;
@@ -102,6 +141,16 @@ int32_t EV::loop()
             int64_t to = (_periodics[HEAP0])->_at - _system_clock;
             if (backend_time > to) backend_time = to;
         }
+        if (_timer_wheel.size())
+        {
+            int64_t to = _timer_wheel.next_at() - _steady_clock;
+            if (backend_time > to) backend_time = to;
+        }
+        if (_periodic_wheel.size())
+        {
+            int64_t to = _periodic_wheel.next_at() - _system_clock;
+            if (backend_time > to) backend_time = to;
+        }
         if (EXPECT_FALSE(backend_time < min_wait)) backend_time = min_wait;
 
         {
@@ -122,10 +171,17 @@ int32_t EV::loop()
                 _cv.wait_for(ul, std::chrono::milliseconds(backend_time));
             }
             _has_job = false;
+            stat_tm  = _loop_stat.add(LoopStat::LP_WAIT, stat_tm);
 
             // 收集io事件 放这里不再额外加锁
             io_receive_event_reify();
         }
+        // 无锁队列中的io事件，必须在_has_job重置之后再取，否则可能漏掉唤醒
+        io_receive_ring_reify();
+
+        int64_t frame_tm = stat_tm;
+        size_t pending   = _pendings.size();
+        stat_tm = _loop_stat.add(LoopStat::LP_IO, stat_tm, (int64_t)pending);
 
         time_update();
 
@@ -137,13 +193,22 @@ int32_t EV::loop()
         // 处理periodic超时
         periodic_reify();
 
+        int64_t timer_ev =
+            (int64_t)(_pendings.size() - pending + _timer_fired.size());
+        // 批量模式下，所有超时的定时器在io事件之前一次性回调
+        if (!_timer_fired.empty()) timer_batch_callback();
+        stat_tm = _loop_stat.add(LoopStat::LP_TIMER, stat_tm, timer_ev);
+
         // 触发io和timer事件
+        pending = _pendings.size();
         invoke_pending();
+        _loop_stat.add(LoopStat::LP_PENDING, stat_tm, (int64_t)pending);
 
         running(); // 执行其他逻辑
+        _loop_stat.add(LoopStat::LP_FRAME, frame_tm);
     }
 
-    _backend->stop();
+    for (auto backend : _backends) backend->stop();
 
     // 这些对象可能会引用其他资源（如buffer之类的），程序正常关闭时应该严谨地
     // 在脚本关闭，而不是等底层强制删除
@@ -243,12 +308,8 @@ int32_t EV::io_delete(int32_t id)
 
 void EV::clear_io_fast_event(EVIO *w)
 {
-    if (w->_b_fevent_index)
-    {
-        assert(w->_b_fevent_index <= (int32_t)_io_fevents.size());
-        _io_fevents[w->_b_fevent_index - 1] = nullptr;
-        w->_b_fevent_index                  = 0;
-    }
+    // 未分配backend的watcher不会进入任何fast_event队列
+    if (w->_backend) w->_backend->clear_fast_event(w);
 }
 
 void EV::clear_io_receive_event(EVIO *w)
@@ -261,40 +322,88 @@ void EV::clear_io_receive_event(EVIO *w)
     }
 }
 
+EVBackend *EV::select_backend(EVIO *w)
+{
+    if (1 == _backends.size()) return _backends[0];
+
+    if (BP_HASH == _backend_policy)
+    {
+        return _backends[((uint32_t)w->_fd) % _backends.size()];
+    }
+
+    EVBackend *least = _backends[0];
+    for (auto backend : _backends)
+    {
+        if (backend->get_io_count() < least->get_io_count()) least = backend;
+    }
+    return least;
+}
+
+void EV::io_flush_reify()
+{
+    for (auto w : _io_flushes)
+    {
+        w->_flush_index = 0;
+        io_fast_event(w, EV_WRITE);
+    }
+    _io_flushes.clear();
+}
+
 void EV::io_reify()
 {
     if (_io_changes.empty()) return;
 
+    // backend线程是先加自己的锁再加主线程锁，这里必须按同样的顺序加锁
+    // 变更通常很少，直接锁住所有backend，不必按watcher逐个加锁
+    for (auto backend : _backends) backend->lock().lock();
     {
         bool non_del = false; // 是否进行过非del操作，仅用于逻辑校验
         std::lock_guard<std::mutex> guard(lock());
+
+        // 持有backend锁时backend线程不会再往队列添加事件，先把队列中的事件取出来
+        // 这样删除watcher时clear_pending就能清除这些事件
+        io_receive_ring_reify();
         for (auto w : _io_changes)
         {
             w->_change_index = 0;
 
             int32_t fd = w->_fd;
+            EVBackend *backend = w->_backend;
             switch (w->_status)
             {
             case EVIO::S_NONE: non_del = true; break;
             case EVIO::S_STOP:
                 non_del = true;
-                _backend->modify(w); // 移除该socket
+                backend->modify(w); // 移除该socket
+                backend->_io_changed = true;
                 break;
             case EVIO::S_START:
                 non_del = true;
-                _backend->modify(w);
+                backend->modify(w);
+                backend->_io_changed = true;
                 break;
             case EVIO::S_NEW:
                 non_del    = true;
                 w->_status = EVIO::S_START;
-                _backend->set_fd_watcher(fd, w);
-                _backend->modify(w);
+
+                // 一个watcher只分配一次backend，之后所有的操作都在这个backend线程
+                backend     = select_backend(w);
+                w->_backend = backend;
+                backend->add_io_count(1);
+                backend->set_fd_watcher(fd, w);
+                backend->modify(w);
+                backend->_io_changed = true;
 
                 // fast_event可能触发一读写操作而调用get_fd_watcher
                 // 因此在第一次set_fd_watcher之前是不允许fast_event执行的
                 assert(-1 == w->_b_fevent_index);
                 w->_b_fevent_index = 0;
-                if (w->_b_fevents) io_fast_event(w, w->_b_fevents);
+                if (w->_b_fevents)
+                {
+                    int32_t events = w->_b_fevents;
+                    w->_b_fevents  = 0;
+                    io_fast_event(w, events);
+                }
                 break;
             case EVIO::S_DEL:
                 // watcher的操作是异步的，同样fd的watcher可能被删掉又被系统复用
@@ -305,15 +414,34 @@ void EV::io_reify()
                 clear_pending(w);
                 clear_io_fast_event(w);
                 clear_io_receive_event(w);
-
+                assert(!w->_flush_index);
+
+                // 未执行过S_NEW的watcher没有分配backend
+                if (backend)
+                {
+                    backend->add_io_count(-1);
+                    backend->set_fd_watcher(fd, nullptr);
+                    backend->del_idle_watcher(w);
+                }
                 _io_mgr.erase(w->_id);
-                _backend->set_fd_watcher(fd, nullptr);
                 break;
             }
         }
     }
+    for (auto iter = _backends.rbegin(); iter != _backends.rend(); iter++)
+    {
+        (*iter)->lock().unlock();
+    }
 
-    _backend->wake(); /// 唤醒子线程，让它及时处理修改的事件
+    /// 唤醒子线程，让它及时处理修改的事件
+    for (auto backend : _backends)
+    {
+        if (backend->_io_changed)
+        {
+            backend->_io_changed = false;
+            backend->wake();
+        }
+    }
     _io_changes.clear();
     _io_delete_index = 0;
 }
@@ -423,23 +551,24 @@ void EV::io_receive_event(EVIO *w, int32_t revents)
 
 void EV::io_fast_event(EVIO *w, int32_t events)
 {
-    bool wake = false;
+    // 尚未执行第一次io_reify的watcher还没有分配backend，先记录下来
+    // 等io_reify分配backend后再一起发送
+    if (EXPECT_FALSE(!w->_backend))
     {
-        std::lock_guard<SpinLock> guard(_spin_lock);
-
         w->_b_fevents |= static_cast<uint8_t>(events);
-
-        // 玩家登录的时候，可能有上百次数据发送，不要每次都插入队列
-        // _b_fevent_index为-1时，表示该watcher尚未执行第一次io_reify，也不放入队列
-        if (0 == w->_b_fevent_index)
-        {
-            wake = _io_fevents.empty();
-            _io_fevents.emplace_back(w);
-            w->_b_fevent_index = static_cast<int32_t>(_io_fevents.size());
-        }
+        return;
     }
 
-    if (wake) _backend->wake();
+    w->_backend->fast_event(w, events);
+}
+
+void EV::io_receive_ring_reify()
+{
+    EVBackend::IOEvent e;
+    for (auto backend : _backends)
+    {
+        while (backend->pop_receive_event(e)) feed_event(e._w, e._events);
+    }
 }
 
 void EV::io_receive_event_reify()
@@ -504,8 +633,52 @@ void EV::clear_pending(EVWatcher *w)
     }
 }
 
+void EV::fire_timer(EVTimer *w)
+{
+    if (EXPECT_TRUE(!_timer_batch))
+    {
+        feed_event(w, EV_TIMER);
+        return;
+    }
+
+    // 用_revents标记已在数组中，同一帧多次超时(如P_SPIN)也只回调一次
+    if (!(w->_revents & EV_TIMER))
+    {
+        w->_revents |= static_cast<uint8_t>(EV_TIMER);
+        _timer_fired.push_back(w);
+    }
+}
+
+void EV::wheel_reify(TimerWheel &wheel, int64_t now)
+{
+    _wheel_expired.clear();
+    wheel.update(now, _wheel_expired);
+
+    for (auto w : _wheel_expired)
+    {
+        if (w->_repeat)
+        {
+            // 和二叉堆一样，本次超时后下次触发的时间必须在now之后
+            // 落后太多的，按policy调整时间。P_SPIN的定时器多次超时只回调一次
+            do
+            {
+                w->_at += w->_repeat;
+                if (EXPECT_FALSE(w->_at < now)) w->reschedule(now);
+            } while (w->_at <= now);
+
+            wheel.add(w);
+        }
+
+        fire_timer(w);
+    }
+}
+
 void EV::timers_reify()
 {
+    // 时间轮为空时也要执行，保证时间轮的时间和当前时间一致
+    // 单次定时器超时后已不在时间轮中，但不能从管理器删除，还要回调到脚本
+    wheel_reify(_timer_wheel, _steady_clock);
+
     while (_timer_cnt && (_timers[HEAP0])->_at <= _steady_clock)
     {
         EVTimer *w = _timers[HEAP0];
@@ -529,12 +702,14 @@ void EV::timers_reify()
             timer_stop(w); // 这里不能从管理器删除，还要回调到脚本
         }
 
-        feed_event(w, EV_TIMER);
+        fire_timer(w);
     }
 }
 
 void EV::periodic_reify()
 {
+    wheel_reify(_periodic_wheel, _system_clock);
+
     while (_periodic_cnt && (_periodics[HEAP0])->_at <= _system_clock)
     {
         EVTimer *w = _periodics[HEAP0];
@@ -544,7 +719,7 @@ void EV::periodic_reify()
         // 因为脚本逻辑都是用_system_now作为时间基准
         assert(w->_at <= _system_now * 1000);
 
-        feed_event(w, EV_TIMER);
+        fire_timer(w);
         if (w->_repeat)
         {
             w->_at += w->_repeat;
@@ -564,7 +739,8 @@ void EV::periodic_reify()
     }
 }
 
-int32_t EV::timer_start(int32_t id, int64_t after, int64_t repeat, int32_t policy)
+int32_t EV::timer_start(int32_t id, int64_t after, int64_t repeat,
+                        int32_t policy, bool wheel)
 {
     assert(repeat >= 0);
 
@@ -577,9 +753,16 @@ int32_t EV::timer_start(int32_t id, int64_t after, int64_t repeat, int32_t polic
     w->_at     = _steady_clock + after;
     w->_repeat = repeat;
     w->_policy = policy;
+    w->_wheel  = wheel;
 
     assert(w->_repeat >= 0);
 
+    if (wheel)
+    {
+        _timer_wheel.add(w);
+        return 1;
+    }
+
     ++_timer_cnt;
     int32_t index = _timer_cnt + HEAP0 - 1;
     if (_timers.size() < (size_t)index + 1)
@@ -612,6 +795,16 @@ int32_t EV::timer_stop(int32_t id)
 int32_t EV::timer_stop(EVTimer *w)
 {
     clear_pending(w);
+    if (w->_wheel)
+    {
+        // 已超时的单次定时器不在时间轮中
+        if (w->_slot)
+        {
+            _timer_wheel.del(w);
+            w->_at -= _steady_clock;
+        }
+        return 0;
+    }
     if (EXPECT_FALSE(!w->_index)) return 0;
 
     {
@@ -637,7 +830,7 @@ int32_t EV::timer_stop(EVTimer *w)
 }
 
 int32_t EV::periodic_start(int32_t id, int64_t after, int64_t repeat,
-                           int32_t policy)
+                           int32_t policy, bool wheel)
 {
     assert(repeat >= 0);
 
@@ -657,6 +850,13 @@ int32_t EV::periodic_start(int32_t id, int64_t after, int64_t repeat,
     w->_at     = (_system_now + after) * 1000;
     w->_repeat = repeat * 1000;
     w->_policy = policy;
+    w->_wheel  = wheel;
+
+    if (wheel)
+    {
+        _periodic_wheel.add(w);
+        return 1;
+    }
 
     ++_periodic_cnt;
     int32_t index = _periodic_cnt + HEAP0 - 1;
@@ -691,6 +891,11 @@ int32_t EV::periodic_stop(int32_t id)
 int32_t EV::periodic_stop(EVTimer *w)
 {
     clear_pending(w);
+    if (w->_wheel)
+    {
+        if (w->_slot) _periodic_wheel.del(w);
+        return 0;
+    }
     if (EXPECT_FALSE(!w->_index)) return 0;
 
     {
@@ -4,7 +4,8 @@
 #include <condition_variable>
 
 #include "ev_watcher.hpp"
-#include "../thread/spin_lock.hpp"
+#include "loop_stat.hpp"
+#include "timer_wheel.hpp"
 #include "../global/global.hpp"
 
 /**
@@ -35,6 +36,22 @@ extern const char *__BACKEND__;
 // event loop
 class EV
 {
+public:
+    /// 多个backend线程时，io分配到backend的策略
+    enum BackendPolicy
+    {
+        BP_LEAST = 0, ///< 分配到当前io数量最少的backend
+        BP_HASH  = 1  ///< 按fd取模分配
+    };
+
+    /// backend的实现类型
+    enum BackendType
+    {
+        BT_DEFAULT  = 0, ///< 默认，linux下为epoll
+        BT_EPOLL    = 1, ///< 强制使用epoll(仅linux)
+        BT_IO_URING = 2  ///< 使用io_uring，未编译或内核不支持时设置失败
+    };
+
 public:
     EV();
     virtual ~EV();
@@ -42,6 +59,15 @@ public:
     int32_t loop();
     int32_t quit();
 
+    /**
+     * @brief 设置backend(io线程)的数量、分配策略及实现类型，必须在loop之前调用
+     * @param num backend线程数量
+     * @param policy io分配策略，详见BackendPolicy
+     * @param type backend实现类型，详见BackendType
+     * @return 成功返回0
+     */
+    int32_t set_backend(int32_t num, int32_t policy, int32_t type);
+
     /**
      * @brief 启动一个io监听
      * @param id 唯一的id
@@ -79,9 +105,10 @@ public:
     /// @param after N毫秒秒后第一次执行
     /// @param repeat 重复执行间隔，毫秒数
     /// @param policy 定时器重新规则时的策略
+    /// @param wheel 是否使用时间轮(插入、删除O(1)，适用于大量定时器)
     /// @return 成功返回》=1,失败返回值<0
     int32_t timer_start(int32_t id, int64_t after, int64_t repeat,
-                        int32_t policy);
+                        int32_t policy, bool wheel = false);
     /// @brief 停止定时器并从管理器中删除
     /// @param id 定时器唯一id
     /// @return 成功返回0
@@ -94,9 +121,10 @@ public:
     /// @param after N秒后第一次执行
     /// @param repeat 重复执行间隔，秒数
     /// @param policy 定时器重新规则时的策略
+    /// @param wheel 是否使用时间轮(插入、删除O(1)，适用于大量定时器)
     /// @return 成功返回》=1,失败返回值<0
     int32_t periodic_start(int32_t id, int64_t after, int64_t repeat,
-                           int32_t policy);
+                           int32_t policy, bool wheel = false);
     /// @brief 停止utc定时器并从管理器删除
     /// @param id 定时器唯一id
     /// @return 成功返回0
@@ -108,6 +136,12 @@ public:
      * 获取自进程启动以来的毫秒数
      */
     static int64_t steady_clock();
+
+    /// 获取主循环各阶段的耗时统计
+    LoopStat &get_loop_stat()
+    {
+        return _loop_stat;
+    }
     /**
      * 获取UTC时间，精度毫秒
      */
@@ -127,6 +161,19 @@ public:
     virtual void timer_callback(int32_t id, int32_t revents)
     {
     }
+    /**
+     * @brief 批量回调本帧超时的定时器(_timer_fired)，仅在_timer_batch时使用
+     * 默认逐个放到待处理队列，和非批量模式一样回调timer_callback
+     */
+    virtual void timer_batch_callback()
+    {
+        for (auto w : _timer_fired)
+        {
+            w->_revents = 0;
+            feed_event(w, EV_TIMER);
+        }
+        _timer_fired.clear();
+    }
     /**
      * @brief 标记io变化，稍后异步处理
      * @param fd
@@ -141,12 +188,18 @@ public:
     void io_fast_event(EVIO *w, int32_t events);
 
     /**
-     * 获取backend线程待处理的事件
+     * @brief 标记io有数据需要发送，本帧逻辑执行完后再统一唤醒backend线程发送
+     * 同一帧内多次发送数据只会产生一次fast_event，减少唤醒backend线程和send的次数
+     * @param w io监听器
      */
-    std::vector<EVIO *> &get_fast_event()
+    void io_flush(EVIO *w)
     {
-        return _io_fevents;
+        if (w->_flush_index) return;
+
+        _io_flushes.emplace_back(w);
+        w->_flush_index = static_cast<int32_t>(_io_flushes.size());
     }
+
     /// 其他线程发送io事件给主线程处理(此函数需要外部加锁)
     void io_receive_event(EVIO *w, int32_t revents);
 
@@ -159,26 +212,34 @@ public:
         return _mutex;
     }
 
-    /// 获取快速锁
-    SpinLock &fast_lock()
-    {
-        return _spin_lock;
-    }
-
     /**
-     * @brief 唤醒主线程
-     * @param job 如果为true，则加锁并设置_has_job标记
-    */
-    void wake(bool job)
+     * @brief 唤醒主线程，其他线程统一使用这个函数唤醒主线程(调用者不能持有主线程锁)
+     * 通过_has_job合并唤醒：主线程处理之前，多个线程或者同一线程多次唤醒，只会通知一次
+     */
+    void wake()
     {
-        if (job)
+        // 已经有其他线程设置了标记，主线程在下次wait之前一定会检测到，不需要再通知
+        if (_has_job.exchange(true)) return;
+
+        // 主线程检测_has_job到进入wait期间一直持有锁，这里加锁再通知，保证通知时
+        // 主线程要么已在wait中，要么还未检测_has_job，不会漏掉唤醒
         {
             std::lock_guard<std::mutex> guard(_mutex);
-            _has_job = true;
         }
+
+        // The notifying thread does not need to hold the lock on the same mutex
+        // as the one held by the waiting thread(s)
         _cv.notify_one();
     }
 
+    /**
+     * @brief 唤醒主线程，同wake，但调用者已持有主线程锁
+     */
+    void wake_locked()
+    {
+        if (!_has_job.exchange(true)) _cv.notify_one();
+    }
+
     /// 设置是否有任务需要处理
     void set_job(bool job)
     {
@@ -189,6 +250,14 @@ protected:
     virtual void running() = 0;
 
     void io_reify();
+    /// 把本帧标记需要发送数据的io统一发送给backend线程
+    void io_flush_reify();
+    /**
+     * @brief 为一个新的io分配backend
+     * @param w io监听器
+     * @return backend对象
+     */
+    EVBackend *select_backend(EVIO *w);
     void time_update();
     /**
      * 设置watcher的回调事件
@@ -207,8 +276,21 @@ protected:
      */
     void clear_io_receive_event(EVIO *w);
     void io_receive_event_reify();
+    /// 取出各个backend通过无锁队列发送过来的io事件
+    void io_receive_ring_reify();
     void timers_reify();
     void periodic_reify();
+    /**
+     * @brief 定时器超时，放到待处理队列或者本帧批量回调的数组
+     * @param w 定时器
+     */
+    void fire_timer(EVTimer *w);
+    /**
+     * @brief 处理时间轮中超时的定时器
+     * @param wheel 时间轮
+     * @param now 时间轮对应的当前时间，毫秒
+     */
+    void wheel_reify(TimerWheel &wheel, int64_t now);
     void down_heap(HeapNode *heap, int32_t N, int32_t k);
     void up_heap(HeapNode *heap, int32_t k);
     void adjust_heap(HeapNode *heap, int32_t N, int32_t k);
@@ -218,7 +300,7 @@ protected:
     volatile bool _done; /// 主循环是否已结束
 
     /**
-     * @brief 是否有任务需要处理
+     * @brief 是否有任务需要处理，同时用于合并多次唤醒
      * std::atomic_flag guaranteed to be lock-free而std::atomic<bool>不一定
      * 但atomic_flag需要C++20才有test函数，这就离谱
      * std::atomic<bool>在x86下是lock-free，将就着用吧，过几年再改用flag
@@ -230,13 +312,12 @@ protected:
     /// 触发了事件，等待处理的watcher
     std::vector<EVWatcher *> _pendings;
 
-    /// 在主线程设置，待backend线程处理的事件
-    std::vector<EVIO *> _io_fevents;
-
     /**
      * @brief 已经改变，等待设置到内核的io watcher
     */
     std::vector<EVIO *> _io_changes;
+    /// 本帧有数据需要发送的io
+    std::vector<EVIO *> _io_flushes;
     /**
      * @brief _io_changes中用于删除的索引
     */
@@ -256,8 +337,20 @@ protected:
     std::vector<EVTimer *> _periodics; /// 按二叉树排列的utc定时器
     std::unordered_map<int32_t, EVTimer> _periodic_mgr;
 
-    EVBackend *_backend;          ///< io后台
+    TimerWheel _timer_wheel;    ///< 使用时间轮的定时器
+    TimerWheel _periodic_wheel; ///< 使用时间轮的utc定时器
+    std::vector<EVTimer *> _wheel_expired; ///< 时间轮本次超时的定时器
+
+    /// 是否把一帧内超时的定时器收集起来批量回调，而不是逐个回调
+    bool _timer_batch;
+    std::vector<EVTimer *> _timer_fired; ///< 本帧超时，等待批量回调的定时器
+
+    int32_t _backend_num;    ///< backend线程数量
+    int32_t _backend_policy; ///< io分配到backend的策略
+    int32_t _backend_type;   ///< backend的实现类型
+    std::vector<EVBackend *> _backends; ///< io后台
     int64_t _busy_time;           ///< 上一次执行消耗的时间，毫秒
+    LoopStat _loop_stat;          ///< 主循环各阶段的耗时统计
 
     int64_t _steady_clock;              ///< 起服到现在的毫秒
     int64_t _system_clock; // UTC时间戳（单位：毫秒）
@@ -276,7 +369,4 @@ protected:
 
     /// 主线程锁
     std::mutex _mutex;
-
-    /// 用于数据交换的spin lock
-    SpinLock _spin_lock;
 };
@@ -3,13 +3,50 @@
 
 #if defined(__linux__)
     #include "ev_epoll.inl"
+    #ifdef CONF_IO_URING
+        #include "ev_iouring.inl"
+    #endif
 #elif defined(__windows__)
     #include "ev_poll.inl"
 #endif
 
+/// 编译的默认backend名字，__BACKEND__会被set_backend修改，这里单独保存
+static const char *final_backend_name = __BACKEND__;
 
-EVBackend *EVBackend::instance()
+bool EVBackend::is_supported(int32_t type)
 {
+    switch (type)
+    {
+    case EV::BT_DEFAULT: return true;
+#if defined(__linux__)
+    case EV::BT_EPOLL: return true;
+    #ifdef CONF_IO_URING
+    case EV::BT_IO_URING: return IOUringBackend::is_supported();
+    #endif
+#endif
+    default: return false;
+    }
+}
+
+const char *EVBackend::name(int32_t type)
+{
+#ifdef CONF_IO_URING
+    if (EV::BT_IO_URING == type) return "io_uring";
+#else
+    UNUSED(type);
+#endif
+    return final_backend_name;
+}
+
+EVBackend *EVBackend::instance(int32_t type)
+{
+    // io_uring目前只是用POLL_ADD代替epoll的就绪通知，读写仍是单独的系统调用，
+    // backend_bench中并不比epoll快，所以只在脚本明确指定时才使用
+#ifdef CONF_IO_URING
+    if (EV::BT_IO_URING == type) return new IOUringBackend();
+#else
+    UNUSED(type);
+#endif
     return new FinalBackend();
 }
 
@@ -23,13 +60,19 @@ void EVBackend::uninstance(EVBackend *backend)
 
 EVBackend::EVBackend()
 {
-    _has_ev = false;
     _busy = false;
     _done = false;
     _ev   = nullptr;
     _last_pending_tm = 0;
+    _now = 0;
     _modify_protected = false;
+    _io_changed = false;
+    _io_count = 0;
+    _has_receive = false;
+    _fast_wake   = false;
     _fast_events.reserve(1024);
+    _io_fevents.reserve(1024);
+    _receive_events.reserve(1024);
 }
 
 EVBackend::~EVBackend()
@@ -58,12 +101,14 @@ void EVBackend::stop()
 
 void EVBackend::backend_once(int32_t ev_count, int64_t now)
 {
+    _now = now;
     _fast_events.clear();
 
     // TODO 下面的操作，是每个操作，加锁、解锁一次，还是全程解锁呢？
     // 即使全程加锁，至少是不会影响主线程执行逻辑的。主线程执行逻辑回调时，不会用到锁
     {
-        std::lock_guard<std::mutex> guard(_ev->lock());
+        // 这里只加当前backend的锁，多个backend线程可以同时读写
+        std::lock_guard<std::mutex> guard(_mutex);
 
         // poll等结构在处理事件时需要for循环遍历所有fd列表
         // 中间禁止调用modify_fd来删除这个列表
@@ -72,15 +117,18 @@ void EVBackend::backend_once(int32_t ev_count, int64_t now)
         do_wait_event(ev_count);
         _modify_protected = false;
 
-        // 主线程和backend线程会频繁交换fast_event,因此使用一个快速、独立的锁
-        // 注意这里必须在do_wait_event之后交换数据，因为唤醒backend的eventfd在wait_event
-        // 必须先清空eventfd再交换数据，否则可能会漏掉一些事件
+        // 注意这里必须在do_wait_event之后处理fast_event，因为唤醒backend的eventfd在wait_event
+        // 必须先清空eventfd及唤醒标记再取数据，否则可能会漏掉一些事件
+        _fast_wake.store(false);
         {
-            std::lock_guard<SpinLock> guard(_ev->fast_lock());
-            _fast_events.swap(_ev->get_fast_event());
+            std::lock_guard<SpinLock> guard(_fast_lock);
+            _fast_events.swap(_io_fevents);
         }
 
         do_fast_event();
+
+        // 超时的连接在do_user_event中关闭
+        if (!_idle_list.empty()) check_idle_watcher(now);
         do_user_event();
 
         // 检测待删除的连接是否超时
@@ -91,11 +139,24 @@ void EVBackend::backend_once(int32_t ev_count, int64_t now)
             check_pending_watcher(now);
         }
 
-        if (_has_ev)
+        // 必须在释放backend锁之前把事件交给主线程，否则主线程可能删掉这些watcher
+        // 大部分事件已通过_receive_ring交给主线程，只有溢出的才需要加主线程锁
+        if (!_receive_events.empty())
+        {
+            std::lock_guard<std::mutex> ev_guard(_ev->lock());
+            for (auto &e : _receive_events)
+            {
+                _ev->io_receive_event(e.first, e.second);
+            }
+            _ev->wake_locked();
+
+            _receive_events.clear();
+        }
+        else if (_has_receive)
         {
-            _ev->set_job(true);
-            _ev->wake(false);
+            _ev->wake();
         }
+        _has_receive = false;
     }
 }
 
@@ -111,8 +172,6 @@ void EVBackend::backend()
 
     while (!_done)
     {
-        _has_ev = false;
-
         int32_t ev_count = wait(max_wait);
         if (ev_count < 0) break;
 
@@ -230,18 +289,47 @@ int32_t EVBackend::modify_watcher(EVIO *w)
         new_ev = b_uevents | w->_b_eevents;
 
         op = old_ev ? FD_OP_MOD : FD_OP_ADD;
+
+        // 暂停读取(见Socket::pause_read)期间收不到数据，不能按空闲超时断开，
+        // 恢复读取时重新计时
+        if (FD_OP_MOD == op && w->_idle_timeout > 0)
+        {
+            if (!(new_ev & EV_READ))
+            {
+                if (old_ev & EV_READ) del_idle_watcher(w);
+            }
+            else
+            {
+                add_idle_watcher(w);
+            }
+        }
     }
 
     // 关闭连接时，这里必须置0，这样do_event才不会继续执行读写逻辑
     w->_b_kevents = static_cast<uint8_t>(new_ev);
 
+    if (FD_OP_ADD == op)
+    {
+        if (w->_idle_timeout > 0) add_idle_watcher(w);
+    }
+    else if (FD_OP_DEL == op)
+    {
+        if (w->_b_idle_index) del_idle_watcher(w);
+    }
+
     return modify_fd(w->_fd, op, new_ev);
 }
 
 void EVBackend::feed_receive_event(EVIO *w, int32_t ev)
 {
-    _has_ev = true;
-    _ev->io_receive_event(w, ev);
+    if (EXPECT_TRUE(_receive_ring.push({w, ev})))
+    {
+        _has_receive = true;
+        return;
+    }
+
+    // 主线程处理不过来，队列满了，回退到加锁的数组
+    _receive_events.emplace_back(w, ev);
 }
 
 
@@ -302,21 +390,12 @@ bool EVBackend::do_io_status(EVIO *w, int32_t ev, const IO::IOStatus &status)
     return false;
 }
 
-void EVBackend::do_watcher_fast_event(EVIO *w)
+void EVBackend::do_watcher_fast_event(EVIO *w, int32_t events)
 {
-    int32_t events = 0;
-    {
-        std::lock_guard<SpinLock> guard(_ev->fast_lock());
-
-        // 执行fast_event时，需要保证watcher已就位
-        // 因为fast_event可能会修改该watcher在epoll中的信息从而产生event
-        // 这时候没有watcher就无法正确处理
-        assert(get_fd_watcher(w->_fd));
-
-        events           = w->_b_fevents;
-        w->_b_fevents    = 0;
-        w->_b_fevent_index = 0;
-    }
+    // 执行fast_event时，需要保证watcher已就位
+    // 因为fast_event可能会修改该watcher在epoll中的信息从而产生event
+    // 这时候没有watcher就无法正确处理
+    assert(get_fd_watcher(w->_fd));
 
     // TODO 执行fast_event时，可能还未执行该watcher的user_event
     // 即当前fd仍不归epoll管理从目前来看这个暂时没有影响
@@ -376,6 +455,8 @@ void EVBackend::do_watcher_wait_event(EVIO *w, int32_t revents)
         {
             events |= EV_READ;
 
+            if (w->_b_idle_index) update_idle_watcher(w);
+
             auto status = w->recv();
             do_io_status(w, EV_READ, status);
         }
@@ -401,12 +482,27 @@ void EVBackend::do_watcher_wait_event(EVIO *w, int32_t revents)
 
 void EVBackend::do_fast_event()
 {
-    for (auto w : _fast_events)
+    IOEvent e;
+    while (_fast_ring.pop(e))
     {
         // 主线程发出io请求后，后续逻辑可能删掉了这个对象
+        if (e._w) do_watcher_fast_event(e._w, e._events);
+    }
+
+    // _fast_ring溢出时放到数组中的事件
+    for (auto w : _fast_events)
+    {
         if (!w) continue;
 
-        do_watcher_fast_event(w);
+        int32_t events = 0;
+        {
+            std::lock_guard<SpinLock> guard(_fast_lock);
+
+            events             = w->_b_fevents;
+            w->_b_fevents      = 0;
+            w->_b_fevent_index = 0;
+        }
+        do_watcher_fast_event(w, events);
     }
 }
 
@@ -457,11 +553,111 @@ void EVBackend::del_pending_watcher(int32_t fd, EVIO *w)
 
     // 标记为已关闭
     w->_b_eevents |= EV_CLOSE;
+    if (w->_b_idle_index) del_idle_watcher(w);
 
     feed_receive_event(w, EV_CLOSE);
     modify_fd(w->_fd, FD_OP_DEL, 0);
 }
 
+void EVBackend::add_idle_watcher(EVIO *w)
+{
+    if (w->_b_idle_index) return;
+
+    int32_t index = 0;
+    int32_t size  = static_cast<int32_t>(_idle_list.size());
+    while (index < size && _idle_list[index]._timeout != w->_idle_timeout)
+    {
+        ++index;
+    }
+    if (index == size) _idle_list.push_back({w->_idle_timeout, nullptr, nullptr});
+
+    IdleList &list = _idle_list[index];
+
+    w->_b_idle_index = index + 1;
+    w->_b_last_recv  = _now;
+    w->_b_idle_prev  = list._tail;
+    w->_b_idle_next  = nullptr;
+    if (list._tail)
+    {
+        list._tail->_b_idle_next = w;
+    }
+    else
+    {
+        list._head = w;
+    }
+    list._tail = w;
+}
+
+void EVBackend::del_idle_watcher(EVIO *w)
+{
+    if (!w->_b_idle_index) return;
+
+    IdleList &list = _idle_list[w->_b_idle_index - 1];
+    if (w->_b_idle_prev)
+    {
+        w->_b_idle_prev->_b_idle_next = w->_b_idle_next;
+    }
+    else
+    {
+        list._head = w->_b_idle_next;
+    }
+    if (w->_b_idle_next)
+    {
+        w->_b_idle_next->_b_idle_prev = w->_b_idle_prev;
+    }
+    else
+    {
+        list._tail = w->_b_idle_prev;
+    }
+
+    w->_b_idle_index = 0;
+    w->_b_idle_prev  = nullptr;
+    w->_b_idle_next  = nullptr;
+}
+
+void EVBackend::update_idle_watcher(EVIO *w)
+{
+    // 同一毫秒内多次收到数据，不需要调整链表
+    if (w->_b_last_recv == _now) return;
+
+    // 所有watcher都是按时间先后移到链表尾，因此链表一直是有序的
+    IdleList &list = _idle_list[w->_b_idle_index - 1];
+    if (list._tail != w)
+    {
+        int32_t index = w->_b_idle_index;
+        del_idle_watcher(w);
+
+        w->_b_idle_index = index;
+        w->_b_idle_prev  = list._tail;
+        list._tail->_b_idle_next = w;
+        list._tail = w;
+    }
+    w->_b_last_recv = _now;
+}
+
+void EVBackend::check_idle_watcher(int64_t now)
+{
+    /**
+     * 超时的连接不单独通知主线程，而是和普通的关闭一样在do_user_event中关闭，
+     * 通过_receive_ring与本帧其他事件一起交给主线程，整帧只唤醒主线程一次。
+     * 主线程仍需逐个回调conn_del，因为每个连接都要释放socket及脚本中的对象
+     */
+    for (auto &list : _idle_list)
+    {
+        while (list._head && now - list._head->_b_last_recv > list._timeout)
+        {
+            EVIO *w = list._head;
+            del_idle_watcher(w);
+
+            PLOG("idle timeout, id = %d, fd = %d", w->_id, w->_fd);
+
+            // 由close_cb把这个错误码传给脚本
+            w->_errno = ETIMEDOUT;
+            modify_later(w, EV_CLOSE);
+        }
+    }
+}
+
 void EVBackend::set_fd_watcher(int32_t fd, EVIO *w)
 {
     // win的socket是unsigned类型，可能会很大，得强转unsigned来判断
@@ -495,3 +691,42 @@ EVIO *EVBackend::get_fd_watcher(int32_t fd)
     auto found = _fd_watcher_huge.find(fd);
     return found == _fd_watcher_huge.end() ? nullptr : found->second;
 }
+
+void EVBackend::fast_event(EVIO *w, int32_t events)
+{
+    // 发送数据已经在EV::io_flush合并，一帧内同一个watcher一般只有一个事件
+    if (EXPECT_FALSE(!_fast_ring.push({w, events})))
+    {
+        std::lock_guard<SpinLock> guard(_fast_lock);
+
+        w->_b_fevents |= static_cast<uint8_t>(events);
+
+        // 玩家登录的时候，可能有上百次数据发送，不要每次都插入队列
+        // _b_fevent_index为-1时，表示该watcher尚未执行第一次io_reify，也不放入队列
+        if (0 == w->_b_fevent_index)
+        {
+            _io_fevents.emplace_back(w);
+            w->_b_fevent_index = static_cast<int32_t>(_io_fevents.size());
+        }
+    }
+
+    // backend线程取数据前会清除这个标记，在这之后添加的事件会再次唤醒
+    if (!_fast_wake.exchange(true)) this->wake();
+}
+
+void EVBackend::clear_fast_event(EVIO *w)
+{
+    // 外部持有backend锁，backend线程不会pop，可以直接修改队列中的数据
+    _fast_ring.for_each(
+        [w](IOEvent &e)
+        {
+            if (e._w == w) e._w = nullptr;
+        });
+
+    if (w->_b_fevent_index > 0)
+    {
+        assert(w->_b_fevent_index <= (int32_t)_io_fevents.size());
+        _io_fevents[w->_b_fevent_index - 1] = nullptr;
+        w->_b_fevent_index                  = 0;
+    }
+}
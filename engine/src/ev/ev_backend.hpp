@@ -1,7 +1,11 @@
 #pragma once
 
+#include <mutex>
 #include <thread>
 
+#include "../thread/spin_lock.hpp"
+#include "../thread/spsc_queue.hpp"
+
 /**
  * 1. 主线程和io线程共用同一个读写缓冲区
  * 
@@ -20,6 +24,23 @@
  * 2. io线程使用独立的缓冲区
  *      io线程读写的数据需要使用memcpy复制一闪
  *      上面大部分逻辑的锁都可以去掉
+ *
+ * 3. 多个io线程(multi reactor)
+ *      每个backend有独立的epoll、fd映射、锁及事件队列，一个watcher只属于一个backend
+ *      backend线程处理完io后，再加主线程锁把事件交给主线程，加锁顺序固定为
+ *      backend锁 -> 主线程锁，主线程io_reify时也必须按这个顺序加锁，避免死锁
+ *
+ * 4. 无锁事件队列
+ *      主线程与backend线程之间的io事件通过两个SPSC环形队列传递，不再竞争锁
+ *      fast_ring: 主线程 -> backend线程，backend线程只在持有backend锁时pop
+ *      receive_ring: backend线程 -> 主线程，backend线程只在持有backend锁时push
+ *      因此主线程持有backend锁(io_reify)时，可以安全地清理队列中已删除的watcher
+ *      队列满时回退到原来加锁的数组，保证事件不丢失
+ *
+ * 5. 空闲连接检测
+ *      设置了_idle_timeout的watcher按超时时间分组，每组一个按最后收到数据时间排序的链表
+ *      收到数据时移到链表尾，检测时只需要从链表头开始检查，没有超时的连接时为O(1)
+ *      超时的连接以ETIMEDOUT关闭，和正常断开一样通过conn_del通知脚本
  */
 
 /**
@@ -37,6 +58,13 @@ public:
         FD_OP_DEL = 2, // 删除
         FD_OP_MOD = 3  // 修改
     };
+
+    /// 在主线程和backend线程之间传递的io事件
+    struct IOEvent
+    {
+        EVIO *_w;        // watcher，被删除时置为nullptr
+        int32_t _events; // 事件，如EV_WRITE
+    };
 public:
     EVBackend();
     virtual ~EVBackend();
@@ -70,10 +98,62 @@ public:
      * 通过fd获取watcher
      */
     EVIO *get_fd_watcher(int32_t fd);
+    /**
+     * @brief 主线程把一个io操作事件发送给backend线程并马上唤醒它来执行
+     * @param w io监听器
+     * @param events 需要执行的事件，如EV_WRITE
+     */
+    void fast_event(EVIO *w, int32_t events);
+    /**
+     * @brief 清除等待backend线程处理的事件，需要外部加锁
+     * @param w io监听器
+     */
+    void clear_fast_event(EVIO *w);
+    /**
+     * @brief 从空闲检测链表中删除watcher，需要外部加锁
+     * @param w io监听器
+     */
+    void del_idle_watcher(EVIO *w);
+    /**
+     * @brief 取出backend线程通过无锁队列发给主线程的事件，仅主线程调用
+     * @param e 取出的事件
+     * @return 是否有事件
+     */
+    bool pop_receive_event(IOEvent &e)
+    {
+        return _receive_ring.pop(e);
+    }
+
+    /// 获取backend锁，操作该backend下的watcher时必须加锁
+    std::mutex &lock()
+    {
+        return _mutex;
+    }
+
+    /// 当前分配到这个backend的io数量，仅主线程使用
+    int32_t get_io_count() const
+    {
+        return _io_count;
+    }
+    /// 修改当前分配到这个backend的io数量，仅主线程使用
+    void add_io_count(int32_t count)
+    {
+        _io_count += count;
+    }
+    /**
+     * 检测当前平台、编译选项及内核是否支持指定的backend类型
+     * @param type backend实现类型，详见EV::BackendType
+     */
+    static bool is_supported(int32_t type);
+    /**
+     * 获取指定类型使用的backend名字
+     */
+    static const char *name(int32_t type);
     /**
      * 创建一个backend实例
+     * @param type backend实现类型，详见EV::BackendType
      */
-    static EVBackend *instance();
+    static EVBackend *instance(int32_t type);
     /**
      * 销毁一个backend实例
      */
@@ -88,7 +168,7 @@ protected:
     /**
      * 处理主线程发起的事件
      */
-    void do_watcher_fast_event(EVIO *w);
+    void do_watcher_fast_event(EVIO *w, int32_t events);
     /**
      * 处理从网络收到的事件
      */
@@ -145,6 +225,21 @@ private:
      * 删除主动关闭，等待删除的watcher
      */
     void del_pending_watcher(int32_t fd, EVIO *w);
+    /**
+     * @brief 把设置了空闲超时的watcher加入到检测链表
+     * @param w io监听器
+     */
+    void add_idle_watcher(EVIO *w);
+    /**
+     * @brief watcher收到数据，更新最后收到数据时间
+     * @param w io监听器
+     */
+    void update_idle_watcher(EVIO *w);
+    /**
+     * @brief 关闭空闲超时的连接
+     * @param now 当前时间，毫秒
+     */
+    void check_idle_watcher(int64_t now);
     /**
      * 处理待修改的io
      */
@@ -162,22 +257,60 @@ private:
     */
     void modify_later(EVIO *w, int32_t events);
 
+public:
+    /// 主线程本次io_reify是否修改过这个backend，需要唤醒，仅主线程使用
+    bool _io_changed;
+
 protected:
-    bool _has_ev;   /// 是否有待主线程处理的事件
     bool _done;     /// 是否终止进程
     bool _busy;     /// io读写返回busy，意味主线程处理不完这些数据
     bool _modify_protected; // 当前禁止修改poll等数组结构
     int64_t _last_pending_tm; // 上次检测待删除watcher时间
+    int64_t _now;             // 本次backend_once的时间，毫秒
     class EV *_ev;  /// 主循环
     std::thread _thread;
+    int32_t _io_count; /// 分配到这个backend的io数量，仅主线程使用
     std::vector<EVIO *> _fast_events; // 等待backend线程快速处理的事件
 
+    /// 在主线程设置，待backend线程处理的事件
+    std::vector<EVIO *> _io_fevents;
+    /// 用于和主线程交换_io_fevents的spin lock，仅在_fast_ring溢出时使用
+    SpinLock _fast_lock;
+    /// backend锁，保护这个backend下的watcher不被主线程删除
+    std::mutex _mutex;
+
+    /**
+     * 本次收到的io事件，backend处理完所有读写后，再统一加主线程锁交给主线程
+     * 这样各个backend线程读写时不需要竞争主线程锁
+     */
+    std::vector<std::pair<EVIO *, int32_t>> _receive_events;
+
+    static const size_t RING_SIZE = 4096;
+    /// 主线程发给backend线程的事件
+    SPSCQueue<IOEvent, RING_SIZE> _fast_ring;
+    /// backend线程发给主线程的事件，溢出时放到_receive_events
+    SPSCQueue<IOEvent, RING_SIZE> _receive_ring;
+    /// 本次是否有事件放到了_receive_ring，需要唤醒主线程
+    bool _has_receive;
+    /// 是否已唤醒backend线程来处理_fast_ring，用于合并多次唤醒
+    std::atomic<bool> _fast_wake;
+
     /// 等待变更到backend的事件
     std::vector<EVIO *> _user_events;
 
     // 待发送完数据后删除的watcher
     std::unordered_map<int32_t, int64_t> _pending_watcher;
 
+    /// 同一空闲超时时间的watcher链表，按最后收到数据的时间排序
+    struct IdleList
+    {
+        int32_t _timeout; // 空闲超时时间，毫秒
+        EVIO *_head;      // 最早收到数据的watcher
+        EVIO *_tail;      // 最后收到数据的watcher
+    };
+    /// 连接类型一般只有几种，超时时间也只有几种，直接用数组
+    std::vector<IdleList> _idle_list;
+
     /// 小于该值的fd，可通过数组快速获取io对象
     static const int32_t HUGE_FD = 10240;
     /**
@@ -0,0 +1,454 @@
+/*
+ * for io_uring
+ * 1. 直接使用syscall及<linux/io_uring.h>，不依赖liburing
+ * 2. 仍然是就绪通知模型：用IORING_OP_POLL_ADD代替epoll_ctl+epoll_wait，读写仍由
+ *    IO对象(包括ssl)负责。这样backend的逻辑和epoll完全一致，只是把fd变更、重新监听
+ *    等操作写入SQ，和等待事件一起在一次io_uring_enter中批量提交，减少系统调用
+ * 3. poll请求使用oneshot模式，触发后重新提交，相当于epoll的LT模式。multishot poll是
+ *    边沿触发的，读缓冲区溢出(IOS_BUSY)时未读完的数据不会再次通知
+ * 4. user_data = (generation << 32) | fd，每次修改fd都会增加generation，用于忽略
+ *    已被删除、修改的旧poll请求返回的事件
+ * 5. 只有脚本通过ev:set_backend(num, policy, BT_IO_URING)指定时才使用，内核不支持
+ *    (低于5.1、被seccomp禁止等)时设置失败。由于读写仍是单独的系统调用，backend_bench
+ *    中并不比epoll快，默认仍使用epoll
+ */
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/// 单个ring的SQ大小，CQ大小由内核默认为SQ的2倍
+static const uint32_t IOURING_ENTRIES = 4096;
+
+/// 超时请求的user_data，fd不可能为-1，不会和fd冲突
+static const uint64_t IOURING_UD_TIMEOUT = 0xFFFFFFFFull;
+/// 删除poll请求的user_data
+static const uint64_t IOURING_UD_REMOVE = 0xFFFFFFFEull;
+
+/// backend using io_uring implement
+class IOUringBackend final : public EVBackend
+{
+public:
+    IOUringBackend();
+    ~IOUringBackend();
+
+    void after_stop() override;
+    bool before_start() override;
+    void wake() override;
+
+    /**
+     * @brief 检测当前内核是否支持io_uring，结果会缓存
+     * @return 是否支持
+     */
+    static bool is_supported();
+
+private:
+    int32_t wait(int32_t timeout) override;
+    void do_wait_event(int32_t ev_count) override;
+    int32_t modify_fd(int32_t fd, int32_t op, int32_t new_ev) override;
+
+    /// 获取一个空闲的sqe，SQ满时先提交
+    io_uring_sqe *get_sqe();
+    /// 提交所有待提交的sqe
+    int32_t submit(uint32_t min_complete, uint32_t flags);
+    /// 提交一个poll请求
+    void poll_add(int32_t fd, int32_t events);
+    /// 删除一个poll请求
+    void poll_remove(int32_t fd);
+
+    /// 获取fd当前的user_data
+    uint64_t fd_data(int32_t fd)
+    {
+        return (((uint64_t)_fd_gen[fd]) << 32) | (uint32_t)fd;
+    }
+
+    static int32_t sys_setup(uint32_t entries, io_uring_params *p)
+    {
+        return (int32_t)syscall(__NR_io_uring_setup, entries, p);
+    }
+    static int32_t sys_enter(int32_t fd, uint32_t to_submit,
+                             uint32_t min_complete, uint32_t flags)
+    {
+        return (int32_t)syscall(__NR_io_uring_enter, fd, to_submit,
+                                min_complete, flags, nullptr, 0);
+    }
+
+private:
+    int32_t _ring_fd; /// io_uring句柄
+    int32_t _wake_fd; /// 用于唤醒子线程的fd
+
+    void *_sq_ptr;      /// SQ ring映射的内存
+    void *_cq_ptr;      /// CQ ring映射的内存
+    size_t _sq_sz;      /// SQ ring映射的大小
+    size_t _cq_sz;      /// CQ ring映射的大小
+    io_uring_sqe *_sqes; /// sqe数组
+    size_t _sqes_sz;    /// sqe数组映射的大小
+
+    uint32_t *_sq_head;
+    uint32_t *_sq_tail;
+    uint32_t *_sq_array;
+    uint32_t _sq_mask;
+    uint32_t _sq_entries;
+    uint32_t _sq_local_tail; /// 本地的tail，提交时才写入_sq_tail
+    uint32_t _sq_pending;    /// 已填充未提交的sqe数量
+
+    uint32_t *_cq_head;
+    uint32_t *_cq_tail;
+    io_uring_cqe *_cqes;
+    uint32_t _cq_mask;
+
+    __kernel_timespec _ts; /// 超时请求的时间，必须在提交前一直有效
+
+    std::vector<uint32_t> _fd_gen; /// fd对应的generation
+    std::vector<int32_t> _fd_ev;   /// fd当前监听的事件
+};
+
+bool IOUringBackend::is_supported()
+{
+    static int32_t supported = -1;
+    if (-1 == supported)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+
+        int32_t fd = sys_setup(4, &p);
+        supported  = fd >= 0 ? 1 : 0;
+        if (fd >= 0) ::close(fd);
+    }
+
+    return 1 == supported;
+}
+
+IOUringBackend::IOUringBackend()
+{
+    _ring_fd = -1;
+    _wake_fd = -1;
+
+    _sq_ptr  = MAP_FAILED;
+    _cq_ptr  = MAP_FAILED;
+    _sqes    = (io_uring_sqe *)MAP_FAILED;
+    _sq_sz   = 0;
+    _cq_sz   = 0;
+    _sqes_sz = 0;
+
+    _sq_head       = nullptr;
+    _sq_tail       = nullptr;
+    _sq_array      = nullptr;
+    _sq_mask       = 0;
+    _sq_entries    = 0;
+    _sq_local_tail = 0;
+    _sq_pending    = 0;
+
+    _cq_head = nullptr;
+    _cq_tail = nullptr;
+    _cqes    = nullptr;
+    _cq_mask = 0;
+
+    memset(&_ts, 0, sizeof(_ts));
+}
+
+IOUringBackend::~IOUringBackend()
+{
+}
+
+bool IOUringBackend::before_start()
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    _ring_fd = sys_setup(IOURING_ENTRIES, &p);
+    if (_ring_fd < 0)
+    {
+        FATAL("io_uring_setup fail:%s", strerror(errno));
+        return false;
+    }
+
+    _sq_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    _cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+
+    // 5.4以后SQ和CQ可以一次映射
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && _cq_sz > _sq_sz) _sq_sz = _cq_sz;
+
+    _sq_ptr = mmap(nullptr, _sq_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == _sq_ptr)
+    {
+        FATAL("io_uring mmap sq fail:%s", strerror(errno));
+        return false;
+    }
+
+    _cq_ptr = single ? _sq_ptr
+                     : mmap(nullptr, _cq_sz, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, _ring_fd,
+                            IORING_OFF_CQ_RING);
+    if (MAP_FAILED == _cq_ptr)
+    {
+        FATAL("io_uring mmap cq fail:%s", strerror(errno));
+        return false;
+    }
+
+    _sqes_sz = p.sq_entries * sizeof(io_uring_sqe);
+    _sqes    = (io_uring_sqe *)mmap(nullptr, _sqes_sz, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, _ring_fd,
+                                 IORING_OFF_SQES);
+    if (MAP_FAILED == (void *)_sqes)
+    {
+        FATAL("io_uring mmap sqes fail:%s", strerror(errno));
+        return false;
+    }
+
+    char *sq = (char *)_sq_ptr;
+    char *cq = (char *)_cq_ptr;
+
+    _sq_head       = (uint32_t *)(sq + p.sq_off.head);
+    _sq_tail       = (uint32_t *)(sq + p.sq_off.tail);
+    _sq_array      = (uint32_t *)(sq + p.sq_off.array);
+    _sq_mask       = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    _sq_entries    = p.sq_entries;
+    _sq_local_tail = *_sq_tail;
+
+    _cq_head = (uint32_t *)(cq + p.cq_off.head);
+    _cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+    _cqes    = (io_uring_cqe *)(cq + p.cq_off.cqes);
+    _cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+
+    // 创建一个fd用于实现self pipe，唤醒io线程
+    _wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_wake_fd < 0)
+    {
+        ELOG("fail to create eventfd e = %d: %s", errno, strerror(errno));
+        return false;
+    }
+
+    poll_add(_wake_fd, EV_READ);
+
+    return true;
+}
+
+void IOUringBackend::after_stop()
+{
+    if (MAP_FAILED != (void *)_sqes) munmap(_sqes, _sqes_sz);
+    if (MAP_FAILED != _cq_ptr && _cq_ptr != _sq_ptr) munmap(_cq_ptr, _cq_sz);
+    if (MAP_FAILED != _sq_ptr) munmap(_sq_ptr, _sq_sz);
+    _sqes   = (io_uring_sqe *)MAP_FAILED;
+    _cq_ptr = MAP_FAILED;
+    _sq_ptr = MAP_FAILED;
+
+    ::close(_wake_fd);
+    _wake_fd = -1;
+
+    ::close(_ring_fd);
+    _ring_fd = -1;
+}
+
+io_uring_sqe *IOUringBackend::get_sqe()
+{
+    uint32_t head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (EXPECT_FALSE(_sq_local_tail - head >= _sq_entries))
+    {
+        // SQ已满，先把已有的提交给内核，不等待完成事件
+        submit(0, 0);
+        head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (_sq_local_tail - head >= _sq_entries) return nullptr;
+    }
+
+    uint32_t index   = _sq_local_tail & _sq_mask;
+    io_uring_sqe *sqe = _sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+
+    _sq_array[index] = index;
+    _sq_local_tail++;
+    _sq_pending++;
+
+    return sqe;
+}
+
+int32_t IOUringBackend::submit(uint32_t min_complete, uint32_t flags)
+{
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+
+    int32_t ret = sys_enter(_ring_fd, _sq_pending, min_complete, flags);
+    if (ret >= 0)
+    {
+        _sq_pending -= std::min(_sq_pending, (uint32_t)ret);
+    }
+
+    return ret;
+}
+
+void IOUringBackend::poll_add(int32_t fd, int32_t events)
+{
+    io_uring_sqe *sqe = get_sqe();
+    if (EXPECT_FALSE(!sqe))
+    {
+        ELOG("io_uring sq full, poll add fail: %d", fd);
+        return;
+    }
+
+    uint32_t ufd = (uint32_t)fd;
+    if (EXPECT_FALSE(_fd_gen.size() <= ufd))
+    {
+        _fd_gen.resize(ufd + 1024, 0);
+        _fd_ev.resize(ufd + 1024, 0);
+    }
+    _fd_ev[ufd] = events;
+
+    // 即使events为0，poll还是会返回POLLERR和POLLHUP，可以处理socket的关闭
+    uint32_t poll_ev =
+        ((events & EV_READ || events & EV_ACCEPT) ? (uint32_t)POLLIN : 0)
+        | ((events & EV_WRITE || events & EV_CONNECT) ? (uint32_t)POLLOUT : 0);
+
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fd;
+    sqe->poll32_events = poll_ev;
+    sqe->user_data     = fd_data(fd);
+}
+
+void IOUringBackend::poll_remove(int32_t fd)
+{
+    io_uring_sqe *sqe = get_sqe();
+    if (EXPECT_FALSE(!sqe))
+    {
+        ELOG("io_uring sq full, poll remove fail: %d", fd);
+        return;
+    }
+
+    sqe->opcode    = IORING_OP_POLL_REMOVE;
+    sqe->fd        = -1;
+    sqe->addr      = fd_data(fd);
+    sqe->user_data = IOURING_UD_REMOVE;
+}
+
+void IOUringBackend::do_wait_event(int32_t ev_count)
+{
+    UNUSED(ev_count);
+
+    uint32_t head = *_cq_head;
+    while (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+    {
+        io_uring_cqe *cqe = _cqes + (head & _cq_mask);
+
+        uint64_t data = cqe->user_data;
+        int32_t res   = cqe->res;
+
+        // 先把cqe还给内核，后面的处理可能会提交新的sqe
+        ++head;
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+
+        if (IOURING_UD_TIMEOUT == data || IOURING_UD_REMOVE == data) continue;
+
+        int32_t fd = (int32_t)(data & 0xFFFFFFFF);
+        if (fd == _wake_fd)
+        {
+            int64_t v = 0;
+            if (::read(fd, &v, sizeof(v)) < 0 && EAGAIN != errno)
+            {
+                ELOG("read io_uring wakeup fd error e = %d: %s", errno,
+                     strerror(errno));
+                // 避免出错日志把硬盘刷爆
+                std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+            }
+            poll_add(fd, EV_READ);
+            continue;
+        }
+
+        // 这个fd在poll请求返回前已被删除或者修改，是旧请求的事件
+        if (data != fd_data(fd)) continue;
+
+        // 被主动取消的请求
+        if (-ECANCELED == res) continue;
+
+        int32_t events = 0;
+        if (res < 0)
+        {
+            events |= EV_CLOSE;
+        }
+        else
+        {
+            if (res & POLLOUT) events |= EV_WRITE;
+            if (res & POLLIN) events |= EV_READ;
+            if (res & (POLLERR | POLLHUP)) events |= EV_CLOSE;
+        }
+
+        EVIO *w = get_fd_watcher(fd);
+        assert(w);
+        do_watcher_wait_event(w, events);
+
+        // oneshot的poll请求已经结束，重新提交以模拟epoll的LT模式
+        // 如果do_watcher_wait_event需要修改事件，会在do_user_event中重新修改
+        if (data == fd_data(fd) && !(events & EV_CLOSE))
+        {
+            poll_add(fd, _fd_ev[fd]);
+        }
+    }
+}
+
+void IOUringBackend::wake()
+{
+    static const int64_t v = 1;
+    if (::write(_wake_fd, &v, sizeof(v)) <= 0)
+    {
+        ELOG("fail to wakeup io_uring e = %d: %s", errno, strerror(errno));
+    }
+}
+
+int32_t IOUringBackend::wait(int32_t timeout)
+{
+    if (timeout > 0)
+    {
+        // off = 1表示只要有一个其他的完成事件，这个超时请求就结束
+        // 这样不会在ring中残留超时请求
+        io_uring_sqe *sqe = get_sqe();
+        if (sqe)
+        {
+            _ts.tv_sec  = timeout / 1000;
+            _ts.tv_nsec = (timeout % 1000) * 1000000;
+
+            sqe->opcode    = IORING_OP_TIMEOUT;
+            sqe->fd        = -1;
+            sqe->addr      = (uint64_t)&_ts;
+            sqe->len       = 1;
+            sqe->off       = 1;
+            sqe->user_data = IOURING_UD_TIMEOUT;
+        }
+    }
+
+    // 提交所有fd变更并等待事件，只需要一次系统调用
+    if (EXPECT_FALSE(submit(1, IORING_ENTER_GETEVENTS) < 0))
+    {
+        // EBUSY表示CQ已满，直接处理已有的事件即可
+        if (errno != EINTR && errno != EBUSY)
+        {
+            FATAL("io_uring_enter errno(%d)", errno);
+            _ev->quit();
+            return -1;
+        }
+    }
+
+    return (int32_t)(__atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE) - *_cq_head);
+}
+
+int32_t IOUringBackend::modify_fd(int32_t fd, int32_t op, int32_t new_ev)
+{
+    uint32_t ufd = (uint32_t)fd;
+    if (EXPECT_FALSE(_fd_gen.size() <= ufd))
+    {
+        _fd_gen.resize(ufd + 1024, 0);
+        _fd_ev.resize(ufd + 1024, 0);
+    }
+
+    // 修改或者删除时，先删除旧的poll请求。旧请求可能已经触发，删除失败也没关系，
+    // 因为generation已改变，旧请求的事件会被忽略
+    if (FD_OP_ADD != op) poll_remove(fd);
+
+    _fd_gen[ufd]++;
+    _fd_ev[ufd] = 0;
+
+    if (FD_OP_DEL != op) poll_add(fd, new_ev);
+
+    return 0;
+}
@@ -30,8 +30,16 @@ EVIO::EVIO(int32_t id, int32_t fd, int32_t events, EV *loop) : EVWatcher(loop)
     _b_uevent_index = 0;
     _b_fevent_index = -1;
     _b_revent_index = 0;
+    _flush_index    = 0;
 
-    _io = nullptr;
+    _idle_timeout = 0;
+    _b_idle_index = 0;
+    _b_last_recv  = 0;
+    _b_idle_prev  = nullptr;
+    _b_idle_next  = nullptr;
+
+    _io      = nullptr;
+    _backend = nullptr;
 }
 
 EVIO::~EVIO()
@@ -107,6 +115,11 @@ EVTimer::EVTimer(int32_t id, EV *loop) : EVWatcher(loop)
     _policy = P_NONE;
     _at     = 0;
     _repeat = 0;
+
+    _wheel = false;
+    _slot  = nullptr;
+    _prev  = nullptr;
+    _next  = nullptr;
 }
 
 EVTimer::~EVTimer()
@@ -162,10 +162,22 @@ public:
     int32_t _b_uevent_index; // 在backend中待修改数组中的下标
     int32_t _b_fevent_index; // 在io_fevents数组中的下标-1表示未初始化不能使用fast_event
     int32_t _b_revent_index; // 在io_revents数组中的下标
+    int32_t _flush_index; // 在io_flushes数组中的下标
+
+    // 空闲超时，毫秒，超过这个时间没收到数据则由backend线程关闭连接，0表示不检测
+    // 在主线程io_start之后、第一次io_reify之前设置，之后backend线程只读
+    int32_t _idle_timeout;
+    int32_t _b_idle_index; // 在backend空闲链表数组中的下标，0表示不在链表中
+    int64_t _b_last_recv;  // 最后一次收到数据的时间，毫秒
+    EVIO *_b_idle_prev;    // 空闲链表中的上一个watcher
+    EVIO *_b_idle_next;    // 空闲链表中的下一个watcher
 
     Buffer _recv;  /// 接收缓冲区，由io线程写，主线程读取并处理数据
     Buffer _send;  /// 发送缓冲区，由主线程写，io线程发送
     IO *_io; /// 负责数据读写的io对象，如ssl读写
+
+    /// 负责该io读写的backend线程，第一次io_reify时分配，之后不再改变
+    class EVBackend *_backend;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -196,4 +208,10 @@ public:
     int32_t _policy; ///< 修正定时器时间偏差策略，详见 reschedule 函数
     int64_t _at; ///< 定时器首次触发延迟的毫秒数（未激活），下次触发时间（已激活）
     int64_t _repeat; ///< 定时器重复的间隔（毫秒数）
+
+    // 以下字段仅在使用时间轮时有效
+    bool _wheel;      ///< 是否使用时间轮而不是二叉堆
+    EVTimer **_slot;  ///< 所在时间轮槽的链表头，不在时间轮中时为nullptr
+    EVTimer *_prev;   ///< 时间轮槽链表中的上一个定时器
+    EVTimer *_next;   ///< 时间轮槽链表中的下一个定时器
 };
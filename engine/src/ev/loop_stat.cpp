@@ -0,0 +1,32 @@
+#include "loop_stat.hpp"
+
+int64_t LoopStat::percentile(int32_t phase, int32_t percent) const
+{
+    const Histogram &h = _phase[phase];
+    if (0 == h._count) return 0;
+
+    // 向上取整，保证p100时能取到最后一个有数据的桶
+    int64_t target = (h._count * percent + 99) / 100;
+    int64_t sum    = 0;
+    for (int32_t i = 0; i < BUCKET; i++)
+    {
+        sum += h._bucket[i];
+        if (sum >= target)
+        {
+            int64_t upper = (int64_t(1) << i) - 1;
+            return upper < h._max ? upper : h._max;
+        }
+    }
+
+    return h._max;
+}
+
+const char *LoopStat::get_name(int32_t phase)
+{
+    static const char *names[LP_MAX] = {
+        "reify",  "wait",   "io",    "timer",  "pending", "signal",
+        "app_ev", "thread", "flush", "delete", "buffer",  "frame",
+    };
+
+    return phase >= 0 && phase < LP_MAX ? names[phase] : "unknow";
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+
+#include "../global/global.hpp"
+
+/**
+ * @brief 主循环各阶段的耗时统计
+ * 1. 每个阶段一个按2的幂次划分的直方图(微秒)，用于计算p50、p99等，不保存原始数据
+ * 2. 每次记录只有一次取时间及几次加法，可以一直开启，用于线上排查卡顿
+ * 3. 同时统计每个阶段处理的事件数量，如回调的io事件、超时的定时器
+ */
+class LoopStat final
+{
+public:
+    /// 主循环的阶段
+    enum Phase
+    {
+        LP_REIFY   = 0,  ///< 把io变更及待发送数据设置到backend
+        LP_WAIT    = 1,  ///< 等待io、定时器等事件(空闲时间)
+        LP_IO      = 2,  ///< 收集backend线程的io事件
+        LP_TIMER   = 3,  ///< 处理超时的定时器
+        LP_PENDING = 4,  ///< 回调io及定时器事件
+        LP_SIGNAL  = 5,  ///< 处理信号
+        LP_APP_EV  = 6,  ///< 回调application_ev
+        LP_THREAD  = 7,  ///< 处理其他线程的回调(ThreadMgr::main_routine)
+        LP_FLUSH   = 8,  ///< 发送合并的数据包及释放预先编码的数据包
+        LP_DELETE  = 9,  ///< 回调已关闭的连接(LNetworkMgr)
+        LP_BUFFER  = 10, ///< 回收空闲缓冲区及检查缓冲区内存预算
+        LP_FRAME   = 11, ///< 一帧中除wait外的总耗时
+
+        LP_MAX
+    };
+
+    /// 直方图的桶数量，第i个桶表示[2^(i-1), 2^i)微秒，最后一个桶包含所有更大的值
+    static const int32_t BUCKET = 32;
+
+    /// 单个阶段的统计数据
+    struct Histogram
+    {
+        int64_t _count;  ///< 执行次数
+        int64_t _total;  ///< 总耗时，微秒
+        int64_t _max;    ///< 最大耗时，微秒
+        int64_t _events; ///< 处理的事件数量
+        int64_t _bucket[BUCKET];
+    };
+
+public:
+    LoopStat()
+    {
+        reset();
+    }
+
+    /// 获取当前时间，微秒
+    static int64_t now_us()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    /**
+     * @brief 记录一个阶段的耗时
+     * @param phase 阶段，详见Phase
+     * @param beg 阶段开始时间，微秒
+     * @param events 本阶段处理的事件数量
+     * @return 当前时间，可直接作为下一阶段的开始时间
+     */
+    int64_t add(int32_t phase, int64_t beg, int64_t events = 0)
+    {
+        int64_t now = now_us();
+        record(phase, now - beg, events);
+
+        return now;
+    }
+
+    /**
+     * @brief 记录一个阶段的耗时
+     * @param phase 阶段，详见Phase
+     * @param us 耗时，微秒
+     * @param events 本阶段处理的事件数量
+     */
+    void record(int32_t phase, int64_t us, int64_t events)
+    {
+        Histogram &h = _phase[phase];
+
+        int32_t index = 0;
+        while (index < BUCKET - 1 && (us >> index)) ++index;
+
+        h._count++;
+        h._total += us;
+        h._events += events;
+        h._bucket[index]++;
+        if (us > h._max) h._max = us;
+    }
+
+    /**
+     * @brief 根据直方图估算百分位耗时，结果为所在桶的上限(不超过最大值)
+     * @param phase 阶段，详见Phase
+     * @param percent 百分位，如99
+     * @return 耗时，微秒
+     */
+    int64_t percentile(int32_t phase, int32_t percent) const;
+
+    /// 获取阶段的统计数据
+    const Histogram &get(int32_t phase) const
+    {
+        return _phase[phase];
+    }
+
+    /// 获取阶段的名字
+    static const char *get_name(int32_t phase);
+
+    /// 清空所有统计数据
+    void reset()
+    {
+        memset(_phase, 0, sizeof(_phase));
+    }
+
+private:
+    Histogram _phase[LP_MAX];
+};
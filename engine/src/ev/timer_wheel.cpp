@@ -0,0 +1,228 @@
+#include <algorithm>
+
+#include "timer_wheel.hpp"
+#include "ev_watcher.hpp"
+
+TimerWheel::TimerWheel()
+{
+    _time = 0;
+    _size = 0;
+    _due  = nullptr;
+
+    memset(_near, 0, sizeof(_near));
+    memset(_level, 0, sizeof(_level));
+}
+
+TimerWheel::~TimerWheel()
+{
+}
+
+void TimerWheel::reset(int64_t now)
+{
+    assert(0 == _size);
+    _time = now;
+}
+
+void TimerWheel::link(EVTimer **slot, EVTimer *w)
+{
+    w->_slot = slot;
+    w->_prev = nullptr;
+    w->_next = *slot;
+    if (*slot) (*slot)->_prev = w;
+    *slot = w;
+}
+
+void TimerWheel::add(EVTimer *w)
+{
+    assert(!w->_slot);
+
+    ++_size;
+
+    int64_t at = w->_at;
+    if (at <= _time)
+    {
+        link(&_due, w);
+        return;
+    }
+
+    uint64_t diff = (uint64_t)(at - _time);
+    if (diff < (uint64_t)NEAR_SIZE)
+    {
+        link(_near + (at & NEAR_MASK), w);
+        return;
+    }
+
+    // 超过最大范围的，先放在最高层，下放时会根据_at重新计算位置
+    static const uint64_t MAX_DIFF = 0xFFFFFFFFull;
+    if (diff > MAX_DIFF) at = _time + (int64_t)MAX_DIFF;
+
+    int32_t shift = NEAR_BITS;
+    for (int32_t i = 0; i < LEVEL; i++)
+    {
+        uint64_t limit = 1ull << (shift + LEVEL_BITS);
+        if (diff < limit || LEVEL - 1 == i)
+        {
+            link(_level[i] + ((at >> shift) & LEVEL_MASK), w);
+            return;
+        }
+        shift += LEVEL_BITS;
+    }
+}
+
+void TimerWheel::del(EVTimer *w)
+{
+    assert(w->_slot);
+
+    if (w->_prev)
+    {
+        w->_prev->_next = w->_next;
+    }
+    else
+    {
+        assert(*(w->_slot) == w);
+        *(w->_slot) = w->_next;
+    }
+    if (w->_next) w->_next->_prev = w->_prev;
+
+    w->_slot = nullptr;
+    w->_prev = nullptr;
+    w->_next = nullptr;
+
+    --_size;
+}
+
+void TimerWheel::cascade(int32_t level, int32_t index)
+{
+    EVTimer *w = _level[level][index];
+
+    _level[level][index] = nullptr;
+    while (w)
+    {
+        EVTimer *next = w->_next;
+
+        w->_slot = nullptr;
+        --_size;
+        add(w);
+
+        w = next;
+    }
+}
+
+void TimerWheel::expire(EVTimer **slot, std::vector<EVTimer *> &expired)
+{
+    EVTimer *w = *slot;
+
+    *slot = nullptr;
+    while (w)
+    {
+        EVTimer *next = w->_next;
+
+        w->_slot = nullptr;
+        w->_prev = nullptr;
+        w->_next = nullptr;
+        --_size;
+        expired.push_back(w);
+
+        w = next;
+    }
+}
+
+void TimerWheel::fast_forward(int64_t now, std::vector<EVTimer *> &expired)
+{
+    std::vector<EVTimer *> timers;
+    timers.reserve(_size);
+
+    for (int32_t i = 0; i < NEAR_SIZE; i++)
+    {
+        if (_near[i]) expire(_near + i, timers);
+    }
+    for (int32_t i = 0; i < LEVEL; i++)
+    {
+        for (int32_t j = 0; j < LEVEL_SIZE; j++)
+        {
+            if (_level[i][j]) expire(_level[i] + j, timers);
+        }
+    }
+    assert(0 == _size);
+
+    _time = now;
+
+    size_t beg = expired.size();
+    for (auto w : timers)
+    {
+        if (w->_at <= now)
+        {
+            expired.push_back(w);
+        }
+        else
+        {
+            add(w);
+        }
+    }
+
+    std::stable_sort(expired.begin() + beg, expired.end(),
+                     [](const EVTimer *a, const EVTimer *b) {
+                         return a->_at < b->_at;
+                     });
+}
+
+void TimerWheel::update(int64_t now, std::vector<EVTimer *> &expired)
+{
+    if (_due) expire(&_due, expired);
+
+    // 时间轮为空时不需要逐个tick推进，例如utc时间被调整了很多
+    if (0 == _size)
+    {
+        _time = now;
+        return;
+    }
+
+    // utc时间被往后调整或者主循环卡住很久，逐个tick推进的次数和时间差成正比(调整1天
+    // 就要推进8640万次)，这时取出所有定时器重新放置，开销只和定时器数量有关
+    if (now - _time > FAST_FORWARD_TICK)
+    {
+        fast_forward(now, expired);
+        return;
+    }
+
+    while (_time < now)
+    {
+        ++_time;
+
+        // 第0层转完一圈，把上层对应的槽下放
+        int64_t t = _time;
+        if (0 == (t & NEAR_MASK))
+        {
+            t >>= NEAR_BITS;
+            for (int32_t i = 0; i < LEVEL; i++)
+            {
+                int32_t index = (int32_t)(t & LEVEL_MASK);
+                cascade(i, index);
+
+                // 当前层未转完一圈，不需要处理更上一层
+                if (index) break;
+                t >>= LEVEL_BITS;
+            }
+
+            // 下放时刚好在当前tick超时的定时器会放到_due
+            if (_due) expire(&_due, expired);
+        }
+
+        EVTimer **slot = _near + (_time & NEAR_MASK);
+        if (*slot) expire(slot, expired);
+    }
+}
+
+int64_t TimerWheel::next_at() const
+{
+    if (_due) return _time;
+
+    // 只查找到第0层这一圈结束，再往后可能会有上层的定时器下放下来
+    int64_t end = (_time | NEAR_MASK) + 1;
+    for (int64_t t = _time + 1; t <= end; t++)
+    {
+        if (_near[t & NEAR_MASK]) return t;
+    }
+
+    return end;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../global/global.hpp"
+
+class EVTimer;
+
+/**
+ * @brief 分层时间轮(hashed hierarchical timing wheel)
+ * 1. 插入、删除都是O(1)，适用于数量很多(如怪物、buff)的定时器
+ * 2. 每个tick为1毫秒，第0层256个槽，其余4层各64个槽，最大可表示2^32毫秒(约49天)，
+ *    更长的定时器放在最高层，下放时再重新计算位置
+ * 3. 高层的槽在低层转完一圈时下放(cascade)到低层
+ * 4. 定时器通过EVTimer中的_prev、_next组成双向链表，不额外分配内存
+ * 5. 时间跳变太大(如utc时间被调整)时不逐个tick推进，而是取出所有定时器重新放置
+ */
+class TimerWheel final
+{
+public:
+    TimerWheel();
+    ~TimerWheel();
+
+    /**
+     * @brief 设置时间轮的当前时间，必须在添加定时器之前调用
+     * @param now 当前时间，毫秒
+     */
+    void reset(int64_t now);
+
+    /**
+     * @brief 添加定时器，定时器的触发时间为w->_at
+     * @param w 定时器
+     */
+    void add(EVTimer *w);
+    /**
+     * @brief 从时间轮中删除定时器
+     * @param w 定时器
+     */
+    void del(EVTimer *w);
+
+    /**
+     * @brief 把时间轮推进到now，并把已超时的定时器从时间轮中移除
+     * @param now 当前时间，毫秒
+     * @param expired 已超时的定时器，按超时的时间先后排列
+     */
+    void update(int64_t now, std::vector<EVTimer *> &expired);
+
+    /**
+     * @brief 获取下一个定时器触发的时间，只用于计算主循环可以等待的时间
+     * 为了效率只查找第0层，因此这个时间可能比实际的偏早，但不会偏晚
+     * @return 触发时间，毫秒
+     */
+    int64_t next_at() const;
+
+    /// 时间轮中定时器的数量
+    int32_t size() const
+    {
+        return _size;
+    }
+
+private:
+    static const int32_t NEAR_BITS  = 8;
+    static const int32_t NEAR_SIZE  = 1 << NEAR_BITS;
+    static const int32_t NEAR_MASK  = NEAR_SIZE - 1;
+    static const int32_t LEVEL_BITS = 6;
+    static const int32_t LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int32_t LEVEL_MASK = LEVEL_SIZE - 1;
+    static const int32_t LEVEL      = 4;
+    /// 超过这个时间差不再逐个tick推进，即第1层转一圈的时间(约16秒)
+    static const int64_t FAST_FORWARD_TICK = NEAR_SIZE << LEVEL_BITS;
+
+    /// 把定时器插入链表头
+    void link(EVTimer **slot, EVTimer *w);
+    /// 把一个槽中的定时器重新放到时间轮中
+    void cascade(int32_t level, int32_t index);
+    /// 把一个槽中的定时器全部移到expired
+    void expire(EVTimer **slot, std::vector<EVTimer *> &expired);
+    /// 时间差太大时，直接把时间轮设置为now，所有定时器重新放置
+    void fast_forward(int64_t now, std::vector<EVTimer *> &expired);
+
+private:
+    int64_t _time; ///< 时间轮当前时间，即已处理到的tick
+    int32_t _size; ///< 定时器数量
+
+    EVTimer *_due; ///< 添加时已经超时的定时器，下次update时直接触发
+    EVTimer *_near[NEAR_SIZE];
+    EVTimer *_level[LEVEL][LEVEL_SIZE];
+};
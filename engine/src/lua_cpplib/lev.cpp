@@ -1,5 +1,6 @@
 #include "lev.hpp"
 #include "ltools.hpp"
+#include "lstatistic.hpp"
 
 #include "../net/socket.hpp"
 #include "../system/static_global.hpp"
@@ -7,6 +8,10 @@
 LEV::LEV()
 {
     _critical_tm       = -1;
+    _timer_wheel       = false;
+    _batch_ids         = 0;
+    _batch_handler     = 0;
+    _batch_traceback   = 0;
     _app_repeat        = 60000;
     _app_next_tm       = 0;
 }
@@ -95,6 +100,24 @@ int32_t LEV::signal(lua_State *L)
     return 0;
 }
 
+int32_t LEV::set_backend(lua_State *L)
+{
+    int32_t num    = luaL_checkinteger32(L, 1);
+    int32_t policy = luaL_optinteger32(L, 2, BP_LEAST);
+    int32_t type   = luaL_optinteger32(L, 3, BT_DEFAULT);
+
+    int32_t e = EV::set_backend(num, policy, type);
+    if (0 == e)
+    {
+        // 启动时设置的__BACKEND__是默认类型，这里更新为实际使用的backend
+        lua_pushstring(L, __BACKEND__);
+        lua_setglobal(L, "__BACKEND__");
+    }
+    lua_pushinteger(L, e);
+
+    return 1;
+}
+
 int32_t LEV::set_app_ev(lua_State *L) // 设置脚本主循环回调
 {
     // 主循环不要设置太长的循环时间，如果太长用定时器就好了
@@ -174,12 +197,40 @@ void LEV::running()
         PLOG("ev busy: " FMT64d "msec", _busy_time);
     }
 
+    int64_t stat_tm = LoopStat::now_us();
+
     invoke_signal();
+    stat_tm = _loop_stat.add(LoopStat::LP_SIGNAL, stat_tm);
+
     invoke_app_ev();
+    stat_tm = _loop_stat.add(LoopStat::LP_APP_EV, stat_tm);
+
+    int32_t thread_ev = StaticGlobal::thread_mgr()->main_routine();
+    stat_tm = _loop_stat.add(LoopStat::LP_THREAD, stat_tm, thread_ev);
+
+    class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
+
+    // 本帧的逻辑都已执行完，合并的数据包在下一帧开始时统一唤醒io线程发送
+    size_t flushed = network_mgr->invoke_batch();
+    flushed += network_mgr->invoke_encoded();
+    stat_tm = _loop_stat.add(LoopStat::LP_FLUSH, stat_tm, (int64_t)flushed);
 
-    StaticGlobal::thread_mgr()->main_routine();
+    size_t deleted = network_mgr->invoke_delete();
+    stat_tm = _loop_stat.add(LoopStat::LP_DELETE, stat_tm, (int64_t)deleted);
 
-    StaticGlobal::network_mgr()->invoke_delete();
+    size_t shrinked = network_mgr->shrink_buffer(_steady_clock);
+    network_mgr->check_buffer_budget(_steady_clock);
+    _loop_stat.add(LoopStat::LP_BUFFER, stat_tm, (int64_t)shrinked);
+}
+
+int32_t LEV::loop_stats(lua_State *L)
+{
+    bool reset = lua_toboolean(L, 1);
+
+    LStatistic::dump_loop(L);
+    if (reset) _loop_stat.reset();
+
+    return 1;
 }
 
 int32_t LEV::periodic_start(lua_State *L)
@@ -188,8 +239,9 @@ int32_t LEV::periodic_start(lua_State *L)
     int64_t after  = luaL_checkinteger(L, 2);
     int64_t repeat = luaL_checkinteger(L, 3);
     int32_t policy = luaL_checkinteger32(L, 4);
+    bool wheel = lua_isnoneornil(L, 5) ? _timer_wheel : lua_toboolean(L, 5);
 
-    int32_t e = EV::periodic_start(id, after, repeat, policy);
+    int32_t e = EV::periodic_start(id, after, repeat, policy, wheel);
     lua_pushinteger(L, e);
 
     return 1;
@@ -211,13 +263,58 @@ int32_t LEV::timer_start(lua_State *L)
     int64_t after  = luaL_checkinteger(L, 2);
     int64_t repeat = luaL_checkinteger(L, 3);
     int32_t policy = luaL_checkinteger32(L, 4);
+    bool wheel = lua_isnoneornil(L, 5) ? _timer_wheel : lua_toboolean(L, 5);
 
-    int32_t e = EV::timer_start(id, after, repeat, policy);
+    int32_t e = EV::timer_start(id, after, repeat, policy, wheel);
     lua_pushinteger(L, e);
 
     return 1;
 }
 
+int32_t LEV::set_timer_wheel(lua_State *L)
+{
+    _timer_wheel = lua_toboolean(L, 1);
+
+    return 0;
+}
+
+int32_t LEV::set_timer_batch(lua_State *L)
+{
+    if (!lua_toboolean(L, 1))
+    {
+        _timer_batch = false;
+        LUA_UNREF(_batch_ids);
+        LUA_UNREF(_batch_handler);
+        LUA_UNREF(_batch_traceback);
+        return 0;
+    }
+
+    LUA_PUSHTRACEBACK(L);
+    if (!lua_isfunction(L, -1))
+    {
+        return luaL_error(L, "traceback function not found");
+    }
+    LUA_REF(_batch_traceback);
+
+    lua_getglobal(L, "timer_event_batch");
+    if (!lua_isfunction(L, -1))
+    {
+        return luaL_error(L, "timer_event_batch function not found");
+    }
+    LUA_REF(_batch_handler);
+
+    // id数组重复使用，只在第一次开启时创建
+    if (!_batch_ids)
+    {
+        lua_createtable(L, 1024, 0);
+        LUA_REF(_batch_ids);
+    }
+
+    _timer_batch = true;
+
+    return 0;
+}
+
 int32_t LEV::timer_stop(lua_State *L)
 {
     int32_t id = luaL_checkinteger32(L, 1);
@@ -246,3 +343,32 @@ void LEV::timer_callback(int32_t id, int32_t revents)
     }
     lua_pop(L, 1); /* remove traceback */
 }
+
+void LEV::timer_batch_callback()
+{
+    static lua_State *L = StaticGlobal::state();
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, _batch_traceback);
+    int32_t top = lua_gettop(L);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, _batch_handler);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, _batch_ids);
+
+    // 回调前全部转为id，回调中脚本可能会删除定时器，不能再访问_timer_fired
+    // 数组不清空，脚本只使用前n个
+    lua_Integer n = 0;
+    for (auto w : _timer_fired)
+    {
+        w->_revents = 0;
+        lua_pushinteger(L, w->_id);
+        lua_rawseti(L, -2, ++n);
+    }
+    _timer_fired.clear();
+
+    lua_pushinteger(L, n);
+    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 2, 0, top)))
+    {
+        ELOG("timer batch call back fail:%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1); /* remove error message */
+    }
+    lua_pop(L, 1); /* remove traceback */
+}
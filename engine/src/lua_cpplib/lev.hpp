@@ -30,6 +30,7 @@ public:
      * @param after N秒后第一次执行
      * @param repeat 重复执行间隔，秒数
      * @param policy 定时器重新规则时的策略
+     * @param wheel 是否使用时间轮，不传则使用set_timer_wheel设置的默认值
      */
     int32_t periodic_start(lua_State *L);
     /**
@@ -44,6 +45,7 @@ public:
      * @param after N毫秒后第一次执行
      * @param repeat 重复执行间隔，毫秒数
      * @param policy 定时器重新规则时的策略
+     * @param wheel 是否使用时间轮，不传则使用set_timer_wheel设置的默认值
      */
     int32_t timer_start(lua_State *L);
     /**
@@ -52,6 +54,22 @@ public:
      */
     int32_t timer_stop(lua_State *L);
 
+    /**
+     * 设置定时器默认是否使用时间轮
+     * 时间轮插入、删除都是O(1)，适合定时器数量很多的进程(如场景进程)
+     * @param wheel 是否使用时间轮
+     */
+    int32_t set_timer_wheel(lua_State *L);
+
+    /**
+     * 设置定时器是否批量回调
+     * 开启后，一帧内所有超时的定时器id放到同一个数组，只调用一次脚本全局函数
+     * timer_event_batch(ids, n)，而不是每个定时器调用一次timer_event
+     * 回调函数及traceback函数在开启时缓存，脚本热更这些函数后需要重新设置
+     * @param batch 是否批量回调
+     */
+    int32_t set_timer_batch(lua_State *L);
+
     /**
      * 获取帧时间戳，秒
      * 如果服务器卡了，这时间和实时时间是不一样的
@@ -106,12 +124,28 @@ public:
      */
     int32_t signal(lua_State *L);
 
+    /**
+     * 设置io线程(backend)数量、io分配策略及实现类型，必须在backend之前调用
+     * @param num io线程数量
+     * @param policy 分配策略，BP_LEAST分配到io最少的线程，BP_HASH按fd取模
+     * @param type 实现类型，BT_DEFAULT、BT_EPOLL、BT_IO_URING，平台或内核不支持时失败
+     * @return 成功返回0
+     */
+    int32_t set_backend(lua_State *L);
+
     /**
      * 设置app回调时间，不断回调到脚本全局application_ev函数
      * @param interval 回调间隔，毫秒
      */
     int32_t set_app_ev(lua_State *L);
 
+    /**
+     * 获取主循环各阶段的耗时统计
+     * @param reset 获取后是否清空统计数据
+     * @return 以阶段名为key的table，包含count、avg、p50、p99、max、events等
+     */
+    int32_t loop_stats(lua_State *L);
+
 private:
     void running() override;
 
@@ -119,9 +153,15 @@ private:
     void invoke_app_ev();
 
     virtual void timer_callback(int32_t id, int32_t revents);
+    virtual void timer_batch_callback();
 
 private:
     int32_t _critical_tm; // 每次主循环的临界时间，毫秒
+    bool _timer_wheel; // 定时器默认是否使用时间轮
+
+    int32_t _batch_ids;       // 批量回调定时器id数组的引用
+    int32_t _batch_handler;   // 批量回调函数timer_event_batch的引用
+    int32_t _batch_traceback; // 批量回调时traceback函数的引用
 
     int32_t _app_repeat; // 脚本主循环回调隔间，毫秒
     int64_t _app_next_tm; // 下次回调脚本主循环的时间，毫秒
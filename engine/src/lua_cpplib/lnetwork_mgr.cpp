@@ -2,11 +2,14 @@
 
 #include "../system/static_global.hpp"
 #include "ltools.hpp"
+#include "lstatistic.hpp"
 #include "../net/net_compat.hpp"
 
+#include "../net/codec/protobuf_codec.hpp"
 #include "../net/packet/http_packet.hpp"
 #include "../net/packet/stream_packet.hpp"
 #include "../net/packet/websocket_packet.hpp"
+#include "../net/packet/ws_deflate.hpp"
 
 LNetworkMgr::~LNetworkMgr()
 {
@@ -15,6 +18,20 @@ LNetworkMgr::~LNetworkMgr()
 
 LNetworkMgr::LNetworkMgr() : _conn_seed(0)
 {
+    memset(_idle_timeout, 0, sizeof(_idle_timeout));
+
+    _buffer_idle = 30000;
+    _next_shrink = 0;
+
+    _buffer_limit = 0;
+    _buffer_high  = 90;
+    _buffer_low   = 70;
+    _next_budget  = 0;
+
+    _flood_action = FloodCtrl::FA_DROP;
+    _flood_limit  = {0, 0};
+
+    _encoded_base = 1; // 句柄从1开始，0不是有效的句柄
 }
 
 void LNetworkMgr::clear() /* 清除所有网络数据，不通知上层脚本 */
@@ -31,12 +48,88 @@ void LNetworkMgr::clear() /* 清除所有网络数据，不通知上层脚本 */
     _socket_map.clear();
     _session_map.clear();
     _conn_session_map.clear();
+
+    _channel.clear();
+    _owner_channel.clear();
+    _batch_conn.clear();
+    invoke_encoded();
+}
+
+size_t LNetworkMgr::invoke_batch()
+{
+    if (_batch_conn.empty()) return 0;
+
+    for (int32_t conn_id : _batch_conn)
+    {
+        class Socket *sk = get_conn_by_conn_id(conn_id);
+        if (!sk || sk->is_closed()) continue;
+
+        class Packet *packet = sk->get_packet();
+        if (packet) packet->flush_batch();
+    }
+
+    size_t count = _batch_conn.size();
+    _batch_conn.clear();
+
+    return count;
+}
+
+size_t LNetworkMgr::invoke_encoded()
+{
+    if (_encoded.empty()) return 0;
+
+    // 已经发出的数据各自引用了共享数据，这里只释放句柄的引用
+    for (EncodedPacket &encoded : _encoded) encoded._shared->release();
+
+    size_t count = _encoded.size();
+    _encoded_base += static_cast<int64_t>(count);
+    _encoded.clear();
+
+    return count;
+}
+
+const LNetworkMgr::EncodedPacket *LNetworkMgr::check_encoded(
+    lua_State *L, int32_t index, int32_t codec_ty, int32_t cmd) const
+{
+    if (!lua_isinteger(L, index)) return nullptr;
+
+    int64_t handle = lua_tointeger(L, index);
+    int64_t offset = handle - _encoded_base;
+    if (offset < 0 || offset >= static_cast<int64_t>(_encoded.size()))
+    {
+        luaL_error(L, "encoded packet expired: %d", (int32_t)handle);
+        return nullptr;
+    }
+
+    const EncodedPacket &encoded = _encoded[offset];
+    if (encoded._codec != codec_ty || encoded._cmd != cmd)
+    {
+        luaL_error(L, "encoded packet mismatch, expect codec %d cmd %d,got %d %d",
+                   codec_ty, cmd, encoded._codec, encoded._cmd);
+        return nullptr;
+    }
+
+    return &encoded;
+}
+
+int32_t LNetworkMgr::send_encoded(class Packet *pkt, uint16_t ecode,
+                                  const EncodedPacket *encoded)
+{
+    Buffer::Shared *shared = encoded->_shared;
+
+    // 数据较小时每个连接直接拷贝更快，较大时所有连接引用同一份数据
+    if (shared->size() < Buffer::SHARED_MIN)
+    {
+        return pkt->raw_pack_clt(encoded->_cmd, ecode, shared->get_ctx(),
+                                 shared->size());
+    }
+    return pkt->raw_pack_clt_shared(encoded->_cmd, ecode, shared);
 }
 
 /* 删除无效的连接 */
-void LNetworkMgr::invoke_delete()
+size_t LNetworkMgr::invoke_delete()
 {
-    if (_deleting.empty()) return;
+    if (_deleting.empty()) return 0;
 
     static lua_State *L = StaticGlobal::state();
     LUA_PUSHTRACEBACK(L);
@@ -70,7 +163,10 @@ void LNetworkMgr::invoke_delete()
 
     lua_pop(L, 1); /* remove traceback */
 
+    size_t count = _deleting.size();
     _deleting.clear();
+
+    return count;
 }
 
 /* 产生一个唯一的连接id
@@ -99,10 +195,12 @@ int32_t LNetworkMgr::set_cs_cmd(lua_State *L)
     int32_t mask       = luaL_optinteger32(L, 4, 0);
     int32_t session    = luaL_optinteger32(L, 5, _session);
 
-    CmdCfg &cfg  = _cs_cmd_map[cmd];
-    cfg._cmd     = cmd;
-    cfg._mask    = mask;
-    cfg._session = session;
+    CmdCfg &cfg   = _cs_cmd_map[cmd];
+    cfg._cmd      = cmd;
+    cfg._mask     = mask;
+    cfg._session  = session;
+    cfg._plan     = nullptr;
+    cfg._plan_ver = 0;
 
     snprintf(cfg._schema, MAX_SCHEMA_NAME, "%s", schema);
     snprintf(cfg._object, MAX_SCHEMA_NAME, "%s", object);
@@ -121,10 +219,12 @@ int32_t LNetworkMgr::set_ss_cmd(lua_State *L)
     int32_t mask       = luaL_optinteger32(L, 4, 0);
     int32_t session    = luaL_optinteger32(L, 5, _session);
 
-    CmdCfg &cfg  = _ss_cmd_map[cmd];
-    cfg._cmd     = cmd;
-    cfg._mask    = mask;
-    cfg._session = session;
+    CmdCfg &cfg   = _ss_cmd_map[cmd];
+    cfg._cmd      = cmd;
+    cfg._mask     = mask;
+    cfg._session  = session;
+    cfg._plan     = nullptr;
+    cfg._plan_ver = 0;
 
     snprintf(cfg._schema, MAX_SCHEMA_NAME, "%s", schema);
     snprintf(cfg._object, MAX_SCHEMA_NAME, "%s", object);
@@ -143,10 +243,12 @@ int32_t LNetworkMgr::set_sc_cmd(lua_State *L)
     int32_t mask       = luaL_optinteger32(L, 4, 0);
     int32_t session    = luaL_optinteger32(L, 5, _session);
 
-    CmdCfg &cfg  = _sc_cmd_map[cmd];
-    cfg._cmd     = cmd;
-    cfg._mask    = mask;
-    cfg._session = session;
+    CmdCfg &cfg   = _sc_cmd_map[cmd];
+    cfg._cmd      = cmd;
+    cfg._mask     = mask;
+    cfg._session  = session;
+    cfg._plan     = nullptr;
+    cfg._plan_ver = 0;
 
     snprintf(cfg._schema, MAX_SCHEMA_NAME, "%s", schema);
     snprintf(cfg._object, MAX_SCHEMA_NAME, "%s", object);
@@ -178,6 +280,300 @@ int32_t LNetworkMgr::close(lua_State *L)
     return 0;
 }
 
+/**
+ * 设置某种连接的空闲超时时间
+ * @param conn_ty 连接类型
+ * @param timeout 超时时间，毫秒，0表示不检测
+ */
+int32_t LNetworkMgr::set_idle_timeout(lua_State *L)
+{
+    int32_t conn_ty = luaL_checkinteger32(L, 1);
+    int32_t timeout = luaL_checkinteger32(L, 2);
+
+    if (conn_ty <= Socket::CT_NONE || conn_ty >= Socket::CT_MAX)
+    {
+        return luaL_error(L, "illegal connection type");
+    }
+
+    _idle_timeout[conn_ty] = timeout > 0 ? timeout : 0;
+
+    return 0;
+}
+
+int32_t LNetworkMgr::set_flood_limit(lua_State *L)
+{
+    int32_t rate   = luaL_checkinteger32(L, 1);
+    int32_t burst  = luaL_optinteger32(L, 2, rate);
+    int32_t action = luaL_optinteger32(L, 3, FloodCtrl::FA_DROP);
+
+    if (action <= FloodCtrl::FA_NONE || action >= FloodCtrl::FA_MAX)
+    {
+        return luaL_error(L, "illegal flood action");
+    }
+
+    _flood_action = action;
+    _flood_limit  = {rate > 0 ? rate : 0, burst > 1 ? burst : 1};
+
+    return 0;
+}
+
+int32_t LNetworkMgr::set_cmd_flood_limit(lua_State *L)
+{
+    int32_t cmd   = luaL_checkinteger32(L, 1);
+    int32_t rate  = luaL_checkinteger32(L, 2);
+    int32_t burst = luaL_optinteger32(L, 3, rate);
+
+    if (cmd <= 0 || cmd > UINT16_MAX)
+    {
+        return luaL_error(L, "illegal cmd");
+    }
+
+    if (rate <= 0)
+    {
+        _flood_cmd.erase(static_cast<uint16_t>(cmd));
+    }
+    else
+    {
+        _flood_cmd[static_cast<uint16_t>(cmd)] = {rate, burst > 1 ? burst : 1};
+    }
+
+    return 0;
+}
+
+bool LNetworkMgr::flood_check(class Socket *sk, uint16_t cmd)
+{
+    // 未设置任何限制，不需要查找
+    if (0 == _flood_limit._rate && _flood_cmd.empty()) return true;
+
+    FloodCtrl &flood = sk->get_flood();
+    if (EXPECT_FALSE(flood.is_kicked())) return false;
+
+    const FloodCtrl::Limit *cmd_limit = nullptr;
+    if (!_flood_cmd.empty())
+    {
+        auto iter = _flood_cmd.find(cmd);
+        if (iter != _flood_cmd.end()) cmd_limit = &(iter->second);
+    }
+
+    // 使用主循环缓存的时间，不需要每个包都取一次系统时间
+    int64_t now = StaticGlobal::ev()->ms_now();
+    if (EXPECT_TRUE(flood.check(now, cmd, _flood_limit, cmd_limit)))
+    {
+        return true;
+    }
+
+    bool kick = FloodCtrl::FA_KICK == _flood_action;
+    G_STAT->add_flood(cmd, kick);
+    if (kick)
+    {
+        // 断开后缓冲区中剩余的包也全部丢弃，脚本通过conn_del收到断开
+        ELOG("client flood, kick connection,object:" FMT64d ",conn:%d,cmd:%d",
+             sk->get_object_id(), sk->conn_id(), cmd);
+        flood.set_kicked();
+        sk->stop();
+    }
+
+    return false;
+}
+
+int32_t LNetworkMgr::set_buffer_idle(lua_State *L)
+{
+    int64_t msec = luaL_checkinteger(L, 1);
+
+    _buffer_idle = msec > 0 ? msec : 0;
+    _next_shrink = 0;
+
+    return 0;
+}
+
+size_t LNetworkMgr::shrink_buffer(int64_t now)
+{
+    if (0 == _buffer_idle || now < _next_shrink) return 0;
+
+    // Buffer::shrink要两次调用之间都没使用过才会回收，因此实际回收时间
+    // 在1~2倍的空闲时间之间
+    _next_shrink = now + _buffer_idle;
+
+    size_t count = 0;
+    for (auto &iter : _socket_map)
+    {
+        class Socket *sk = iter.second;
+        if (sk) count += sk->shrink_buffer();
+    }
+
+    return count;
+}
+
+int32_t LNetworkMgr::set_buffer_budget(lua_State *L)
+{
+    int64_t limit = luaL_checkinteger(L, 1);
+    int32_t high  = luaL_optinteger32(L, 2, 90);
+    int32_t low   = luaL_optinteger32(L, 3, 70);
+
+    if (high <= 0 || high > 100 || low < 0 || low > high)
+    {
+        return luaL_error(L, "illegal buffer watermark");
+    }
+
+    _buffer_limit = limit > 0 ? (size_t)limit : 0;
+    _buffer_high  = high;
+    _buffer_low   = low;
+    _next_budget  = 0;
+
+    return 0;
+}
+
+int32_t LNetworkMgr::buffer_stat(lua_State *L)
+{
+    int32_t top = luaL_optinteger32(L, 1, 16);
+
+    LStatistic::dump_buffer(L, top > 0 ? (size_t)top : 0);
+
+    return 1;
+}
+
+void LNetworkMgr::get_buffer_usage(std::vector<BufferUsage> &usage) const
+{
+    usage.clear();
+    usage.reserve(_socket_map.size());
+
+    size_t schunk   = 0;
+    size_t rchunk   = 0;
+    size_t spending = 0;
+    size_t rpending = 0;
+    for (const auto &iter : _socket_map)
+    {
+        class Socket *sk = iter.second;
+        if (!sk) continue;
+
+        BufferUsage bu;
+        bu._conn_id   = iter.first;
+        bu._object_id = sk->get_object_id();
+        bu._send      = 0;
+        bu._recv      = 0;
+        sk->get_stat(schunk, rchunk, bu._send, bu._recv, spending, rpending);
+        bu._recv_pending = rpending;
+        bu._pausable     = Socket::CT_SSCN != sk->conn_type();
+
+        if (bu._send || bu._recv) usage.push_back(bu);
+    }
+}
+
+void LNetworkMgr::check_buffer_budget(int64_t now)
+{
+    // 每次最多处理的连接数量，以及检查的间隔，毫秒
+    static const size_t BUDGET_TOP     = 16;
+    static const int64_t BUDGET_INTERVAL = 100;
+
+    if (0 == _buffer_limit || now < _next_budget) return;
+    _next_budget = now + BUDGET_INTERVAL;
+
+    size_t used = StaticGlobal::buffer_ctx_pool()->get_used();
+    if (used < _buffer_limit / 100 * (size_t)_buffer_high)
+    {
+        if (_read_paused.empty()) return;
+
+        // 低于低水位，恢复所有暂停读取的连接
+        if (used < _buffer_limit / 100 * (size_t)_buffer_low)
+        {
+            PLOG("buffer budget resume read, used = %zu, conn = %zu", used,
+                 _read_paused.size());
+            resume_read(now, true);
+            return;
+        }
+    }
+
+    // 暂停太久的连接先恢复，仍超过高水位时下面会按待处理数据重新选择
+    if (!_read_paused.empty()) resume_read(now, false);
+    if (used < _buffer_limit / 100 * (size_t)_buffer_high) return;
+
+    // 超过高水位，暂停读取接收缓冲区待处理数据最多的连接。分配的内存包括了空闲的
+    // chunk，不能反映连接收了多少数据未处理
+    // 只在内存紧张时才遍历所有连接，正常情况下只是一次原子变量读取
+    static std::vector<BufferUsage> usage;
+    get_buffer_usage(usage);
+
+    size_t top = std::min(BUDGET_TOP, usage.size());
+    std::partial_sort(usage.begin(), usage.begin() + top, usage.end(),
+                      [](const BufferUsage &a, const BufferUsage &b)
+                      {
+                          size_t pa = a._pausable ? a._recv_pending : 0;
+                          size_t pb = b._pausable ? b._recv_pending : 0;
+                          return pa > pb;
+                      });
+    for (size_t i = 0; i < top; i++)
+    {
+        const BufferUsage &bu = usage[i];
+        if (!bu._pausable || 0 == bu._recv_pending) break;
+
+        class Socket *sk = get_conn_by_conn_id(bu._conn_id);
+        if (sk && sk->pause_read(true))
+        {
+            _read_paused.push_back({bu._conn_id, now});
+        }
+    }
+
+    if (used < _buffer_limit) return;
+
+    // 超过上限，断开发送缓冲区占用最多的客户端连接，这些客户端接收太慢
+    // 服务器之间的连接不能断开，只能等待
+    std::partial_sort(usage.begin(), usage.begin() + top, usage.end(),
+                      [](const BufferUsage &a, const BufferUsage &b)
+                      { return a._send > b._send; });
+    for (size_t i = 0; i < top && usage[i]._send > 0; i++)
+    {
+        class Socket *sk = get_conn_by_conn_id(usage[i]._conn_id);
+        if (!sk || sk->is_closed() || !sk->is_overflow_kill()) continue;
+
+        ELOG("buffer budget overflow, kill connection, object:" FMT64d
+             ",conn:%d,send buffer:%zu,used:%zu",
+             usage[i]._object_id, usage[i]._conn_id, usage[i]._send, used);
+        sk->stop();
+    }
+}
+
+void LNetworkMgr::resume_read(int64_t now, bool all)
+{
+    // 单个连接最长的暂停时间，毫秒
+    static const int64_t BUDGET_PAUSE_MAX = 3000;
+
+    size_t n = 0;
+    for (const auto &paused : _read_paused)
+    {
+        if (!all && now - paused._time < BUDGET_PAUSE_MAX)
+        {
+            _read_paused[n++] = paused;
+            continue;
+        }
+
+        class Socket *sk = get_conn_by_conn_id(paused._conn_id);
+        if (sk) sk->pause_read(false);
+    }
+    _read_paused.resize(n);
+}
+
+/**
+ * 立即唤醒io线程发送缓冲区中的数据
+ * @param conn_id 网关连接id
+ */
+int32_t LNetworkMgr::flush(lua_State *L)
+{
+    int32_t conn_id = luaL_checkinteger32(L, 1);
+
+    socket_map_t::iterator itr = _socket_map.find(conn_id);
+    if (itr == _socket_map.end())
+    {
+        return luaL_error(L, "no such socket found");
+    }
+
+    class Socket *_socket = itr->second;
+
+    // 已关闭的socket由stop决定是否发送剩余数据
+    if (!_socket->is_closed()) _socket->flush_now();
+
+    return 0;
+}
+
 /**
  * 获取某个连接的ip地址
  * @param conn_id 网关连接id
@@ -613,6 +1009,10 @@ int32_t LNetworkMgr::send_raw_packet(lua_State *L)
     const char *ctx = luaL_checklstring(L, 2, &size);
     if (!ctx) return 0;
 
+    // 先发出合并的数据包以保证顺序
+    class Packet *packet = sk->get_packet();
+    if (packet) packet->flush_batch();
+
     sk->send(ctx, size);
 
     return 0;
@@ -795,6 +1195,85 @@ int32_t LNetworkMgr::set_conn_codec(lua_State *L) /* 设置socket的编译方式
     return 0;
 }
 
+int32_t LNetworkMgr::set_conn_compress(lua_State *L)
+{
+    int32_t conn_id   = luaL_checkinteger32(L, 1);
+    int32_t threshold = luaL_checkinteger32(L, 2);
+
+    class Socket *sk = get_conn_by_conn_id(conn_id);
+    if (!sk)
+    {
+        return luaL_error(L, "invalid conn id");
+    }
+
+    if (threshold < 0)
+    {
+        return luaL_error(L, "invalid compress threshold");
+    }
+
+    sk->set_compress(threshold);
+
+    return 0;
+}
+
+int32_t LNetworkMgr::set_conn_batch(lua_State *L)
+{
+    int32_t conn_id = luaL_checkinteger32(L, 1);
+    bool on         = lua_toboolean(L, 2);
+
+    class Socket *sk = get_conn_by_conn_id(conn_id);
+    if (!sk)
+    {
+        return luaL_error(L, "invalid conn id");
+    }
+
+    class Packet *packet = sk->get_packet();
+    if (!packet)
+    {
+        return luaL_error(L, "no packet set");
+    }
+
+    if (packet->set_batch(on) < 0)
+    {
+        return luaL_error(L, "packet type %d not support batch",
+                          packet->type());
+    }
+
+    return 0;
+}
+
+int32_t LNetworkMgr::set_conn_deflate(lua_State *L)
+{
+    int32_t conn_id     = luaL_checkinteger32(L, 1);
+    int32_t window_bits = luaL_checkinteger32(L, 2);
+    int32_t mem_limit   = luaL_optinteger32(L, 3, 0);
+
+    class Socket *sk = get_conn_by_conn_id(conn_id);
+    if (!sk)
+    {
+        return luaL_error(L, "invalid conn id");
+    }
+
+    if (window_bits < WSDeflate::MIN_WINDOW_BITS
+        || window_bits > WSDeflate::MAX_WINDOW_BITS)
+    {
+        return luaL_error(L, "invalid window bits");
+    }
+
+    class Packet *pkt = sk->get_packet();
+    if (!pkt
+        || (Packet::PT_WSSTREAM != pkt->type()
+            && Packet::PT_WEBSOCKET != pkt->type()))
+    {
+        return luaL_error(L, "illegal packet type");
+    }
+
+    static_cast<class WebsocketPacket *>(pkt)->set_deflate(window_bits,
+                                                           mem_limit);
+
+    return 0;
+}
+
 int32_t LNetworkMgr::set_conn_packet(lua_State *L) /* 设置socket的打包方式 */
 {
     int32_t conn_id     = luaL_checkinteger32(L, 1);
@@ -967,7 +1446,7 @@ int32_t LNetworkMgr::srv_multicast(lua_State *L)
 
     Codec *encoder = StaticGlobal::codec_mgr()->get_codec(
         static_cast<Codec::CodecType>(codec_ty));
-    if (!cfg)
+    if (!encoder)
     {
         return luaL_error(L, "no codec conf found: %d", (int32_t)cmd);
     }
@@ -981,10 +1460,10 @@ int32_t LNetworkMgr::srv_multicast(lua_State *L)
         return 0;
     }
 
-    if (len > MAX_PACKET_LEN)
+    if (len > MAX_EXT_PACKET_LEN)
     {
         encoder->finalize();
-        return luaL_error(L, "buffer size over MAX_PACKET_LEN");
+        return luaL_error(L, "buffer size over MAX_EXT_PACKET_LEN");
     }
 
     lua_pushnil(L); /* first key */
@@ -1040,7 +1519,8 @@ int32_t LNetworkMgr::clt_multicast(lua_State *L)
         return luaL_error(L, "illegal codec type");
     }
 
-    if (!lua_istable(L, 5))
+    const EncodedPacket *encoded = check_encoded(L, 5, codec_ty, cmd);
+    if (!encoded && !lua_istable(L, 5))
     {
         return luaL_error(L, "expect table,got %s",
                           lua_typename(L, lua_type(L, 5)));
@@ -1054,24 +1534,43 @@ int32_t LNetworkMgr::clt_multicast(lua_State *L)
 
     Codec *encoder = StaticGlobal::codec_mgr()->get_codec(
         static_cast<Codec::CodecType>(codec_ty));
-    if (!cfg)
+    if (!encoder)
     {
         return luaL_error(L, "no codec conf found: %d", (int32_t)cmd);
     }
 
-    const char *buffer = nullptr;
-    int32_t len        = encoder->encode(L, 5, &buffer, cfg);
-    if (len < 0)
+    const char *buffer     = nullptr;
+    int32_t len            = 0;
+    Buffer::Shared *shared = nullptr;
+    if (encoded)
     {
-        encoder->finalize();
-        ELOG("clt_multicast encode error");
-        return 0;
+        // 已经编码好的数据，直接引用
+        buffer = encoded->_shared->get_ctx();
+        len    = static_cast<int32_t>(encoded->_shared->size());
+        if (static_cast<size_t>(len) >= Buffer::SHARED_MIN)
+        {
+            shared = encoded->_shared;
+            shared->grab();
+        }
     }
-
-    if (len > MAX_PACKET_LEN)
+    else
     {
-        encoder->finalize();
-        return luaL_error(L, "buffer size over MAX_PACKET_LEN");
+        len = encoder->encode(L, 5, &buffer, cfg);
+        if (len < 0)
+        {
+            encoder->finalize();
+            ELOG("clt_multicast encode error");
+            return 0;
+        }
+
+        if (len > MAX_PACKET_LEN)
+        {
+            encoder->finalize();
+            return luaL_error(L, "buffer size over MAX_PACKET_LEN");
+        }
+
+        // 数据较大时只拷贝一次，所有连接引用同一份数据
+        shared = StreamPacket::new_multicast_shared(buffer, len);
     }
 
     lua_pushnil(L); /* first key */
@@ -1080,7 +1579,8 @@ int32_t LNetworkMgr::clt_multicast(lua_State *L)
         if (!lua_isinteger(L, -1))
         {
             lua_pop(L, 1);
-            encoder->finalize();
+            if (shared) shared->release();
+            if (!encoded) encoder->finalize();
             return luaL_error(L, "conn list expect integer");
         }
 
@@ -1094,14 +1594,17 @@ int32_t LNetworkMgr::clt_multicast(lua_State *L)
             continue;
         }
 
-        if (pkt->raw_pack_clt(cmd, ecode, buffer, len) < 0)
+        int32_t e = shared ? pkt->raw_pack_clt_shared(cmd, ecode, shared)
+                           : pkt->raw_pack_clt(cmd, ecode, buffer, len);
+        if (e < 0)
         {
             ELOG("clt_multicast can not raw_pack_ss:%ud", conn_id);
             continue;
         }
     }
 
-    encoder->finalize();
+    if (shared) shared->release();
+    if (!encoded) encoder->finalize();
 
     PKT_STAT_ADD(SPT_SCPK, cmd, int32_t(len + sizeof(struct s2c_header)),
                  STAT_TIME_END());
@@ -1127,6 +1630,365 @@ int32_t LNetworkMgr::ssc_multicast(lua_State *L)
     return 0;
 }
 
+int32_t LNetworkMgr::channel_join(lua_State *L)
+{
+    int32_t channel_id = luaL_checkinteger32(L, 1);
+    Owner owner        = static_cast<Owner>(luaL_checkinteger(L, 2));
+
+    Channel &channel = _channel[channel_id];
+    if (channel._index.find(owner) != channel._index.end()) return 0;
+
+    channel._index[owner] = channel._members.size();
+    channel._members.push_back(owner);
+
+    _owner_channel[owner].push_back(channel_id);
+
+    return 0;
+}
+
+bool LNetworkMgr::do_channel_leave(int32_t channel_id, Owner owner)
+{
+    auto itr = _channel.find(channel_id);
+    if (itr == _channel.end()) return false;
+
+    Channel &channel = itr->second;
+    auto idx_itr     = channel._index.find(owner);
+    if (idx_itr == channel._index.end()) return false;
+
+    // 用最后一个成员填补空位，广播的顺序不重要
+    size_t idx  = idx_itr->second;
+    Owner back  = channel._members.back();
+    channel._members[idx] = back;
+    channel._index[back]  = idx;
+
+    channel._members.pop_back();
+    channel._index.erase(owner);
+
+    if (channel._members.empty()) _channel.erase(itr);
+
+    return true;
+}
+
+int32_t LNetworkMgr::channel_leave(lua_State *L)
+{
+    int32_t channel_id = luaL_checkinteger32(L, 1);
+    Owner owner        = static_cast<Owner>(luaL_checkinteger(L, 2));
+
+    if (!do_channel_leave(channel_id, owner)) return 0;
+
+    auto itr = _owner_channel.find(owner);
+    if (itr != _owner_channel.end())
+    {
+        std::vector<int32_t> &channels = itr->second;
+        channels.erase(std::remove(channels.begin(), channels.end(), channel_id),
+                       channels.end());
+        if (channels.empty()) _owner_channel.erase(itr);
+    }
+
+    return 0;
+}
+
+int32_t LNetworkMgr::channel_quit(lua_State *L)
+{
+    Owner owner = static_cast<Owner>(luaL_checkinteger(L, 1));
+
+    auto itr = _owner_channel.find(owner);
+    if (itr == _owner_channel.end()) return 0;
+
+    for (int32_t channel_id : itr->second) do_channel_leave(channel_id, owner);
+    _owner_channel.erase(itr);
+
+    return 0;
+}
+
+int32_t LNetworkMgr::channel_del(lua_State *L)
+{
+    int32_t channel_id = luaL_checkinteger32(L, 1);
+
+    auto itr = _channel.find(channel_id);
+    if (itr == _channel.end()) return 0;
+
+    for (Owner owner : itr->second._members)
+    {
+        auto owner_itr = _owner_channel.find(owner);
+        if (owner_itr == _owner_channel.end()) continue;
+
+        std::vector<int32_t> &channels = owner_itr->second;
+        channels.erase(std::remove(channels.begin(), channels.end(), channel_id),
+                       channels.end());
+        if (channels.empty()) _owner_channel.erase(owner_itr);
+    }
+    _channel.erase(itr);
+
+    return 0;
+}
+
+int32_t LNetworkMgr::channel_size(lua_State *L)
+{
+    int32_t channel_id = luaL_checkinteger32(L, 1);
+
+    auto itr = _channel.find(channel_id);
+    lua_pushinteger(L, itr == _channel.end() ? 0 : itr->second._members.size());
+
+    return 1;
+}
+
+int32_t LNetworkMgr::channel_cast(int32_t channel_id, uint16_t cmd,
+                                  uint16_t ecode, const char *ctx, size_t size,
+                                  Buffer::Shared *shared) const
+{
+    auto itr = _channel.find(channel_id);
+    if (itr == _channel.end()) return 0;
+
+    int32_t count = 0;
+    // 数据较大时只拷贝一次，所有连接引用同一份数据
+    if (shared)
+    {
+        shared->grab();
+    }
+    else
+    {
+        shared = StreamPacket::new_multicast_shared(ctx, size);
+    }
+    for (Owner owner : itr->second._members)
+    {
+        // 频道成员由脚本维护，玩家可能正在断线重连，不在线的直接跳过
+        class Socket *sk = get_conn_by_owner(owner);
+        if (!sk || sk->is_closed()) continue;
+
+        class Packet *pkt = sk->get_packet();
+        if (!pkt) continue;
+
+        int32_t e = shared ? pkt->raw_pack_clt_shared(cmd, ecode, shared)
+                           : pkt->raw_pack_clt(cmd, ecode, ctx, size);
+        if (e >= 0) count++;
+    }
+    if (shared) shared->release();
+
+    return count;
+}
+
+int32_t LNetworkMgr::clt_channel_cast(lua_State *L)
+{
+    STAT_TIME_BEG();
+
+    int32_t channel_id = luaL_checkinteger32(L, 1);
+    int32_t codec_ty   = luaL_checkinteger32(L, 2);
+    uint16_t cmd       = static_cast<uint16_t>(luaL_checkinteger(L, 3));
+    uint16_t ecode     = static_cast<uint16_t>(luaL_checkinteger(L, 4));
+    if (codec_ty < Codec::CT_NONE || codec_ty >= Codec::CT_MAX)
+    {
+        return luaL_error(L, "illegal codec type");
+    }
+
+    const EncodedPacket *encoded = check_encoded(L, 5, codec_ty, cmd);
+    if (!encoded) lUAL_CHECKTABLE(L, 5);
+
+    const CmdCfg *cfg = get_sc_cmd(cmd);
+    if (!cfg)
+    {
+        return luaL_error(L, "no command conf found: %d", (int32_t)cmd);
+    }
+
+    // 频道不存在或者没有成员，不需要编码
+    if (_channel.find(channel_id) == _channel.end())
+    {
+        lua_pushinteger(L, 0);
+        return 1;
+    }
+
+    if (encoded)
+    {
+        Buffer::Shared *shared = encoded->_shared;
+        size_t size            = shared->size();
+
+        int32_t count = channel_cast(
+            channel_id, cmd, ecode, shared->get_ctx(), size,
+            size < Buffer::SHARED_MIN ? nullptr : shared);
+
+        PKT_STAT_ADD(SPT_SCPK, cmd, int32_t(size + sizeof(struct s2c_header)),
+                     STAT_TIME_END());
+
+        lua_pushinteger(L, count);
+        return 1;
+    }
+
+    Codec *encoder = StaticGlobal::codec_mgr()->get_codec(
+        static_cast<Codec::CodecType>(codec_ty));
+    if (!encoder)
+    {
+        return luaL_error(L, "no codec conf found: %d", (int32_t)cmd);
+    }
+
+    const char *buffer = nullptr;
+    int32_t len        = encoder->encode(L, 5, &buffer, cfg);
+    if (len < 0)
+    {
+        encoder->finalize();
+        ELOG("clt_channel_cast encode error");
+        return 0;
+    }
+
+    if (len > MAX_PACKET_LEN)
+    {
+        encoder->finalize();
+        return luaL_error(L, "buffer size over MAX_PACKET_LEN");
+    }
+
+    int32_t count = channel_cast(channel_id, cmd, ecode, buffer, len);
+
+    encoder->finalize();
+
+    PKT_STAT_ADD(SPT_SCPK, cmd, int32_t(len + sizeof(struct s2c_header)),
+                 STAT_TIME_END());
+
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+int32_t LNetworkMgr::encode_packet(lua_State *L)
+{
+    int32_t codec_ty = luaL_checkinteger32(L, 1);
+    int32_t cmd      = luaL_checkinteger32(L, 2);
+    if (codec_ty < Codec::CT_NONE || codec_ty >= Codec::CT_MAX)
+    {
+        return luaL_error(L, "illegal codec type");
+    }
+
+    lUAL_CHECKTABLE(L, 3);
+
+    const CmdCfg *cfg = get_sc_cmd(cmd);
+    if (!cfg)
+    {
+        return luaL_error(L, "no command conf found: %d", cmd);
+    }
+
+    Codec *encoder = StaticGlobal::codec_mgr()->get_codec(
+        static_cast<Codec::CodecType>(codec_ty));
+    if (!encoder)
+    {
+        return luaL_error(L, "no codec conf found: %d", cmd);
+    }
+
+    const char *buffer = nullptr;
+    int32_t len        = encoder->encode(L, 3, &buffer, cfg);
+    if (len < 0)
+    {
+        encoder->finalize();
+        return luaL_error(L, "encode_packet encode error: %d", cmd);
+    }
+
+    if (len > MAX_PACKET_LEN)
+    {
+        encoder->finalize();
+        return luaL_error(L, "buffer size over MAX_PACKET_LEN");
+    }
+
+    EncodedPacket encoded;
+    encoded._codec  = codec_ty;
+    encoded._cmd    = cmd;
+    encoded._shared = Buffer::Shared::create(buffer, len);
+    encoder->finalize();
+
+    _encoded.push_back(encoded);
+    lua_pushinteger(L, _encoded_base + static_cast<int64_t>(_encoded.size()) - 1);
+
+    return 1;
+}
+
+int32_t LNetworkMgr::encode_raw_packet(lua_State *L)
+{
+    int32_t codec_ty = luaL_checkinteger32(L, 1);
+    int32_t cmd      = luaL_checkinteger32(L, 2);
+    if (codec_ty < Codec::CT_NONE || codec_ty >= Codec::CT_MAX)
+    {
+        return luaL_error(L, "illegal codec type");
+    }
+
+    lUAL_CHECKTABLE(L, 3);
+
+    const CmdCfg *cfg = get_sc_cmd(cmd);
+    if (!cfg)
+    {
+        return luaL_error(L, "no command conf found: %d", cmd);
+    }
+
+    Codec *encoder = StaticGlobal::codec_mgr()->get_codec(
+        static_cast<Codec::CodecType>(codec_ty));
+    if (!encoder)
+    {
+        return luaL_error(L, "no codec conf found: %d", cmd);
+    }
+
+    const char *buffer = nullptr;
+    int32_t len        = encoder->encode(L, 3, &buffer, cfg);
+    if (len < 0)
+    {
+        encoder->finalize();
+        return luaL_error(L, "encode_raw_packet encode error: %d", cmd);
+    }
+
+    lua_pushlstring(L, buffer, len);
+    encoder->finalize();
+
+    return 1;
+}
+
+int32_t LNetworkMgr::decode_raw_packet(lua_State *L)
+{
+    int32_t codec_ty = luaL_checkinteger32(L, 1);
+    int32_t cmd      = luaL_checkinteger32(L, 2);
+    if (codec_ty < Codec::CT_NONE || codec_ty >= Codec::CT_MAX)
+    {
+        return luaL_error(L, "illegal codec type");
+    }
+
+    size_t size     = 0;
+    const char *ctx = luaL_checklstring(L, 3, &size);
+
+    const CmdCfg *cfg = get_sc_cmd(cmd);
+    if (!cfg)
+    {
+        return luaL_error(L, "no command conf found: %d", cmd);
+    }
+    // 视图只在数据包回调期间有效，不能返回给脚本
+    if (cfg->_mask & CmdCfg::MK_VIEW)
+    {
+        return luaL_error(L, "decode_raw_packet view not support: %d", cmd);
+    }
+
+    Codec *decoder = StaticGlobal::codec_mgr()->get_codec(
+        static_cast<Codec::CodecType>(codec_ty));
+    if (!decoder)
+    {
+        return luaL_error(L, "no codec conf found: %d", cmd);
+    }
+
+    // 不解码为视图，因此不需要decode_done。这个函数可能在某个数据包的回调中调用，
+    // decode_done会使该数据包还在使用的视图失效
+    int32_t top = lua_gettop(L);
+    decoder->set_stable(false);
+    int32_t cnt = decoder->decode(L, ctx, size, cfg);
+    if (cnt < 0)
+    {
+        lua_settop(L, top);
+        return luaL_error(L, "decode_raw_packet decode error: %d", cmd);
+    }
+
+    return cnt;
+}
+
+int32_t LNetworkMgr::set_protobuf_plan(lua_State *L)
+{
+    bool on = lua_toboolean(L, 1);
+
+    ProtobufCodec *codec = static_cast<ProtobufCodec *>(
+        StaticGlobal::codec_mgr()->get_codec(Codec::CT_PROTOBUF));
+    codec->set_plan(on);
+
+    return 0;
+}
+
 // 设置玩家当前所在的session
 int32_t LNetworkMgr::set_player_session(lua_State *L)
 {
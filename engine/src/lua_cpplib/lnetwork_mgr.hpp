@@ -16,6 +16,33 @@ private:
     using cmd_map_t    = std::unordered_map<int32_t, CmdCfg>;
     using socket_map_t = std::unordered_map<int32_t, class Socket *>;
 
+public:
+    /// 单个连接的缓冲区内存占用
+    struct BufferUsage
+    {
+        int32_t _conn_id;     ///< 连接id
+        int64_t _object_id;   ///< 连接对应的对象id，客户端连接为玩家pid
+        size_t _send;         ///< 发送缓冲区分配的内存
+        size_t _recv;         ///< 接收缓冲区分配的内存
+        size_t _recv_pending; ///< 接收缓冲区中待处理的数据
+        bool _pausable;       ///< 是否可以暂停读取，服务器之间的连接不暂停
+    };
+
+    /// 因内存不足暂停读取的连接
+    struct PausedConn
+    {
+        int32_t _conn_id; ///< 连接id
+        int64_t _time;    ///< 暂停的时间，毫秒
+    };
+
+    /// 预先编码的发往客户端的数据包，见encode_packet
+    struct EncodedPacket
+    {
+        int32_t _codec;          ///< 编码方式
+        int32_t _cmd;            ///< 协议号
+        Buffer::Shared *_shared; ///< 编码后的数据
+    };
+
 public:
     ~LNetworkMgr();
     explicit LNetworkMgr();
@@ -65,6 +92,31 @@ public:
      */
     int32_t set_conn_codec(lua_State *L);
 
+    /**
+     * 设置socket的数据包压缩，双方都要设置(客户端需要在登录时协商)
+     * 开启后，发往客户端的错误码不能超过0x7FFF，见PKT_COMPRESS
+     * @param conn_id 连接id
+     * @param threshold 数据超过此长度才压缩，0表示不压缩
+     */
+    int32_t set_conn_compress(lua_State *L);
+
+    /**
+     * 开启或关闭合并发送，同一帧内发往客户端的数据包合并成一个容器包发送
+     * 客户端需要支持拆分容器包(见BATCH_PKT_CMD)，需要在登录时协商
+     * @param conn_id 连接id
+     * @param on 是否开启
+     */
+    int32_t set_conn_batch(lua_State *L);
+
+    /**
+     * 开启websocket连接的permessage-deflate压缩，需要在握手前设置
+     * @param conn_id 连接id
+     * @param window_bits 压缩的最大窗口(9~15)，窗口越大压缩率越高，内存也越多
+     * @param mem_limit 每个连接压缩上下文的内存上限，握手时据此协商窗口大小，
+     *        0表示不限制
+     */
+    int32_t set_conn_deflate(lua_State *L);
+
     /**
      * 设置socket的打包方式
      * @param conn_id 连接id
@@ -223,6 +275,87 @@ public:
      */
     int32_t ssc_multicast(lua_State *L); /* 非网关数据广播数据到客户端 */
 
+    /**
+     * 玩家加入广播频道(世界、帮派、场景、队伍...)，频道成员只在网关维护
+     * 非网关进程通过ssc_multicast(CLT_MC_CHANNEL)广播到频道
+     * @param channel_id 频道id，由脚本定义
+     * @param owner 玩家id
+     */
+    int32_t channel_join(lua_State *L);
+
+    /**
+     * 玩家离开广播频道
+     * @param channel_id 频道id
+     * @param owner 玩家id
+     */
+    int32_t channel_leave(lua_State *L);
+
+    /**
+     * 玩家离开所有广播频道，一般在玩家下线时调用
+     * @param owner 玩家id
+     */
+    int32_t channel_quit(lua_State *L);
+
+    /**
+     * 删除广播频道(如帮派解散)
+     * @param channel_id 频道id
+     */
+    int32_t channel_del(lua_State *L);
+
+    /**
+     * 获取广播频道的成员数量
+     * @param channel_id 频道id
+     * @return 成员数量
+     */
+    int32_t channel_size(lua_State *L);
+
+    /**
+     * 网关进程广播数据到频道内的所有客户端
+     * @param channel_id 频道id
+     * @param codec_type 编码方式(protobuf、flatbuffers)
+     * @param cmd 协议号
+     * @param errno 错误码
+     * @param pkt 数据包(lua table)
+     * @return 发送成功的客户端数量
+     */
+    int32_t clt_channel_cast(lua_State *L);
+
+    /**
+     * 把发往客户端的数据包编码一次，同一帧内发给多个客户端时不用每次都编码
+     * 返回的句柄可以代替pkt传给send_clt_packet、send_ssc_packet、clt_multicast、
+     * ssc_multicast、clt_channel_cast，编码方式、协议号必须一致
+     * 句柄在本帧结束时自动释放，之后再使用会报错，不要保存
+     * @param codec_type 编码方式(protobuf、flatbuffers)
+     * @param cmd 协议号
+     * @param pkt 数据包(lua table)
+     * @return 句柄
+     */
+    int32_t encode_packet(lua_State *L);
+
+    /**
+     * 把发往客户端的数据包编码为二进制字符串，不发送，用于测试、调试编码结果
+     * @param codec_type 编码方式(protobuf、flatbuffers)
+     * @param cmd 协议号
+     * @param pkt 数据包(lua table)
+     * @return 编码后的二进制字符串
+     */
+    int32_t encode_raw_packet(lua_State *L);
+
+    /**
+     * 把encode_raw_packet编码的二进制字符串解码，不支持只读视图
+     * @param codec_type 编码方式(protobuf、flatbuffers)
+     * @param cmd 协议号
+     * @param data 二进制字符串
+     * @return 数据包(lua table)
+     */
+    int32_t decode_raw_packet(lua_State *L);
+
+    /**
+     * 设置protobuf是否使用编码计划，默认开启。关闭后使用pbc编码、解码
+     * @param on 是否开启
+     */
+    int32_t set_protobuf_plan(lua_State *L);
+
     /**
      * 设置收发缓冲区参数
      * @param conn_id 网关连接id
@@ -262,6 +395,13 @@ public:
      */
     int32_t close(lua_State *L);
 
+    /**
+     * 立即唤醒io线程发送缓冲区中的数据
+     * 默认情况下，发送的数据在本帧逻辑执行完后才统一发送
+     * @param conn_id 网关连接id
+     */
+    int32_t flush(lua_State *L);
+
     /**
      * 获取某个连接的ip地址
      * @param conn_id 网关连接id
@@ -292,12 +432,144 @@ public:
      */
     int32_t get_connect_type(lua_State *L);
 
+    /**
+     * 设置某种连接的空闲超时时间，超过这个时间没有收到数据则由io线程关闭连接，
+     * 脚本通过conn_del收到ETIMEDOUT错误码。只对之后创建的连接生效
+     * @param conn_ty 连接类型，参考 ConnType 定义
+     * @param timeout 超时时间，毫秒，0表示不检测
+     */
+    int32_t set_idle_timeout(lua_State *L);
+
+    /**
+     * 设置客户端连接的流量限制(令牌桶)，限制每个连接所有包的数量
+     * 超出限制的包在回调脚本前处理，不再解码
+     * @param rate 每秒允许的包数量，0表示不限制
+     * @param burst 允许突发的包数量，默认与rate相同
+     * @param action 超出限制时的处理方式，FA_DROP丢弃，FA_KICK断开连接
+     */
+    int32_t set_flood_limit(lua_State *L);
+
+    /**
+     * 设置某个客户端指令的流量限制，每个连接单独计算，超出时的处理方式同
+     * set_flood_limit
+     * @param cmd 指令
+     * @param rate 每秒允许的包数量，0表示取消限制
+     * @param burst 允许突发的包数量，默认与rate相同
+     */
+    int32_t set_cmd_flood_limit(lua_State *L);
+
+    /**
+     * 设置缓冲区空闲回收时间，连接的收发缓冲区超过这个时间没有使用，则释放其内存
+     * @param msec 空闲时间，毫秒，0表示不回收
+     */
+    int32_t set_buffer_idle(lua_State *L);
+
+    /**
+     * 设置所有连接缓冲区的内存预算
+     * 1. 超过高水位时，暂停读取接收缓冲区待处理数据最多的连接，低于低水位时全部
+     *    恢复。单个连接暂停超过BUDGET_PAUSE_MAX也会恢复，仍超过高水位时可能被再次
+     *    暂停。服务器之间的连接(可能正在接收一个很大的扩展数据包)不暂停。暂停期间
+     *    不检测空闲超时，见EVBackend::modify_watcher
+     * 2. 超过上限时，断开发送缓冲区占用最多的客户端连接(接收太慢)
+     * 3. 统计的内存包括所有连接收发缓冲区的数据区、广播的共享数据、LargeBuffer、
+     *    数据包压缩及websocket压缩的上下文和缓冲区，见Buffer::CtxPool::get_used
+     *    chunk链表节点、socket对象等不统计。后面几项不属于某个连接的收发缓冲区，
+     *    只影响是否触发，暂停、断开时仍按连接的收发缓冲区排序
+     * @param limit 内存上限，字节，0表示不限制
+     * @param high 高水位，上限的百分比，默认90
+     * @param low 低水位，上限的百分比，默认70
+     */
+    int32_t set_buffer_budget(lua_State *L);
+
+    /**
+     * 获取缓冲区内存使用情况
+     * @param top 返回内存占用最多的连接数量，默认16
+     * @return 包含used、extra、limit、paused及top列表的table
+     */
+    int32_t buffer_stat(lua_State *L);
+
 public:
     /// 清除所有网络数据，不通知上层脚本
     void clear();
 
-    /// 删除无效的连接
-    void invoke_delete();
+    /**
+     * @brief 发送本帧合并的数据包，见CltBatch
+     * @return 处理的连接数量
+     */
+    size_t invoke_batch();
+
+    /// 连接有合并的数据包需要在帧结束时发送
+    void add_batch(int32_t conn_id)
+    {
+        _batch_conn.push_back(conn_id);
+    }
+
+    /**
+     * @brief 释放本帧预先编码的数据包，见encode_packet
+     * @return 释放的数据包数量
+     */
+    size_t invoke_encoded();
+
+    /**
+     * @brief 获取预先编码的数据包，见encode_packet
+     * 句柄已过期，或者编码方式、协议号不一致时抛出lua错误
+     * @param index 参数在栈上的位置
+     * @param codec_ty 发送时使用的编码方式
+     * @param cmd 发送时的协议号
+     * @return 参数不是句柄时返回nullptr，需要按lua table编码
+     */
+    const EncodedPacket *check_encoded(lua_State *L, int32_t index,
+                                       int32_t codec_ty, int32_t cmd) const;
+
+    /**
+     * @brief 把预先编码的数据包发给一个客户端，数据较小时直接拷贝
+     * @return <0 出错
+     */
+    static int32_t send_encoded(class Packet *pkt, uint16_t ecode,
+                                const EncodedPacket *encoded);
+
+    /**
+     * @brief 删除无效的连接
+     * @return 删除的连接数量
+     */
+    size_t invoke_delete();
+
+    /**
+     * @brief 定时回收空闲连接的缓冲区，每帧调用，到时间才会执行
+     * @param now 当前时间，毫秒
+     * @return 回收的缓冲区数量
+     */
+    size_t shrink_buffer(int64_t now);
+
+    /**
+     * @brief 定时检查缓冲区内存预算，每帧调用，到时间才会执行
+     * @param now 当前时间，毫秒
+     */
+    void check_buffer_budget(int64_t now);
+    /**
+     * 恢复因内存不足暂停读取的连接
+     * @param now 当前时间，毫秒
+     * @param all 是否恢复所有连接，否则只恢复暂停超过BUDGET_PAUSE_MAX的连接
+     */
+    void resume_read(int64_t now, bool all);
+
+    /**
+     * @brief 获取所有连接的缓冲区内存占用
+     * @param usage 用于存放结果的数组
+     */
+    void get_buffer_usage(std::vector<BufferUsage> &usage) const;
+
+    /// 获取缓冲区内存上限，字节
+    size_t get_buffer_limit() const
+    {
+        return _buffer_limit;
+    }
+
+    /// 获取因内存不足暂停读取的连接数量
+    size_t get_read_paused() const
+    {
+        return _read_paused.size();
+    }
 
     /// 通过所有者查找连接id
     int32_t get_conn_id_by_owner(Owner owner) const;
@@ -314,6 +586,15 @@ public:
     /// 通过conn_id获取session
     int32_t get_session_by_conn_id(int32_t conn_id) const;
 
+    /**
+     * 把已打包好的客户端数据包发给频道内所有在线的玩家
+     * @param shared 数据已经是共享数据时传入，不再另外创建
+     * @return 发送成功的客户端数量
+     */
+    int32_t channel_cast(int32_t channel_id, uint16_t cmd, uint16_t ecode,
+                         const char *ctx, size_t size,
+                         Buffer::Shared *shared = nullptr) const;
+
     /// 获取指令配置
     const CmdCfg *get_cs_cmd(int32_t cmd) const;
     const CmdCfg *get_ss_cmd(int32_t cmd) const;
@@ -323,6 +604,11 @@ public:
     {
         return _session;
     }
+    /// 获取某种连接的空闲超时时间，毫秒
+    int32_t get_idle_timeout(Socket::ConnType conn_ty) const
+    {
+        return _idle_timeout[conn_ty];
+    }
     int32_t new_connect_id(); /* 获取新connect_id */
 
     /// io建立完成
@@ -334,6 +620,14 @@ public:
     /// 接受连接成功，需要执行始化
     bool accept_new(int32_t conn_id, class Socket *new_sk);
 
+    /**
+     * 检测客户端发来的包是否超出流量限制，见set_flood_limit
+     * @param sk 客户端连接
+     * @param cmd 指令
+     * @return 是否允许处理，超出限制的包需要直接丢弃
+     */
+    bool flood_check(class Socket *sk, uint16_t cmd);
+
     /**
      * 把客户端数据包转发给另一服务器
      * @return <0 出错，0 未处理 1 已转发到其他服务器
@@ -342,6 +636,14 @@ public:
                         const char *ctx, size_t size) const;
 
 private:
+    /// 广播频道，成员数组用于广播时遍历，索引用于O(1)删除成员
+    struct Channel
+    {
+        std::vector<Owner> _members;
+        std::unordered_map<Owner, size_t> _index;
+    };
+
+    bool do_channel_leave(int32_t channel_id, Owner owner);
     void delete_socket(int32_t conn_id);
     int32_t get_cmd_session(int64_t object_id, int32_t cmd) const;
     class Packet *lua_check_packet(lua_State *L, Socket::ConnType conn_ty);
@@ -352,6 +654,21 @@ private:
     int32_t _session;   /* 当前进程的session */
     int32_t _conn_seed; /* connect_id种子 */
 
+    int32_t _idle_timeout[Socket::CT_MAX]; /* 各种连接的空闲超时时间，毫秒 */
+
+    int64_t _buffer_idle; /* 缓冲区空闲回收时间，毫秒 */
+    int64_t _next_shrink; /* 下次回收缓冲区的时间，毫秒 */
+
+    size_t _buffer_limit;  /* 所有连接缓冲区内存上限，字节，0表示不限制 */
+    int32_t _buffer_high;  /* 高水位，上限的百分比 */
+    int32_t _buffer_low;   /* 低水位，上限的百分比 */
+    int64_t _next_budget;  /* 下次检查内存预算的时间，毫秒 */
+    std::vector<PausedConn> _read_paused; /* 因内存不足暂停读取的连接 */
+
+    int32_t _flood_action;          /* 超出流量限制时的处理方式 */
+    FloodCtrl::Limit _flood_limit;  /* 客户端连接所有包的流量限制 */
+    std::unordered_map<uint16_t, FloodCtrl::Limit> _flood_cmd; /* 指令的流量限制 */
+
     cmd_map_t _cs_cmd_map;
     cmd_map_t _ss_cmd_map;
     cmd_map_t _sc_cmd_map;
@@ -360,6 +677,13 @@ private:
     /// 异步删除的socket
     std::unordered_map<int32_t, int32_t> _deleting;
 
+    /// 本帧有合并的数据包需要发送的连接
+    std::vector<int32_t> _batch_conn;
+
+    /// 本帧预先编码的数据包，句柄为_encoded_base + 数组下标
+    int64_t _encoded_base;
+    std::vector<EncodedPacket> _encoded;
+
     /// owner-conn_id 映射,ssc数据包转发时需要
     std::unordered_map<Owner, int32_t> _owner_map;
 
@@ -368,4 +692,9 @@ private:
 
     std::unordered_map<int32_t, int32_t> _session_map; /* session-conn_id 映射 */
     std::unordered_map<int32_t, Owner> _conn_session_map; /* conn_id-session 映射 */
+
+    /// 广播频道
+    std::unordered_map<int32_t, Channel> _channel;
+    /// 玩家加入的频道，玩家下线时用于退出所有频道
+    std::unordered_map<Owner, std::vector<int32_t>> _owner_channel;
 };
@@ -73,6 +73,7 @@ int32_t luaopen_ev(lua_State *L)
     lc.def<&LEV::backend>("backend");
     lc.def<&LEV::who_busy>("who_busy");
     lc.def<&LEV::set_app_ev>("set_app_ev");
+    lc.def<&LEV::loop_stats>("loop_stats");
     lc.def<&LEV::time_update>("time_update");
     lc.def<&LEV::steady_clock>("steady_clock");
     lc.def<&LEV::system_clock>("system_clock");
@@ -81,6 +82,15 @@ int32_t luaopen_ev(lua_State *L)
     lc.def<&LEV::periodic_stop>("periodic_stop");
     lc.def<&LEV::periodic_start>("periodic_start");
     lc.def<&LEV::set_critical_time>("set_critical_time");
+    lc.def<&LEV::set_backend>("set_backend");
+    lc.def<&LEV::set_timer_wheel>("set_timer_wheel");
+    lc.def<&LEV::set_timer_batch>("set_timer_batch");
+
+    lc.set(LEV::BP_LEAST, "BP_LEAST");
+    lc.set(LEV::BP_HASH, "BP_HASH");
+    lc.set(LEV::BT_DEFAULT, "BT_DEFAULT");
+    lc.set(LEV::BT_EPOLL, "BT_EPOLL");
+    lc.set(LEV::BT_IO_URING, "BT_IO_URING");
 
     return 0;
 }
@@ -159,6 +169,11 @@ int32_t luaopen_network_mgr(lua_State *L)
     LBaseClass<LNetworkMgr> lc(L, "engine.NetworkMgr");
 
     lc.def<&LNetworkMgr::close>("close");
+    lc.def<&LNetworkMgr::flush>("flush");
+    lc.def<&LNetworkMgr::set_idle_timeout>("set_idle_timeout");
+    lc.def<&LNetworkMgr::set_buffer_idle>("set_buffer_idle");
+    lc.def<&LNetworkMgr::set_buffer_budget>("set_buffer_budget");
+    lc.def<&LNetworkMgr::buffer_stat>("buffer_stat");
     lc.def<&LNetworkMgr::listen>("listen");
     lc.def<&LNetworkMgr::connect>("connect");
     lc.def<&LNetworkMgr::reset_schema>("reset_schema");
@@ -177,6 +192,11 @@ int32_t luaopen_network_mgr(lua_State *L)
 
     lc.def<&LNetworkMgr::set_conn_io>("set_conn_io");
     lc.def<&LNetworkMgr::set_conn_codec>("set_conn_codec");
+    lc.def<&LNetworkMgr::set_conn_compress>("set_conn_compress");
+    lc.def<&LNetworkMgr::set_conn_batch>("set_conn_batch");
+    lc.def<&LNetworkMgr::set_flood_limit>("set_flood_limit");
+    lc.def<&LNetworkMgr::set_cmd_flood_limit>("set_cmd_flood_limit");
+    lc.def<&LNetworkMgr::set_conn_deflate>("set_conn_deflate");
     lc.def<&LNetworkMgr::set_conn_packet>("set_conn_packet");
 
     lc.def<&LNetworkMgr::get_http_header>("get_http_header");
@@ -193,6 +213,17 @@ int32_t luaopen_network_mgr(lua_State *L)
     lc.def<&LNetworkMgr::clt_multicast>("clt_multicast");
     lc.def<&LNetworkMgr::ssc_multicast>("ssc_multicast");
 
+    lc.def<&LNetworkMgr::channel_join>("channel_join");
+    lc.def<&LNetworkMgr::channel_leave>("channel_leave");
+    lc.def<&LNetworkMgr::channel_quit>("channel_quit");
+    lc.def<&LNetworkMgr::channel_del>("channel_del");
+    lc.def<&LNetworkMgr::channel_size>("channel_size");
+    lc.def<&LNetworkMgr::clt_channel_cast>("clt_channel_cast");
+    lc.def<&LNetworkMgr::encode_packet>("encode_packet");
+    lc.def<&LNetworkMgr::encode_raw_packet>("encode_raw_packet");
+    lc.def<&LNetworkMgr::decode_raw_packet>("decode_raw_packet");
+    lc.def<&LNetworkMgr::set_protobuf_plan>("set_protobuf_plan");
+
     lc.def<&LNetworkMgr::set_buffer_params>("set_buffer_params");
 
     lc.def<&LNetworkMgr::new_ssl_ctx>("new_ssl_ctx");
@@ -207,6 +238,9 @@ int32_t luaopen_network_mgr(lua_State *L)
     lc.set(Socket::CT_SCCN, "CT_SCCN");
     lc.set(Socket::CT_SSCN, "CT_SSCN");
 
+    lc.set(FloodCtrl::FA_DROP, "FA_DROP");
+    lc.set(FloodCtrl::FA_KICK, "FA_KICK");
+
     lc.set(IO::IOT_NONE, "IOT_NONE");
     lc.set(IO::IOT_SSL, "IOT_SSL");
 
@@ -223,6 +257,10 @@ int32_t luaopen_network_mgr(lua_State *L)
     lc.set(Codec::CT_FLATBUF, "CDT_FLATBUF");
     lc.set(Codec::CT_PROTOBUF, "CDT_PROTOBUF");
 
+    // 协议掩码，见set_cs_cmd等函数的mask参数
+    lc.set(CmdCfg::MK_DYNAMIC, "MK_DYNAMIC");
+    lc.set(CmdCfg::MK_VIEW, "MK_VIEW");
+
     lc.set(SSLMgr::SSLVT_NONE, "SSLVT_NONE");
     lc.set(SSLMgr::SSLVT_TLS_GEN_AT, "SSLVT_TLS_GEN_AT");
     lc.set(SSLMgr::SSLVT_TLS_SRV_AT, "SSLVT_TLS_SRV_AT");
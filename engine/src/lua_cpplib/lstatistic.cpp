@@ -58,6 +58,22 @@ int32_t LStatistic::dump(lua_State *L)
     dump_socket(L);
     lua_rawset(L, -3);
 
+    lua_pushstring(L, "loop");
+    dump_loop(L);
+    lua_rawset(L, -3);
+
+    lua_pushstring(L, "buffer");
+    dump_buffer(L, 16);
+    lua_rawset(L, -3);
+
+    lua_pushstring(L, "ws_deflate");
+    dump_ws_deflate(L);
+    lua_rawset(L, -3);
+
+    lua_pushstring(L, "flood");
+    dump_flood(L);
+    lua_rawset(L, -3);
+
     return 1;
 
 #undef DUMP_BASE_COUNTER
@@ -87,6 +103,37 @@ void LStatistic::dump_base_counter(const Statistic::BaseCounterType &counter,
     }
 }
 
+void LStatistic::dump_loop(lua_State *L)
+{
+    const LoopStat &stat = StaticGlobal::ev()->get_loop_stat();
+
+    lua_createtable(L, 0, LoopStat::LP_MAX);
+    for (int32_t phase = 0; phase < LoopStat::LP_MAX; phase++)
+    {
+        const LoopStat::Histogram &h = stat.get(phase);
+
+        lua_pushstring(L, LoopStat::get_name(phase));
+        lua_createtable(L, 0, 7);
+
+        PUSH_INTEGER("count", h._count);
+
+        PUSH_INTEGER("total", h._total);
+
+        int64_t count = h._count > 0 ? h._count : 1;
+        PUSH_INTEGER("avg", h._total / count);
+
+        PUSH_INTEGER("p50", stat.percentile(phase, 50));
+
+        PUSH_INTEGER("p99", stat.percentile(phase, 99));
+
+        PUSH_INTEGER("max", h._max);
+
+        PUSH_INTEGER("events", h._events);
+
+        lua_rawset(L, -3);
+    }
+}
+
 void LStatistic::dump_thread(lua_State *L)
 {
     auto &threads = StaticGlobal::thread_mgr()->get_threads();
@@ -136,6 +183,56 @@ void LStatistic::dump_lua_gc(lua_State *L)
     PUSH_INTEGER("avg", counter._msec / count);
 }
 
+void LStatistic::dump_ws_deflate(lua_State *L)
+{
+    static const char *names[] = {"deflate", "inflate"};
+    const Statistic::DeflateCounter *counter =
+        StaticGlobal::statistic()->get_ws_deflate();
+
+    lua_newtable(L);
+    for (int32_t i = 0; i < 2; i++)
+    {
+        const Statistic::DeflateCounter &c = counter[i];
+
+        lua_pushstring(L, names[i]);
+        lua_newtable(L);
+
+        PUSH_INTEGER("count", c._count);
+        PUSH_INTEGER("raw", c._raw);
+        PUSH_INTEGER("size", c._size);
+        PUSH_INTEGER("usec", c._usec);
+
+        // 压缩率(压缩后大小占原大小的百分比)及每MB原始数据消耗的微秒数，
+        // 用于评估压缩的CPU开销
+        int64_t raw = c._raw > 0 ? c._raw : 1;
+        PUSH_INTEGER("ratio", c._size * 100 / raw);
+        PUSH_INTEGER("usec_per_mb", c._usec * 1024 * 1024 / raw);
+
+        lua_rawset(L, -3);
+    }
+}
+
+void LStatistic::dump_flood(lua_State *L)
+{
+    const Statistic::FloodCounter &flood =
+        StaticGlobal::statistic()->get_flood();
+
+    lua_newtable(L);
+
+    PUSH_INTEGER("drop", flood._drop);
+    PUSH_INTEGER("kick", flood._kick);
+
+    // 各指令丢弃的包数量，用于找出被刷的指令
+    lua_pushstring(L, "cmd");
+    lua_newtable(L);
+    for (const auto &iter : flood._cmd)
+    {
+        lua_pushinteger(L, iter.second);
+        lua_rawseti(L, -2, iter.first);
+    }
+    lua_rawset(L, -3);
+}
+
 void LStatistic::dump_mem_pool(lua_State *L)
 {
     int32_t index = 1;
@@ -270,6 +367,45 @@ void LStatistic::dump_socket(lua_State *L)
 #undef ST_T
 }
 
+void LStatistic::dump_buffer(lua_State *L, size_t top)
+{
+    using BufferUsage = LNetworkMgr::BufferUsage;
+
+    const class LNetworkMgr *nm = StaticGlobal::network_mgr();
+
+    std::vector<BufferUsage> usage;
+    nm->get_buffer_usage(usage);
+
+    top = std::min(top, usage.size());
+    std::partial_sort(usage.begin(), usage.begin() + top, usage.end(),
+                      [](const BufferUsage &a, const BufferUsage &b)
+                      { return a._send + a._recv > b._send + b._recv; });
+
+    lua_createtable(L, 0, 5);
+
+    PUSH_INTEGER("used", StaticGlobal::buffer_ctx_pool()->get_used());
+    PUSH_INTEGER("extra", Buffer::CtxPool::get_extra());
+    PUSH_INTEGER("limit", nm->get_buffer_limit());
+    PUSH_INTEGER("paused", nm->get_read_paused());
+
+    lua_pushstring(L, "top");
+    lua_createtable(L, (int32_t)top, 0);
+    for (size_t i = 0; i < top; i++)
+    {
+        const BufferUsage &bu = usage[i];
+
+        lua_createtable(L, 0, 5);
+        PUSH_INTEGER("conn_id", bu._conn_id);
+        PUSH_INTEGER("object_id", bu._object_id);
+        PUSH_INTEGER("send_mem", bu._send);
+        PUSH_INTEGER("recv_mem", bu._recv);
+        PUSH_INTEGER("recv_pending", bu._recv_pending);
+
+        lua_rawseti(L, -2, (int32_t)i + 1);
+    }
+    lua_rawset(L, -3);
+}
+
 /**
  * 导出引擎的发包状态数据
  * @return 包含引擎发包状态数据的table
@@ -298,8 +434,21 @@ int32_t LStatistic::dump_pkt(lua_State *L)
             PUSH_INTEGER("count", counter._count);
             PUSH_INTEGER("max_size", counter._max_size);
             PUSH_INTEGER("min_size", counter._min_size);
-            PUSH_INTEGER("avg", counter._msec / counter._count);
-            PUSH_INTEGER("avg_size", counter._size / counter._count);
+            // rpc只统计压缩数据，_count可能为0
+            if (counter._count > 0)
+            {
+                PUSH_INTEGER("avg", counter._msec / counter._count);
+                PUSH_INTEGER("avg_size", counter._size / counter._count);
+            }
+            if (counter._zip_count > 0)
+            {
+                PUSH_INTEGER("zip_count", counter._zip_count);
+                PUSH_INTEGER("zip_raw", counter._zip_raw);
+                PUSH_INTEGER("zip_size", counter._zip_size);
+                // 压缩率，压缩后大小占原大小的百分比
+                PUSH_INTEGER("zip_ratio",
+                             counter._zip_size * 100 / counter._zip_raw);
+            }
 
             itr++;
             lua_rawseti(L, -2, index++);
@@ -9,8 +9,19 @@ public:
     static int32_t dump(lua_State *L);
     static int32_t dump_pkt(lua_State *L);
 
+    /// 导出主循环各阶段的耗时统计，ev:loop_stats也使用这个函数
+    static void dump_loop(lua_State *L);
+
+    /**
+     * 导出缓冲区内存预算及占用最多的连接，network_mgr:buffer_stat也使用这个函数
+     * @param top 导出内存占用最多的连接数量
+     */
+    static void dump_buffer(lua_State *L, size_t top);
+
 private:
     static void dump_lua_gc(lua_State *L);
+    static void dump_ws_deflate(lua_State *L);
+    static void dump_flood(lua_State *L);
     static void dump_thread(lua_State *L);
     static void dump_mem_pool(lua_State *L);
     static void dump_socket(lua_State *L);
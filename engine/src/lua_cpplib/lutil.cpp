@@ -11,6 +11,8 @@
 #include "ltools.hpp"
 #include "../net/socket.hpp" // get_addr_info
 #include "../net/net_compat.hpp"
+#include "../net/codec/luabin_codec.hpp"
+#include "../system/static_global.hpp"
 
 #ifdef __windows__
     #include <rpc.h>
@@ -469,11 +471,70 @@ static int32_t ls(lua_State *L)
     return 1;
 }
 
+/**
+ * 以rpc的二进制格式编码lua变量，用于测试、调试编码格式
+ * @param dict 是否使用字典，使用时仅在本次编码中有效
+ * @param ... 需要编码的变量
+ * @return 编码后的二进制字符串
+ */
+static int32_t luabin_encode(lua_State *L)
+{
+    bool use_dict = lua_toboolean(L, 1);
+
+    LuaBinDict dict;
+    LuaBinCodec *encoder = static_cast<LuaBinCodec *>(
+        StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN));
+
+    const char *buffer = nullptr;
+    int32_t len =
+        encoder->encode_with_dict(L, 2, &buffer, use_dict ? &dict : nullptr);
+    if (len < 0)
+    {
+        encoder->finalize();
+        return luaL_error(L, "luabin encode error");
+    }
+
+    lua_pushlstring(L, buffer, len);
+    encoder->finalize();
+
+    return 1;
+}
+
+/**
+ * 解码luabin_encode编码的二进制字符串
+ * @param str 二进制字符串
+ * @param dict 是否使用字典，使用时仅在本次解码中有效
+ * @return 解码后的变量
+ */
+static int32_t luabin_decode(lua_State *L)
+{
+    size_t len      = 0;
+    const char *str = luaL_checklstring(L, 1, &len);
+    bool use_dict   = lua_toboolean(L, 2);
+
+    LuaBinDict dict;
+    LuaBinCodec *decoder = static_cast<LuaBinCodec *>(
+        StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN));
+
+    int32_t top = lua_gettop(L);
+    int32_t cnt =
+        decoder->decode_with_dict(L, str, len, use_dict ? &dict : nullptr);
+    if (cnt < 0)
+    {
+        lua_settop(L, top);
+        return luaL_error(L, "luabin decode error");
+    }
+
+    return cnt;
+}
+
 static const luaL_Reg utillib[] = {{"ls", ls},
                                    {"md5", md5},
                                    {"uuid", uuid},
                                    {"sha1", sha1},
                                    {"base64", base64},
+                                   {"luabin_encode", luabin_encode},
+                                   {"luabin_decode", luabin_decode},
                                    {"mkdir_p", mkdir_p},
                                    {"sha1_raw", sha1_raw},
                                    {"what_error", what_error},
@@ -22,7 +22,7 @@ public:
     };
 
 public:
-    Codec() {}
+    Codec() : _stable(false) {}
     virtual ~Codec() {}
 
     /**
@@ -47,6 +47,20 @@ public:
      */
     virtual void finalize() = 0;
 
+    /**
+     * 解码出来的数据包已回调脚本处理完，直接引用了接收缓冲区的解码结果
+     * (如flatbuffers的视图)在此之后失效
+     */
+    virtual void decode_done() {}
+
+    /**
+     * 设置下一次decode的数据在decode_done之前是否一直有效
+     * 在接收缓冲区chunk中的数据，回调脚本期间不会被修改。跨chunk拼接(LargeBuffer)、
+     * 解压后的数据，回调脚本期间可能被其他数据包复用，直接引用数据的解码结果需要
+     * 先拷贝一份。默认为false
+     */
+    void set_stable(bool stable) { _stable = stable; }
+
     /**
      * 从目录加载所有schema文件
      * @param path schema文件所在路径
@@ -58,4 +72,7 @@ public:
      * @param path schema文件所在路径
      */
     virtual int32_t load_file(const char *path) = 0;
+
+protected:
+    bool _stable; ///< 见set_stable
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "codec.hpp"
+#include "compressor.hpp"
 
 class CodecMgr
 {
@@ -13,6 +14,13 @@ public:
     int32_t load_one_schema(Codec::CodecType type, const char *path) const;
     int32_t load_one_schema_file(Codec::CodecType type, const char *path) const;
 
+    /// 获取数据包压缩器，仅主线程使用
+    class Compressor *get_compressor()
+    {
+        return &_compressor;
+    }
+
 private:
     class Codec *_codecs[Codec::CT_MAX];
+    class Compressor _compressor;
 };
@@ -0,0 +1,114 @@
+#include "compressor.hpp"
+#include "../net_header.hpp"
+#include "../../ev/buffer.hpp"
+
+Compressor::Compressor()
+{
+    memset(&_deflate, 0, sizeof(_deflate));
+    memset(&_inflate, 0, sizeof(_inflate));
+
+    // windowBits为负数表示raw deflate，不需要zlib头和校验
+    int32_t e = deflateInit2(&_deflate, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8,
+                             Z_DEFAULT_STRATEGY);
+    if (Z_OK != e) ELOG("compressor deflateInit2 error:%d", e);
+
+    e = inflateInit2(&_inflate, -MAX_WBITS);
+    if (Z_OK != e) ELOG("compressor inflateInit2 error:%d", e);
+
+    _zip._ctx   = nullptr;
+    _zip._len   = 0;
+    _unzip._ctx = nullptr;
+    _unzip._len = 0;
+}
+
+Compressor::~Compressor()
+{
+    deflateEnd(&_deflate);
+    inflateEnd(&_inflate);
+
+    delete[] _zip._ctx;
+    delete[] _unzip._ctx;
+    Buffer::CtxPool::add_extra(-static_cast<int64_t>(_zip._len + _unzip._len));
+}
+
+char *Compressor::reserve(Buff &buff, size_t len)
+{
+    if (buff._len >= len) return buff._ctx;
+
+    // 以64k为基数，每次翻倍
+    size_t old_len = buff._len;
+    if (0 == buff._len) buff._len = 64 * 1024;
+    while (buff._len < len) buff._len *= 2;
+
+    // 计入缓冲区内存预算
+    Buffer::CtxPool::add_extra(static_cast<int64_t>(buff._len - old_len));
+
+    delete[] buff._ctx;
+    buff._ctx = new char[buff._len];
+
+    return buff._ctx;
+}
+
+const char *Compressor::compress(const char *ctx, size_t size, size_t &len)
+{
+    static const size_t HEAD = sizeof(uint32_t);
+
+    if (size > MAX_EXT_PACKET_LEN) return nullptr;
+
+    uLong bound = deflateBound(&_deflate, static_cast<uLong>(size));
+    char *buff  = reserve(_zip, HEAD + bound);
+
+    uint32_t raw_len = static_cast<uint32_t>(size);
+    memcpy(buff, &raw_len, HEAD);
+
+    deflateReset(&_deflate);
+    _deflate.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(ctx));
+    _deflate.avail_in  = static_cast<uInt>(size);
+    _deflate.next_out  = reinterpret_cast<Bytef *>(buff + HEAD);
+    _deflate.avail_out = static_cast<uInt>(bound);
+
+    int32_t e = deflate(&_deflate, Z_FINISH);
+    if (Z_STREAM_END != e)
+    {
+        ELOG("compress error:%d", e);
+        return nullptr;
+    }
+
+    len = HEAD + _deflate.total_out;
+
+    // 压缩后没有变小(如已经压缩过的数据)，直接发原数据
+    return len < size ? buff : nullptr;
+}
+
+const char *Compressor::uncompress(const char *ctx, size_t size, size_t &len)
+{
+    static const size_t HEAD = sizeof(uint32_t);
+
+    uint32_t raw_len = 0;
+    if (size <= HEAD) return nullptr;
+
+    memcpy(&raw_len, ctx, HEAD);
+    if (0 == raw_len || raw_len > MAX_EXT_PACKET_LEN)
+    {
+        ELOG("uncompress illegal length:%u", raw_len);
+        return nullptr;
+    }
+
+    char *buff = reserve(_unzip, raw_len);
+
+    inflateReset(&_inflate);
+    _inflate.next_in   = reinterpret_cast<Bytef *>(const_cast<char *>(ctx + HEAD));
+    _inflate.avail_in  = static_cast<uInt>(size - HEAD);
+    _inflate.next_out  = reinterpret_cast<Bytef *>(buff);
+    _inflate.avail_out = raw_len;
+
+    int32_t e = inflate(&_inflate, Z_FINISH);
+    if (Z_STREAM_END != e || _inflate.total_out != raw_len)
+    {
+        ELOG("uncompress error:%d", e);
+        return nullptr;
+    }
+
+    len = raw_len;
+    return buff;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <zlib.h>
+
+#include "../../global/global.hpp"
+
+/**
+ * @brief 数据包压缩，使用zlib的raw deflate(最快的压缩等级)
+ * 压缩后的数据格式为：原始长度(uint32_t) + deflate数据
+ *
+ * 1. 每个数据包独立压缩，不依赖之前的数据，因此不需要每个连接一个压缩上下文
+ *    (每个deflate上下文约256k)，所有连接共用一个，只在主线程使用
+ * 2. 压缩、解压各有一个缓冲区，网关转发时会先解压服务器的包再压缩发给客户端，
+ *    两个缓冲区不能共用
+ */
+class Compressor final
+{
+public:
+    Compressor();
+    ~Compressor();
+
+    /**
+     * @brief 压缩数据
+     * @param ctx 需要压缩的数据
+     * @param size 数据长度
+     * @param len 压缩后的数据长度
+     * @return 压缩后的数据，在下一次压缩前有效。压缩失败或者压缩后没有变小返回nullptr
+     */
+    const char *compress(const char *ctx, size_t size, size_t &len);
+
+    /**
+     * @brief 解压数据
+     * @param ctx compress压缩后的数据
+     * @param size 数据长度
+     * @param len 解压后的数据长度
+     * @return 解压后的数据，在下一次解压前有效。数据错误返回nullptr
+     */
+    const char *uncompress(const char *ctx, size_t size, size_t &len);
+
+private:
+    /// 一块可复用的缓冲区，只增不减
+    struct Buff
+    {
+        char *_ctx;
+        size_t _len;
+    };
+
+    static char *reserve(Buff &buff, size_t len);
+
+private:
+    z_stream _deflate;
+    z_stream _inflate;
+
+    Buff _zip;   // 压缩用的缓冲区
+    Buff _unzip; // 解压用的缓冲区
+};
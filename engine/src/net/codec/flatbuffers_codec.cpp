@@ -2,6 +2,12 @@
 
 #include "../net_header.hpp"
 #include <lflatbuffers.hpp>
+#include <flatbuffers/reflection.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include "flatbuffers_view.hpp"
 
 FlatbuffersCodec::FlatbuffersCodec()
 {
@@ -16,20 +22,129 @@ FlatbuffersCodec::~FlatbuffersCodec()
 
 void FlatbuffersCodec::finalize() {}
 
+void FlatbuffersCodec::decode_done()
+{
+    // 接收缓冲区的数据即将被移除，之前解码的视图都不能再访问
+    FlatbuffersView::invalidate();
+    _view_copy.clear();
+}
+
 void FlatbuffersCodec::reset()
 {
     delete _lflatbuffers;
     _lflatbuffers = new class lflatbuffers();
+
+    // 视图引用了schema，schema销毁后视图也要失效
+    _view_schemas.clear();
+    FlatbuffersView::invalidate();
+    _view_copy.clear();
 }
 
 int32_t FlatbuffersCodec::load_path(const char *path)
 {
+    if (load_view_path(path) < 0) return -1;
+
     return _lflatbuffers->load_bfbs_path(path);
 }
 
 int32_t FlatbuffersCodec::load_file(const char *path)
 {
-    return _lflatbuffers->load_bfbs_file(path) ? 0 : -1;
+    if (!_lflatbuffers->load_bfbs_file(path)) return -1;
+
+    return load_view_file(path);
+}
+
+int32_t FlatbuffersCodec::load_view_file(const char *path)
+{
+    std::ifstream ifs(path, std::ifstream::binary | std::ifstream::in);
+    if (!ifs.good())
+    {
+        ELOG("can NOT open file(%s):%s", path, strerror(errno));
+        return -1;
+    }
+
+    std::string data((std::istreambuf_iterator<char>(ifs)),
+                     std::istreambuf_iterator<char>());
+    if (!ifs.good() && !ifs.eof())
+    {
+        ELOG("read file content error:%s", path);
+        return -1;
+    }
+
+    flatbuffers::Verifier verifier(
+        reinterpret_cast<const uint8_t *>(data.c_str()), data.size());
+    if (!reflection::VerifySchemaBuffer(verifier))
+    {
+        ELOG("invalid bfbs file:%s", path);
+        return -1;
+    }
+
+    // 重新加载的schema可能会替换旧的，引用旧schema的视图需要失效
+    FlatbuffersView::invalidate();
+    _view_schemas[std::filesystem::path(path).filename().string()] =
+        std::move(data);
+
+    return 0;
+}
+
+int32_t FlatbuffersCodec::load_view_path(const char *path)
+{
+    std::error_code e;
+    std::filesystem::directory_iterator dir_iter(path, e);
+    if (e)
+    {
+        ELOG("can not open directory(%s):%s", path, e.message().c_str());
+        return -1;
+    }
+
+    for (auto &p : dir_iter)
+    {
+        if (!p.is_regular_file() || ".bfbs" != p.path().extension()) continue;
+
+        if (load_view_file(p.path().string().c_str()) < 0) return -1;
+    }
+
+    return 0;
+}
+
+int32_t FlatbuffersCodec::decode_view(lua_State *L, const char *buffer,
+                                      size_t len, const CmdCfg *cfg)
+{
+    auto iter = _view_schemas.find(cfg->_schema);
+    if (iter == _view_schemas.end())
+    {
+        ELOG("flatbuffers view no schema found:%s", cfg->_schema);
+        return -1;
+    }
+
+    const reflection::Schema *schema =
+        reflection::GetSchema(iter->second.c_str());
+    const reflection::Object *object =
+        schema->objects()->LookupByKey(cfg->_object);
+    if (!object || object->is_struct())
+    {
+        ELOG("flatbuffers view no table found:%s", cfg->_object);
+        return -1;
+    }
+
+    // 数据来自网络，不校验的话视图可能会越界访问。校验只是遍历一次数据，
+    // 不分配内存，比转换为lua table要快得多
+    if (!flatbuffers::Verify(*schema, *object,
+                             reinterpret_cast<const uint8_t *>(buffer), len))
+    {
+        ELOG("flatbuffers view verify fail:%s", cfg->_object);
+        return -1;
+    }
+
+    // LargeBuffer、解压缓冲区在回调脚本期间可能被其他数据包覆盖
+    if (!_stable)
+    {
+        _view_copy.emplace_back(buffer, len);
+        buffer = _view_copy.back().data();
+    }
+
+    FlatbuffersView::push_root(L, schema, object, buffer);
+    return 1;
 }
 
 /* 解码数据包
@@ -38,6 +153,8 @@ int32_t FlatbuffersCodec::load_file(const char *path)
 int32_t FlatbuffersCodec::decode(lua_State *L, const char *buffer, size_t len,
                                  const CmdCfg *cfg)
 {
+    if (cfg->_mask & CmdCfg::MK_VIEW) return decode_view(L, buffer, len, cfg);
+
     if (_lflatbuffers->decode(L, cfg->_schema, cfg->_object, buffer, len) < 0)
     {
         ELOG("flatbuffers decode:%s", _lflatbuffers->last_error());
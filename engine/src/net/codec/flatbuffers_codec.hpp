@@ -1,5 +1,7 @@
 #pragma once
 
+#include <deque>
+
 #include "codec.hpp"
 
 class lflatbuffers;
@@ -10,6 +12,7 @@ public:
     ~FlatbuffersCodec();
 
     void finalize() override;
+    void decode_done() override;
     void reset() override;
     int32_t load_path(const char *path) override;
     int32_t load_file(const char *path) override;
@@ -25,6 +28,22 @@ public:
     int32_t encode(lua_State *L, int32_t index, const char **buffer,
                    const CmdCfg *cfg) override;
 
+private:
+    /**
+     * 解码为只读视图，不创建lua table，见FlatbuffersView
+     * 视图直接引用buffer，数据包处理完(decode_done)后失效。buffer不在接收缓冲区
+     * 的chunk中时(见set_stable)，先拷贝到_view_copy再引用
+     */
+    int32_t decode_view(lua_State *L, const char *buffer, size_t len,
+                        const CmdCfg *cfg);
+    /// 加载视图用的反射schema，lflatbuffers没有提供访问其schema的接口
+    int32_t load_view_file(const char *path);
+    int32_t load_view_path(const char *path);
+
 private:
     class lflatbuffers *_lflatbuffers;
+    /// 文件名(如player.bfbs，与CmdCfg::_schema一致) - bfbs文件内容
+    std::unordered_map<std::string, std::string> _view_schemas;
+    /// 视图引用的数据拷贝，decode_done时释放。deque添加元素时不会移动已有的元素
+    std::deque<std::string> _view_copy;
 };
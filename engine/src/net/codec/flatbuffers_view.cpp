@@ -0,0 +1,421 @@
+#include <lua.hpp>
+#include <flatbuffers/reflection.h>
+
+#include "flatbuffers_view.hpp"
+
+/// 所有视图共用的metatable名
+static const char *VIEW_META = "FlatbuffersView";
+
+uint32_t FlatbuffersView::_epoch = 0;
+
+void FlatbuffersView::push_root(lua_State *L, const reflection::Schema *schema,
+                                const reflection::Object *object,
+                                const char *buffer)
+{
+    const flatbuffers::Table *root =
+        flatbuffers::GetAnyRoot(reinterpret_cast<const uint8_t *>(buffer));
+
+    new_view(L, VT_TABLE, schema, object, nullptr,
+             reinterpret_cast<const uint8_t *>(root));
+}
+
+void FlatbuffersView::new_view(lua_State *L, int32_t type,
+                               const reflection::Schema *schema,
+                               const reflection::Object *object,
+                               const reflection::Field *field,
+                               const uint8_t *data)
+{
+    View *view    = (View *)lua_newuserdata(L, sizeof(View));
+    view->_epoch  = _epoch;
+    view->_type   = type;
+    view->_schema = schema;
+    view->_object = object;
+    view->_field  = field;
+    view->_data   = data;
+
+    if (luaL_newmetatable(L, VIEW_META))
+    {
+        luaL_Reg meta[] = {{"__index", index},   {"__newindex", newindex},
+                           {"__len", len},       {"__pairs", pairs},
+                           {"__tostring", tostring}, {nullptr, nullptr}};
+        luaL_setfuncs(L, meta, 0);
+    }
+    lua_setmetatable(L, -2);
+}
+
+const FlatbuffersView::View *FlatbuffersView::check_view(lua_State *L,
+                                                         int32_t index)
+{
+    const View *view = (const View *)luaL_checkudata(L, index, VIEW_META);
+    if (view->_epoch != _epoch)
+    {
+        luaL_error(L, "flatbuffers view expired, it is only valid in the "
+                      "command handler");
+        return nullptr;
+    }
+
+    return view;
+}
+
+/// 把标量push到栈顶，bool、浮点、整数分别对应lua的类型
+template <typename I, typename F>
+static void push_scalar(lua_State *L, reflection::BaseType type, I &&get_i,
+                        F &&get_f)
+{
+    if (reflection::Bool == type)
+    {
+        lua_pushboolean(L, 0 != get_i());
+    }
+    else if (flatbuffers::IsFloat(type))
+    {
+        lua_pushnumber(L, get_f());
+    }
+    else
+    {
+        lua_pushinteger(L, static_cast<lua_Integer>(get_i()));
+    }
+}
+
+void FlatbuffersView::push_field(lua_State *L, const View *view,
+                                 const reflection::Field *field)
+{
+    if (VT_TABLE == view->_type)
+    {
+        push_table_field(L, view, field);
+        return;
+    }
+
+    // struct的字段只能是标量或者struct，并且总是存在
+    const flatbuffers::Struct *st =
+        reinterpret_cast<const flatbuffers::Struct *>(view->_data);
+    const reflection::Type *type = field->type();
+    switch (type->base_type())
+    {
+    case reflection::Obj:
+        new_view(L, VT_STRUCT, view->_schema,
+                 view->_schema->objects()->Get(type->index()), nullptr,
+                 st->GetAddressOf(field->offset()));
+        return;
+    case reflection::Array:
+        luaL_error(L, "flatbuffers view not support array field: %s",
+                   field->name()->c_str());
+        return;
+    default:
+        push_scalar(
+            L, type->base_type(),
+            [st, field]() { return flatbuffers::GetAnyFieldI(*st, *field); },
+            [st, field]() { return flatbuffers::GetAnyFieldF(*st, *field); });
+        return;
+    }
+}
+
+void FlatbuffersView::push_table_field(lua_State *L, const View *view,
+                                       const reflection::Field *field)
+{
+    const flatbuffers::Table *table =
+        reinterpret_cast<const flatbuffers::Table *>(view->_data);
+    const reflection::Type *type = field->type();
+    reflection::BaseType bt      = type->base_type();
+
+    // 不存在的标量返回默认值，与普通解码一致
+    if (flatbuffers::IsScalar(bt))
+    {
+        push_scalar(
+            L, bt,
+            [table, field]() {
+                return flatbuffers::GetAnyFieldI(*table, *field);
+            },
+            [table, field]() {
+                return flatbuffers::GetAnyFieldF(*table, *field);
+            });
+        return;
+    }
+
+    switch (bt)
+    {
+    case reflection::String:
+    {
+        const flatbuffers::String *str = flatbuffers::GetFieldS(*table, *field);
+        if (!str) break;
+
+        lua_pushlstring(L, str->c_str(), str->size());
+        return;
+    }
+    case reflection::Obj:
+    {
+        const reflection::Object *object =
+            view->_schema->objects()->Get(type->index());
+        if (object->is_struct())
+        {
+            const flatbuffers::Struct *st =
+                flatbuffers::GetFieldStruct(*table, *field);
+            if (!st) break;
+
+            new_view(L, VT_STRUCT, view->_schema, object, nullptr,
+                     reinterpret_cast<const uint8_t *>(st));
+        }
+        else
+        {
+            const flatbuffers::Table *sub =
+                flatbuffers::GetFieldT(*table, *field);
+            if (!sub) break;
+
+            new_view(L, VT_TABLE, view->_schema, object, nullptr,
+                     reinterpret_cast<const uint8_t *>(sub));
+        }
+        return;
+    }
+    case reflection::Vector:
+    {
+        const flatbuffers::VectorOfAny *vec =
+            flatbuffers::GetFieldAnyV(*table, *field);
+        if (!vec) break;
+
+        // byte数组与普通解码一致，返回字符串
+        reflection::BaseType et = type->element();
+        if (reflection::Byte == et || reflection::UByte == et)
+        {
+            lua_pushlstring(L, reinterpret_cast<const char *>(vec->Data()),
+                            vec->size());
+            return;
+        }
+
+        const reflection::Object *object =
+            reflection::Obj == et ? view->_schema->objects()->Get(type->index())
+                                  : nullptr;
+        new_view(L, VT_VECTOR, view->_schema, object, field,
+                 reinterpret_cast<const uint8_t *>(vec));
+        return;
+    }
+    case reflection::Union: push_union(L, view, field); return;
+    default:
+        luaL_error(L, "flatbuffers view not support field: %s",
+                   field->name()->c_str());
+        return;
+    }
+
+    lua_pushnil(L);
+}
+
+void FlatbuffersView::push_union(lua_State *L, const View *view,
+                                 const reflection::Field *field)
+{
+    const flatbuffers::Table *table =
+        reinterpret_cast<const flatbuffers::Table *>(view->_data);
+
+    // union的类型字段(xxx_type)由flatc生成，id总是比union字段小1
+    const reflection::Field *type_field = nullptr;
+    for (const reflection::Field *f : *(view->_object->fields()))
+    {
+        if (f->id() + 1 == field->id())
+        {
+            type_field = f;
+            break;
+        }
+    }
+
+    const flatbuffers::Table *sub = flatbuffers::GetFieldT(*table, *field);
+    if (!type_field || !sub)
+    {
+        lua_pushnil(L);
+        return;
+    }
+
+    const reflection::Enum *e =
+        view->_schema->enums()->Get(field->type()->index());
+    const reflection::EnumVal *val = e->values()->LookupByKey(
+        flatbuffers::GetAnyFieldI(*table, *type_field));
+    if (!val || !val->union_type())
+    {
+        lua_pushnil(L);
+        return;
+    }
+
+    new_view(L, VT_TABLE, view->_schema,
+             view->_schema->objects()->Get(val->union_type()->index()),
+             nullptr, reinterpret_cast<const uint8_t *>(sub));
+}
+
+void FlatbuffersView::push_element(lua_State *L, const View *view, size_t i)
+{
+    const flatbuffers::VectorOfAny *vec =
+        reinterpret_cast<const flatbuffers::VectorOfAny *>(view->_data);
+    if (i >= vec->size())
+    {
+        lua_pushnil(L);
+        return;
+    }
+
+    reflection::BaseType et = view->_field->type()->element();
+    if (flatbuffers::IsScalar(et))
+    {
+        push_scalar(
+            L, et,
+            [vec, et, i]() {
+                return flatbuffers::GetAnyVectorElemI(vec, et, i);
+            },
+            [vec, et, i]() {
+                return flatbuffers::GetAnyVectorElemF(vec, et, i);
+            });
+        return;
+    }
+
+    switch (et)
+    {
+    case reflection::String:
+    {
+        const flatbuffers::String *str =
+            flatbuffers::GetAnyVectorElemPointer<const flatbuffers::String>(vec,
+                                                                            i);
+        lua_pushlstring(L, str->c_str(), str->size());
+        return;
+    }
+    case reflection::Obj:
+        if (view->_object->is_struct())
+        {
+            new_view(L, VT_STRUCT, view->_schema, view->_object, nullptr,
+                     flatbuffers::GetAnyVectorElemAddressOf<const uint8_t>(
+                         vec, i,
+                         static_cast<size_t>(view->_object->bytesize())));
+        }
+        else
+        {
+            new_view(L, VT_TABLE, view->_schema, view->_object, nullptr,
+                     reinterpret_cast<const uint8_t *>(
+                         flatbuffers::GetAnyVectorElemPointer<
+                             const flatbuffers::Table>(vec, i)));
+        }
+        return;
+    default:
+        luaL_error(L, "flatbuffers view not support vector: %s",
+                   view->_field->name()->c_str());
+        return;
+    }
+}
+
+int32_t FlatbuffersView::index(lua_State *L)
+{
+    const View *view = check_view(L, 1);
+    if (VT_VECTOR == view->_type)
+    {
+        // 与lua的数组一致，下标从1开始
+        if (!lua_isinteger(L, 2)) return 0;
+
+        lua_Integer i = lua_tointeger(L, 2);
+        if (i < 1) return 0;
+
+        push_element(L, view, static_cast<size_t>(i - 1));
+        return 1;
+    }
+
+    if (LUA_TSTRING != lua_type(L, 2)) return 0;
+
+    const reflection::Field *field =
+        view->_object->fields()->LookupByKey(lua_tostring(L, 2));
+    if (!field || field->deprecated()) return 0;
+
+    push_field(L, view, field);
+    return 1;
+}
+
+int32_t FlatbuffersView::newindex(lua_State *L)
+{
+    return luaL_error(L, "flatbuffers view is read only");
+}
+
+int32_t FlatbuffersView::len(lua_State *L)
+{
+    const View *view = check_view(L, 1);
+
+    lua_Integer size = 0;
+    if (VT_VECTOR == view->_type)
+    {
+        size = static_cast<lua_Integer>(
+            reinterpret_cast<const flatbuffers::VectorOfAny *>(view->_data)
+                ->size());
+    }
+    lua_pushinteger(L, size);
+
+    return 1;
+}
+
+int32_t FlatbuffersView::pairs(lua_State *L)
+{
+    check_view(L, 1);
+
+    // 遍历的位置放在upvalue，不需要每次都根据key查找
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, next, 1);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+
+    return 3;
+}
+
+int32_t FlatbuffersView::next(lua_State *L)
+{
+    const View *view = check_view(L, 1);
+    lua_Integer pos  = lua_tointeger(L, lua_upvalueindex(1));
+
+    if (VT_VECTOR == view->_type)
+    {
+        const flatbuffers::VectorOfAny *vec =
+            reinterpret_cast<const flatbuffers::VectorOfAny *>(view->_data);
+        if (pos >= static_cast<lua_Integer>(vec->size())) return 0;
+
+        lua_pushinteger(L, pos + 1);
+        lua_replace(L, lua_upvalueindex(1));
+
+        lua_pushinteger(L, pos + 1);
+        push_element(L, view, static_cast<size_t>(pos));
+        return 2;
+    }
+
+    // 按schema中的字段顺序(字段名排序)遍历，跳过不存在的table、字符串等字段
+    const auto *fields = view->_object->fields();
+    while (pos < static_cast<lua_Integer>(fields->size()))
+    {
+        const reflection::Field *field =
+            fields->Get(static_cast<flatbuffers::uoffset_t>(pos++));
+        if (field->deprecated()) continue;
+
+        push_field(L, view, field);
+        if (lua_isnil(L, -1))
+        {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        lua_pushinteger(L, pos);
+        lua_replace(L, lua_upvalueindex(1));
+
+        lua_pushstring(L, field->name()->c_str());
+        lua_insert(L, -2);
+        return 2;
+    }
+
+    lua_pushinteger(L, pos);
+    lua_replace(L, lua_upvalueindex(1));
+    return 0;
+}
+
+int32_t FlatbuffersView::tostring(lua_State *L)
+{
+    const View *view = (const View *)luaL_checkudata(L, 1, VIEW_META);
+    if (view->_epoch != _epoch)
+    {
+        lua_pushstring(L, "flatbuffers view(expired)");
+    }
+    else if (VT_VECTOR == view->_type)
+    {
+        lua_pushfstring(L, "flatbuffers view(vector %s)",
+                        view->_field->name()->c_str());
+    }
+    else
+    {
+        lua_pushfstring(L, "flatbuffers view(%s)",
+                        view->_object->name()->c_str());
+    }
+
+    return 1;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../../global/global.hpp"
+
+struct lua_State;
+namespace reflection
+{
+struct Schema;
+struct Object;
+struct Field;
+} // namespace reflection
+
+/**
+ * @brief flatbuffers数据包的只读视图
+ * 普通解码会把整个数据包转换为lua table，对于很大但只读取少数字段的数据包(如配置
+ * 同步、排行榜)，大部分工作都浪费了。视图是一个很小的userdata，直接引用接收缓冲区
+ * 中的数据，访问字段时才通过反射schema读取：
+ * 1. 标量、字符串在访问时push到lua，子table、struct、数组返回一个新的视图
+ * 2. byte、ubyte数组与普通解码一致，返回字符串
+ * 3. 数据只在回调脚本期间有效，回调返回后调用invalidate，之后再访问视图会报错，
+ *    需要保存的字段应该在回调中取出来
+ * 4. 跨chunk拼接、解压后的数据不在接收缓冲区中，回调脚本期间可能被覆盖，由
+ *    FlatbuffersCodec先拷贝一份再创建视图(见Codec::set_stable)
+ */
+class FlatbuffersView final
+{
+public:
+    /// 把数据包的根table作为视图push到栈顶，buffer必须已经校验过
+    static void push_root(lua_State *L, const reflection::Schema *schema,
+                          const reflection::Object *object, const char *buffer);
+
+    /// 使之前创建的所有视图失效，数据包处理完或者schema重新加载时调用
+    static void invalidate() { ++_epoch; }
+
+private:
+    enum ViewType
+    {
+        VT_TABLE  = 1, ///< flatbuffers::Table
+        VT_STRUCT = 2, ///< flatbuffers::Struct
+        VT_VECTOR = 3  ///< flatbuffers::VectorOfAny
+    };
+
+    struct View
+    {
+        uint32_t _epoch; ///< 创建时的_epoch，不一致表示已失效
+        int32_t _type;   ///< 见ViewType
+        const reflection::Schema *_schema;
+        /// table、struct的类型，数组的元素为table、struct时为元素的类型
+        const reflection::Object *_object;
+        const reflection::Field *_field; ///< 数组对应的字段，用于获取元素类型
+        const uint8_t *_data;            ///< 视图数据在缓冲区中的地址
+    };
+
+    static void new_view(lua_State *L, int32_t type,
+                         const reflection::Schema *schema,
+                         const reflection::Object *object,
+                         const reflection::Field *field, const uint8_t *data);
+    static const View *check_view(lua_State *L, int32_t index);
+
+    /// 把table、struct的字段push到栈顶，字段不存在时push nil
+    static void push_field(lua_State *L, const View *view,
+                           const reflection::Field *field);
+    static void push_table_field(lua_State *L, const View *view,
+                                 const reflection::Field *field);
+    static void push_union(lua_State *L, const View *view,
+                           const reflection::Field *field);
+    /// 把数组的第i(从0开始)个元素push到栈顶
+    static void push_element(lua_State *L, const View *view, size_t i);
+
+    static int32_t index(lua_State *L);
+    static int32_t newindex(lua_State *L);
+    static int32_t len(lua_State *L);
+    static int32_t pairs(lua_State *L);
+    static int32_t next(lua_State *L);
+    static int32_t tostring(lua_State *L);
+
+private:
+    static uint32_t _epoch;
+};
@@ -8,23 +8,65 @@ static const int32_t MAX_BUFF = 1024 * 1024;
 //< 编码的变量最大数量
 static const int32_t MAX_VARIABLE = 255;
 
+//< 字典最多包含的key数量
+static const size_t MAX_DICT_SIZE = 4096;
+
+//< 长度不超过该值的key才放到字典
+static const size_t MAX_DICT_KEY_LEN = 64;
+
 //< 支持编码的数据类型，不能直接用lua本身的类型T_NIL之类的，因为没有区分整形
 enum LuaType
 {
-    LT_NIL   = 0, //< nil值
-    LT_BOOL  = 1, //< boolean类型
-    LT_NUM   = 2, //< 浮点型
-    LT_STR   = 3, //< 字符串
-    LT_TABLE = 4, //< table
-    LT_INT   = 5, //< 整形
+    LT_NIL     = 0, //< nil值
+    LT_FALSE   = 1, //< boolean类型false
+    LT_TRUE    = 2, //< boolean类型true
+    LT_NUM     = 3, //< 浮点型
+    LT_INT     = 4, //< 整形，zigzag + varint
+    LT_STR     = 5, //< 字符串，varint长度 + 内容
+    LT_TABLE   = 6, //< table，varint数组数量 + varint hash数量 + 内容
+    LT_KEY_DEF = 7, //< 字典中新增的key，varint编号 + varint长度 + 内容
+    LT_KEY_REF = 8, //< 字典中已有的key，varint编号
+
+    LT_SMALL_INT = 0x80, //< 0~127的整数，值放在类型的低7位
 };
 
+int32_t LuaBinDict::add(const char *key, size_t len)
+{
+    if (_encode_keys.size() >= MAX_DICT_SIZE) return -1;
+
+    int32_t id = static_cast<int32_t>(_encode_keys.size());
+
+    const std::string &str = _encode_keys.emplace_back(key, len);
+    _encode_index.emplace(std::string_view(str), id);
+
+    return id;
+}
+
+void LuaBinDict::rollback(size_t size)
+{
+    while (_encode_keys.size() > size)
+    {
+        _encode_index.erase(std::string_view(_encode_keys.back()));
+        _encode_keys.pop_back();
+    }
+}
+
+bool LuaBinDict::set(uint32_t id, const char *key, size_t len)
+{
+    // 编号是按顺序分配的，不连续说明两端的字典已经不一致了
+    if (id != _decode_keys.size() || id >= MAX_DICT_SIZE) return false;
+
+    _decode_keys.emplace_back(key, len);
+    return true;
+}
+
 LuaBinCodec::LuaBinCodec()
 {
     _buff_len    = 0;
     _buff_pos    = 0;
     _decode_buff = nullptr;
     _encode_buff = new char[MAX_BUFF];
+    _dict        = nullptr;
 }
 
 LuaBinCodec::~LuaBinCodec()
@@ -34,9 +76,23 @@ LuaBinCodec::~LuaBinCodec()
 
 int32_t LuaBinCodec::decode_table(lua_State *L)
 {
-    size_t count = 0;
-    // 这里不检测缓冲区，由decode_value检测
-    *this >> count;
+    uint64_t narr  = 0;
+    uint64_t nhash = 0;
+    if (!read_varint(narr) || !read_varint(nhash))
+    {
+        ELOG("invalid table size");
+        return -1;
+    }
+
+    // 每个值至少占1字节，避免错误的数据创建超大的table
+    // narr、nhash来自网络数据，需要分开检测，相加可能溢出
+    uint64_t remain = _buff_len - _buff_pos;
+    if (narr > remain || nhash > (remain - narr) / 2)
+    {
+        ELOG("invalid table size %llu %llu", (unsigned long long)narr,
+             (unsigned long long)nhash);
+        return -1;
+    }
 
     if (!lua_checkstack(L, 3))
     {
@@ -45,14 +101,35 @@ int32_t LuaBinCodec::decode_table(lua_State *L)
     }
     int32_t top = lua_gettop(L);
 
-    lua_createtable(L, 0, 0);
-    for (size_t i = 0; i < count; i++)
+    lua_createtable(L, static_cast<int32_t>(narr), static_cast<int32_t>(nhash));
+    for (uint64_t i = 1; i <= narr; i++)
+    {
+        if (decode_value(L) < 0)
+        {
+            lua_settop(L, top);
+            return -1;
+        }
+        lua_rawseti(L, -2, static_cast<lua_Integer>(i));
+    }
+
+    for (uint64_t i = 0; i < nhash; i++)
     {
         if (decode_value(L) < 0 || decode_value(L) < 0)
         {
             lua_settop(L, top);
             return -1;
         }
+
+        // nil、NaN作key时lua_rawset会抛异常，只有错误的数据才会出现
+        int32_t key_type = lua_type(L, -2);
+        if (LUA_TNIL == key_type
+            || (LUA_TNUMBER == key_type && !lua_isinteger(L, -2)
+                && lua_tonumber(L, -2) != lua_tonumber(L, -2)))
+        {
+            ELOG("invalid table key");
+            lua_settop(L, top);
+            return -1;
+        }
         lua_rawset(L, -3);
     }
 
@@ -68,9 +145,9 @@ int32_t LuaBinCodec::decode_value(lua_State *L)
         return -1;                                  \
     }
 
-    int8_t type = 0;
+    uint8_t type = 0;
 
-    CHECK_DECODE_LEN(sizeof(int8_t));
+    CHECK_DECODE_LEN(sizeof(uint8_t));
     *this >> type;
 
     // 由encode和encode_table检测，这里不用每次都检测
@@ -80,18 +157,17 @@ int32_t LuaBinCodec::decode_value(lua_State *L)
     //        return -1;
     //    }
 
+    if (type & LT_SMALL_INT)
+    {
+        lua_pushinteger(L, type & 0x7F);
+        return 0;
+    }
+
     switch (type)
     {
     case LT_NIL: lua_pushnil(L); break;
-    case LT_BOOL:
-    {
-        int8_t b = 0;
-
-        CHECK_DECODE_LEN(sizeof(int8_t));
-        *this >> b;
-        lua_pushboolean(L, b);
-        break;
-    }
+    case LT_FALSE: lua_pushboolean(L, 0); break;
+    case LT_TRUE: lua_pushboolean(L, 1); break;
     case LT_NUM:
     {
         double d = 0.;
@@ -103,31 +179,73 @@ int32_t LuaBinCodec::decode_value(lua_State *L)
     }
     case LT_STR:
     {
-        size_t len = 0;
-        *this >> len;
+        uint64_t len = 0;
+        if (!read_varint(len) || len > _buff_len - _buff_pos)
+        {
+            ELOG("buff reach end, invalid string");
+            return -1;
+        }
 
-        CHECK_DECODE_LEN(len);
         lua_pushlstring(L, subtract(len), len);
-
         break;
     }
     case LT_INT:
     {
-        int64_t i = 0;
-        CHECK_DECODE_LEN(sizeof(int64_t));
-
-        *this >> i;
-        lua_pushinteger(L, i);
+        uint64_t i = 0;
+        if (!read_varint(i))
+        {
+            ELOG("buff reach end, invalid integer");
+            return -1;
+        }
 
+        // zigzag解码
+        lua_pushinteger(L, static_cast<lua_Integer>((i >> 1) ^ (0 - (i & 1))));
         break;
     }
     case LT_TABLE:
     {
-        CHECK_DECODE_LEN(sizeof(size_t));
-
         return decode_table(L);
         break;
     }
+    case LT_KEY_DEF:
+    {
+        uint64_t id  = 0;
+        uint64_t len = 0;
+        if (!read_varint(id) || !read_varint(len)
+            || len > _buff_len - _buff_pos)
+        {
+            ELOG("buff reach end, invalid dict key");
+            return -1;
+        }
+
+        const char *key = subtract(len);
+        if (!_dict || !_dict->set(static_cast<uint32_t>(id), key, len))
+        {
+            ELOG("lua binary dict key error: %llu", (unsigned long long)id);
+            return -1;
+        }
+        lua_pushlstring(L, key, len);
+        break;
+    }
+    case LT_KEY_REF:
+    {
+        uint64_t id = 0;
+        if (!read_varint(id))
+        {
+            ELOG("buff reach end, invalid dict key");
+            return -1;
+        }
+
+        const std::string *key =
+            _dict ? _dict->get(static_cast<uint32_t>(id)) : nullptr;
+        if (!key)
+        {
+            ELOG("lua binary dict key not found: %llu", (unsigned long long)id);
+            return -1;
+        }
+        lua_pushlstring(L, key->c_str(), key->size());
+        break;
+    }
     default: ELOG("uknow data type %d", (int32_t)type); return -1;
     }
 
@@ -136,14 +254,13 @@ int32_t LuaBinCodec::decode_value(lua_State *L)
 #undef CHECK_DECODE_LEN
 }
 
-int32_t LuaBinCodec::decode(lua_State *L, const char *buffer, size_t len,
-                            const CmdCfg *cfg)
+int32_t LuaBinCodec::decode_with_dict(lua_State *L, const char *buffer,
+                                      size_t len, LuaBinDict *dict)
 {
-    UNUSED(cfg);
-
     _buff_pos    = 0;
     _buff_len    = len;
     _decode_buff = buffer;
+    _dict        = dict;
 
     uint8_t count = 0;
     if (len < sizeof(count))
@@ -169,65 +286,165 @@ int32_t LuaBinCodec::decode(lua_State *L, const char *buffer, size_t len,
 
 int32_t LuaBinCodec::encode_table(lua_State *L, int32_t index)
 {
-    // table的key数量
-    size_t *p_count = reinterpret_cast<size_t *>(_encode_buff + _buff_len);
+    if (!lua_checkstack(L, 3))
+    {
+        ELOG("lua stack overflow, top = %d", lua_gettop(L));
+        return -1;
+    }
 
-    size_t count = 0;
-    // 写入数量，只是占位。这里不检测长度，由encode_value检测
-    *this << count;
+    // 数组部分，中间为nil的也按nil写入，解码时按数量预分配
+    lua_Integer narr = static_cast<lua_Integer>(lua_rawlen(L, index));
+    append_varint(static_cast<uint64_t>(narr));
 
-    int32_t top = lua_gettop(L);
+    // hash部分的数量，只是占位。大部分table的key不超过127个，只预留1字节
+    size_t pos = _buff_len;
+    *this << (uint8_t)0;
+
+    for (lua_Integer i = 1; i <= narr; i++)
+    {
+        lua_rawgeti(L, index, i);
+        if (encode_value(L, lua_gettop(L)) < 0) return -1;
+
+        lua_pop(L, 1);
+    }
+
+    int32_t top   = lua_gettop(L);
+    uint64_t nhash = 0;
 
     lua_pushnil(L);
     while (lua_next(L, index))
     {
+        // 已经在数组部分写入
+        if (lua_isinteger(L, top + 1))
+        {
+            lua_Integer key = lua_tointeger(L, top + 1);
+            if (key >= 1 && key <= narr)
+            {
+                lua_pop(L, 1);
+                continue;
+            }
+        }
+
         // lua中用table作key是相当于用table的内存地址作key，传过去就不一样了，要注意
         //        if (LUA_TTABLE == lua_type(L, top + 1))
         //        {
         //            ELOG("table as key not support");
         //            return -1;
         //        }
-        if (encode_value(L, top + 1) < 0 || encode_value(L, top + 2))
+        if (encode_key(L, top + 1) < 0 || encode_value(L, top + 2) < 0)
         {
             return -1;
         }
 
-        count++;
+        nhash++;
         lua_pop(L, 1);
     }
 
-    *p_count = count;
+    if (nhash < 0x80)
+    {
+        _encode_buff[pos] = static_cast<char>(nhash);
+        return 0;
+    }
+
+    // 数量超过1字节时，把数据往后移动
+    char buff[10];
+    size_t size = 0;
+    uint64_t v  = nhash;
+    while (v >= 0x80)
+    {
+        buff[size++] = static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    buff[size++] = static_cast<char>(v);
+
+    if (_buff_len + size >= MAX_BUFF)
+    {
+        ELOG("buff overflow %zu", _buff_len + size);
+        return -1;
+    }
+    memmove(_encode_buff + pos + size, _encode_buff + pos + 1,
+            _buff_len - pos - 1);
+    memcpy(_encode_buff + pos, buff, size);
+    _buff_len += size - 1;
+
+    return 0;
+}
+
+int32_t LuaBinCodec::encode_key(lua_State *L, int32_t index)
+{
+    if (!_dict || LUA_TSTRING != lua_type(L, index))
+    {
+        return encode_value(L, index);
+    }
+
+    size_t len      = 0;
+    const char *key = lua_tolstring(L, index, &len);
+    if (len > MAX_DICT_KEY_LEN) return encode_value(L, index);
+
+    if (sizeof(uint8_t) + 20 + len + _buff_len >= MAX_BUFF)
+    {
+        ELOG("buff overflow %zu", sizeof(uint8_t) + 20 + len + _buff_len);
+        return -1;
+    }
+
+    int32_t id = _dict->find(key, len);
+    if (id >= 0)
+    {
+        *this << (uint8_t)LT_KEY_REF;
+        append_varint(static_cast<uint64_t>(id));
+        return 0;
+    }
+
+    id = _dict->add(key, len);
+    if (id < 0) return encode_value(L, index); // 字典已满
+
+    *this << (uint8_t)LT_KEY_DEF;
+    append_varint(static_cast<uint64_t>(id));
+    append_varint(len);
+    this->append(key, len);
+
     return 0;
 }
 
 int32_t LuaBinCodec::encode_value(lua_State *L, int32_t index)
 {
-#define CHECK_ENCODE_LEN(len)                                       \
-    if (sizeof(int8_t) + len + _buff_len >= MAX_BUFF)               \
-    {                                                               \
-        ELOG("buff overflow %s", sizeof(int8_t) + len + _buff_len); \
-        return -1;                                                  \
+#define CHECK_ENCODE_LEN(len)                                         \
+    if (sizeof(uint8_t) + len + _buff_len >= MAX_BUFF)                \
+    {                                                                 \
+        ELOG("buff overflow %zu", sizeof(uint8_t) + len + _buff_len); \
+        return -1;                                                    \
     }
 
     switch (lua_type(L, index))
     {
     case LUA_TNIL:
         CHECK_ENCODE_LEN(8);
-        *this << (int8_t)LT_NIL;
+        *this << (uint8_t)LT_NIL;
         break;
     case LUA_TBOOLEAN:
         CHECK_ENCODE_LEN(8);
-        *this << (int8_t)LT_BOOL << (int8_t)(lua_toboolean(L, index) ? 1 : 0);
+        *this << (uint8_t)(lua_toboolean(L, index) ? LT_TRUE : LT_FALSE);
         break;
     case LUA_TNUMBER:
-        CHECK_ENCODE_LEN(8);
+        CHECK_ENCODE_LEN(10);
         if (lua_isinteger(L, index))
         {
-            *this << (int8_t)LT_INT << (int64_t)lua_tointeger(L, index);
+            lua_Integer i = lua_tointeger(L, index);
+            if (i >= 0 && i < 0x80)
+            {
+                *this << (uint8_t)(LT_SMALL_INT | i);
+            }
+            else
+            {
+                // zigzag编码，绝对值小的负数也只占很少的字节
+                *this << (uint8_t)LT_INT;
+                append_varint((static_cast<uint64_t>(i) << 1)
+                              ^ static_cast<uint64_t>(i >> 63));
+            }
         }
         else
         {
-            *this << (int8_t)LT_NUM << (double)lua_tonumber(L, index);
+            *this << (uint8_t)LT_NUM << (double)lua_tonumber(L, index);
         }
         break;
     case LUA_TSTRING:
@@ -235,15 +452,15 @@ int32_t LuaBinCodec::encode_value(lua_State *L, int32_t index)
         size_t len      = 0;
         const char *str = lua_tolstring(L, index, &len);
 
-        CHECK_ENCODE_LEN(len);
-        // TODO 字符串长度用int32是否会好一点？好像也节省不了多少
-        *this << (int8_t)LT_STR << (size_t)len;
+        CHECK_ENCODE_LEN(10 + len);
+        *this << (uint8_t)LT_STR;
+        append_varint(len);
         this->append(str, len);
         break;
     }
     case LUA_TTABLE:
-        CHECK_ENCODE_LEN(16);
-        *this << (int8_t)LT_TABLE;
+        CHECK_ENCODE_LEN(24);
+        *this << (uint8_t)LT_TABLE;
         return encode_table(L, index);
     default:
         ELOG("unsupport lua type %s", lua_typename(L, lua_type(L, index)));
@@ -255,11 +472,9 @@ int32_t LuaBinCodec::encode_value(lua_State *L, int32_t index)
 #undef CHECK_ENCODE_LEN
 }
 
-int32_t LuaBinCodec::encode(lua_State *L, int32_t index, const char **buffer,
-                            const CmdCfg *cfg)
+int32_t LuaBinCodec::encode_with_dict(lua_State *L, int32_t index,
+                                      const char **buffer, LuaBinDict *dict)
 {
-    UNUSED(cfg);
-
     int top = lua_gettop(L);
     if (index > top || top - index > MAX_VARIABLE)
     {
@@ -269,13 +484,21 @@ int32_t LuaBinCodec::encode(lua_State *L, int32_t index, const char **buffer,
     }
 
     _buff_len = 0;
+    _dict     = dict;
+
+    // 编码失败时数据不会发出，本次添加到字典的key需要删除
+    size_t dict_size = dict ? dict->encode_size() : 0;
 
     // 写入数量
     *this << uint8_t(top - index + 1);
 
     for (int32_t i = index; i <= top; i++)
     {
-        if (encode_value(L, i) < 0) return -1;
+        if (encode_value(L, i) < 0)
+        {
+            if (dict) dict->rollback(dict_size);
+            return -1;
+        }
     }
 
     *buffer = _encode_buff;
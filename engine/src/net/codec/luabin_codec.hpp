@@ -1,13 +1,68 @@
 #pragma once
 
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 #include "codec.hpp"
 
+/**
+ * @brief 连接上的字符串key字典
+ * rpc的参数大多是结构相同的table，同样的字段名在每个包里都要完整地写一次。
+ * 开启字典后，table的字符串key第一次出现时连同编号一起发送，之后只发送编号。
+ * 编码、解码各自维护一份，依赖tcp的有序性与对端保持一致，因此每个连接一个，
+ * 连接断开后一起销毁
+ * 编码失败、发送失败时需要rollback，否则本端字典会多出对端没收到的key。解码出错
+ * (编号不连续、编号不存在、数据不完整、解压失败)时两端的字典已无法对齐，只能断开
+ * 连接，重连后双方都从空字典开始
+ */
+class LuaBinDict final
+{
+public:
+    /// 编码时查找key，未找到返回-1
+    int32_t find(const char *key, size_t len) const
+    {
+        auto iter = _encode_index.find(std::string_view(key, len));
+        return iter == _encode_index.end() ? -1 : iter->second;
+    }
+    /// 编码时添加key，字典已满返回-1
+    int32_t add(const char *key, size_t len);
+    /// 编码时已添加的key数量
+    size_t encode_size() const { return _encode_keys.size(); }
+    /// 编码失败时，删除本次编码添加的key，对端并没有收到
+    void rollback(size_t size);
+
+    /// 解码时设置key
+    bool set(uint32_t id, const char *key, size_t len);
+    /// 解码时获取key，不存在返回nullptr
+    const std::string *get(uint32_t id) const
+    {
+        return id < _decode_keys.size() ? &_decode_keys[id] : nullptr;
+    }
+
+private:
+    /// 字符串的地址作为map的key，deque在尾部插入、删除时不会移动其他元素
+    std::deque<std::string> _encode_keys;
+    std::unordered_map<std::string_view, int32_t> _encode_index;
+    std::vector<std::string> _decode_keys;
+};
+
 /**
  * @brief 以二进制方式编码、解码Lua变量，目前仅用于RPC调用，限定缓冲区大小为1M
+ * 整数使用zigzag、varint编码，0~127的整数只占1字节，table的数组部分和hash部分
+ * 分开计数，解码时按数量预分配table
  */
 class LuaBinCodec final : public Codec
 {
 public:
+    /**
+     * 编码格式的版本，rpc包头的_cmd字段(rpc不用协议号)填这个值，对端版本不一致时
+     * 断开连接。1为旧的定长格式，2为varint + 字典格式，修改格式时需要增加版本
+     */
+    static const uint16_t VERSION = 2;
+
     LuaBinCodec();
     ~LuaBinCodec();
 
@@ -29,19 +84,40 @@ public:
      * @return <0 error,otherwise the number of parameter push to stack
      */
     int32_t decode(lua_State *L, const char *buffer, size_t len,
-                   const CmdCfg *cfg) override;
+                   const CmdCfg *cfg) override
+    {
+        UNUSED(cfg);
+        return decode_with_dict(L, buffer, len, nullptr);
+    }
     /**
      * 编码数据包
      * @return <0 error,otherwise the length of buffer
      */
     int32_t encode(lua_State *L, int32_t index, const char **buffer,
-                   const CmdCfg *cfg) override;
+                   const CmdCfg *cfg) override
+    {
+        UNUSED(cfg);
+        return encode_with_dict(L, index, buffer, nullptr);
+    }
+
+    /**
+     * 使用连接的字典解码数据包，dict为nullptr时不使用字典
+     * @return <0 error,otherwise the number of parameter push to stack
+     */
+    int32_t decode_with_dict(lua_State *L, const char *buffer, size_t len,
+                             LuaBinDict *dict);
+    /**
+     * 使用连接的字典编码数据包，dict为nullptr时不使用字典
+     * @return <0 error,otherwise the length of buffer
+     */
+    int32_t encode_with_dict(lua_State *L, int32_t index, const char **buffer,
+                             LuaBinDict *dict);
 
 private:
     //< 把基础类型写入缓冲区，不支持指针及自定义结构
     template <typename T> LuaBinCodec &operator<<(const T &v)
     {
-        *(reinterpret_cast<T *>(_encode_buff + _buff_len)) = v;
+        memcpy(_encode_buff + _buff_len, &v, sizeof(T));
         _buff_len += sizeof(T);
         return *this;
     }
@@ -50,6 +126,15 @@ private:
         memcpy(_encode_buff + _buff_len, buff, len);
         _buff_len += len;
     }
+    void append_varint(uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            _encode_buff[_buff_len++] = static_cast<char>(v | 0x80);
+            v >>= 7;
+        }
+        _encode_buff[_buff_len++] = static_cast<char>(v);
+    }
     const char *subtract(const size_t len)
     {
         size_t pos = _buff_pos;
@@ -60,15 +145,30 @@ private:
 
     template <typename T> LuaBinCodec &operator>>(T &v)
     {
-        v = *(reinterpret_cast<const T *>(_decode_buff + _buff_pos));
+        memcpy(&v, _decode_buff + _buff_pos, sizeof(T));
         _buff_pos += sizeof(T);
         return *this;
     }
+    //< 读取一个varint，数据不完整返回false
+    bool read_varint(uint64_t &v)
+    {
+        v = 0;
+        for (int32_t shift = 0; shift < 64 && _buff_pos < _buff_len;
+             shift += 7)
+        {
+            uint8_t b = static_cast<uint8_t>(_decode_buff[_buff_pos++]);
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
 
     //< 把lua变量编码到缓冲区中
     int32_t encode_value(lua_State *L, int32_t index);
     //< 把lua table编码到缓冲区中
     int32_t encode_table(lua_State *L, int32_t index);
+    //< 把table的字符串key编码到缓冲区中，有字典时使用字典
+    int32_t encode_key(lua_State *L, int32_t index);
 
     //< 从缓冲区解码数据到lua中
     int32_t decode_value(lua_State *L);
@@ -80,4 +180,5 @@ private:
     size_t _buff_pos;   // 已读取的缓冲区长度，仅decode时用到
     char *_encode_buff; // 用于序列化的缓冲区，避免内存分配
     const char *_decode_buff; // 反序列化缓冲区
+    LuaBinDict *_dict;  // 当前编码、解码使用的字典
 };
@@ -8,6 +8,7 @@
 #include <filesystem>
 
 #include "protobuf_codec.hpp"
+#include "protobuf_plan.hpp"
 
 /* check if suffix match */
 static int is_suffix_file(const char *path, const char *suffix)
@@ -49,13 +50,16 @@ public:
 
     void reset();
 
-    int32_t encode(lua_State *L, const char *object, int32_t index);
-    int32_t decode(lua_State *L, const char *object, const char *buffer,
+    int32_t encode(lua_State *L, const CmdCfg *cfg, int32_t index);
+    int32_t decode(lua_State *L, const CmdCfg *cfg, const char *buffer,
                    size_t size);
 
     const char *last_error();
     void get_buffer(struct pbc_slice &slice);
 
+    /// 是否使用编码计划，关闭后全部使用pbc
+    void set_plan(bool on) { _plan_on = on; }
+
     int32_t load_file(const char *paeth);
     int32_t load_path(const char *path, const char *suffix = "pb");
 
@@ -80,7 +84,12 @@ private:
     int32_t push_value(lua_State *L, int type, const char *object,
                        union pbc_value *v);
 
+    const ProtobufPlan::Message *get_plan(const CmdCfg *cfg);
+
 private:
+    bool _plan_on;  // 是否使用编码计划
+    bool _use_plan; // 最后一次编码、解码是否使用了编码计划
+    ProtobufPlan _plan;
     struct pbc_env *_env;
     struct pbc_wmessage *_write_msg;
 
@@ -92,6 +101,8 @@ lprotobuf::lprotobuf()
 {
     _env       = pbc_new();
     _write_msg = NULL;
+    _plan_on   = true;
+    _use_plan  = false;
 }
 
 lprotobuf::~lprotobuf()
@@ -113,6 +124,7 @@ void lprotobuf::reset()
     }
 
     _write_msg = NULL;
+    _use_plan  = false;
     _error_msg.clear();
     _trace_back.clear();
 }
@@ -159,6 +171,12 @@ int32_t lprotobuf::load_file(const char *path)
         return -1;
     }
 
+    // 编译失败的只是没有编码计划，仍可以使用pbc编码、解码
+    if (_plan.load((const char *)slice.buffer, slice.len) < 0)
+    {
+        ELOG("protobuf plan load error, use pbc instead:%s", path);
+    }
+
     delete[](char *) slice.buffer;
     return 0;
 }
@@ -200,8 +218,25 @@ int32_t lprotobuf::load_path(const char *path, const char *suffix)
     return count;
 }
 
+const ProtobufPlan::Message *lprotobuf::get_plan(const CmdCfg *cfg)
+{
+    if (!_plan_on) return nullptr;
+
+    // 查找结果缓存在CmdCfg中，只有重新加载了描述文件才需要再次查找
+    int32_t version = _plan.get_version();
+    if (cfg->_plan_ver != version)
+    {
+        cfg->_plan     = _plan.find(cfg->_object);
+        cfg->_plan_ver = version;
+    }
+
+    return static_cast<const ProtobufPlan::Message *>(cfg->_plan);
+}
+
 const char *lprotobuf::last_error()
 {
+    if (_use_plan) return _plan.last_error();
+
     const char *env_e = pbc_error(_env);
     if (env_e && strlen(env_e) > 0)
     {
@@ -223,16 +258,32 @@ const char *lprotobuf::last_error()
 
 void lprotobuf::get_buffer(struct pbc_slice &slice)
 {
+    if (_use_plan)
+    {
+        const std::string &buffer = _plan.get_buffer();
+
+        slice.buffer = const_cast<char *>(buffer.data());
+        slice.len    = static_cast<int>(buffer.size());
+        return;
+    }
+
     assert(_write_msg);
 
     pbc_wmessage_buffer(_write_msg, &slice);
 }
 
-int32_t lprotobuf::decode(lua_State *L, const char *object, const char *buffer,
+int32_t lprotobuf::decode(lua_State *L, const CmdCfg *cfg, const char *buffer,
                           size_t size)
 {
     reset();
 
+    const ProtobufPlan::Message *plan = get_plan(cfg);
+    if (plan)
+    {
+        _use_plan = true;
+        return _plan.decode(L, plan, buffer, size);
+    }
+
     struct pbc_slice slice;
     slice.len    = static_cast<int32_t>(size);
     slice.buffer = const_cast<char *>(buffer);
@@ -244,8 +295,7 @@ int32_t lprotobuf::decode(lua_State *L, const char *object, const char *buffer,
      * 而pbc_decode的方式则是在解析过程中直接放到lua表，稍微快一些
      */
 
-    return decode_message(L, object, &slice);
-    ;
+    return decode_message(L, cfg->_object, &slice);
 }
 
 int32_t lprotobuf::decode_message(lua_State *L, const char *object,
@@ -369,12 +419,20 @@ int32_t lprotobuf::push_value(lua_State *L, int type, const char *object,
     return 0;
 }
 
-int32_t lprotobuf::encode(lua_State *L, const char *object, int32_t index)
+int32_t lprotobuf::encode(lua_State *L, const CmdCfg *cfg, int32_t index)
 {
     reset();
 
+    const ProtobufPlan::Message *plan = get_plan(cfg);
+    if (plan)
+    {
+        _use_plan = true;
+        return _plan.encode(L, plan, index);
+    }
+
     assert(NULL == _write_msg);
 
+    const char *object = cfg->_object;
     _write_msg = pbc_wmessage_new(_env, object);
     if (!_write_msg)
     {
@@ -539,6 +597,7 @@ int32_t lprotobuf::raw_encode(lua_State *L, struct pbc_wmessage *wmsg,
 ////////////////////////////////////////////////////////////////////////////////
 ProtobufCodec::ProtobufCodec()
 {
+    _plan_on         = true;
     _is_proto_loaded = false;
     _lprotobuf       = new class lprotobuf();
 }
@@ -561,6 +620,13 @@ void ProtobufCodec::reset()
 {
     delete _lprotobuf;
     _lprotobuf = new class lprotobuf();
+    _lprotobuf->set_plan(_plan_on);
+}
+
+void ProtobufCodec::set_plan(bool on)
+{
+    _plan_on = on;
+    _lprotobuf->set_plan(on);
 }
 
 int32_t ProtobufCodec::load_path(const char *path)
@@ -584,7 +650,7 @@ int32_t ProtobufCodec::load_file(const char *path)
 int32_t ProtobufCodec::decode(lua_State *L, const char *buffer, size_t len,
                               const CmdCfg *cfg)
 {
-    if (_lprotobuf->decode(L, cfg->_object, buffer, len) < 0)
+    if (_lprotobuf->decode(L, cfg, buffer, len) < 0)
     {
         ELOG("protobuf decode:%s", _lprotobuf->last_error());
         return -1;
@@ -601,7 +667,7 @@ int32_t ProtobufCodec::decode(lua_State *L, const char *buffer, size_t len,
 int32_t ProtobufCodec::encode(lua_State *L, int32_t index, const char **buffer,
                               const CmdCfg *cfg)
 {
-    if (_lprotobuf->encode(L, cfg->_object, index) < 0)
+    if (_lprotobuf->encode(L, cfg, index) < 0)
     {
         ELOG("protobuf encode:%s", _lprotobuf->last_error());
         return -1;
@@ -25,7 +25,14 @@ public:
     int32_t encode(lua_State *L, int32_t index, const char **buffer,
                    const CmdCfg *cfg) override;
 
+    /**
+     * 是否使用编码计划(见ProtobufPlan)，默认开启。关闭后全部使用pbc编码、解码，
+     * 用于对比两者的结果，或者编码计划有问题时临时切回pbc
+     */
+    void set_plan(bool on);
+
 private:
+    bool _plan_on;
     bool _is_proto_loaded;
     class lprotobuf *_lprotobuf;
 };
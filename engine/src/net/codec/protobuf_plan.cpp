@@ -0,0 +1,1127 @@
+#include <cstring>
+#include <lua.hpp>
+
+#include "protobuf_plan.hpp"
+
+// 嵌套message的最大层数，防止循环引用的数据导致栈溢出
+#define MAX_PLAN_DEPTH 64
+// 字段号小于该值时，用数组来索引字段
+#define MAX_PLAN_INDEX 1024
+
+// 注册表中key表的地址
+static const char PLAN_KEYS_TAG = 0;
+// 每个计划对象、每次加载都分配一个新版本
+static int32_t plan_version = 0;
+
+/// 读取描述文件、解码时使用的wire格式读取
+class WireReader
+{
+public:
+    WireReader(const char *buffer, size_t size)
+        : _pos(buffer), _end(buffer + size)
+    {
+    }
+
+    bool eof() const { return _pos >= _end; }
+
+    static bool read_varint(const char *&pos, const char *end, uint64_t &val)
+    {
+        val = 0;
+        for (int32_t shift = 0; shift < 64 && pos < end; shift += 7)
+        {
+            uint8_t b = static_cast<uint8_t>(*pos++);
+            val |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    static bool skip(const char *&pos, const char *end, int32_t wire)
+    {
+        uint64_t val = 0;
+        switch (wire)
+        {
+        case ProtobufPlan::WT_VARINT: return read_varint(pos, end, val);
+        case ProtobufPlan::WT_I64:
+            if (end - pos < 8) return false;
+            pos += 8;
+            return true;
+        case ProtobufPlan::WT_LEN:
+            if (!read_varint(pos, end, val) || val > (uint64_t)(end - pos))
+            {
+                return false;
+            }
+            pos += val;
+            return true;
+        case ProtobufPlan::WT_I32:
+            if (end - pos < 4) return false;
+            pos += 4;
+            return true;
+        default: return false;
+        }
+    }
+
+    /**
+     * @brief 读取下一个字段
+     * @return 是否成功，wire type为WT_LEN时，data、len为字段内容，否则val为字段值
+     */
+    bool next(int32_t &id, int32_t &wire, uint64_t &val, const char *&data,
+              size_t &len)
+    {
+        uint64_t tag = 0;
+        if (!read_varint(_pos, _end, tag)) return false;
+
+        id   = static_cast<int32_t>(tag >> 3);
+        wire = static_cast<int32_t>(tag & 0x07);
+        if (ProtobufPlan::WT_LEN == wire)
+        {
+            if (!read_varint(_pos, _end, val) || val > (uint64_t)(_end - _pos))
+            {
+                return false;
+            }
+            data = _pos;
+            len  = static_cast<size_t>(val);
+            _pos += len;
+            return true;
+        }
+        if (ProtobufPlan::WT_VARINT == wire)
+        {
+            return read_varint(_pos, _end, val);
+        }
+
+        // 描述文件中用到的字段没有fixed类型，直接跳过
+        val = 0;
+        return skip(_pos, _end, wire);
+    }
+
+private:
+    const char *_pos;
+    const char *_end;
+};
+
+/// 获取字段类型对应的wire type，不支持的类型返回-1
+static int32_t type_to_wire(int32_t type)
+{
+    switch (type)
+    {
+    case ProtobufPlan::TYPE_INT64:
+    case ProtobufPlan::TYPE_UINT64:
+    case ProtobufPlan::TYPE_INT32:
+    case ProtobufPlan::TYPE_BOOL:
+    case ProtobufPlan::TYPE_UINT32:
+    case ProtobufPlan::TYPE_ENUM:
+    case ProtobufPlan::TYPE_SINT32:
+    case ProtobufPlan::TYPE_SINT64: return ProtobufPlan::WT_VARINT;
+    case ProtobufPlan::TYPE_DOUBLE:
+    case ProtobufPlan::TYPE_FIXED64:
+    case ProtobufPlan::TYPE_SFIXED64: return ProtobufPlan::WT_I64;
+    case ProtobufPlan::TYPE_FLOAT:
+    case ProtobufPlan::TYPE_FIXED32:
+    case ProtobufPlan::TYPE_SFIXED32: return ProtobufPlan::WT_I32;
+    case ProtobufPlan::TYPE_STRING:
+    case ProtobufPlan::TYPE_MESSAGE:
+    case ProtobufPlan::TYPE_BYTES: return ProtobufPlan::WT_LEN;
+    default: return -1;
+    }
+}
+
+ProtobufPlan::ProtobufPlan()
+{
+    _version = ++plan_version;
+    _keys.emplace_back(); // 下标从1开始，和lua数组一致
+}
+
+ProtobufPlan::~ProtobufPlan() {}
+
+int32_t ProtobufPlan::new_key(const std::string &name)
+{
+    auto iter = _key_index.find(name);
+    if (iter != _key_index.end()) return iter->second;
+
+    int32_t index = static_cast<int32_t>(_keys.size());
+    _keys.push_back(name);
+    _key_index[name] = index;
+
+    return index;
+}
+
+int32_t ProtobufPlan::load(const char *buffer, size_t size)
+{
+    // 新加载的文件可能包含之前缺少的依赖类型，链接失败的需要重新链接
+    for (auto &iter : _messages)
+    {
+        Message *msg = iter.second.get();
+        if (Message::LS_FAIL == msg->_state) msg->_state = Message::LS_NONE;
+    }
+    _version = ++plan_version;
+
+    // FileDescriptorSet { repeated FileDescriptorProto file = 1; }
+    int32_t id   = 0;
+    int32_t wire = 0;
+    uint64_t val = 0;
+    const char *data = nullptr;
+    size_t len       = 0;
+    WireReader reader(buffer, size);
+    while (!reader.eof())
+    {
+        if (!reader.next(id, wire, val, data, len)) return -1;
+
+        if (1 == id && WT_LEN == wire && load_file(data, len) < 0) return -1;
+    }
+
+    return 0;
+}
+
+int32_t ProtobufPlan::load_file(const char *buffer, size_t size)
+{
+    // FileDescriptorProto { name = 1; package = 2; message_type = 4;
+    //  enum_type = 5; }
+    int32_t id   = 0;
+    int32_t wire = 0;
+    uint64_t val = 0;
+    const char *data = nullptr;
+    size_t len       = 0;
+    std::string package;
+
+    // package可能在message之后，先找出package
+    WireReader reader(buffer, size);
+    while (!reader.eof())
+    {
+        if (!reader.next(id, wire, val, data, len)) return -1;
+        if (2 == id && WT_LEN == wire) package.assign(data, len);
+    }
+
+    WireReader body(buffer, size);
+    while (!body.eof())
+    {
+        if (!body.next(id, wire, val, data, len)) return -1;
+        if (WT_LEN != wire) continue;
+
+        if (4 == id)
+        {
+            if (load_message(package, data, len) < 0) return -1;
+        }
+        else if (5 == id)
+        {
+            if (load_enum(package, data, len) < 0) return -1;
+        }
+    }
+
+    return 0;
+}
+
+int32_t ProtobufPlan::load_message(const std::string &prefix,
+                                   const char *buffer, size_t size)
+{
+    // DescriptorProto { name = 1; field = 2; nested_type = 3; enum_type = 4; }
+    int32_t id   = 0;
+    int32_t wire = 0;
+    uint64_t val = 0;
+    const char *data = nullptr;
+    size_t len       = 0;
+    std::string name;
+
+    WireReader reader(buffer, size);
+    while (!reader.eof())
+    {
+        if (!reader.next(id, wire, val, data, len)) return -1;
+        if (1 == id && WT_LEN == wire) name.assign(data, len);
+    }
+    if (name.empty()) return -1;
+
+    std::string full_name = prefix.empty() ? name : prefix + "." + name;
+
+    // 重复加载同一个文件时，保留之前的定义，其他message可能引用了它
+    bool exist = _messages.find(full_name) != _messages.end();
+
+    auto msg    = std::make_unique<Message>();
+    msg->_name  = full_name;
+    msg->_state = Message::LS_NONE;
+
+    WireReader body(buffer, size);
+    while (!body.eof())
+    {
+        if (!body.next(id, wire, val, data, len)) return -1;
+        if (WT_LEN != wire) continue;
+
+        switch (id)
+        {
+        case 2:
+            if (load_field(*msg, data, len) < 0) return -1;
+            break;
+        case 3:
+            if (load_message(full_name, data, len) < 0) return -1;
+            break;
+        case 4:
+            if (load_enum(full_name, data, len) < 0) return -1;
+            break;
+        default: break;
+        }
+    }
+
+    if (exist) return 0;
+
+    int32_t max_id = 0;
+    for (const Field &field : msg->_fields)
+    {
+        if (field._id > max_id) max_id = field._id;
+    }
+
+    if (max_id < MAX_PLAN_INDEX)
+    {
+        msg->_index.resize(max_id + 1, 0);
+        for (size_t i = 0; i < msg->_fields.size(); i++)
+        {
+            msg->_index[msg->_fields[i]._id] = static_cast<int32_t>(i + 1);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < msg->_fields.size(); i++)
+        {
+            msg->_index_map[msg->_fields[i]._id] = static_cast<int32_t>(i);
+        }
+    }
+
+    _messages[full_name] = std::move(msg);
+
+    return 0;
+}
+
+int32_t ProtobufPlan::load_field(Message &msg, const char *buffer, size_t size)
+{
+    // FieldDescriptorProto { name = 1; number = 3; label = 4; type = 5;
+    //  type_name = 6; default_value = 7; options = 8; }
+    int32_t id   = 0;
+    int32_t wire = 0;
+    uint64_t val = 0;
+    const char *data = nullptr;
+    size_t len       = 0;
+
+    Field field;
+    field._id       = 0;
+    field._type     = 0;
+    field._repeated = false;
+    field._packed   = false;
+    field._message  = nullptr;
+    field._enum     = nullptr;
+    field._def_i    = 0;
+    field._def_d    = 0.0;
+
+    WireReader reader(buffer, size);
+    while (!reader.eof())
+    {
+        if (!reader.next(id, wire, val, data, len)) return -1;
+
+        switch (id)
+        {
+        case 1: field._name.assign(data, len); break;
+        case 3: field._id = static_cast<int32_t>(val); break;
+        case 4: field._repeated = (3 == val); break; // LABEL_REPEATED = 3
+        case 5: field._type = static_cast<int32_t>(val); break;
+        case 6:
+            // 描述文件中的类型名是全名，以.开头
+            if (len > 0 && '.' == *data)
+            {
+                data++;
+                len--;
+            }
+            field._type_name.assign(data, len);
+            break;
+        case 7: field._default.assign(data, len); break;
+        case 8:
+        {
+            // FieldOptions { bool packed = 2; }
+            int32_t opt_id   = 0;
+            int32_t opt_wire = 0;
+            uint64_t opt_val = 0;
+            const char *opt_data = nullptr;
+            size_t opt_len       = 0;
+            WireReader opt(data, len);
+            while (!opt.eof())
+            {
+                if (!opt.next(opt_id, opt_wire, opt_val, opt_data, opt_len))
+                {
+                    return -1;
+                }
+                if (2 == opt_id && WT_VARINT == opt_wire)
+                {
+                    field._packed = 0 != opt_val;
+                }
+            }
+            break;
+        }
+        default: break;
+        }
+    }
+
+    if (field._name.empty() || field._id <= 0) return -1;
+
+    field._key  = new_key(field._name);
+    field._wire = type_to_wire(field._type);
+    if (field._packed && (!field._repeated || WT_LEN == field._wire))
+    {
+        field._packed = false;
+    }
+
+    msg._fields.push_back(std::move(field));
+    return 0;
+}
+
+int32_t ProtobufPlan::load_enum(const std::string &prefix, const char *buffer,
+                                size_t size)
+{
+    // EnumDescriptorProto { name = 1; value = 2; }
+    // EnumValueDescriptorProto { name = 1; number = 2; }
+    int32_t id   = 0;
+    int32_t wire = 0;
+    uint64_t val = 0;
+    const char *data = nullptr;
+    size_t len       = 0;
+
+    auto e      = std::make_unique<Enum>();
+    e->_default = 0;
+
+    bool first = true;
+    WireReader reader(buffer, size);
+    while (!reader.eof())
+    {
+        if (!reader.next(id, wire, val, data, len)) return -1;
+        if (WT_LEN != wire) continue;
+
+        if (1 == id)
+        {
+            e->_name.assign(data, len);
+            continue;
+        }
+        if (2 != id) continue;
+
+        std::string name;
+        int32_t number = 0;
+
+        int32_t v_id   = 0;
+        int32_t v_wire = 0;
+        uint64_t v_val = 0;
+        const char *v_data = nullptr;
+        size_t v_len       = 0;
+        WireReader value(data, len);
+        while (!value.eof())
+        {
+            if (!value.next(v_id, v_wire, v_val, v_data, v_len)) return -1;
+
+            if (1 == v_id && WT_LEN == v_wire)
+            {
+                name.assign(v_data, v_len);
+            }
+            else if (2 == v_id && WT_VARINT == v_wire)
+            {
+                number = static_cast<int32_t>(v_val);
+            }
+        }
+
+        if (first)
+        {
+            first       = false;
+            e->_default = number;
+        }
+
+        // 别名(allow_alias)解码时使用第一个名字
+        e->_keys.emplace(number, new_key(name));
+        e->_values.emplace(name, number);
+    }
+    if (e->_name.empty()) return -1;
+
+    std::string full_name =
+        prefix.empty() ? e->_name : prefix + "." + e->_name;
+    if (_enums.find(full_name) != _enums.end()) return 0;
+
+    e->_name = full_name;
+    _enums[full_name] = std::move(e);
+
+    return 0;
+}
+
+bool ProtobufPlan::link_field(Field &field)
+{
+    switch (field._type)
+    {
+    case TYPE_MESSAGE:
+    {
+        auto iter = _messages.find(field._type_name);
+        if (iter == _messages.end() || !link(iter->second.get())) return false;
+
+        field._message = iter->second.get();
+        return true;
+    }
+    case TYPE_ENUM:
+    {
+        auto iter = _enums.find(field._type_name);
+        if (iter == _enums.end()) return false;
+
+        field._enum  = iter->second.get();
+        field._def_i = field._enum->_default;
+        if (!field._default.empty())
+        {
+            auto val = field._enum->_values.find(field._default);
+            if (val != field._enum->_values.end()) field._def_i = val->second;
+        }
+        return true;
+    }
+    case TYPE_DOUBLE:
+    case TYPE_FLOAT:
+        if (!field._default.empty())
+        {
+            field._def_d = strtod(field._default.c_str(), nullptr);
+        }
+        return true;
+    case TYPE_BOOL:
+        field._def_i = "true" == field._default ? 1 : 0;
+        return true;
+    case TYPE_STRING:
+    case TYPE_BYTES: return true;
+    default:
+        if (field._wire < 0) return false; // group等不支持的类型
+
+        if (!field._default.empty())
+        {
+            field._def_i = strtoll(field._default.c_str(), nullptr, 10);
+        }
+        return true;
+    }
+}
+
+bool ProtobufPlan::link(Message *msg)
+{
+    switch (msg->_state)
+    {
+    case Message::LS_OK:
+    case Message::LS_LINKING: return true;
+    case Message::LS_FAIL: return false;
+    default: break;
+    }
+
+    msg->_state = Message::LS_LINKING;
+    for (Field &field : msg->_fields)
+    {
+        if (!link_field(field))
+        {
+            msg->_state = Message::LS_FAIL;
+            return false;
+        }
+    }
+    msg->_state = Message::LS_OK;
+
+    return true;
+}
+
+const ProtobufPlan::Message *ProtobufPlan::find(const char *name)
+{
+    auto iter = _messages.find(name);
+    if (iter == _messages.end()) return nullptr;
+
+    Message *msg = iter->second.get();
+    return link(msg) ? msg : nullptr;
+}
+
+const char *ProtobufPlan::last_error()
+{
+    _error.append(" @ ");
+    for (auto rit = _trace.rbegin(); rit != _trace.rend(); rit++)
+    {
+        _error.append("[").append(*rit).append("]");
+    }
+
+    return _error.c_str();
+}
+
+void ProtobufPlan::push_keys(lua_State *L)
+{
+    // 同一个lua虚拟机可能先后用于多个计划对象，以版本区分
+    if (LUA_TTABLE == lua_rawgetp(L, LUA_REGISTRYINDEX, &PLAN_KEYS_TAG))
+    {
+        lua_rawgeti(L, -1, 0);
+        bool ok = lua_tointeger(L, -1) == _version;
+        lua_pop(L, 1);
+        if (ok) return;
+    }
+    lua_pop(L, 1);
+
+    int32_t size = static_cast<int32_t>(_keys.size());
+    lua_createtable(L, size, 1);
+    for (int32_t i = 1; i < size; i++)
+    {
+        const std::string &key = _keys[i];
+        lua_pushlstring(L, key.c_str(), key.size());
+        lua_rawseti(L, -2, i);
+    }
+    lua_pushinteger(L, _version);
+    lua_rawseti(L, -2, 0);
+
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &PLAN_KEYS_TAG);
+}
+
+void ProtobufPlan::append_varint(uint64_t val)
+{
+    char buff[10];
+    int32_t len = 0;
+    while (val >= 0x80)
+    {
+        buff[len++] = static_cast<char>(val | 0x80);
+        val >>= 7;
+    }
+    buff[len++] = static_cast<char>(val);
+
+    _buffer.append(buff, len);
+}
+
+void ProtobufPlan::set_length(size_t pos)
+{
+    size_t len = _buffer.size() - pos - 1;
+    if (len < 0x80)
+    {
+        _buffer[pos] = static_cast<char>(len);
+        return;
+    }
+
+    // 长度超过1字节时，把数据往后移动
+    char buff[10];
+    int32_t size = 0;
+    while (len >= 0x80)
+    {
+        buff[size++] = static_cast<char>(len | 0x80);
+        len >>= 7;
+    }
+    buff[size++] = static_cast<char>(len);
+
+    _buffer.insert(pos + 1, size - 1, 0);
+    memcpy(&_buffer[pos], buff, size);
+}
+
+int32_t ProtobufPlan::encode(lua_State *L, const Message *msg, int32_t index)
+{
+    _buffer.clear();
+    _error.clear();
+    _trace.clear();
+
+    if (!lua_istable(L, index))
+    {
+        _error = STD_FMT("protobuf encode expect a table at %d", index);
+        return -1;
+    }
+    if (!lua_checkstack(L, 4))
+    {
+        _error = STD_FMT("protobuf encode stack overflow: %d", lua_gettop(L));
+        return -1;
+    }
+
+    int32_t top = lua_gettop(L);
+    index       = lua_absindex(L, index);
+
+    push_keys(L);
+    int32_t e = encode_message(L, msg, index, top + 1, 0);
+
+    // 出错时中间可能有残留的值，统一还原
+    lua_settop(L, top);
+    return e;
+}
+
+int32_t ProtobufPlan::encode_message(lua_State *L, const Message *msg,
+                                     int32_t index, int32_t keys,
+                                     int32_t depth)
+{
+    if (depth > MAX_PLAN_DEPTH || !lua_checkstack(L, 4))
+    {
+        _error = STD_FMT("protobuf encode too deep: %s", msg->_name.c_str());
+        return -1;
+    }
+
+    for (const Field &field : msg->_fields)
+    {
+        lua_rawgeti(L, keys, field._key);
+        if (LUA_TNIL == lua_rawget(L, index))
+        {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        int32_t top = lua_gettop(L);
+        int32_t e   = field._repeated
+                          ? encode_repeated(L, field, top, keys, depth)
+                          : encode_field(L, field, top, keys, depth, true);
+        if (e < 0)
+        {
+            _trace.push_back(msg->_name);
+            return -1;
+        }
+        lua_pop(L, 1);
+    }
+
+    return 0;
+}
+
+int32_t ProtobufPlan::encode_repeated(lua_State *L, const Field &field,
+                                     int32_t index, int32_t keys,
+                                     int32_t depth)
+{
+    if (!lua_istable(L, index))
+    {
+        _error = STD_FMT("field(%s) expect a table", field._name.c_str());
+        return -1;
+    }
+
+    if (field._packed) return encode_packed(L, field, index);
+
+    lua_pushnil(L);
+    while (lua_next(L, index))
+    {
+        if (encode_field(L, field, index + 2, keys, depth, false) < 0)
+        {
+            return -1;
+        }
+        lua_pop(L, 1);
+    }
+
+    return 0;
+}
+
+int32_t ProtobufPlan::encode_packed(lua_State *L, const Field &field,
+                                   int32_t index)
+{
+    size_t count = lua_rawlen(L, index);
+    if (0 == count) return 0;
+
+    append_varint(static_cast<uint64_t>(field._id) << 3 | WT_LEN);
+
+    // 先预留1字节长度，大部分数组都不超过127字节，超过时再移动数据
+    size_t pos = _buffer.size();
+    _buffer.push_back(0);
+
+    lua_pushnil(L);
+    while (lua_next(L, index))
+    {
+        if (encode_value(L, field, index + 2, false) < 0) return -1;
+        lua_pop(L, 1);
+    }
+
+    set_length(pos);
+
+    return 0;
+}
+
+int32_t ProtobufPlan::encode_field(lua_State *L, const Field &field,
+                                  int32_t index, int32_t keys, int32_t depth,
+                                  bool skip_default)
+{
+    if (TYPE_MESSAGE != field._type)
+    {
+        // 需要先判断是否为默认值，默认值不写入tag
+        size_t pos = _buffer.size();
+        append_varint(static_cast<uint64_t>(field._id) << 3 | field._wire);
+
+        size_t tag_end = _buffer.size();
+        if (encode_value(L, field, index, skip_default) < 0) return -1;
+
+        if (tag_end == _buffer.size()) _buffer.resize(pos);
+        return 0;
+    }
+
+    if (!lua_istable(L, index))
+    {
+        _trace.push_back(field._name);
+        _error = STD_FMT("field(%s) expect table,got %s", field._name.c_str(),
+                         lua_typename(L, lua_type(L, index)));
+        return -1;
+    }
+    if (!field._message)
+    {
+        _error = STD_FMT("field(%s) type not found: %s", field._name.c_str(),
+                         field._type_name.c_str());
+        return -1;
+    }
+
+    append_varint(static_cast<uint64_t>(field._id) << 3 | WT_LEN);
+
+    size_t pos = _buffer.size();
+    _buffer.push_back(0);
+    if (encode_message(L, field._message, index, keys, depth + 1) < 0)
+    {
+        _trace.push_back(field._name);
+        return -1;
+    }
+
+    set_length(pos);
+
+    return 0;
+}
+
+int32_t ProtobufPlan::encode_value(lua_State *L, const Field &field,
+                                  int32_t index, bool skip_default)
+{
+#define LUAL_CHECK(TYPE)                                                     \
+    if (!lua_is##TYPE(L, index))                                             \
+    {                                                                        \
+        _trace.push_back(field._name);                                       \
+        _error = STD_FMT("field(%s) expect " #TYPE ",got %s",                \
+                         field._name.c_str(), lua_typename(L, lua_type(L, index))); \
+        return -1;                                                           \
+    }
+
+    switch (field._type)
+    {
+    case TYPE_INT32:
+    case TYPE_ENUM:
+    {
+        LUAL_CHECK(integer)
+        // 负数按int64编码，占10字节
+        int64_t val = static_cast<int32_t>(lua_tointeger(L, index));
+        if (skip_default && val == field._def_i) return 0;
+        append_varint(static_cast<uint64_t>(val));
+        break;
+    }
+    case TYPE_INT64:
+    case TYPE_UINT64:
+    case TYPE_UINT32:
+    {
+        LUAL_CHECK(integer)
+        int64_t val = lua_tointeger(L, index);
+        if (TYPE_UINT32 == field._type) val = static_cast<uint32_t>(val);
+        if (skip_default && val == field._def_i) return 0;
+        append_varint(static_cast<uint64_t>(val));
+        break;
+    }
+    case TYPE_SINT32:
+    case TYPE_SINT64:
+    {
+        LUAL_CHECK(integer)
+        int64_t val = lua_tointeger(L, index);
+        if (TYPE_SINT32 == field._type) val = static_cast<int32_t>(val);
+        if (skip_default && val == field._def_i) return 0;
+        append_varint((static_cast<uint64_t>(val) << 1)
+                      ^ static_cast<uint64_t>(val >> 63));
+        break;
+    }
+    case TYPE_FIXED32:
+    case TYPE_SFIXED32:
+    {
+        LUAL_CHECK(integer)
+        int64_t val = lua_tointeger(L, index);
+        if (skip_default && val == field._def_i) return 0;
+        uint32_t v32 = static_cast<uint32_t>(val);
+        _buffer.append(reinterpret_cast<const char *>(&v32), sizeof(v32));
+        break;
+    }
+    case TYPE_FIXED64:
+    case TYPE_SFIXED64:
+    {
+        LUAL_CHECK(integer)
+        int64_t val = lua_tointeger(L, index);
+        if (skip_default && val == field._def_i) return 0;
+        _buffer.append(reinterpret_cast<const char *>(&val), sizeof(val));
+        break;
+    }
+    case TYPE_BOOL:
+    {
+        int64_t val = lua_toboolean(L, index);
+        if (skip_default && val == field._def_i) return 0;
+        _buffer.push_back(static_cast<char>(val));
+        break;
+    }
+    case TYPE_DOUBLE:
+    {
+        LUAL_CHECK(number)
+        double val = lua_tonumber(L, index);
+        if (skip_default && val == field._def_d) return 0;
+        _buffer.append(reinterpret_cast<const char *>(&val), sizeof(val));
+        break;
+    }
+    case TYPE_FLOAT:
+    {
+        LUAL_CHECK(number)
+        float val = static_cast<float>(lua_tonumber(L, index));
+        if (skip_default && val == field._def_d) return 0;
+        _buffer.append(reinterpret_cast<const char *>(&val), sizeof(val));
+        break;
+    }
+    case TYPE_STRING:
+    case TYPE_BYTES:
+    {
+        LUAL_CHECK(string)
+        size_t len      = 0;
+        const char *val = lua_tolstring(L, index, &len);
+        if (skip_default && len == field._default.size()
+            && 0 == memcmp(val, field._default.c_str(), len))
+        {
+            return 0;
+        }
+        append_varint(len);
+        _buffer.append(val, len);
+        break;
+    }
+    default:
+        _error = STD_FMT("protobuf unknow type: %d", field._type);
+        return -1;
+    }
+    return 0;
+
+#undef LUAL_CHECK
+}
+
+int32_t ProtobufPlan::decode(lua_State *L, const Message *msg,
+                             const char *buffer, size_t size)
+{
+    _error.clear();
+    _trace.clear();
+
+    if (!lua_checkstack(L, 4))
+    {
+        _error = STD_FMT("protobuf decode stack overflow:%s", msg->_name.c_str());
+        return -1;
+    }
+
+    int32_t top = lua_gettop(L);
+    push_keys(L);
+    if (decode_message(L, msg, buffer, size, top + 1, 0) < 0)
+    {
+        lua_settop(L, top);
+        return -1;
+    }
+
+    lua_remove(L, top + 1);
+    return 0;
+}
+
+int32_t ProtobufPlan::decode_message(lua_State *L, const Message *msg,
+                                     const char *buffer, size_t size,
+                                     int32_t keys, int32_t depth)
+{
+    if (depth > MAX_PLAN_DEPTH || !lua_checkstack(L, 4))
+    {
+        _error = STD_FMT("protobuf decode too deep:%s", msg->_name.c_str());
+        return -1;
+    }
+
+    lua_createtable(L, 0, static_cast<int32_t>(msg->_fields.size()));
+    int32_t index = lua_gettop(L);
+
+    const char *pos = buffer;
+    const char *end = buffer + size;
+    while (pos < end)
+    {
+        uint64_t tag = 0;
+        if (!WireReader::read_varint(pos, end, tag))
+        {
+            _error = STD_FMT("protobuf decode tag error:%s", msg->_name.c_str());
+            return -1;
+        }
+
+        int32_t wire       = static_cast<int32_t>(tag & 0x07);
+        const Field *field = msg->find(static_cast<int32_t>(tag >> 3));
+        if (!field)
+        {
+            // 未定义的字段，可能是新版本协议加的，跳过
+            if (!WireReader::skip(pos, end, wire))
+            {
+                _error = STD_FMT("protobuf decode skip error:%s",
+                                 msg->_name.c_str());
+                return -1;
+            }
+            continue;
+        }
+
+        if (!field->_repeated)
+        {
+            lua_rawgeti(L, keys, field->_key);
+            if (decode_value(L, *field, wire, pos, end, keys, depth) < 0)
+            {
+                _trace.push_back(msg->_name);
+                return -1;
+            }
+            lua_rawset(L, index);
+            continue;
+        }
+
+        // 同一个数组的元素不一定是连续的，每次都从table中取
+        lua_rawgeti(L, keys, field->_key);
+        if (LUA_TTABLE != lua_rawget(L, index))
+        {
+            lua_pop(L, 1);
+            lua_createtable(L, 4, 0);
+            lua_rawgeti(L, keys, field->_key);
+            lua_pushvalue(L, -2);
+            lua_rawset(L, index);
+        }
+
+        lua_Integer n = static_cast<lua_Integer>(lua_rawlen(L, -1));
+        if (WT_LEN == wire && WT_LEN != field->_wire)
+        {
+            // packed数组
+            uint64_t len = 0;
+            if (!WireReader::read_varint(pos, end, len)
+                || len > (uint64_t)(end - pos))
+            {
+                _error = STD_FMT("field(%s) packed length error",
+                                 field->_name.c_str());
+                _trace.push_back(msg->_name);
+                return -1;
+            }
+
+            const char *packed_end = pos + len;
+            while (pos < packed_end)
+            {
+                if (decode_value(L, *field, field->_wire, pos, packed_end, keys,
+                                 depth)
+                    < 0)
+                {
+                    _trace.push_back(msg->_name);
+                    return -1;
+                }
+                lua_rawseti(L, -2, ++n);
+            }
+        }
+        else
+        {
+            if (decode_value(L, *field, wire, pos, end, keys, depth) < 0)
+            {
+                _trace.push_back(msg->_name);
+                return -1;
+            }
+            lua_rawseti(L, -2, ++n);
+        }
+        lua_pop(L, 1);
+    }
+
+    return 0;
+}
+
+int32_t ProtobufPlan::decode_value(lua_State *L, const Field &field,
+                                   int32_t wire, const char *&pos,
+                                   const char *end, int32_t keys, int32_t depth)
+{
+    if (wire != field._wire)
+    {
+        _error = STD_FMT("field(%s) wire type error, expect %d,got %d",
+                         field._name.c_str(), field._wire, wire);
+        return -1;
+    }
+
+    uint64_t val = 0;
+    switch (wire)
+    {
+    case WT_VARINT:
+        if (!WireReader::read_varint(pos, end, val))
+        {
+            _error = STD_FMT("field(%s) varint error", field._name.c_str());
+            return -1;
+        }
+        break;
+    case WT_I64:
+        if (end - pos < 8)
+        {
+            _error = STD_FMT("field(%s) fixed64 error", field._name.c_str());
+            return -1;
+        }
+        memcpy(&val, pos, 8);
+        pos += 8;
+        break;
+    case WT_I32:
+        if (end - pos < 4)
+        {
+            _error = STD_FMT("field(%s) fixed32 error", field._name.c_str());
+            return -1;
+        }
+        {
+            uint32_t v32 = 0;
+            memcpy(&v32, pos, 4);
+            val = v32;
+        }
+        pos += 4;
+        break;
+    case WT_LEN:
+        if (!WireReader::read_varint(pos, end, val)
+            || val > (uint64_t)(end - pos))
+        {
+            _error = STD_FMT("field(%s) length error", field._name.c_str());
+            return -1;
+        }
+        break;
+    default: break;
+    }
+
+    switch (field._type)
+    {
+    case TYPE_INT32:
+    case TYPE_SFIXED32: lua_pushinteger(L, static_cast<int32_t>(val)); break;
+    case TYPE_UINT32:
+    case TYPE_FIXED32: lua_pushinteger(L, static_cast<uint32_t>(val)); break;
+    case TYPE_SINT32:
+    {
+        uint32_t v32 = static_cast<uint32_t>(val);
+        lua_pushinteger(L, static_cast<int32_t>((v32 >> 1) ^ (0 - (v32 & 1))));
+        break;
+    }
+    case TYPE_SINT64:
+        lua_pushinteger(L, static_cast<lua_Integer>((val >> 1) ^ (0 - (val & 1))));
+        break;
+    case TYPE_INT64:
+    case TYPE_UINT64:
+    case TYPE_FIXED64:
+    case TYPE_SFIXED64:
+        // lua不支持uint64_t，都按int64_t处理
+        lua_pushinteger(L, static_cast<lua_Integer>(val));
+        break;
+    case TYPE_BOOL: lua_pushboolean(L, 0 != val); break;
+    case TYPE_DOUBLE:
+    {
+        double d = 0;
+        memcpy(&d, &val, sizeof(d));
+        lua_pushnumber(L, d);
+        break;
+    }
+    case TYPE_FLOAT:
+    {
+        uint32_t v32 = static_cast<uint32_t>(val);
+        float f      = 0;
+        memcpy(&f, &v32, sizeof(f));
+        lua_pushnumber(L, f);
+        break;
+    }
+    case TYPE_ENUM:
+    {
+        int32_t v32 = static_cast<int32_t>(val);
+        auto iter   = field._enum->_keys.find(v32);
+        if (iter == field._enum->_keys.end())
+        {
+            lua_pushinteger(L, v32); // 新版本协议加的枚举值
+        }
+        else
+        {
+            lua_rawgeti(L, keys, iter->second);
+        }
+        break;
+    }
+    case TYPE_STRING:
+    case TYPE_BYTES:
+        lua_pushlstring(L, pos, static_cast<size_t>(val));
+        pos += val;
+        break;
+    case TYPE_MESSAGE:
+    {
+        const char *data = pos;
+        pos += val;
+        if (decode_message(L, field._message, data, static_cast<size_t>(val),
+                           keys, depth + 1)
+            < 0)
+        {
+            _trace.push_back(field._name);
+            return -1;
+        }
+        break;
+    }
+    default:
+        _error = STD_FMT("protobuf unknow type: %d", field._type);
+        return -1;
+    }
+
+    return 0;
+}
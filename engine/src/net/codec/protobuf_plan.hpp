@@ -0,0 +1,211 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../../global/global.hpp"
+
+struct lua_State;
+
+/**
+ * @brief protobuf的编码、解码计划
+ * pbc编码时，lua table的每个字段都要按名字查找类型，写入时再按名字查找一次；解码时
+ * 每个字段都要回调并push字段名。这里在加载描述文件时把每个message编译成字段数组
+ * (字段号、类型、wire type等)，编码、解码时直接遍历数组：
+ * 1. 字段名在lua中只创建一次，放在注册表的一个数组中，按下标取出，不需要再计算hash
+ * 2. 直接按protobuf的wire格式读写，不经过pbc的中间结构
+ * 3. 与pbc的行为保持一致：非repeated字段等于默认值时不编码，repeated的标量
+ *    只在显式指定packed时才使用packed编码(解码时两种都支持)，枚举解码为名字
+ * 4. 依赖的类型不存在等无法编译的message，查找时返回nullptr，由调用者使用pbc处理
+ */
+class ProtobufPlan final
+{
+public:
+    /// google.protobuf.FieldDescriptorProto.Type
+    enum FieldType
+    {
+        TYPE_DOUBLE   = 1,
+        TYPE_FLOAT    = 2,
+        TYPE_INT64    = 3,
+        TYPE_UINT64   = 4,
+        TYPE_INT32    = 5,
+        TYPE_FIXED64  = 6,
+        TYPE_FIXED32  = 7,
+        TYPE_BOOL     = 8,
+        TYPE_STRING   = 9,
+        TYPE_GROUP    = 10,
+        TYPE_MESSAGE  = 11,
+        TYPE_BYTES    = 12,
+        TYPE_UINT32   = 13,
+        TYPE_ENUM     = 14,
+        TYPE_SFIXED32 = 15,
+        TYPE_SFIXED64 = 16,
+        TYPE_SINT32   = 17,
+        TYPE_SINT64   = 18,
+
+        TYPE_MAX
+    };
+
+    /// protobuf的wire type
+    enum WireType
+    {
+        WT_VARINT = 0,
+        WT_I64    = 1,
+        WT_LEN    = 2,
+        WT_I32    = 5,
+    };
+
+    struct Message;
+    struct Enum
+    {
+        std::string _name;
+        int32_t _default; ///< 第一个值，proto3中必须为0
+        std::unordered_map<int32_t, int32_t> _keys; ///< 值 - 名字在key表中的下标
+        std::unordered_map<std::string, int32_t> _values; ///< 名字 - 值
+    };
+
+    struct Field
+    {
+        std::string _name;
+        int32_t _id;   ///< 字段号
+        int32_t _type; ///< 字段类型，见FieldType
+        int32_t _wire; ///< 非packed时的wire type
+        int32_t _key;  ///< 字段名在key表中的下标
+        bool _repeated;
+        bool _packed; ///< repeated的标量是否使用packed编码
+
+        std::string _type_name; ///< message、enum的类型名
+        std::string _default;   ///< 描述文件中的默认值，proto3没有
+
+        const Message *_message; ///< 链接后的message类型
+        const Enum *_enum;       ///< 链接后的enum类型
+
+        // 解析后的默认值，非repeated字段等于默认值时不编码
+        int64_t _def_i;
+        double _def_d;
+    };
+
+    struct Message
+    {
+        enum LinkState
+        {
+            LS_NONE    = 0, ///< 未链接
+            LS_LINKING = 1, ///< 链接中，用于处理循环引用
+            LS_OK      = 2, ///< 已链接
+            LS_FAIL    = 3  ///< 依赖的类型不存在或者不支持
+        };
+
+        std::string _name;
+        int32_t _state;
+        std::vector<Field> _fields;
+        std::vector<int32_t> _index; ///< 字段号 - _fields下标 + 1，字段号较小时使用
+        std::unordered_map<int32_t, int32_t> _index_map; ///< 字段号较大时使用
+
+        const Field *find(int32_t id) const
+        {
+            if (!_index_map.empty())
+            {
+                auto iter = _index_map.find(id);
+                return iter == _index_map.end() ? nullptr
+                                                : &_fields[iter->second];
+            }
+            if (id < 0 || id >= (int32_t)_index.size() || 0 == _index[id])
+            {
+                return nullptr;
+            }
+            return &_fields[_index[id] - 1];
+        }
+    };
+
+public:
+    ProtobufPlan();
+    ~ProtobufPlan();
+
+    /**
+     * @brief 从描述文件(FileDescriptorSet，protoc -o 生成的.pb文件)编译所有类型
+     * @return <0 描述文件格式错误
+     */
+    int32_t load(const char *buffer, size_t size);
+
+    /**
+     * @brief 查找message的计划
+     * @param name message的全名，如player.SLogin
+     * @return 未找到或者无法链接时返回nullptr
+     */
+    const Message *find(const char *name);
+
+    /**
+     * @brief 把lua table编码为protobuf数据
+     * @param index table在栈上的位置
+     * @return <0 错误，见last_error
+     */
+    int32_t encode(lua_State *L, const Message *msg, int32_t index);
+
+    /**
+     * @brief 解码protobuf数据，成功时解码出的table放在栈顶
+     * @return <0 错误，见last_error
+     */
+    int32_t decode(lua_State *L, const Message *msg, const char *buffer,
+                   size_t size);
+
+    /// 获取编码后的数据，在下一次编码前有效
+    const std::string &get_buffer() const { return _buffer; }
+
+    /// 获取最后一次编码、解码的错误信息
+    const char *last_error();
+
+    /**
+     * 当前版本，每个计划对象、每次加载描述文件都不一样，缓存了查找结果的
+     * 调用者(如CmdCfg)据此判断是否需要重新查找
+     */
+    int32_t get_version() const { return _version; }
+
+private:
+    int32_t load_file(const char *buffer, size_t size);
+    int32_t load_message(const std::string &prefix, const char *buffer,
+                         size_t size);
+    int32_t load_field(Message &msg, const char *buffer, size_t size);
+    int32_t load_enum(const std::string &prefix, const char *buffer,
+                      size_t size);
+    int32_t new_key(const std::string &name);
+    bool link(Message *msg);
+    bool link_field(Field &field);
+
+    /// 把key表放到栈顶，版本不一致时重建
+    void push_keys(lua_State *L);
+
+    int32_t encode_message(lua_State *L, const Message *msg, int32_t index,
+                           int32_t keys, int32_t depth);
+    int32_t encode_repeated(lua_State *L, const Field &field, int32_t index,
+                            int32_t keys, int32_t depth);
+    int32_t encode_field(lua_State *L, const Field &field, int32_t index,
+                         int32_t keys, int32_t depth, bool skip_default);
+    int32_t encode_packed(lua_State *L, const Field &field, int32_t index);
+    /// 只写入值，不写入tag，用于packed及普通字段
+    int32_t encode_value(lua_State *L, const Field &field, int32_t index,
+                         bool skip_default);
+
+    int32_t decode_message(lua_State *L, const Message *msg, const char *buffer,
+                           size_t size, int32_t keys, int32_t depth);
+    int32_t decode_value(lua_State *L, const Field &field, int32_t wire,
+                         const char *&buffer, const char *end, int32_t keys,
+                         int32_t depth);
+
+    inline void append_varint(uint64_t val);
+    /// 写入message、packed数组前在pos预留了1字节的长度，写入后修正长度
+    void set_length(size_t pos);
+
+private:
+    int32_t _version;
+    std::string _buffer;     // 编码后的数据
+    std::string _error;      // 错误信息
+    std::vector<std::string> _trace; // 出错时，用于跟踪哪个字段有问题
+
+    std::vector<std::string> _keys; // 字段名、枚举名，下标从1开始
+    std::unordered_map<std::string, int32_t> _key_index;
+
+    std::unordered_map<std::string, std::unique_ptr<Message>> _messages;
+    std::unordered_map<std::string, std::unique_ptr<Enum>> _enums;
+};
@@ -0,0 +1,32 @@
+#include "flood_ctrl.hpp"
+
+bool FloodCtrl::take(Bucket &bucket, int64_t now, const Limit &limit)
+{
+    const int64_t cap = static_cast<int64_t>(limit._burst) * 1000;
+    if (0 == bucket._last)
+    {
+        bucket._tokens = cap; // 新连接允许马上突发
+    }
+    else if (now > bucket._last)
+    {
+        // 每毫秒补充 rate / 1000 个令牌，放大1000倍后即为rate
+        bucket._tokens += (now - bucket._last) * limit._rate;
+        if (bucket._tokens > cap) bucket._tokens = cap;
+    }
+    bucket._last = now;
+
+    if (bucket._tokens < 1000) return false;
+
+    bucket._tokens -= 1000;
+    return true;
+}
+
+bool FloodCtrl::check(int64_t now, uint16_t cmd, const Limit &limit,
+                      const Limit *cmd_limit)
+{
+    if (limit._rate > 0 && !take(_bucket, now, limit)) return false;
+
+    if (cmd_limit && !take(_cmd_bucket[cmd], now, *cmd_limit)) return false;
+
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "../global/global.hpp"
+
+/**
+ * @brief 客户端连接的流量控制(令牌桶)
+ * 客户端发来的包在解包后、回调脚本前检测，超出限制的包直接丢弃或者断开连接，
+ * 不再进行协议解码，也不占用脚本的时间
+ * 1. 每个连接一个令牌桶，限制所有包的数量
+ * 2. 可以单独限制某个指令，每个连接只为设置了限制的指令创建令牌桶
+ */
+class FloodCtrl final
+{
+public:
+    /// 超出限制时的处理方式
+    enum Action
+    {
+        FA_NONE = 0, ///< 无效值
+        FA_DROP = 1, ///< 丢弃超出限制的包
+        FA_KICK = 2, ///< 断开连接
+
+        FA_MAX
+    };
+
+    /// 限制参数
+    struct Limit
+    {
+        int32_t _rate;  ///< 每秒允许的包数量，0表示不限制
+        int32_t _burst; ///< 允许突发的包数量，即令牌桶的容量
+    };
+
+public:
+    FloodCtrl() : _kicked(false), _bucket{0, 0} {}
+
+    /**
+     * @brief 检测一个包是否超出限制，未超出则消耗对应的令牌
+     * @param now 当前时间，毫秒
+     * @param cmd 指令
+     * @param limit 连接所有包的限制
+     * @param cmd_limit 该指令的限制，nullptr表示不限制
+     * @return 是否允许处理
+     */
+    bool check(int64_t now, uint16_t cmd, const Limit &limit,
+               const Limit *cmd_limit);
+
+    /// 是否已因超出限制被断开
+    bool is_kicked() const { return _kicked; }
+    /// 标记为已断开，之后收到的包全部丢弃
+    void set_kicked() { _kicked = true; }
+
+private:
+    /// 令牌桶，令牌数量放大1000倍，按毫秒补充时不需要浮点运算
+    struct Bucket
+    {
+        int64_t _tokens; ///< 当前令牌数量 * 1000
+        int64_t _last;   ///< 上次补充令牌的时间，0表示未使用
+    };
+
+    static bool take(Bucket &bucket, int64_t now, const Limit &limit);
+
+private:
+    bool _kicked;
+    Bucket _bucket; ///< 连接所有包的令牌桶
+    std::unordered_map<uint16_t, Bucket> _cmd_bucket;
+};
@@ -6,6 +6,7 @@
     #include <winsock2.h>
 #else
     #include <sys/socket.h>
+    #include <sys/uio.h> // writev
 #endif
 
 IO::IO(int32_t conn_id, class Buffer *recv, class Buffer *send)
@@ -65,15 +66,46 @@ IO::IOStatus IO::send(EVIO *w)
 {
     assert(_fd != netcompat::INVALID);
 
-    int32_t len  = 0;
-    size_t bytes = 0;
-    bool next    = false;
+    // 发送缓冲区可能由多个chunk组成(如登录时下发大量场景数据)
+    // 用writev一次把多个chunk发送出去，减少系统调用
+    static const int32_t MAX_VEC = 64;
+
+#ifdef __windows__
+    WSABUF iov[MAX_VEC];
+#else
+    struct iovec iov[MAX_VEC];
+#endif
+    Buffer::UsedCtx vec[MAX_VEC];
+
+    int32_t len = 0;
+    bool next   = false;
     while (true)
     {
-        const char *data = _send->get_front_used(bytes, next);
-        if (0 == bytes) return IOS_OK;
+        int32_t cnt = _send->get_front_used_vec(vec, MAX_VEC, next);
+        if (0 == cnt) return IOS_OK;
 
-        len = (int32_t)::send(_fd, data, (int32_t)bytes, 0);
+        size_t bytes = 0;
+        for (int32_t i = 0; i < cnt; i++)
+        {
+#ifdef __windows__
+            iov[i].buf = const_cast<char *>(vec[i]._ctx);
+            iov[i].len = static_cast<ULONG>(vec[i]._len);
+#else
+            iov[i].iov_base = const_cast<char *>(vec[i]._ctx);
+            iov[i].iov_len  = vec[i]._len;
+#endif
+            bytes += vec[i]._len;
+        }
+
+#ifdef __windows__
+        DWORD sent = 0;
+        len        = 0 == WSASend(_fd, iov, static_cast<DWORD>(cnt), &sent, 0,
+                                  nullptr, nullptr)
+                         ? static_cast<int32_t>(sent)
+                         : -1;
+#else
+        len = static_cast<int32_t>(::writev(_fd, iov, cnt));
+#endif
         if (len <= 0) break;
 
         _send->remove(len); // 删除已发送数据
@@ -81,7 +113,7 @@ IO::IOStatus IO::send(EVIO *w)
         // socket发送缓冲区已满，等下次发送了
         if (len < (int32_t)bytes) return IOS_WRITE;
 
-        // 当前chunk数据已发送完，如果有下一个chunk，则继续发送
+        // 数组放不下的chunk，继续发送
         if (!next) return IOS_OK;
     }
 
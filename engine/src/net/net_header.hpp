@@ -14,6 +14,7 @@ struct CmdCfg
     {
         MK_UNPACK  = 1, //解码方式:0 普通解码，1 unpack解码
         MK_DYNAMIC = 2, // 是否动态转发
+        MK_VIEW    = 4, // flatbuffers解码为只读视图，字段在访问时才解析
         MK_MAX
     };
     int32_t _cmd;
@@ -21,6 +22,10 @@ struct CmdCfg
     int32_t _session;
     char _schema[MAX_SCHEMA_NAME];
     char _object[MAX_SCHEMA_NAME];
+
+    // 编码器缓存的_object对应的编码计划，_plan_ver与编码器的版本不一致时重新查找
+    mutable const void *_plan;
+    mutable int32_t _plan_ver;
 };
 typedef int32_t Owner;
 
@@ -58,6 +63,22 @@ typedef int32_t Owner;
 /* 根据一个header指针获取header后buffer的长度 */
 #define PACKET_BUFFER_LEN(h) ((h)->_length - sizeof(*h))
 
+/* 数据包已压缩的标识，见Compressor。s2c包放在_errno的最高位，因此开启压缩的连接
+ * 错误码不能超过0x7FFF(脚本中的错误码定义见modules/system/error.lua，加载时会检测)，
+ * 发送时冲突会打印错误日志并发送失败；s2s包放在_codec的最高位
+ */
+#define PKT_COMPRESS 0x8000
+
+/* 服务器之间扩展长度数据包的最大长度，实际还受限于编码器的缓冲区大小
+ * 以及连接的缓冲区上限(ss_conn.lua中的recv_chunk_max)
+ */
+#define MAX_EXT_PACKET_LEN (8 * 1024 * 1024)
+
+/* 容器包的指令。协议号由工具从1开始生成，0保留给容器包。容器包的_errno为
+ * 容器类型(如SPT_BTCP)，数据为多个完整的s2c包(包含包头)，见CltBatch
+ */
+#define BATCH_PKT_CMD 0
+
 typedef enum
 {
     SPT_NONE = 0, // invalid
@@ -68,6 +89,7 @@ typedef enum
     SPT_RPCR = 5, // rpc return packet
     SPT_CBCP = 6, // client broadcast packet
     SPT_SBCP = 7, // server broadcast packet
+    SPT_BTCP = 8, // batch client packet，见BATCH_PKT_CMD
 
     SPT_MAXT // max packet type
 } StreamPacketType;
@@ -75,7 +97,8 @@ typedef enum
 typedef enum
 {
     CLT_MC_NONE  = 0,
-    CLT_MC_OWNER = 1, // 根据玩家id广播
+    CLT_MC_OWNER   = 1, // 根据玩家id广播
+    CLT_MC_CHANNEL = 2, // 根据频道广播，频道成员在网关维护
     // 未定义的值，会回调到脚本处理
 
     CLT_MC_MAX
@@ -86,6 +109,7 @@ typedef enum
 typedef uint16_t array_size_t; // 数组长度类型，自定义二进制用。数组最大不超过65535
 typedef uint16_t packet_size_t; // 包长类型，包最大不超过65535
 typedef uint16_t string_size_t; // 字符串长度类型，自定义二进制用。最大不超过65535
+typedef uint32_t ext_packet_size_t; // 扩展包长类型，见s2s_header
 
 /* !!!!!!!!! 这里的数据结构必须符合POD结构 !!!!!!!!! */
 
@@ -106,7 +130,10 @@ struct s2c_header : public base_header
     uint16_t _errno; /* 错误码 */
 };
 
-/* 服务器发往服务器 */
+/* 服务器发往服务器
+ * 数据包超过MAX_PACKET_LEN时(如跨服时的玩家数据)，_length为0，包头后紧跟一个
+ * ext_packet_size_t表示实际长度(包含包头及这个长度本身)，然后才是数据
+ */
 struct s2s_header : public base_header
 {
     uint16_t _errno;  /* 错误码 */
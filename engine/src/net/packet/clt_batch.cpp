@@ -0,0 +1,49 @@
+#include "clt_batch.hpp"
+
+CltBatch::CltBatch() : _pending(false), _count(0)
+{
+    _data.resize(sizeof(struct s2c_header));
+}
+
+bool CltBatch::append(const struct s2c_header &s2ch, const char *ctx,
+                      size_t size)
+{
+    // 第一个包总是可以放下，单独发出时不需要容器包头
+    if (_count > 0 && _data.size() + s2ch._length > MAX_PACKET_LEN)
+    {
+        return false;
+    }
+
+    _data.append(reinterpret_cast<const char *>(&s2ch), sizeof(s2ch));
+    if (size > 0) _data.append(ctx, size);
+
+    _count++;
+    return true;
+}
+
+const char *CltBatch::get(size_t &size)
+{
+    static const size_t HEADER_LEN = sizeof(struct s2c_header);
+    if (1 == _count)
+    {
+        size = _data.size() - HEADER_LEN;
+        return _data.data() + HEADER_LEN;
+    }
+
+    struct s2c_header s2ch;
+    s2ch._length = static_cast<packet_size_t>(_data.size());
+    s2ch._cmd    = BATCH_PKT_CMD;
+    s2ch._errno  = static_cast<uint16_t>(SPT_BTCP);
+    _data.replace(0, HEADER_LEN, reinterpret_cast<const char *>(&s2ch),
+                  HEADER_LEN);
+
+    size = _data.size();
+    return _data.data();
+}
+
+void CltBatch::clear()
+{
+    _pending = false;
+    _count   = 0;
+    _data.resize(sizeof(struct s2c_header));
+}
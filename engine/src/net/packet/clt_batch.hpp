@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+
+#include "../net_header.hpp"
+
+/**
+ * @brief 合并同一帧内发往客户端的数据包
+ * 战斗时一个客户端每帧可能收到几十个很小的包，每个包都有自己的包头、websocket帧，
+ * 开启合并后：
+ * 1. 同一帧内的s2c包(包含包头)先追加到这里，帧结束时(LNetworkMgr::invoke_batch)
+ *    合并成一个容器包(SPT_BTCP)发出，只有一个包时按原样发出，不增加额外的包头
+ * 2. 容器包长度不超过MAX_PACKET_LEN，放不下时先发出已合并的数据
+ * 3. 接收方在sc_command中拆分，对脚本透明
+ */
+class CltBatch final
+{
+public:
+    CltBatch();
+
+    /**
+     * @brief 追加一个s2c包
+     * @param s2ch 包头
+     * @param ctx 数据
+     * @param size 数据长度
+     * @return 容器包放不下时返回false，需要先发出已合并的数据再追加
+     */
+    bool append(const struct s2c_header &s2ch, const char *ctx, size_t size);
+
+    /**
+     * @brief 获取合并后需要发送的数据
+     * @param size 数据长度
+     * @return 只有一个包时返回这个包，否则返回容器包
+     */
+    const char *get(size_t &size);
+
+    /// 清空已合并的数据
+    void clear();
+
+    /// 是否没有需要发送的数据
+    bool empty() const { return 0 == _count; }
+
+    /**
+     * @brief 标记在帧结束时发送
+     * @return 之前未标记，需要加入帧结束时的发送队列
+     */
+    bool set_pending()
+    {
+        if (_pending) return false;
+
+        _pending = true;
+        return true;
+    }
+
+private:
+    bool _pending;     // 是否已在帧结束时的发送队列中
+    int32_t _count;    // 已合并的包数量
+    std::string _data; // 开头预留容器包头的位置，后面是合并的s2c包
+};
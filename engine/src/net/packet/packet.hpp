@@ -62,6 +62,28 @@ public:
         assert(false);
         return -1;
     }
+    /**
+     * 打包服务器发往客户端的数据包，数据部分为共享数据，用于广播
+     * 默认拷贝数据，能直接引用共享数据的packet需要重写
+     */
+    virtual int32_t raw_pack_clt_shared(int32_t cmd, uint16_t ecode,
+                                        Buffer::Shared *shared)
+    {
+        return raw_pack_clt(cmd, ecode, shared->get_ctx(), shared->size());
+    }
+    /**
+     * 开启或关闭合并发送，同一帧内发往客户端的数据包合并成一个容器包，见CltBatch
+     * 客户端需要能拆分容器包，因此需要连接双方协商一致
+     * @return <0 当前打包方式不支持
+     */
+    virtual int32_t set_batch(bool on)
+    {
+        return -1;
+    }
+    /**
+     * 把合并的数据包发送出去，在帧结束或者需要保证发送顺序时调用
+     */
+    virtual void flush_batch() {}
     /**
      * 打包服务器发往服务器的数据包，用于广播
      */
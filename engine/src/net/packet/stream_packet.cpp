@@ -2,14 +2,37 @@
 
 #include "../../lua_cpplib/ltools.hpp"
 #include "../../system/static_global.hpp"
+#include "../codec/luabin_codec.hpp"
 #include "../socket.hpp"
+#include "clt_batch.hpp"
 
 StreamPacket::StreamPacket(class Socket *sk) : Packet(sk)
 {
+    _batch    = nullptr;
+    _rpc_dict = nullptr;
 }
 
 StreamPacket::~StreamPacket()
 {
+    delete _batch;
+    delete _rpc_dict;
+}
+
+LuaBinDict *StreamPacket::get_rpc_dict()
+{
+    // 只有服务器之间的连接才会用到，按需创建
+    if (!_rpc_dict) _rpc_dict = new LuaBinDict();
+
+    return _rpc_dict;
+}
+
+void StreamPacket::rpc_desync(const s2s_header *header, const char *what)
+{
+    // 字典的编号依赖两端收发顺序一致，丢掉任何一个包都无法再对齐，只能断开
+    // 重连后使用新的连接、新的字典
+    ELOG("rpc %s, close conn %d: packet = %d, version = %d", what,
+         _socket->conn_id(), header->_packet, header->_cmd);
+    _socket->stop();
 }
 
 int32_t StreamPacket::unpack(Buffer &buffer)
@@ -22,19 +45,49 @@ int32_t StreamPacket::unpack(Buffer &buffer)
         reinterpret_cast<const struct base_header *>(buf);
 
     // 检测包内容是否完整
-    uint32_t length = header->_length;
-    if (!buffer.check_used_size(length)) return 0;
+    size_t length = header->_length;
+    if (EXPECT_FALSE(0 == length))
+    {
+        // 服务器之间扩展长度的数据包
+        if (Socket::CT_SSCN != _socket->conn_type())
+        {
+            ELOG("stream_packet unpack zero length packet, conn_type = %d",
+                 _socket->conn_type());
+            return -1;
+        }
+
+        static const size_t EXT_HEADER_LEN =
+            sizeof(struct s2s_header) + sizeof(ext_packet_size_t);
+        buf = buffer.to_flat_ctx(EXT_HEADER_LEN);
+        if (!buf) return 0;
+
+        ext_packet_size_t ext_length = 0;
+        memcpy(&ext_length, buf + sizeof(struct s2s_header), sizeof(ext_length));
+        if (ext_length <= EXT_HEADER_LEN || ext_length > MAX_EXT_PACKET_LEN)
+        {
+            ELOG("stream_packet unpack illegal ext length:%u", ext_length);
+            return -1;
+        }
+        length = ext_length;
+    }
+    if (!buffer.check_used_size(length))
+    {
+        // 大包预先分配一块连续的缓冲区，后续数据直接接收到这块缓冲区
+        // 避免数据包完整后再从多个chunk拷贝到一起
+        if (length > Buffer::CHUNK_UNIT) buffer.reserve_flat(length);
+        return 0;
+    }
 
     header =
         reinterpret_cast<const struct base_header *>(buffer.to_flat_ctx(length));
 
-    dispatch(header);      // 数据包完整，派发处理
+    dispatch(header, length); // 数据包完整，派发处理
     bool next = buffer.remove(length); // 无论成功或失败，都移除该数据包
 
     return next ? 1 : 0;
 }
 
-void StreamPacket::dispatch(const struct base_header *header)
+void StreamPacket::dispatch(const struct base_header *header, size_t length)
 {
     switch (_socket->conn_type())
     {
@@ -45,7 +98,8 @@ void StreamPacket::dispatch(const struct base_header *header)
         cs_dispatch(reinterpret_cast<const struct c2s_header *>(header));
         break;
     case Socket::CT_SSCN: /* 解析服务器发往服务器的包 */
-        process_ss_command(reinterpret_cast<const struct s2s_header *>(header));
+        process_ss_command(reinterpret_cast<const struct s2s_header *>(header),
+                           length);
         break;
     default:
         ELOG("stream_packet dispatch "
@@ -62,6 +116,12 @@ void StreamPacket::sc_command(const struct s2c_header *header)
     static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
 
     assert(0 == lua_gettop(L));
+    if (EXPECT_FALSE(BATCH_PKT_CMD == header->_cmd))
+    {
+        sc_batch(header);
+        return;
+    }
+
     const CmdCfg *cmd_cfg = network_mgr->get_sc_cmd(header->_cmd);
     if (!cmd_cfg)
     {
@@ -73,13 +133,26 @@ void StreamPacket::sc_command(const struct s2c_header *header)
     /* 去掉header内容 */
     const char *buffer = reinterpret_cast<const char *>(header + 1);
 
+    uint16_t ecode = header->_errno;
+    if (_socket->is_compress() && (ecode & PKT_COMPRESS))
+    {
+        ecode  = static_cast<uint16_t>(ecode & ~PKT_COMPRESS);
+        buffer = StaticGlobal::codec_mgr()->get_compressor()->uncompress(
+            buffer, PACKET_BUFFER_LEN(header), size);
+        if (!buffer)
+        {
+            ELOG("sc_command cmd(%d) uncompress error", header->_cmd);
+            return;
+        }
+    }
+
     uint32_t conn_id = _socket->conn_id();
 
     LUA_PUSHTRACEBACK(L);
     lua_getglobal(L, "command_new");
     lua_pushinteger(L, conn_id);
     lua_pushinteger(L, header->_cmd);
-    lua_pushinteger(L, header->_errno);
+    lua_pushinteger(L, ecode);
 
     class Codec *decoder =
         StaticGlobal::codec_mgr()->get_codec(_socket->get_codec_type());
@@ -89,6 +162,9 @@ void StreamPacket::sc_command(const struct s2c_header *header)
         lua_settop(L, 0);
         return;
     }
+    // 解压、跨chunk拼接的数据在回调脚本期间可能被覆盖
+    decoder->set_stable(buffer == reinterpret_cast<const char *>(header + 1)
+                        && !Buffer::is_large_buffer(buffer));
     int32_t cnt = decoder->decode(L, buffer, size, cmd_cfg);
     if (cnt < 0)
     {
@@ -96,7 +172,9 @@ void StreamPacket::sc_command(const struct s2c_header *header)
         return;
     }
 
-    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 3 + cnt, 0, 1)))
+    int32_t ok = lua_pcall(L, 3 + cnt, 0, 1);
+    decoder->decode_done();
+    if (EXPECT_FALSE(LUA_OK != ok))
     {
         ELOG("sc_command:%s", lua_tostring(L, -1));
 
@@ -106,15 +184,48 @@ void StreamPacket::sc_command(const struct s2c_header *header)
     lua_settop(L, 0); /* remove traceback */
 }
 
+void StreamPacket::sc_batch(const struct s2c_header *header)
+{
+    if (SPT_BTCP != header->_errno)
+    {
+        ELOG("sc_batch unknow container type:%d", header->_errno);
+        return;
+    }
+
+    const char *ctx = reinterpret_cast<const char *>(header + 1);
+    size_t size     = PACKET_BUFFER_LEN(header);
+    while (size > 0)
+    {
+        const struct s2c_header *one =
+            reinterpret_cast<const struct s2c_header *>(ctx);
+        if (size < sizeof(*one) || one->_length < sizeof(*one)
+            || one->_length > size || BATCH_PKT_CMD == one->_cmd)
+        {
+            ELOG("sc_batch packet broken");
+            return;
+        }
+
+        sc_command(one);
+        // 脚本可能在处理其中一个包时关闭了连接
+        if (_socket->is_closed()) return;
+
+        ctx += one->_length;
+        size -= one->_length;
+    }
+}
+
 /* 派发客户端发给服务器数据包 */
 void StreamPacket::cs_dispatch(const struct c2s_header *header)
 {
-    static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
+    static class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
 
     uint16_t cmd    = header->_cmd;
     size_t size     = PACKET_BUFFER_LEN(header);
     const char *ctx = reinterpret_cast<const char *>(header + 1);
 
+    /* 超出流量限制的包直接丢弃，不解码也不转发 */
+    if (!network_mgr->flood_check(_socket, cmd)) return;
+
     /* 这个指令不是在当前进程处理，自动转发到对应进程 */
     if (0 != network_mgr->cs_dispatch(cmd, _socket, ctx, size)) return;
 
@@ -151,6 +262,7 @@ void StreamPacket::cs_command(int32_t cmd, const char *ctx, size_t size)
         lua_settop(L, 0);
         return;
     }
+    decoder->set_stable(!Buffer::is_large_buffer(ctx));
     int32_t cnt = decoder->decode(L, ctx, size, cmd_cfg);
     if (cnt < 0)
     {
@@ -158,7 +270,9 @@ void StreamPacket::cs_command(int32_t cmd, const char *ctx, size_t size)
         return;
     }
 
-    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 2 + cnt, 0, 1)))
+    int32_t ok = lua_pcall(L, 2 + cnt, 0, 1);
+    decoder->decode_done();
+    if (EXPECT_FALSE(LUA_OK != ok))
     {
         ELOG("cs_command:%s", lua_tostring(L, -1));
 
@@ -169,17 +283,43 @@ void StreamPacket::cs_command(int32_t cmd, const char *ctx, size_t size)
 }
 
 /* 处理服务器之间数据包 */
-void StreamPacket::process_ss_command(const s2s_header *header)
+void StreamPacket::process_ss_command(const s2s_header *header, size_t length)
 {
+    /* 去掉header内容，扩展长度的数据包还要去掉长度 */
+    const char *ctx = reinterpret_cast<const char *>(header + 1);
+    size_t size     = length - sizeof(*header);
+    if (EXPECT_FALSE(0 == header->_length))
+    {
+        ctx += sizeof(ext_packet_size_t);
+        size -= sizeof(ext_packet_size_t);
+    }
+    if (header->_codec & PKT_COMPRESS)
+    {
+        size_t raw_size = 0;
+        ctx = StaticGlobal::codec_mgr()->get_compressor()->uncompress(
+            ctx, size, raw_size);
+        if (!ctx)
+        {
+            if (SPT_RPCS == header->_packet || SPT_RPCR == header->_packet)
+            {
+                rpc_desync(header, "uncompress error");
+                return;
+            }
+            ELOG("process_ss_command cmd(%d) uncompress error", header->_cmd);
+            return;
+        }
+        size = raw_size;
+    }
+
     /* 先判断数据包类型 */
     switch (header->_packet)
     {
-    case SPT_SSPK: ss_dispatch(header); return;
-    case SPT_CSPK: css_command(header); return;
-    case SPT_SCPK: ssc_command(header); return;
-    case SPT_RPCS: rpc_command(header); return;
-    case SPT_RPCR: rpc_return(header); return;
-    case SPT_CBCP: ssc_multicast(header); return;
+    case SPT_SSPK: ss_dispatch(header, ctx, size); return;
+    case SPT_CSPK: css_command(header, ctx, size); return;
+    case SPT_SCPK: ssc_command(header, ctx, size); return;
+    case SPT_RPCS: rpc_command(header, ctx, size); return;
+    case SPT_RPCR: rpc_return(header, ctx, size); return;
+    case SPT_CBCP: ssc_multicast(header, ctx, size); return;
     default:
     {
         ELOG("unknow server "
@@ -191,7 +331,8 @@ void StreamPacket::process_ss_command(const s2s_header *header)
 }
 
 /* 派发服务器之间的数据包 */
-void StreamPacket::ss_dispatch(const s2s_header *header)
+void StreamPacket::ss_dispatch(const s2s_header *header, const char *ctx,
+                               size_t size)
 {
     static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
 
@@ -227,19 +368,16 @@ void StreamPacket::ss_dispatch(const s2s_header *header)
     //     return;
     // }
 
-    ss_command(header, cmd_cfg);
+    ss_command(header, cmd_cfg, ctx, size);
 }
 
 /* 服务器发往服务器数据包回调脚本 */
-void StreamPacket::ss_command(const s2s_header *header, const CmdCfg *cmd_cfg)
+void StreamPacket::ss_command(const s2s_header *header, const CmdCfg *cmd_cfg,
+                              const char *buffer, size_t size)
 {
     static lua_State *L = StaticGlobal::state();
     assert(0 == lua_gettop(L));
 
-    size_t size = PACKET_BUFFER_LEN(header);
-    /* 去掉header内容 */
-    const char *buffer = reinterpret_cast<const char *>(header + 1);
-
     LUA_PUSHTRACEBACK(L);
     lua_getglobal(L, "command_new");
     lua_pushinteger(L, _socket->conn_id());
@@ -255,6 +393,8 @@ void StreamPacket::ss_command(const s2s_header *header, const CmdCfg *cmd_cfg)
         lua_settop(L, 0);
         return;
     }
+    decoder->set_stable(!(header->_codec & PKT_COMPRESS)
+                        && !Buffer::is_large_buffer(buffer));
     int32_t cnt = decoder->decode(L, buffer, size, cmd_cfg);
     if (cnt < 0)
     {
@@ -262,7 +402,9 @@ void StreamPacket::ss_command(const s2s_header *header, const CmdCfg *cmd_cfg)
         return;
     }
 
-    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 4 + cnt, 0, 1)))
+    int32_t ok = lua_pcall(L, 4 + cnt, 0, 1);
+    decoder->decode_done();
+    if (EXPECT_FALSE(LUA_OK != ok))
     {
         ELOG("ss_command:%s", lua_tostring(L, -1));
 
@@ -273,7 +415,8 @@ void StreamPacket::ss_command(const s2s_header *header, const CmdCfg *cmd_cfg)
 }
 
 /* 客户端发往服务器，由网关转发的数据包回调脚本 */
-void StreamPacket::css_command(const s2s_header *header)
+void StreamPacket::css_command(const s2s_header *header, const char *buffer,
+                               size_t size)
 {
     static lua_State *L                         = StaticGlobal::state();
     static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
@@ -287,10 +430,6 @@ void StreamPacket::css_command(const s2s_header *header)
         return;
     }
 
-    size_t size = PACKET_BUFFER_LEN(header);
-    /* 去掉header内容 */
-    const char *buffer = reinterpret_cast<const char *>(header + 1);
-
     LUA_PUSHTRACEBACK(L);
     lua_getglobal(L, "css_command_new");
     lua_pushinteger(L, _socket->conn_id());
@@ -298,13 +437,15 @@ void StreamPacket::css_command(const s2s_header *header)
     lua_pushinteger(L, header->_cmd);
 
     Codec *decoder = StaticGlobal::codec_mgr()->get_codec(
-        static_cast<Codec::CodecType>(header->_codec));
+        static_cast<Codec::CodecType>(header->_codec & ~PKT_COMPRESS));
     if (!decoder)
     {
         ELOG("css_command_new no codec found:%d", header->_cmd);
         lua_settop(L, 0);
         return;
     }
+    decoder->set_stable(!(header->_codec & PKT_COMPRESS)
+                        && !Buffer::is_large_buffer(buffer));
     int32_t cnt = decoder->decode(L, buffer, size, cmd_cfg);
     if (cnt < 0)
     {
@@ -312,7 +453,9 @@ void StreamPacket::css_command(const s2s_header *header)
         return;
     }
 
-    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 3 + cnt, 0, 1)))
+    int32_t ok = lua_pcall(L, 3 + cnt, 0, 1);
+    decoder->decode_done();
+    if (EXPECT_FALSE(LUA_OK != ok))
     {
         ELOG("css_command:%s", lua_tostring(L, -1));
 
@@ -323,7 +466,8 @@ void StreamPacket::css_command(const s2s_header *header)
 }
 
 /* 解析其他服务器转发到网关的客户端数据包 */
-void StreamPacket::ssc_command(const s2s_header *header)
+void StreamPacket::ssc_command(const s2s_header *header, const char *ctx,
+                               size_t size)
 {
     static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
 
@@ -340,21 +484,22 @@ void StreamPacket::ssc_command(const s2s_header *header)
         return;
     }
 
-    size_t size             = PACKET_BUFFER_LEN(header);
-    const char *ctx         = reinterpret_cast<const char *>(header + 1);
     class Packet *sk_packet = sk->get_packet();
     sk_packet->raw_pack_clt(header->_cmd, header->_errno, ctx, size);
 }
 
 /* 处理rpc调用 */
-void StreamPacket::rpc_command(const s2s_header *header)
+void StreamPacket::rpc_command(const s2s_header *header, const char *buffer,
+                               size_t size)
 {
     static lua_State *L = StaticGlobal::state();
     assert(0 == lua_gettop(L));
 
-    size_t size = PACKET_BUFFER_LEN(header);
-    /* 去掉header内容 */
-    const char *buffer = reinterpret_cast<const char *>(header + 1);
+    if (EXPECT_FALSE(LuaBinCodec::VERSION != header->_cmd))
+    {
+        rpc_desync(header, "version mismatch");
+        return;
+    }
 
     LUA_PUSHTRACEBACK(L);
     int32_t top = lua_gettop(L); // pcall后，下面的栈都会被弹出
@@ -363,8 +508,15 @@ void StreamPacket::rpc_command(const s2s_header *header)
     lua_pushinteger(L, _socket->conn_id());
     lua_pushinteger(L, header->_owner);
 
-    Codec *decoder = StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN);
-    int32_t cnt    = decoder->decode(L, buffer, size, nullptr);
+    LuaBinCodec *decoder = static_cast<LuaBinCodec *>(
+        StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN));
+    int32_t cnt = decoder->decode_with_dict(L, buffer, size, get_rpc_dict());
+    if (EXPECT_FALSE(cnt < 0))
+    {
+        lua_settop(L, 0);
+        rpc_desync(header, "command decode error");
+        return;
+    }
     if (cnt < 1) // rpc调用至少要带参数名
     {
         lua_settop(L, 0);
@@ -392,13 +544,17 @@ void StreamPacket::rpc_command(const s2s_header *header)
 }
 
 /* 处理rpc返回 */
-void StreamPacket::rpc_return(const s2s_header *header)
+void StreamPacket::rpc_return(const s2s_header *header, const char *buffer,
+                              size_t size)
 {
     static lua_State *L = StaticGlobal::state();
     assert(0 == lua_gettop(L));
 
-    size_t size        = PACKET_BUFFER_LEN(header);
-    const char *buffer = reinterpret_cast<const char *>(header + 1);
+    if (EXPECT_FALSE(LuaBinCodec::VERSION != header->_cmd))
+    {
+        rpc_desync(header, "version mismatch");
+        return;
+    }
 
     LUA_PUSHTRACEBACK(L);
     lua_getglobal(L, "rpc_command_return");
@@ -410,8 +566,15 @@ void StreamPacket::rpc_return(const s2s_header *header)
     int32_t cnt = 0;
     if (size > 0)
     {
-        Codec *decoder = StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN);
-        cnt            = decoder->decode(L, buffer, size, nullptr);
+        LuaBinCodec *decoder = static_cast<LuaBinCodec *>(
+            StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN));
+        cnt = decoder->decode_with_dict(L, buffer, size, get_rpc_dict());
+        if (EXPECT_FALSE(cnt < 0))
+        {
+            lua_settop(L, 0);
+            rpc_desync(header, "return decode error");
+            return;
+        }
     }
     if (LUA_OK != lua_pcall(L, 3 + cnt, 0, 1))
     {
@@ -433,11 +596,15 @@ int32_t StreamPacket::do_pack_rpc(lua_State *L, int32_t unique_id,
 
     int32_t len        = 0;
     const char *buffer = nullptr;
-    Codec *encoder     = StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN);
+    LuaBinCodec *encoder = static_cast<LuaBinCodec *>(
+        StaticGlobal::codec_mgr()->get_codec(Codec::CT_LUABIN));
 
+    // 编码成功但包太大发不出去时，本次添加到字典的key对端收不到，需要回滚
+    LuaBinDict *dict = get_rpc_dict();
+    size_t dict_size = dict->encode_size();
     if (LUA_OK == ecode)
     {
-        len = encoder->encode(L, index, &buffer, nullptr);
+        len = encoder->encode_with_dict(L, index, &buffer, dict);
         if (len < 0)
         {
             // 发送时，出错就不发了
@@ -449,27 +616,25 @@ int32_t StreamPacket::do_pack_rpc(lua_State *L, int32_t unique_id,
     }
 
     struct s2s_header s2sh;
-    SET_HEADER_LENGTH(s2sh, len, 0, SET_LENGTH_FAIL_RETURN);
-    s2sh._cmd    = 0;
+    s2sh._cmd    = LuaBinCodec::VERSION; // rpc没有协议号，用来校验编码版本
     s2sh._errno  = ecode;
     s2sh._packet = pkt;
     s2sh._codec = Codec::CT_NONE; // 用不着，但不初始化valgrind会警告
     s2sh._owner = unique_id;
 
-    _socket->append(&s2sh, sizeof(struct s2s_header));
-    if (len > 0)
-    {
-        _socket->append(buffer, static_cast<uint32_t>(len));
-    }
-    _socket->flush();
+    int32_t length = append_ss(s2sh, buffer, static_cast<size_t>(len));
 
     encoder->finalize();
+    if (length < 0)
+    {
+        dict->rollback(dict_size);
+        return -1;
+    }
 
     // rcp返回结果也是走这里，但是返回是不包含rpc函数名的
     if (SPT_RPCS == pkt && lua_isstring(L, index))
     {
-        RPC_STAT_ADD(lua_tostring(L, index), (int32_t)s2sh._length,
-                     STAT_TIME_END());
+        RPC_STAT_ADD(lua_tostring(L, index), length, STAT_TIME_END());
     }
 
     return 0;
@@ -490,6 +655,21 @@ int32_t StreamPacket::pack_clt(lua_State *L, int32_t index)
         return luaL_error(L, "no command conf found: %d", cmd);
     }
 
+    const LNetworkMgr::EncodedPacket *encoded =
+        network_mgr->check_encoded(L, index + 2, _socket->get_codec_type(), cmd);
+    if (encoded)
+    {
+        if (LNetworkMgr::send_encoded(this, ecode, encoded) < 0)
+        {
+            return luaL_error(L, "can not raw pack clt");
+        }
+
+        PKT_STAT_ADD(SPT_SCPK, cmd,
+                     int32_t(encoded->_shared->size() + sizeof(struct s2c_header)),
+                     STAT_TIME_END());
+        return 0;
+    }
+
     Codec *encoder =
         StaticGlobal::codec_mgr()->get_codec(_socket->get_codec_type());
     if (!encoder)
@@ -598,10 +778,10 @@ int32_t StreamPacket::pack_ss(lua_State *L, int32_t index)
     int32_t len        = encoder->encode(L, index + 2, &buffer, cfg);
     if (len < 0) return -1;
 
-    if (len > MAX_PACKET_LEN)
+    if (len > MAX_EXT_PACKET_LEN)
     {
         encoder->finalize();
-        return luaL_error(L, "buffer size over MAX_PACKET_LEN");
+        return luaL_error(L, "buffer size over MAX_EXT_PACKET_LEN");
     }
 
     int32_t session = network_mgr->get_curr_session();
@@ -641,7 +821,9 @@ int32_t StreamPacket::pack_ssc(lua_State *L, int32_t index)
         return luaL_error(L, "illegal codec type");
     }
 
-    if (!lua_istable(L, index + 4))
+    const LNetworkMgr::EncodedPacket *encoded =
+        network_mgr->check_encoded(L, index + 4, codec_ty, cmd);
+    if (!encoded && !lua_istable(L, index + 4))
     {
         return luaL_error(L, "expect table,got %s",
                           lua_typename(L, lua_type(L, index + 4)));
@@ -661,8 +843,17 @@ int32_t StreamPacket::pack_ssc(lua_State *L, int32_t index)
     }
 
     const char *buffer = nullptr;
-    int32_t len        = encoder->encode(L, index + 4, &buffer, cfg);
-    if (len < 0) return -1;
+    int32_t len        = 0;
+    if (encoded)
+    {
+        buffer = encoded->_shared->get_ctx();
+        len    = static_cast<int32_t>(encoded->_shared->size());
+    }
+    else
+    {
+        len = encoder->encode(L, index + 4, &buffer, cfg);
+        if (len < 0) return -1;
+    }
 
     /* 把客户端数据包放到服务器数据包 */
     struct s2s_header s2sh;
@@ -676,7 +867,7 @@ int32_t StreamPacket::pack_ssc(lua_State *L, int32_t index)
     _socket->append(&s2sh, sizeof(s2sh));
     if (len > 0) _socket->append(buffer, len);
 
-    encoder->finalize();
+    if (!encoded) encoder->finalize();
     _socket->flush();
 
     PKT_STAT_ADD(SPT_SSPK, cmd, int32_t(s2sh._length), STAT_TIME_END());
@@ -687,12 +878,27 @@ int32_t StreamPacket::pack_ssc(lua_State *L, int32_t index)
 int32_t StreamPacket::raw_pack_clt(int32_t cmd, uint16_t ecode, const char *ctx,
                                    size_t size)
 {
+    if (_socket->compress_clt(cmd, ecode, ctx, size) < 0) return -1;
+
     /* 先构造客户端收到的数据包 */
     struct s2c_header s2ch;
     SET_HEADER_LENGTH(s2ch, size, cmd, SET_LENGTH_FAIL_RETURN);
     s2ch._cmd   = static_cast<uint16_t>(cmd);
     s2ch._errno = ecode;
 
+    if (_batch)
+    {
+        static class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
+
+        if (!_batch->append(s2ch, ctx, size))
+        {
+            flush_batch();
+            _batch->append(s2ch, ctx, size);
+        }
+        if (_batch->set_pending()) network_mgr->add_batch(_socket->conn_id());
+        return 0;
+    }
+
     _socket->append(&s2ch, sizeof(s2ch));
     if (size > 0) _socket->append(ctx, size);
 
@@ -700,22 +906,114 @@ int32_t StreamPacket::raw_pack_clt(int32_t cmd, uint16_t ecode, const char *ctx,
     return 0;
 }
 
+int32_t StreamPacket::raw_pack_clt_shared(int32_t cmd, uint16_t ecode,
+                                          Buffer::Shared *shared)
+{
+    size_t size = shared->size();
+
+    // 共享数据不压缩(每个连接压缩一次就失去了共享的意义)，但错误码不能与压缩标识冲突
+    if (EXPECT_FALSE(_socket->is_compress() && (ecode & PKT_COMPRESS)))
+    {
+        ELOG("packet(%d) errno(%d) conflict with compress flag", cmd,
+             (int32_t)ecode);
+        return -1;
+    }
+
+    // 共享数据一般比较大，不合并，但要先发出已合并的数据以保证顺序
+    if (_batch) flush_batch();
+
+    struct s2c_header s2ch;
+    SET_HEADER_LENGTH(s2ch, size, cmd, SET_LENGTH_FAIL_RETURN);
+    s2ch._cmd   = static_cast<uint16_t>(cmd);
+    s2ch._errno = ecode;
+
+    // 每个连接只拷贝包头，数据部分引用同一份共享数据
+    _socket->append(&s2ch, sizeof(s2ch));
+    if (size > 0) _socket->append_shared(shared);
+
+    _socket->flush();
+    return 0;
+}
+
+int32_t StreamPacket::set_batch(bool on)
+{
+    if (on)
+    {
+        if (!_batch) _batch = new CltBatch();
+        return 0;
+    }
+
+    if (_batch)
+    {
+        flush_batch();
+        delete _batch;
+        _batch = nullptr;
+    }
+    return 0;
+}
+
+void StreamPacket::flush_batch()
+{
+    if (!_batch || _batch->empty()) return;
+
+    size_t size     = 0;
+    const char *ctx = _batch->get(size);
+
+    _socket->append(ctx, size);
+    _socket->flush();
+
+    _batch->clear();
+}
+
 int32_t StreamPacket::raw_pack_ss(int32_t cmd, uint16_t ecode, int32_t session,
                                   const char *ctx, size_t size)
 {
     struct s2s_header s2sh;
-    SET_HEADER_LENGTH(s2sh, size, cmd, SET_LENGTH_FAIL_RETURN);
     s2sh._cmd    = static_cast<uint16_t>(cmd);
     s2sh._errno  = ecode;
     s2sh._owner  = session;
     s2sh._packet = SPT_SSPK;
     s2sh._codec = Codec::CT_NONE; // 这个这里用不着，但不初始化valgrind就会警告
 
-    _socket->append(&s2sh, sizeof(s2sh));
+    if (append_ss(s2sh, ctx, size) < 0)
+    {
+        ELOG("packet(%d) length(%d) overflow", cmd, (int32_t)size);
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t StreamPacket::append_ss(struct s2s_header &s2sh, const char *ctx,
+                                size_t size)
+{
+    if (_socket->compress(s2sh._packet, s2sh._cmd, ctx, size))
+    {
+        s2sh._codec = static_cast<uint16_t>(s2sh._codec | PKT_COMPRESS);
+    }
+
+    size_t length = sizeof(s2sh) + size;
+    if (EXPECT_TRUE(length <= MAX_PACKET_LEN))
+    {
+        s2sh._length = static_cast<packet_size_t>(length);
+        _socket->append(&s2sh, sizeof(s2sh));
+    }
+    else
+    {
+        // 超出包头长度的，包头长度为0，后面跟实际长度
+        length += sizeof(ext_packet_size_t);
+        if (length > MAX_EXT_PACKET_LEN) return -1;
+
+        ext_packet_size_t ext_length = static_cast<ext_packet_size_t>(length);
+
+        s2sh._length = 0;
+        _socket->append(&s2sh, sizeof(s2sh));
+        _socket->append(&ext_length, sizeof(ext_length));
+    }
     if (size > 0) _socket->append(ctx, size);
 
     _socket->flush();
-    return 0;
+    return static_cast<int32_t>(length);
 }
 
 // 打包客户端广播数据
@@ -733,7 +1031,10 @@ int32_t StreamPacket::pack_ssc_multicast(lua_State *L, int32_t index)
     uint16_t ecode = static_cast<uint16_t>(luaL_checkinteger(L, index + 4));
 
     lUAL_CHECKTABLE(L, index + 1);
-    lUAL_CHECKTABLE(L, index + 5);
+
+    const LNetworkMgr::EncodedPacket *encoded =
+        network_mgr->check_encoded(L, index + 5, codec_ty, cmd);
+    if (!encoded) lUAL_CHECKTABLE(L, index + 5);
 
     // 占用list的两个位置，这样写入socket缓存区时不用另外处理
     list[0] = mask;
@@ -782,8 +1083,17 @@ int32_t StreamPacket::pack_ssc_multicast(lua_State *L, int32_t index)
     }
 
     const char *buffer = nullptr;
-    int32_t len        = encoder->encode(L, index + 5, &buffer, cfg);
-    if (len < 0) return -1;
+    int32_t len        = 0;
+    if (encoded)
+    {
+        buffer = encoded->_shared->get_ctx();
+        len    = static_cast<int32_t>(encoded->_shared->size());
+    }
+    else
+    {
+        len = encoder->encode(L, index + 5, &buffer, cfg);
+        if (len < 0) return -1;
+    }
 
     /* 把客户端数据包放到服务器数据包 */
     struct s2s_header s2sh;
@@ -798,7 +1108,7 @@ int32_t StreamPacket::pack_ssc_multicast(lua_State *L, int32_t index)
     _socket->append(list, list_len);
     if (len > 0) _socket->append(buffer, len);
 
-    encoder->finalize();
+    if (!encoded) encoder->finalize();
     _socket->flush();
 
     PKT_STAT_ADD(SPT_CBCP, cmd, int32_t(s2sh._length), STAT_TIME_END());
@@ -808,7 +1118,8 @@ int32_t StreamPacket::pack_ssc_multicast(lua_State *L, int32_t index)
 
 // 转发到一个客户端
 void StreamPacket::ssc_one_multicast(Owner owner, int32_t cmd, uint16_t ecode,
-                                     const char *ctx, size_t size)
+                                     const char *ctx, size_t size,
+                                     Buffer::Shared *shared)
 {
     static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
 
@@ -833,13 +1144,22 @@ void StreamPacket::ssc_one_multicast(Owner owner, int32_t cmd, uint16_t ecode,
         ELOG("ssc_one_multicast no packet found");
         return;
     }
-    sk_packet->raw_pack_clt(cmd, ecode, ctx, size);
+
+    if (shared)
+    {
+        sk_packet->raw_pack_clt_shared(cmd, ecode, shared);
+    }
+    else
+    {
+        sk_packet->raw_pack_clt(cmd, ecode, ctx, size);
+    }
 }
 
 // 处理其他进程发过来的客户端广播
-void StreamPacket::ssc_multicast(const s2s_header *header)
+void StreamPacket::ssc_multicast(const s2s_header *header, const char *ctx,
+                                 size_t size)
 {
-    const Owner *raw_list = reinterpret_cast<const Owner *>(header + 1);
+    const Owner *raw_list = reinterpret_cast<const Owner *>(ctx);
     int32_t mask          = static_cast<int32_t>(*raw_list);
     int32_t count         = static_cast<int32_t>(*(raw_list + 1));
     if (MAX_CLT_CAST < count)
@@ -849,9 +1169,7 @@ void StreamPacket::ssc_multicast(const s2s_header *header)
     }
 
     // 长度记得包含mask和count本身这两个变量
-    size_t size         = PACKET_BUFFER_LEN(header);
     size_t raw_list_len = sizeof(Owner) * (count + 2);
-    const char *ctx     = reinterpret_cast<const char *>(header + 1);
 
     if (size < raw_list_len)
     {
@@ -862,14 +1180,29 @@ void StreamPacket::ssc_multicast(const s2s_header *header)
     ctx += raw_list_len;
     size -= raw_list_len;
 
+    // 根据频道广播，频道成员在网关维护，list为频道id
+    if (CLT_MC_CHANNEL == mask)
+    {
+        static const class LNetworkMgr *network_mgr =
+            StaticGlobal::network_mgr();
+        for (int32_t idx = 0; idx < count; idx++)
+        {
+            network_mgr->channel_cast(*(raw_list + idx + 2), header->_cmd,
+                                      header->_errno, ctx, size);
+        }
+        return;
+    }
+
     // 根据玩家pid广播，底层直接处理
     if (CLT_MC_OWNER == mask)
     {
+        Buffer::Shared *shared = new_multicast_shared(ctx, size);
         for (int32_t idx = 0; idx < count; idx++)
         {
             ssc_one_multicast(*(raw_list + idx + 2), header->_cmd,
-                              header->_errno, ctx, size);
+                              header->_errno, ctx, size, shared);
         }
+        if (shared) shared->release();
         return;
     }
 
@@ -904,6 +1237,9 @@ void StreamPacket::ssc_multicast(const s2s_header *header)
         lua_settop(L, 0);
         return;
     }
+
+    Buffer::Shared *shared = new_multicast_shared(ctx, size);
+
     lua_pushnil(L); /* first key */
     while (lua_next(L, -2) != 0)
     {
@@ -911,12 +1247,24 @@ void StreamPacket::ssc_multicast(const s2s_header *header)
         {
             lua_settop(L, 0);
             ELOG("ssc_multicast list expect integer");
-            return;
+            break;
         }
         Owner owner = static_cast<Owner>(lua_tointeger(L, -1));
-        ssc_one_multicast(owner, header->_cmd, header->_errno, ctx, size);
+        ssc_one_multicast(owner, header->_cmd, header->_errno, ctx, size,
+                          shared);
 
         lua_pop(L, 1);
     }
     lua_settop(L, 0); /* remove traceback */
+
+    if (shared) shared->release();
+}
+
+Buffer::Shared *StreamPacket::new_multicast_shared(const char *ctx,
+                                                   size_t size)
+{
+    // 数据较小时每个连接直接拷贝更快，较大时只拷贝一次，所有连接引用同一份数据
+    if (size < Buffer::SHARED_MIN) return nullptr;
+
+    return Buffer::Shared::create(ctx, size);
 }
@@ -30,25 +30,53 @@ public:
     int32_t pack_ssc_multicast(lua_State *L, int32_t index);
     int32_t raw_pack_clt(int32_t cmd, uint16_t ecode, const char *ctx,
                          size_t size);
+    int32_t raw_pack_clt_shared(int32_t cmd, uint16_t ecode,
+                                Buffer::Shared *shared);
     int32_t raw_pack_ss(int32_t cmd, uint16_t ecode, int32_t session,
                         const char *ctx, size_t size);
     int32_t unpack(Buffer &buffer);
 
+    int32_t set_batch(bool on);
+    void flush_batch();
+
+    /**
+     * 创建广播用的共享数据，数据太小不值得共享时返回nullptr
+     * 返回的对象由调用者release
+     */
+    static Buffer::Shared *new_multicast_shared(const char *ctx, size_t size);
+
 private:
-    void dispatch(const struct base_header *header);
+    void dispatch(const struct base_header *header, size_t length);
     void sc_command(const struct s2c_header *header);
+    /// 拆分合并发送的容器包，见CltBatch
+    void sc_batch(const struct s2c_header *header);
     void cs_dispatch(const struct c2s_header *header);
     void cs_command(int32_t cmd, const char *ctx, size_t size);
-    void process_ss_command(const s2s_header *header);
-    void ss_dispatch(const s2s_header *header);
-    void ss_command(const s2s_header *header, const CmdCfg *cmd_cfg);
-    void css_command(const s2s_header *header);
-    void ssc_command(const s2s_header *header);
-    void rpc_command(const s2s_header *header);
-    void rpc_return(const s2s_header *header);
-    void ssc_multicast(const s2s_header *header);
+    void process_ss_command(const s2s_header *header, size_t length);
+    void ss_dispatch(const s2s_header *header, const char *ctx, size_t size);
+    void ss_command(const s2s_header *header, const CmdCfg *cmd_cfg,
+                    const char *ctx, size_t size);
+    void css_command(const s2s_header *header, const char *ctx, size_t size);
+    void ssc_command(const s2s_header *header, const char *ctx, size_t size);
+    void rpc_command(const s2s_header *header, const char *ctx, size_t size);
+    void rpc_return(const s2s_header *header, const char *ctx, size_t size);
+    void ssc_multicast(const s2s_header *header, const char *ctx, size_t size);
     int32_t do_pack_rpc(lua_State *L, int32_t unique_id, uint16_t ecode,
                         uint16_t pkt, int32_t index);
+    /**
+     * 打包服务器之间的数据包并发送，超过MAX_PACKET_LEN时使用扩展长度的包头
+     * @return 包的总长度，超过MAX_EXT_PACKET_LEN返回-1
+     */
+    int32_t append_ss(struct s2s_header &s2sh, const char *ctx, size_t size);
     void ssc_one_multicast(Owner owner, int32_t cmd, uint16_t ecode,
-                           const char *ctx, size_t size);
+                           const char *ctx, size_t size,
+                           Buffer::Shared *shared);
+    /// 获取rpc编码、解码使用的字符串key字典
+    class LuaBinDict *get_rpc_dict();
+    /// rpc版本不一致或者数据无法解码，两端字典已无法对齐，断开连接
+    void rpc_desync(const s2s_header *header, const char *what);
+
+private:
+    class CltBatch *_batch; // 合并发送的数据包，未开启时为nullptr
+    class LuaBinDict *_rpc_dict; // rpc的字符串key字典，见LuaBinDict
 };
@@ -4,6 +4,8 @@
 #include "../../system/static_global.hpp"
 #include "../socket.hpp"
 #include "websocket_packet.hpp"
+#include "ws_deflate.hpp"
+#include "ws_mask.hpp"
 
 /*
 https://tools.ietf.org/pdf/rfc6455.pdf sector 5.2 page28
@@ -78,6 +80,9 @@ page33
    key.
 */
 
+// 防止被攻击，游戏中不应该需要这么大的数据包，暂时不考虑其他应用
+static const size_t MAX_FRAME_LEN = 10 * 1024 * 1024;
+
 // 解析完websocket的header
 int32_t on_frame_header(struct websocket_parser *parser)
 {
@@ -85,8 +90,7 @@ int32_t on_frame_header(struct websocket_parser *parser)
 
     class WebsocketPacket *ws_packet =
         static_cast<class WebsocketPacket *>(parser->data);
-    // 防止被攻击，游戏中不应该需要这么大的数据包，暂时不考虑其他应用
-    if (parser->length > 10 * 1024 * 1024)
+    if (parser->length > MAX_FRAME_LEN)
     {
         ws_packet->set_error(2);
         ELOG("websocket to large packet :" FMT64u, (uint64_t)parser->length);
@@ -112,11 +116,13 @@ int32_t on_frame_body(struct websocket_parser *parser, const char *at,
     class Buffer &body = ws_packet->body_buffer();
 
     // 如果带masking-key，则收到的body都需要用masking-key来解码才能得到原始数据
+    // 一个帧可能分多次收到，mask_offset记录上一次解码到masking-key的位置
     if (parser->flags & WS_HAS_MASK)
     {
         Buffer::Transaction &&ts = body.flat_reserve(length);
 
-        websocket_parser_decode(ts._ctx, at, length, parser);
+        parser->mask_offset = WSMask::mask(ts._ctx, at, length, parser->mask,
+                                           parser->mask_offset);
         body.commit(ts, (int32_t)length);
     }
     else
@@ -144,7 +150,15 @@ int32_t on_frame_end(struct websocket_parser *parser)
     {
         return ws_packet->on_ctrl_end();
     }
-    return ws_packet->on_frame_end();
+
+    // 压缩的分片消息，收到最后一个帧时再一起解压、回调
+    int32_t e = ws_packet->hold_fragment(parser->flags & WS_FINAL_FRAME);
+    if (e) return e < 0 ? -1 : 0;
+
+    e = ws_packet->on_frame_end();
+    ws_packet->shrink_deflate();
+
+    return e;
 }
 
 //< init all field insted of using websocket_parser_settings_init
@@ -161,6 +175,13 @@ WebsocketPacket::WebsocketPacket(class Socket *sk) : HttpPacket(sk)
     _e          = 0;
     _is_upgrade = false;
 
+    _frame_rsv1   = false;
+    _msg_rsv1     = false;
+    _frame_left   = 0;
+    _deflate_bits = 0;
+    _deflate_mem  = 0;
+    _deflate      = nullptr;
+
     _parser = new struct websocket_parser();
     websocket_parser_init(_parser);
     _parser->data = this;
@@ -172,28 +193,79 @@ WebsocketPacket::~WebsocketPacket()
 
     delete _parser;
     _parser = nullptr;
+
+    delete _deflate;
+    _deflate = nullptr;
 }
 
-int32_t WebsocketPacket::pack_raw(lua_State *L, int32_t index)
+size_t WebsocketPacket::max_message() const
 {
-    // 允许握手未完成就发数据，自己保证顺序
-    // if ( !_is_upgrade ) return http_packet::pack_clt( L,index );
+    return MAX_FRAME_LEN;
+}
 
-    websocket_flags flags =
-        static_cast<websocket_flags>(luaL_checkinteger(L, index));
+void WebsocketPacket::shrink_deflate()
+{
+    if (_deflate) _deflate->shrink(true);
+}
 
-    size_t size     = 0;
-    const char *ctx = luaL_optlstring(L, index + 1, nullptr, &size);
-    // if ( !ctx ) return 0; // 允许发送空包
+void WebsocketPacket::set_deflate(int32_t window_bits, int32_t mem_limit)
+{
+    _deflate_bits = window_bits;
+    _deflate_mem  = mem_limit > 0 ? mem_limit : INT32_MAX;
+}
 
-    size_t len = websocket_calc_frame_size(flags, size);
+int32_t WebsocketPacket::pack_frame(int32_t raw_flags, const char *head,
+                                    size_t head_len, const char *ctx,
+                                    size_t size)
+{
+    websocket_flags flags = static_cast<websocket_flags>(raw_flags);
+
+    // 只压缩完整的text、binary帧，控制帧不能压缩(RFC 7692 section 6.1)
+    // 分片的消息需要整个消息一起压缩，这里不处理。空消息也不需要压缩
+    int32_t op   = flags & WS_OP_MASK;
+    bool deflate = _deflate && (flags & WS_FINAL_FRAME)
+                && (WS_OP_TEXT == op || WS_OP_BINARY == op)
+                && head_len + size > 0;
+    if (deflate)
+    {
+        ctx = _deflate->compress(head, head_len, ctx, size, size);
+        if (!ctx) return -1;
 
-    Buffer &buffer           = _socket->get_send_buffer();
-    Buffer::Transaction &&ts = buffer.flat_reserve(len);
+        head     = nullptr;
+        head_len = 0;
+    }
+
+    size_t frame_size = head_len + size;
+    size_t len        = websocket_calc_frame_size(flags, frame_size);
 
     char mask[4] = {0}; /* 服务器发往客户端并不需要mask */
     if (flags & WS_HAS_MASK) new_masking_key(mask);
-    websocket_build_frame(ts._ctx, flags, mask, ctx, size);
+
+    Buffer &buffer           = _socket->get_send_buffer();
+    Buffer::Transaction &&ts = buffer.flat_reserve(len);
+    size_t offset = websocket_build_frame_header(ts._ctx, flags, mask, frame_size);
+
+    // 数据直接拷贝到发送缓冲区，需要掩码的在拷贝的同时编码
+    char *body = ts._ctx + offset;
+    if (flags & WS_HAS_MASK)
+    {
+        uint8_t mask_offset = WSMask::mask(body, head, head_len, mask, 0);
+        WSMask::mask(body + head_len, ctx, size, mask, mask_offset);
+    }
+    else
+    {
+        if (head_len > 0) memcpy(body, head, head_len);
+        if (size > 0) memcpy(body + head_len, ctx, size);
+    }
+
+    // websocket_flags没有RSV位，只能在帧头上直接设置RSV1
+    if (deflate)
+    {
+        ts._ctx[0] |= 0x40;
+
+        // 这时可能还在处理收到的消息(如回调中发送数据)，只能释放压缩缓冲区
+        _deflate->shrink(false);
+    }
 
     buffer.commit(ts, (int32_t)len);
     _socket->flush();
@@ -201,6 +273,25 @@ int32_t WebsocketPacket::pack_raw(lua_State *L, int32_t index)
     return 0;
 }
 
+int32_t WebsocketPacket::pack_raw(lua_State *L, int32_t index)
+{
+    // 允许握手未完成就发数据，自己保证顺序
+    // if ( !_is_upgrade ) return http_packet::pack_clt( L,index );
+
+    int32_t flags = luaL_checkinteger32(L, index);
+
+    size_t size     = 0;
+    const char *ctx = luaL_optlstring(L, index + 1, nullptr, &size);
+    // if ( !ctx ) return 0; // 允许发送空包
+
+    if (pack_frame(flags, nullptr, 0, ctx, size) < 0)
+    {
+        return luaL_error(L, "websocket pack frame error");
+    }
+
+    return 0;
+}
+
 int32_t WebsocketPacket::pack_clt(lua_State *L, int32_t index)
 {
     return pack_raw(L, index);
@@ -218,6 +309,7 @@ int32_t WebsocketPacket::pack_ctrl(lua_State *L, int32_t index)
      * 标识的应用数据。这个数据是用来说明当前控制帧的。比如close帧后面包含status
      * code，及 关闭原因，pong数据包则必须原封不动返回ping数据包中的数据
      */
+    flush_batch(); // 如close帧，必须在已合并的数据之后发出
     return pack_raw(L, index);
 }
 
@@ -228,7 +320,9 @@ int32_t WebsocketPacket::unpack(Buffer &buffer)
      */
     if (!_is_upgrade) return HttpPacket::unpack(buffer);
 
-    _e        = 0; // 重置上一次解析错误
+    _e = 0; // 重置上一次解析错误
+    if (_deflate) return unpack_deflate(buffer);
+
     bool next = false;
 
     // 不要用 buffer.all_to_flat_ctx(size); 这个会把收到的数据都拷贝到缓冲区
@@ -258,6 +352,98 @@ int32_t WebsocketPacket::unpack(Buffer &buffer)
     return 0;
 }
 
+int32_t WebsocketPacket::unpack_deflate(Buffer &buffer)
+{
+    /* websocket_parser不解析RSV1，只能自己从帧头取出。因此每次只把一个帧的数据
+     * 交给parser，这样解析到下一个帧时才能知道帧头在哪
+     */
+    while (true)
+    {
+        if (0 == _frame_left)
+        {
+            const char *head = buffer.to_flat_ctx(2);
+            if (!head) return 0;
+
+            uint8_t byte0 = static_cast<uint8_t>(head[0]);
+            uint8_t byte1 = static_cast<uint8_t>(head[1]);
+            uint8_t len7  = byte1 & 0x7F;
+
+            size_t head_len = (byte1 & 0x80) ? 6 : 2; // masking-key
+            if (126 == len7)
+            {
+                head_len += 2;
+            }
+            else if (127 == len7)
+            {
+                head_len += 8;
+            }
+
+            head = buffer.to_flat_ctx(head_len);
+            if (!head) return 0;
+
+            uint64_t length = len7;
+            if (126 == len7 || 127 == len7)
+            {
+                length = 0;
+                for (int32_t i = 0; i < (126 == len7 ? 2 : 8); i++)
+                {
+                    length = (length << 8) | static_cast<uint8_t>(head[2 + i]);
+                }
+            }
+            if (length > MAX_FRAME_LEN)
+            {
+                set_error(2);
+                ELOG("websocket to large packet :" FMT64u, length);
+                return -1;
+            }
+
+            // 控制帧不允许压缩。压缩的分片消息只在第一个帧设置RSV1，后续的帧
+            // (opcode为0)不能设置，中间可以插入控制帧(RFC 7692 section 6.1)
+            bool rsv1 = 0 != (byte0 & 0x40);
+            bool bad  = false;
+            if (byte0 & 0x08)
+            {
+                bad         = rsv1;
+                _frame_rsv1 = false;
+            }
+            else if (WS_OP_CONTINUE == (byte0 & WS_OP_MASK))
+            {
+                bad         = rsv1;
+                _frame_rsv1 = _msg_rsv1;
+            }
+            else
+            {
+                // 上一个压缩的分片消息还没收完，就开始了一个新的消息
+                bad         = _msg_rsv1;
+                _frame_rsv1 = rsv1;
+                _msg_rsv1   = rsv1 && !(byte0 & 0x80);
+            }
+            if (bad)
+            {
+                set_error(6);
+                ELOG("websocket illegal compressed frame: %d", byte0);
+                return -1;
+            }
+
+            _frame_left = head_len + static_cast<size_t>(length);
+        }
+
+        bool next       = false;
+        size_t size     = 0;
+        const char *ctx = buffer.get_front_used(size, next);
+        if (size == 0) return 0;
+
+        if (size > _frame_left) size = _frame_left;
+        size_t nparser = websocket_parser_execute(_parser, &settings, ctx, size);
+
+        buffer.remove(nparser);
+        _frame_left -= nparser;
+        if (nparser != size) return _e ? -1 : 0;
+    }
+
+    return 0;
+}
+
 int32_t WebsocketPacket::on_message_complete(bool upgrade)
 {
     // 正在情况下，对方应该只下发一个带upgrade标记的http头来进行握手
@@ -311,6 +497,13 @@ int32_t WebsocketPacket::invoke_handshake()
         return -1;
     }
 
+    std::string ext;
+    if (init_deflate(nullptr != key_str, ext) < 0)
+    {
+        set_error(5);
+        return -1;
+    }
+
     static lua_State *L = StaticGlobal::state();
     assert(0 == lua_gettop(L));
 
@@ -319,8 +512,16 @@ int32_t WebsocketPacket::invoke_handshake()
     lua_pushinteger(L, _socket->conn_id());
     lua_pushstring(L, key_str);
     lua_pushstring(L, accept_str);
+    if (ext.empty())
+    {
+        lua_pushnil(L);
+    }
+    else
+    {
+        lua_pushstring(L, ext.c_str());
+    }
 
-    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 3, 0, 1)))
+    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 4, 0, 1)))
     {
         ELOG("websocket handshake:%s", lua_tostring(L, -1));
     }
@@ -330,6 +531,89 @@ int32_t WebsocketPacket::invoke_handshake()
     return _socket->is_closed() ? -1 : 0;
 }
 
+int32_t WebsocketPacket::init_deflate(bool is_srv, std::string &ext)
+{
+    const head_map_t &head_field = _http_info._head_field;
+    head_map_t::const_iterator itr =
+        head_field.find("Sec-WebSocket-Extensions");
+    if (itr == head_field.end()) return 0;
+
+    const char *offer = itr->second.c_str();
+
+    int32_t mem_level = 8;
+    WSDeflate::Params params;
+    if (is_srv)
+    {
+        // 服务器不支持或者参数不能接受，则不回复该扩展，客户端按不压缩处理
+        if (0 == _deflate_bits) return 0;
+        if (!WSDeflate::negotiate_server(offer, _deflate_bits, _deflate_mem,
+                                         params, mem_level, ext))
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        // 服务器回复了未请求或者不支持的扩展，必须断开(RFC 6455 section 9.1)
+        if (0 == _deflate_bits
+            || !WSDeflate::negotiate_client(offer, _deflate_bits,
+                                            _deflate_mem, params, mem_level))
+        {
+            ELOG("websocket unsupported extension: %s", offer);
+            return -1;
+        }
+    }
+
+    delete _deflate;
+    _deflate = new WSDeflate(params, mem_level, max_message());
+
+    return 0;
+}
+
+int32_t WebsocketPacket::hold_fragment(bool fin)
+{
+    if (!_msg_rsv1) return 0;
+
+    // 最后一个帧由get_body拼接到之前的数据后面再解压
+    if (fin)
+    {
+        _msg_rsv1 = false;
+        return 0;
+    }
+
+    size_t size     = 0;
+    const char *ctx = _body.all_to_flat_ctx(size);
+    if (_frag.get_all_used_size() + size > MAX_FRAME_LEN)
+    {
+        set_error(2);
+        ELOG("websocket to large fragmented message");
+        return -1;
+    }
+    if (size > 0) _frag.append(ctx, size);
+
+    return 1;
+}
+
+const char *WebsocketPacket::get_body(size_t &size)
+{
+    const char *ctx = _body.all_to_flat_ctx(size);
+    if (!_frame_rsv1) return ctx;
+
+    // 压缩的分片消息，把最后一个帧的数据拼接到之前的帧后面，整个消息一起解压
+    if (_frag.get_all_used_size() > 0)
+    {
+        if (size > 0) _frag.append(ctx, size);
+        ctx = _frag.all_to_flat_ctx(size);
+    }
+
+    ctx = _deflate->uncompress(ctx, size, size);
+    if (!ctx) set_error(6);
+
+    _frag.clear();
+
+    return ctx;
+}
+
 // 普通websokcet数据帧完成，ctx直接就是字符串，不用decode
 int32_t WebsocketPacket::on_frame_end()
 {
@@ -337,7 +621,8 @@ int32_t WebsocketPacket::on_frame_end()
     assert(0 == lua_gettop(L));
 
     size_t size     = 0;
-    const char *ctx = _body.all_to_flat_ctx(size);
+    const char *ctx = get_body(size);
+    if (!ctx && _e) return -1;
 
     LUA_PUSHTRACEBACK(L);
     lua_getglobal(L, "command_new");
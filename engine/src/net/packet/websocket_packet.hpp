@@ -44,14 +44,74 @@ public:
     /// 设置错误码
     void set_error(int32_t e) { _e = e; }
 
+    /// 收到的消息处理完后释放解压占用的大块内存，见WSDeflate::shrink
+    void shrink_deflate();
+
+    /**
+     * @brief 压缩的分片消息未收完时，保存当前帧的数据
+     * @param fin 当前帧是否为消息的最后一个帧
+     * @return 0 继续处理当前帧，1 已保存，等待后续的帧，<0 错误
+     */
+    int32_t hold_fragment(bool fin);
+
+    /**
+     * @brief 开启permessage-deflate扩展，需要在握手前设置
+     * @param window_bits 压缩的最大窗口(9~15)
+     * @param mem_limit 每个连接压缩上下文的内存上限，0表示不限制
+     */
+    void set_deflate(int32_t window_bits, int32_t mem_limit);
+
 protected:
     int32_t invoke_handshake();
     void new_masking_key(char mask[4]);
     int32_t pack_raw(lua_State *L, int32_t index);
 
+    /**
+     * @brief 握手时根据Sec-WebSocket-Extensions创建压缩上下文
+     * @param is_srv 是否为服务器
+     * @param ext 服务器回复给客户端的扩展
+     * @return <0 错误，需要断开连接
+     */
+    int32_t init_deflate(bool is_srv, std::string &ext);
+
+    /**
+     * @brief 一个消息(压缩的消息为解压后)的最大长度
+     */
+    virtual size_t max_message() const;
+
+    /**
+     * @brief 获取当前帧的数据，压缩的帧会先解压
+     * @param size 数据长度
+     * @return 数据指针，解压出错返回nullptr
+     */
+    const char *get_body(size_t &size);
+
+    /**
+     * @brief 打包一个帧，开启压缩时数据帧会被压缩
+     * @param flags 帧标识，见websocket_flags
+     * @param head 数据前的包头，可为nullptr
+     * @param head_len 包头长度
+     * @param ctx 数据
+     * @param size 数据长度
+     * @return <0 错误
+     */
+    int32_t pack_frame(int32_t flags, const char *head, size_t head_len,
+                       const char *ctx, size_t size);
+
+private:
+    int32_t unpack_deflate(Buffer &buffer);
+
 protected:
     int32_t _e; /// 错误码 websocket_parser没有提供错误机制，这里自己实现
     bool _is_upgrade;
     class Buffer _body;
     struct websocket_parser *_parser;
+
+    bool _frame_rsv1;       /// 当前帧是否压缩(RSV1)
+    bool _msg_rsv1;         /// 是否正在接收一个压缩的分片消息
+    class Buffer _frag;     /// 压缩的分片消息已收到的数据
+    size_t _frame_left;     /// 当前帧还未交给parser的长度
+    int32_t _deflate_bits;  /// 压缩的最大窗口，0表示不开启压缩
+    int32_t _deflate_mem;   /// 压缩上下文的内存上限
+    class WSDeflate *_deflate;
 };
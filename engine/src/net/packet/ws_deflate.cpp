@@ -0,0 +1,425 @@
+#include <chrono>
+#include <vector>
+
+#include "../../system/static_global.hpp"
+#include "../../ev/buffer.hpp"
+#include "ws_deflate.hpp"
+
+/// 按RFC 7692 7.2.1，每个压缩的消息以Z_SYNC_FLUSH结束，并去掉末尾的这4个字节
+static const char DEFLATE_TAIL[4] = {0x00, 0x00, (char)0xFF, (char)0xFF};
+
+static int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static std::string trim(const std::string &str)
+{
+    size_t beg = str.find_first_not_of(" \t");
+    if (std::string::npos == beg) return std::string();
+
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(beg, end - beg + 1);
+}
+
+/**
+ * @brief 解析一个扩展，如 permessage-deflate; client_max_window_bits=10
+ * @param ext 单个扩展的字符串
+ * @param params 参数名及参数值，无参数值的为空字符串
+ * @return 扩展名
+ */
+static std::string parse_extension(
+    const std::string &ext,
+    std::vector<std::pair<std::string, std::string>> &params)
+{
+    std::string name;
+    size_t beg = 0;
+    while (beg <= ext.size())
+    {
+        size_t end = ext.find(';', beg);
+        if (std::string::npos == end) end = ext.size();
+
+        std::string token = trim(ext.substr(beg, end - beg));
+        if (name.empty())
+        {
+            name = token;
+        }
+        else if (!token.empty())
+        {
+            size_t eq = token.find('=');
+            if (std::string::npos == eq)
+            {
+                params.emplace_back(token, std::string());
+            }
+            else
+            {
+                std::string val = trim(token.substr(eq + 1));
+                // 参数值允许带引号
+                if (val.size() >= 2 && '"' == val.front() && '"' == val.back())
+                {
+                    val = val.substr(1, val.size() - 2);
+                }
+                params.emplace_back(trim(token.substr(0, eq)), val);
+            }
+        }
+        beg = end + 1;
+    }
+
+    return name;
+}
+
+/// 解析窗口大小参数，不合法返回-1
+static int32_t parse_window_bits(const std::string &val)
+{
+    if (val.empty() || val.size() > 2) return -1;
+
+    int32_t bits = atoi(val.c_str());
+    return (bits >= 8 && bits <= WSDeflate::MAX_WINDOW_BITS) ? bits : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+WSDeflate::WSDeflate(const Params &params, int32_t mem_level,
+                     size_t max_inflate)
+    : _params(params), _max_inflate(max_inflate)
+{
+    memset(&_deflate, 0, sizeof(_deflate));
+    memset(&_inflate, 0, sizeof(_inflate));
+
+    // windowBits为负数表示raw deflate，没有zlib头及校验
+    int32_t e = deflateInit2(&_deflate, Z_BEST_SPEED, Z_DEFLATED,
+                             -_params._deflate_bits, mem_level,
+                             Z_DEFAULT_STRATEGY);
+    if (Z_OK != e) ELOG("ws deflateInit2 error:%d", e);
+
+    e = inflateInit2(&_inflate, -_params._inflate_bits);
+    if (Z_OK != e) ELOG("ws inflateInit2 error:%d", e);
+
+    // 上下文的内存由zlib分配，按协商的参数估算后计入缓冲区内存预算
+    _ctx_mem = calc_mem(_params._deflate_bits, mem_level, _params._inflate_bits);
+    Buffer::CtxPool::add_extra(_ctx_mem);
+
+    C_OBJECT_ADD("ws_deflate");
+}
+
+WSDeflate::~WSDeflate()
+{
+    deflateEnd(&_deflate);
+    inflateEnd(&_inflate);
+
+    Buffer::CtxPool::add_extra(
+        -static_cast<int64_t>(_ctx_mem + _zip.size() + _unzip.size()));
+
+    C_OBJECT_DEC("ws_deflate");
+}
+
+void WSDeflate::resize_buff(std::string &buff, size_t len)
+{
+    size_t old_len = buff.size();
+    if (0 == len)
+    {
+        // resize(0)及shrink_to_fit不保证释放内存
+        std::string().swap(buff);
+    }
+    else
+    {
+        buff.resize(len);
+    }
+
+    Buffer::CtxPool::add_extra(static_cast<int64_t>(len)
+                               - static_cast<int64_t>(old_len));
+}
+
+void WSDeflate::shrink(bool unzip)
+{
+    std::string &buff = unzip ? _unzip : _zip;
+    if (buff.size() > KEEP_BUFF) resize_buff(buff, 0);
+}
+
+int32_t WSDeflate::calc_mem(int32_t deflate_bits, int32_t mem_level,
+                            int32_t inflate_bits)
+{
+    // 见zlib的zconf.h，另外加上z_stream等结构本身的内存
+    return (1 << (deflate_bits + 2)) + (1 << (mem_level + 9))
+           + (1 << inflate_bits) + 12 * 1024;
+}
+
+bool WSDeflate::fit_mem(int32_t mem_limit, Params &params, int32_t &mem_level)
+{
+    mem_level = 8;
+    while (calc_mem(params._deflate_bits, mem_level, params._inflate_bits)
+           > mem_limit)
+    {
+        // 优先减小压缩的窗口，内存等级跟着窗口一起减小
+        if (params._deflate_bits > MIN_WINDOW_BITS)
+        {
+            params._deflate_bits--;
+            mem_level = std::max(1, std::min(8, params._deflate_bits - 7));
+        }
+        else if (mem_level > 1)
+        {
+            mem_level--;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WSDeflate::negotiate_server(const char *offer, int32_t window_bits,
+                                 int32_t mem_limit, Params &params,
+                                 int32_t &mem_level, std::string &response)
+{
+    response.clear();
+    if (!offer) return false;
+
+    window_bits =
+        std::max(MIN_WINDOW_BITS, std::min(MAX_WINDOW_BITS, window_bits));
+
+    // 客户端可以同时请求多个扩展或者多组参数，按顺序选择第一个能接受的
+    std::string offers(offer);
+    size_t beg = 0;
+    while (beg < offers.size())
+    {
+        size_t end = offers.find(',', beg);
+        if (std::string::npos == end) end = offers.size();
+
+        std::vector<std::pair<std::string, std::string>> ext_params;
+        std::string name =
+            parse_extension(offers.substr(beg, end - beg), ext_params);
+        beg = end + 1;
+
+        if ("permessage-deflate" != name) continue;
+
+        bool ok             = true;
+        bool has_srv_bits   = false;
+        bool has_clt_bits   = false;
+        int32_t srv_bits    = MAX_WINDOW_BITS;
+        int32_t clt_bits    = MAX_WINDOW_BITS;
+
+        params._deflate_no_takeover = false;
+        params._inflate_no_takeover = false;
+        for (const auto &p : ext_params)
+        {
+            if ("server_no_context_takeover" == p.first)
+            {
+                params._deflate_no_takeover = true;
+            }
+            else if ("client_no_context_takeover" == p.first)
+            {
+                params._inflate_no_takeover = true;
+            }
+            else if ("server_max_window_bits" == p.first)
+            {
+                has_srv_bits = true;
+                srv_bits     = parse_window_bits(p.second);
+                // zlib不支持8位的窗口，只能拒绝
+                if (srv_bits < MIN_WINDOW_BITS) ok = false;
+            }
+            else if ("client_max_window_bits" == p.first)
+            {
+                has_clt_bits = true;
+                if (!p.second.empty())
+                {
+                    clt_bits = parse_window_bits(p.second);
+                    if (clt_bits < 0) ok = false;
+                }
+            }
+            else
+            {
+                ok = false; // 不认识的参数，不能接受这组参数
+            }
+        }
+        if (!ok) continue;
+
+        params._deflate_bits = std::min(window_bits, srv_bits);
+        // 客户端不支持client_max_window_bits时，只能按最大窗口解压
+        params._inflate_bits =
+            has_clt_bits ? std::min(window_bits, clt_bits) : MAX_WINDOW_BITS;
+        if (!fit_mem(mem_limit, params, mem_level)) continue;
+
+        char buff[64];
+        response = "permessage-deflate";
+        if (params._deflate_no_takeover) response += "; server_no_context_takeover";
+        if (params._inflate_no_takeover) response += "; client_no_context_takeover";
+        if (has_srv_bits || params._deflate_bits < MAX_WINDOW_BITS)
+        {
+            snprintf(buff, sizeof(buff), "; server_max_window_bits=%d",
+                     params._deflate_bits);
+            response += buff;
+        }
+        if (has_clt_bits)
+        {
+            snprintf(buff, sizeof(buff), "; client_max_window_bits=%d",
+                     params._inflate_bits);
+            response += buff;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool WSDeflate::negotiate_client(const char *response, int32_t window_bits,
+                                 int32_t mem_limit, Params &params,
+                                 int32_t &mem_level)
+{
+    if (!response) return false;
+
+    std::vector<std::pair<std::string, std::string>> ext_params;
+    if ("permessage-deflate" != parse_extension(response, ext_params))
+    {
+        return false;
+    }
+
+    params._deflate_bits =
+        std::max(MIN_WINDOW_BITS, std::min(MAX_WINDOW_BITS, window_bits));
+    params._inflate_bits        = MAX_WINDOW_BITS;
+    params._deflate_no_takeover = false;
+    params._inflate_no_takeover = false;
+    for (const auto &p : ext_params)
+    {
+        if ("server_no_context_takeover" == p.first)
+        {
+            params._inflate_no_takeover = true;
+        }
+        else if ("client_no_context_takeover" == p.first)
+        {
+            params._deflate_no_takeover = true;
+        }
+        else if ("server_max_window_bits" == p.first)
+        {
+            int32_t bits = parse_window_bits(p.second);
+            if (bits < 0) return false;
+            params._inflate_bits = bits;
+        }
+        else if ("client_max_window_bits" == p.first)
+        {
+            int32_t bits = parse_window_bits(p.second);
+            if (bits < MIN_WINDOW_BITS) return false;
+            params._deflate_bits = std::min(params._deflate_bits, bits);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // 服务器已经同意了，解压的窗口由服务器决定，超出内存上限也只能接受
+    fit_mem(mem_limit, params, mem_level);
+    return true;
+}
+
+int32_t WSDeflate::do_deflate(const char *ctx, size_t size, int32_t flush)
+{
+    _deflate.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(ctx));
+    _deflate.avail_in = static_cast<uInt>(size);
+    do
+    {
+        size_t used = _deflate.total_out;
+        if (_zip.size() - used < 64) resize_buff(_zip, used + size + 1024);
+
+        _deflate.next_out  = reinterpret_cast<Bytef *>(&_zip[used]);
+        _deflate.avail_out = static_cast<uInt>(_zip.size() - used);
+
+        int32_t e = deflate(&_deflate, flush);
+        if (Z_OK != e && Z_BUF_ERROR != e) return e;
+    } while (0 == _deflate.avail_out);
+
+    return Z_OK;
+}
+
+const char *WSDeflate::compress(const char *head, size_t head_len,
+                                const char *ctx, size_t size, size_t &len)
+{
+    int64_t beg = now_us();
+
+    // total_out作为_zip的写入位置，每个消息开始时清零(不影响压缩上下文)
+    _deflate.total_out = 0;
+
+    int32_t e = Z_OK;
+    if (head_len > 0) e = do_deflate(head, head_len, Z_NO_FLUSH);
+    if (Z_OK == e) e = do_deflate(ctx, size, Z_SYNC_FLUSH);
+
+    len = _deflate.total_out;
+    if (Z_OK != e || len < sizeof(DEFLATE_TAIL)
+        || 0 != memcmp(&_zip[len - 4], DEFLATE_TAIL, sizeof(DEFLATE_TAIL)))
+    {
+        ELOG("ws deflate error:%d", e);
+        deflateReset(&_deflate);
+        return nullptr;
+    }
+    len -= sizeof(DEFLATE_TAIL);
+
+    if (_params._deflate_no_takeover) deflateReset(&_deflate);
+
+    G_STAT->add_ws_deflate(false, head_len + size, len, now_us() - beg);
+    return _zip.data();
+}
+
+const char *WSDeflate::uncompress(const char *ctx, size_t size, size_t &len)
+{
+    int64_t beg = now_us();
+
+    bool stream_end    = false;
+    _inflate.total_out = 0;
+
+    // 先解压数据，再补上发送时去掉的结尾
+    const char *in[2]    = {ctx, DEFLATE_TAIL};
+    size_t in_size[2]    = {size, sizeof(DEFLATE_TAIL)};
+    for (int32_t i = 0; i < 2 && !stream_end; i++)
+    {
+        _inflate.next_in  = reinterpret_cast<Bytef *>(const_cast<char *>(in[i]));
+        _inflate.avail_in = static_cast<uInt>(in_size[i]);
+        do
+        {
+            size_t used = _inflate.total_out;
+            if (used > _max_inflate)
+            {
+                ELOG("ws inflate too large:" FMT64u, (uint64_t)used);
+                inflateReset(&_inflate);
+                return nullptr;
+            }
+            // 最多只多分配1024，超过上限的数据不会写满整个缓冲区
+            if (_unzip.size() - used < 1024)
+            {
+                resize_buff(_unzip,
+                            std::min(used * 2 + 4096, _max_inflate + 1024));
+            }
+
+            _inflate.next_out  = reinterpret_cast<Bytef *>(&_unzip[used]);
+            _inflate.avail_out = static_cast<uInt>(_unzip.size() - used);
+
+            int32_t e = inflate(&_inflate, Z_SYNC_FLUSH);
+            if (Z_STREAM_END == e)
+            {
+                // 对方设置了BFINAL，后面的消息需要新的上下文
+                stream_end = true;
+                break;
+            }
+            if (Z_OK != e && Z_BUF_ERROR != e)
+            {
+                ELOG("ws inflate error:%d", e);
+                inflateReset(&_inflate);
+                return nullptr;
+            }
+        } while (_inflate.avail_in > 0 || 0 == _inflate.avail_out);
+    }
+
+    len = _inflate.total_out;
+    if (len > _max_inflate)
+    {
+        ELOG("ws inflate too large:" FMT64u, (uint64_t)len);
+        inflateReset(&_inflate);
+        return nullptr;
+    }
+    if (stream_end || _params._inflate_no_takeover) inflateReset(&_inflate);
+
+    G_STAT->add_ws_deflate(true, len, size, now_us() - beg);
+    return _unzip.data();
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <string>
+#include <zlib.h>
+
+#include "../../global/global.hpp"
+
+/**
+ * @brief websocket的permessage-deflate扩展(RFC 7692)
+ * 1. 每个连接一个压缩、解压上下文，默认保留上下文(context takeover)，后续消息
+ *    可以引用之前消息的数据，压缩率比单个消息压缩高很多
+ * 2. 上下文的内存由窗口大小决定，握手时根据内存上限协商窗口大小
+ *    deflate约为 2^(window_bits + 2) + 2^(mem_level + 9)，inflate约为 2^window_bits
+ *    收发消息用的缓冲区不在这个上限内，超过KEEP_BUFF的在消息处理完后释放。上下文
+ *    及缓冲区都计入缓冲区内存预算(见LNetworkMgr::set_buffer_budget)
+ * 3. 只在主线程使用
+ */
+class WSDeflate final
+{
+public:
+    /// 协商后的参数
+    struct Params
+    {
+        int32_t _deflate_bits;   ///< 压缩的窗口大小
+        int32_t _inflate_bits;   ///< 解压的窗口大小，由对方决定
+        bool _deflate_no_takeover; ///< 压缩时不保留上下文
+        bool _inflate_no_takeover; ///< 解压时不保留上下文
+    };
+
+    /// zlib的raw deflate不支持8位的窗口，协商时最小为9
+    static constexpr int32_t MIN_WINDOW_BITS = 9;
+    static constexpr int32_t MAX_WINDOW_BITS = 15;
+
+    /// 压缩、解压缓冲区超过这个大小时，消息处理完后释放，见shrink
+    static constexpr size_t KEEP_BUFF = 64 * 1024;
+
+public:
+    ~WSDeflate();
+    /**
+     * @param params 协商后的参数
+     * @param mem_level 协商后deflate的内存等级
+     * @param max_inflate 解压后消息的最大长度，超过则认为数据错误，防止压缩炸弹
+     */
+    WSDeflate(const Params &params, int32_t mem_level, size_t max_inflate);
+
+    /**
+     * @brief 服务器根据客户端的Sec-WebSocket-Extensions协商参数
+     * @param offer 客户端请求的扩展
+     * @param window_bits 服务器设置的最大窗口
+     * @param mem_limit 每个连接的内存上限
+     * @param params 协商后的参数
+     * @param mem_level 协商后deflate的内存等级
+     * @param response 回复给客户端的扩展，空表示不使用该扩展
+     * @return 是否使用该扩展
+     */
+    static bool negotiate_server(const char *offer, int32_t window_bits,
+                                 int32_t mem_limit, Params &params,
+                                 int32_t &mem_level, std::string &response);
+
+    /**
+     * @brief 客户端根据服务器回复的Sec-WebSocket-Extensions确定参数
+     * @param response 服务器回复的扩展
+     * @param window_bits 客户端设置的最大窗口
+     * @param mem_limit 每个连接的内存上限
+     * @param params 协商后的参数
+     * @param mem_level 协商后deflate的内存等级
+     * @return 是否使用该扩展
+     */
+    static bool negotiate_client(const char *response, int32_t window_bits,
+                                 int32_t mem_limit, Params &params,
+                                 int32_t &mem_level);
+
+    /**
+     * @brief 压缩一个消息，可以在数据前加一个包头，避免先拼接再压缩
+     * @param head 包头，可为nullptr
+     * @param head_len 包头长度
+     * @param ctx 消息数据
+     * @param size 消息长度
+     * @param len 压缩后的长度
+     * @return 压缩后的数据，在下一次压缩前有效。出错返回nullptr
+     */
+    const char *compress(const char *head, size_t head_len, const char *ctx,
+                         size_t size, size_t &len);
+
+    /**
+     * @brief 解压一个消息
+     * @param ctx 压缩的数据
+     * @param size 数据长度
+     * @param len 解压后的长度
+     * @return 解压后的数据，在下一次解压前有效。出错返回nullptr
+     */
+    const char *uncompress(const char *ctx, size_t size, size_t &len);
+
+    /**
+     * @brief 释放超过KEEP_BUFF的缓冲区，偶尔的大消息不会一直占用内存
+     * 压缩、解压的结果使用完后分别调用
+     * @param unzip 释放解压缓冲区，否则释放压缩缓冲区
+     */
+    void shrink(bool unzip);
+
+private:
+    /// 估算一个连接使用的内存
+    static int32_t calc_mem(int32_t deflate_bits, int32_t mem_level,
+                            int32_t inflate_bits);
+    /// 在内存上限内选择压缩窗口及内存等级
+    static bool fit_mem(int32_t mem_limit, Params &params, int32_t &mem_level);
+
+    int32_t do_deflate(const char *ctx, size_t size, int32_t flush);
+
+    /// 调整缓冲区大小，并计入缓冲区内存预算(Buffer::CtxPool::add_extra)
+    static void resize_buff(std::string &buff, size_t len);
+
+private:
+    Params _params;
+    size_t _max_inflate; // 解压后消息的最大长度
+    int32_t _ctx_mem;    // 压缩、解压上下文估算的内存，见calc_mem
+    z_stream _deflate;
+    z_stream _inflate;
+
+    std::string _zip;   // 压缩后的数据
+    std::string _unzip; // 解压后的数据
+};
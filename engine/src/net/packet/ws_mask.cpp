@@ -0,0 +1,144 @@
+#include <cstring>
+
+#include "ws_mask.hpp"
+
+// x86_64一定支持SSE2
+#if defined(__x86_64__) || defined(_M_X64)
+    #define WS_MASK_SSE2
+    #include <emmintrin.h>
+    // MSVC没有__builtin_cpu_supports，只使用SSE2
+    #if defined(__GNUC__) || defined(__clang__)
+        #define WS_MASK_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
+typedef void (*MaskFunc)(char *, const char *, size_t, const uint32_t);
+
+/// 从offset开始的4个字节的masking-key组成一个32位的掩码，内存序与数据一致
+static inline uint32_t rotate_key(const char key[4], uint8_t offset)
+{
+    char rotated[4];
+    for (int32_t i = 0; i < 4; i++) rotated[i] = key[(offset + i) & 3];
+
+    uint32_t key32;
+    memcpy(&key32, rotated, sizeof(key32));
+    return key32;
+}
+
+/// 每次处理8字节，剩余的逐个字节处理
+static void mask_u64(char *dst, const char *src, size_t len,
+                     const uint32_t key32)
+{
+    const uint64_t key64 = (static_cast<uint64_t>(key32) << 32) | key32;
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t v;
+        memcpy(&v, src + i, sizeof(v));
+        v ^= key64;
+        memcpy(dst + i, &v, sizeof(v));
+    }
+
+    const char *key = reinterpret_cast<const char *>(&key32);
+    for (; i < len; i++) dst[i] = static_cast<char>(src[i] ^ key[i & 3]);
+}
+
+#ifdef WS_MASK_SSE2
+static void mask_sse2(char *dst, const char *src, size_t len,
+                      const uint32_t key32)
+{
+    const __m128i key128 = _mm_set1_epi32(static_cast<int32_t>(key32));
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_xor_si128(v, key128));
+    }
+
+    // 每次处理的长度都是4的倍数，剩余部分的掩码不需要重新计算偏移
+    mask_u64(dst + i, src + i, len - i, key32);
+}
+#endif
+
+#ifdef WS_MASK_AVX2
+__attribute__((target("avx2"))) static void
+mask_avx2(char *dst, const char *src, size_t len, const uint32_t key32)
+{
+    const __m256i key256 = _mm256_set1_epi32(static_cast<int32_t>(key32));
+
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                            _mm256_xor_si256(v, key256));
+    }
+
+    // 剩余部分不能调用mask_sse2，混用AVX与非VEX编码的SSE指令会有切换的开销
+    if (i + 16 <= len)
+    {
+        __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                         _mm_xor_si128(v, _mm256_castsi256_si128(key256)));
+        i += 16;
+    }
+
+    const char *key = reinterpret_cast<const char *>(&key32);
+    for (; i < len; i++) dst[i] = static_cast<char>(src[i] ^ key[i & 3]);
+}
+#endif
+
+struct MaskImpl
+{
+    MaskFunc _func;
+    const char *_name;
+};
+
+static MaskImpl select_impl()
+{
+#ifdef WS_MASK_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {mask_avx2, "avx2"};
+#endif
+#ifdef WS_MASK_SSE2
+    return {mask_sse2, "sse2"};
+#else
+    return {mask_u64, "u64"};
+#endif
+}
+
+static const MaskImpl impl = select_impl();
+
+uint8_t WSMask::mask(char *dst, const char *src, size_t len, const char key[4],
+                     uint8_t offset)
+{
+    // 数据很少时(如控制帧)，直接逐个字节处理
+    if (len < 16) return mask_bytes(dst, src, len, key, offset);
+
+    impl._func(dst, src, len, rotate_key(key, offset));
+
+    return static_cast<uint8_t>((offset + len) & 3);
+}
+
+uint8_t WSMask::mask_bytes(char *dst, const char *src, size_t len,
+                           const char key[4], uint8_t offset)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        dst[i] = static_cast<char>(src[i] ^ key[(offset + i) & 3]);
+    }
+
+    return static_cast<uint8_t>((offset + len) & 3);
+}
+
+const char *WSMask::impl_name()
+{
+    return impl._name;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief websocket的掩码处理(RFC 6455 section 5.3)
+ * 掩码就是按字节和masking-key异或，编码和解码是同一个操作。websocket_parser
+ * 是逐个字节处理的，数据量大时比较慢，这里按SIMD寄存器的宽度批量处理
+ *
+ * 1. x86下运行时检测CPU，支持AVX2则每次处理32字节，否则使用SSE2每次16字节
+ * 2. 其他平台每次处理8字节
+ * 3. 不依赖引擎的其他模块，性能测试程序可以直接链接
+ */
+class WSMask final
+{
+public:
+    /**
+     * @brief 对数据进行掩码编码或者解码
+     * @param dst 输出的缓冲区，可以和src相同(原地处理)
+     * @param src 需要处理的数据
+     * @param len 数据长度
+     * @param key masking-key
+     * @param offset 从masking-key的第几个字节开始，用于一个帧分多次处理
+     * @return 下一次处理时的offset
+     */
+    static uint8_t mask(char *dst, const char *src, size_t len,
+                        const char key[4], uint8_t offset);
+
+    /**
+     * @brief 逐个字节处理，与websocket_parser的实现一致，用于测试对比
+     */
+    static uint8_t mask_bytes(char *dst, const char *src, size_t len,
+                              const char key[4], uint8_t offset);
+
+    /// 当前使用的实现名，用于日志、性能测试
+    static const char *impl_name();
+};
@@ -3,11 +3,18 @@
 #include "../../lua_cpplib/ltools.hpp"
 #include "../../system/static_global.hpp"
 #include "../socket.hpp"
+#include "clt_batch.hpp"
 #include "ws_stream_packet.hpp"
 
-WSStreamPacket::~WSStreamPacket() {}
+WSStreamPacket::~WSStreamPacket()
+{
+    delete _batch;
+}
 
-WSStreamPacket::WSStreamPacket(class Socket *sk) : WebsocketPacket(sk) {}
+WSStreamPacket::WSStreamPacket(class Socket *sk) : WebsocketPacket(sk)
+{
+    _batch = nullptr;
+}
 
 /* 打包服务器发往客户端数据包
  * pack_clt( cmd,errno,flags,ctx )
@@ -32,6 +39,23 @@ int32_t WSStreamPacket::pack_clt(lua_State *L, int32_t index)
         return luaL_error(L, "no command conf found: %d", cmd);
     }
 
+    // 预先编码的数据包按指定的帧类型发送，不使用共享数据
+    const LNetworkMgr::EncodedPacket *encoded =
+        network_mgr->check_encoded(L, index + 3, _socket->get_codec_type(), cmd);
+    if (encoded)
+    {
+        const Buffer::Shared *shared = encoded->_shared;
+        if (do_pack_clt(flags, cmd, ecode, shared->get_ctx(), shared->size()) < 0)
+        {
+            return luaL_error(L, "can not do_pack_clt");
+        }
+
+        PKT_STAT_ADD(SPT_SCPK, cmd,
+                     int32_t(shared->size() + sizeof(struct s2c_header)),
+                     STAT_TIME_END());
+        return 0;
+    }
+
     Codec *encoder =
         StaticGlobal::codec_mgr()->get_codec(_socket->get_codec_type());
 
@@ -96,34 +120,28 @@ int32_t WSStreamPacket::pack_srv(lua_State *L, int32_t index)
     SET_HEADER_LENGTH(c2sh, size, cmd, SET_LENGTH_FAIL_ENCODE);
     c2sh._cmd = static_cast<uint16_t>(cmd);
 
-    size_t frame_size  = size + sizeof(c2sh);
-
-    const char *header_ctx = reinterpret_cast<const char *>(&c2sh);
-    size_t len             = websocket_calc_frame_size(flags, frame_size);
-
-    char mask[4] = {0};
-    new_masking_key(mask);
-
-    uint8_t mask_offset = 0;
-    Buffer &buffer      = _socket->get_send_buffer();
-    Buffer::Transaction &&ts = buffer.flat_reserve(len);
-    size_t offset = websocket_build_frame_header(ts._ctx, flags, mask, frame_size);
-    offset += websocket_append_frame(ts._ctx + offset, flags, mask, header_ctx,
-                                     sizeof(c2sh), &mask_offset);
-    websocket_append_frame(ts._ctx + offset, flags, mask, ctx, size,
-                           &mask_offset);
+    if (pack_frame(flags, reinterpret_cast<const char *>(&c2sh), sizeof(c2sh),
+                   ctx, size) < 0)
+    {
+        encoder->finalize();
+        return luaL_error(L, "websocket pack frame error:%d", cmd);
+    }
 
     encoder->finalize();
 
-    buffer.commit(ts, (int32_t)len);
-    _socket->flush();
-
     PKT_STAT_ADD(SPT_CSPK, cmd, int32_t(c2sh._length), STAT_TIME_END());
 
     return 0;
 }
 
 /* 数据帧完成 */
+size_t WSStreamPacket::max_message() const
+{
+    // 服务器收到的是c2s包，作为客户端时收到的是s2c包
+    return std::max(sizeof(struct c2s_header), sizeof(struct s2c_header))
+           + MAX_PACKET_LEN;
+}
+
 int32_t WSStreamPacket::on_frame_end()
 {
     Socket::ConnType conn_ty = _socket->conn_type();
@@ -133,11 +151,12 @@ int32_t WSStreamPacket::on_frame_end()
         return sc_command();
     }
 
-    static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
+    static class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
 
     /* 服务器收到的包，看要不要转发 */
     size_t data_size     = 0;
-    const char *data_ctx = _body.all_to_flat_ctx(data_size);
+    const char *data_ctx = get_body(data_size);
+    if (!data_ctx && _e) return -1;
     if (data_size < sizeof(struct c2s_header))
     {
         ELOG("ws_stream_packet on_frame_end packet incomplete");
@@ -154,6 +173,9 @@ int32_t WSStreamPacket::on_frame_end()
         return 0;
     }
 
+    /* 超出流量限制的包直接丢弃，不解码也不转发 */
+    if (!network_mgr->flood_check(_socket, cmd)) return 0;
+
     size_t size     = data_size - sizeof(*header);
     const char *ctx = reinterpret_cast<const char *>(header + 1);
     if (0 != network_mgr->cs_dispatch(cmd, _socket, ctx, size)) return 0;
@@ -164,13 +186,9 @@ int32_t WSStreamPacket::on_frame_end()
 /* 回调server to client的数据包 */
 int32_t WSStreamPacket::sc_command()
 {
-    static lua_State *L                         = StaticGlobal::state();
-    static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
-
-    assert(0 == lua_gettop(L));
-
     size_t data_size     = 0;
-    const char *data_ctx = _body.all_to_flat_ctx(data_size);
+    const char *data_ctx = get_body(data_size);
+    if (!data_ctx && _e) return -1;
     if (data_size < sizeof(struct s2c_header))
     {
         ELOG("ws_stream_packet sc_command packet incomplete");
@@ -180,13 +198,61 @@ int32_t WSStreamPacket::sc_command()
     const struct s2c_header *header =
         reinterpret_cast<const struct s2c_header *>(data_ctx);
 
-    int cmd = header->_cmd;
     if (data_size < header->_length)
     {
-        ELOG("ws_stream_packet sc_command packet length error:%d", cmd);
+        ELOG("ws_stream_packet sc_command packet length error:%d",
+             (int32_t)header->_cmd);
+        return 0;
+    }
+
+    if (EXPECT_FALSE(BATCH_PKT_CMD == header->_cmd)) return sc_batch(header);
+
+    return sc_command(header, data_size);
+}
+
+/* 拆分合并发送的容器包，见CltBatch */
+int32_t WSStreamPacket::sc_batch(const struct s2c_header *header)
+{
+    if (SPT_BTCP != header->_errno)
+    {
+        ELOG("ws_stream_packet sc_batch unknow container type:%d",
+             header->_errno);
         return 0;
     }
 
+    const char *ctx = reinterpret_cast<const char *>(header + 1);
+    size_t size     = PACKET_BUFFER_LEN(header);
+    while (size > 0)
+    {
+        const struct s2c_header *one =
+            reinterpret_cast<const struct s2c_header *>(ctx);
+        if (size < sizeof(*one) || one->_length < sizeof(*one)
+            || one->_length > size || BATCH_PKT_CMD == one->_cmd)
+        {
+            ELOG("ws_stream_packet sc_batch packet broken");
+            return 0;
+        }
+
+        // 脚本可能在处理其中一个包时关闭了连接
+        if (sc_command(one, one->_length) < 0) return -1;
+
+        ctx += one->_length;
+        size -= one->_length;
+    }
+
+    return 0;
+}
+
+/* 回调一个server to client的数据包 */
+int32_t WSStreamPacket::sc_command(const struct s2c_header *header,
+                                   size_t data_size)
+{
+    static lua_State *L                         = StaticGlobal::state();
+    static const class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
+
+    assert(0 == lua_gettop(L));
+
+    int cmd = header->_cmd;
     const CmdCfg *cmd_cfg = network_mgr->get_sc_cmd(cmd);
     if (!cmd_cfg)
     {
@@ -194,16 +260,33 @@ int32_t WSStreamPacket::sc_command()
         return 0;
     }
 
+    size_t size     = data_size - sizeof(*header);
+    const char *ctx = reinterpret_cast<const char *>(header + 1);
+
+    uint16_t ecode = header->_errno;
+    if (_socket->is_compress() && (ecode & PKT_COMPRESS))
+    {
+        ecode = static_cast<uint16_t>(ecode & ~PKT_COMPRESS);
+        ctx   = StaticGlobal::codec_mgr()->get_compressor()->uncompress(
+            ctx, data_size - sizeof(*header), size);
+        if (!ctx)
+        {
+            ELOG("ws_stream_packet sc_command uncompress error:%d", cmd);
+            return 0;
+        }
+    }
+
     LUA_PUSHTRACEBACK(L);
     lua_getglobal(L, "command_new");
     lua_pushinteger(L, _socket->conn_id());
     lua_pushinteger(L, cmd);
-    lua_pushinteger(L, header->_errno);
-
-    size_t size     = data_size - sizeof(*header);
-    const char *ctx = reinterpret_cast<const char *>(header + 1);
+    lua_pushinteger(L, ecode);
     Codec *decoder =
         StaticGlobal::codec_mgr()->get_codec(_socket->get_codec_type());
+    // 解压、跨chunk拼接的数据在回调脚本期间可能被覆盖
+    decoder->set_stable(!_frame_rsv1
+                        && ctx == reinterpret_cast<const char *>(header + 1)
+                        && !Buffer::is_large_buffer(ctx));
     int32_t cnt = decoder->decode(L, ctx, size, cmd_cfg);
     if (cnt < 0)
     {
@@ -211,7 +294,9 @@ int32_t WSStreamPacket::sc_command()
         return 0;
     }
 
-    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 3 + cnt, 0, 1)))
+    int32_t ok = lua_pcall(L, 3 + cnt, 0, 1);
+    decoder->decode_done();
+    if (EXPECT_FALSE(LUA_OK != ok))
     {
         ELOG("websocket stream sc_command:%s", lua_tostring(L, -1));
     }
@@ -242,6 +327,7 @@ int32_t WSStreamPacket::cs_command(int32_t cmd, const char *ctx, size_t size)
 
     Codec *decoder =
         StaticGlobal::codec_mgr()->get_codec(_socket->get_codec_type());
+    decoder->set_stable(!_frame_rsv1 && !Buffer::is_large_buffer(ctx));
     int32_t cnt = decoder->decode(L, ctx, (int32_t)size, cmd_cfg);
     if (cnt < 0)
     {
@@ -249,7 +335,9 @@ int32_t WSStreamPacket::cs_command(int32_t cmd, const char *ctx, size_t size)
         return 0;
     }
 
-    if (EXPECT_FALSE(LUA_OK != lua_pcall(L, 2 + cnt, 0, 1)))
+    int32_t ok = lua_pcall(L, 2 + cnt, 0, 1);
+    decoder->decode_done();
+    if (EXPECT_FALSE(LUA_OK != ok))
     {
         ELOG("websocket stream cs_command:%s", lua_tostring(L, -1));
     }
@@ -273,29 +361,64 @@ int32_t WSStreamPacket::raw_pack_clt(int32_t cmd, uint16_t ecode,
 int32_t WSStreamPacket::do_pack_clt(int32_t raw_flags, int32_t cmd,
                                     uint16_t ecode, const char *ctx, size_t size)
 {
+    if (_socket->compress_clt(cmd, ecode, ctx, size) < 0) return -1;
+
     struct s2c_header s2ch;
     SET_HEADER_LENGTH(s2ch, size, cmd, SET_LENGTH_FAIL_RETURN);
     s2ch._cmd   = static_cast<uint16_t>(cmd);
     s2ch._errno = ecode;
 
-    size_t frame_size  = size + sizeof(s2ch);
-
-    websocket_flags flags  = static_cast<websocket_flags>(raw_flags);
-    const char *header_ctx = reinterpret_cast<const char *>(&s2ch);
-    size_t len             = websocket_calc_frame_size(flags, frame_size);
+    if (_batch)
+    {
+        // 只合并完整的binary帧，其他帧先发出已合并的数据以保证顺序
+        if ((WS_OP_BINARY | WS_FINAL_FRAME) == raw_flags)
+        {
+            static class LNetworkMgr *network_mgr = StaticGlobal::network_mgr();
+
+            if (!_batch->append(s2ch, ctx, size))
+            {
+                flush_batch();
+                _batch->append(s2ch, ctx, size);
+            }
+            if (_batch->set_pending())
+            {
+                network_mgr->add_batch(_socket->conn_id());
+            }
+            return 0;
+        }
+        flush_batch();
+    }
 
-    char mask[4]        = {0};
-    uint8_t mask_offset = 0;
-    Buffer &buffer      = _socket->get_send_buffer();
-    Buffer::Transaction &&ts = buffer.flat_reserve(len);
-    size_t offset = websocket_build_frame_header(ts._ctx, flags, mask, frame_size);
-    offset += websocket_append_frame(ts._ctx + offset, flags, mask, header_ctx,
-                                     sizeof(s2ch), &mask_offset);
-    websocket_append_frame(ts._ctx + offset, flags, mask, ctx, size,
-                           &mask_offset);
+    return pack_frame(raw_flags, reinterpret_cast<const char *>(&s2ch),
+                      sizeof(s2ch), ctx, size);
+}
 
-    buffer.commit(ts, (int32_t)len);
-    _socket->flush();
+int32_t WSStreamPacket::set_batch(bool on)
+{
+    if (on)
+    {
+        if (!_batch) _batch = new CltBatch();
+        return 0;
+    }
 
+    if (_batch)
+    {
+        flush_batch();
+        delete _batch;
+        _batch = nullptr;
+    }
     return 0;
 }
+
+void WSStreamPacket::flush_batch()
+{
+    if (!_batch || _batch->empty()) return;
+
+    size_t size     = 0;
+    const char *ctx = _batch->get(size);
+
+    // 合并的数据作为一个帧发出，开启permessage-deflate时整个帧一起压缩
+    pack_frame(WS_OP_BINARY | WS_FINAL_FRAME, nullptr, 0, ctx, size);
+
+    _batch->clear();
+}
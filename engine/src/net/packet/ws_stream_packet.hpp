@@ -25,9 +25,21 @@ public:
     int32_t raw_pack_clt(int32_t cmd, uint16_t ecode, const char *ctx,
                          size_t size);
 
+    int32_t set_batch(bool on);
+    void flush_batch();
+
+protected:
+    /// 数据包(包头 + 数据)的最大长度，压缩的消息解压后也不能超过这个长度
+    virtual size_t max_message() const;
+
 private:
     int32_t sc_command();
+    int32_t sc_command(const struct s2c_header *header, size_t data_size);
+    int32_t sc_batch(const struct s2c_header *header);
     int32_t cs_command(int32_t cmd, const char *ctx, size_t size);
     int32_t do_pack_clt(int32_t raw_flags, int32_t cmd, uint16_t ecode,
                         const char *ctx, size_t size);
+
+private:
+    class CltBatch *_batch; // 合并发送的数据包，未开启时为nullptr
 };
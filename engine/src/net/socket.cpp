@@ -68,6 +68,7 @@ Socket::Socket(int32_t conn_id, ConnType conn_ty)
     _conn_id  = conn_id;
     _conn_ty  = conn_ty;
     _codec_ty = Codec::CT_NONE;
+    _compress = 0;
 
     C_OBJECT_ADD("socket");
 }
@@ -87,6 +88,9 @@ Socket::~Socket()
 
 void Socket::stop(bool flush, bool term)
 {
+    // 合并发送的数据包需要在关闭前放到发送缓冲区，不然就丢掉了
+    if (flush && _w && _packet) _packet->flush_batch();
+
     _status = CS_CLOSING;
 
     // 这里不能直接清掉缓冲区，因为任意消息回调到脚本时，都有可能在脚本关闭socket
@@ -111,12 +115,25 @@ void Socket::append(const void *data, size_t len)
     auto &send_buff = _w->get_send_buffer();
     int32_t e       = send_buff.append(data, len);
 
+    if (EXPECT_FALSE(0 != e)) on_send_overflow();
+}
+
+void Socket::append_shared(Buffer::Shared *shared)
+{
+    auto &send_buff = _w->get_send_buffer();
+    int32_t e       = send_buff.append_shared(shared);
+
+    if (EXPECT_FALSE(0 != e)) on_send_overflow();
+}
+
+void Socket::on_send_overflow()
+{
+    auto &send_buff = _w->get_send_buffer();
+
     /**
      * 一般缓冲区都设置得足够大
      * 如果都溢出了，说明接收端非常慢，比如断点调试，这时候适当处理一下
      */
-    if (EXPECT_TRUE(0 == e)) return;
-
     if (_w->_mask & EVIO::M_OVERFLOW_KILL)
     {
         // 对于客户端这种不重要的，可以断开连接
@@ -133,7 +150,7 @@ void Socket::append(const void *data, size_t len)
         // 如果是服务器之间的连接，考虑阻塞
         // 这会影响定时器这些，但至少数据不会丢
         // 在项目中，比如断点调试，可能会导致数据大量堆积。如果是线上项目，应该不会出现
-        flush();
+        flush_now();
 
         // sleep一会儿，等待backend线程把数据发送出去
         for (int32_t i = 0; i < 4; i++)
@@ -149,6 +166,11 @@ void Socket::append(const void *data, size_t len)
 }
 
 void Socket::flush()
+{
+    StaticGlobal::ev()->io_flush(_w);
+}
+
+void Socket::flush_now()
 {
     StaticGlobal::ev()->io_fast_event(_w, EV_WRITE);
 }
@@ -367,6 +389,7 @@ bool Socket::start(int32_t fd)
         return false;
     }
     _w->bind(&Socket::io_cb, this);
+    _w->_idle_timeout = StaticGlobal::network_mgr()->get_idle_timeout(_conn_ty);
 
     C_SOCKET_TRAFFIC_NEW(_conn_id);
 
@@ -442,6 +465,7 @@ int32_t Socket::connect(const char *host, int32_t port)
         return -1;
     }
     _w->bind(&Socket::io_cb, this);
+    _w->_idle_timeout = StaticGlobal::network_mgr()->get_idle_timeout(_conn_ty);
 
     _fd     = fd;
     _status = CS_OPENED;
@@ -838,6 +862,40 @@ int32_t Socket::set_codec_type(Codec::CodecType codec_type)
     return 0;
 }
 
+bool Socket::compress(int32_t type, int32_t cmd, const char *&ctx,
+                      size_t &size) const
+{
+    if (_compress <= 0 || size < (size_t)_compress) return false;
+
+    size_t len = 0;
+    const char *buff =
+        StaticGlobal::codec_mgr()->get_compressor()->compress(ctx, size, len);
+    if (!buff) return false;
+
+    ZIP_STAT_ADD(type, cmd, size, len);
+
+    ctx  = buff;
+    size = len;
+    return true;
+}
+
+int32_t Socket::compress_clt(int32_t cmd, uint16_t &ecode, const char *&ctx,
+                             size_t &size) const
+{
+    if (_compress <= 0) return 0;
+
+    if (EXPECT_FALSE(ecode & PKT_COMPRESS))
+    {
+        ELOG("packet(%d) errno(%d) conflict with compress flag", cmd,
+             (int32_t)ecode);
+        return -1;
+    }
+    if (!compress(SPT_SCPK, cmd, ctx, size)) return 0;
+
+    ecode = static_cast<uint16_t>(ecode | PKT_COMPRESS);
+    return 1;
+}
+
 void Socket::get_stat(size_t &schunk, size_t &rchunk, size_t &smem,
                       size_t &rmem, size_t &spending, size_t &rpending)
 {
@@ -856,6 +914,38 @@ void Socket::get_stat(size_t &schunk, size_t &rchunk, size_t &smem,
     rpending = recv.get_all_used_size();
 }
 
+int32_t Socket::shrink_buffer()
+{
+    if (!_w) return 0;
+
+    int32_t count = 0;
+    if (_w->get_send_buffer().shrink()) ++count;
+    if (_w->get_recv_buffer().shrink()) ++count;
+
+    return count;
+}
+
+bool Socket::pause_read(bool pause)
+{
+    if (!_w || is_closed()) return false;
+
+    int32_t events = _w->_uevents;
+    if (pause)
+    {
+        // 监听、连接中的socket没有读事件，不需要处理
+        if (!(events & EV_READ)) return false;
+        events &= ~EV_READ;
+    }
+    else
+    {
+        if (events & EV_READ) return false;
+        events |= EV_READ;
+    }
+    _w->set(events);
+
+    return true;
+}
+
 void Socket::set_buffer_params(int32_t send_max, int32_t recv_max, int32_t mask)
 {
     assert(_w);
@@ -5,6 +5,7 @@
 
 #include "io/io.hpp"
 #include "codec/codec.hpp"
+#include "flood_ctrl.hpp"
 #include "packet/packet.hpp"
 
 class LEV;
@@ -125,12 +126,24 @@ public:
     void append(const void *data, size_t len);
 
     /**
-     * @brief 唤醒io线程来发送数据
+     * @brief 追加要发送的共享数据，不拷贝数据，但不唤醒io线程
+     * @param shared 共享数据，由缓冲区增加引用计数
+    */
+    void append_shared(Buffer::Shared *shared);
+
+    /**
+     * @brief 标记需要发送数据，本帧逻辑执行完后再统一唤醒io线程发送
+     * 同一帧内多次调用只会唤醒一次
     */
     void flush();
 
     /**
-     * @brief 追加要发送的数据，并且唤醒io线程
+     * @brief 立即唤醒io线程来发送数据，不等待本帧结束
+    */
+    void flush_now();
+
+    /**
+     * @brief 追加要发送的数据，并在本帧结束时唤醒io线程
      * @param data 需要发送的数据指针
      * @param len 需要发送的数据长度
      */
@@ -147,6 +160,31 @@ public:
     class Packet *get_packet() const { return _packet; }
     Codec::CodecType get_codec_type() const { return _codec_ty; }
 
+    /**
+     * 设置数据包压缩，需要连接双方协商一致(见PKT_COMPRESS)
+     * @param threshold 数据超过此长度才压缩，0表示不压缩
+     */
+    void set_compress(int32_t threshold) { _compress = threshold; }
+    /// 是否开启了数据包压缩
+    bool is_compress() const { return _compress > 0; }
+
+    /**
+     * 根据连接的设置压缩待发送的数据，数据太小或者压缩后没有变小则不压缩
+     * @param type 数据包类型，用于统计
+     * @param cmd 指令，用于统计
+     * @param ctx 需要压缩的数据，压缩后指向压缩后的数据
+     * @param size 数据长度，压缩后为压缩后的长度
+     * @return 是否压缩
+     */
+    bool compress(int32_t type, int32_t cmd, const char *&ctx,
+                  size_t &size) const;
+    /**
+     * 同compress，用于发往客户端的数据包，压缩后在错误码中设置PKT_COMPRESS
+     * @return <0 错误码与压缩标识冲突，0 未压缩，1 已压缩
+     */
+    int32_t compress_clt(int32_t cmd, uint16_t &ecode, const char *&ctx,
+                         size_t &size) const;
+
     inline int32_t fd() const { return _fd; }
     inline int32_t conn_id() const { return _conn_id; }
     inline ConnType conn_type() const { return _conn_ty; }
@@ -159,6 +197,9 @@ public:
     */
     void set_buffer_params(int32_t send_max, int32_t recv_max, int32_t mask);
 
+    /// 获取流量控制数据，见LNetworkMgr::flood_check
+    FloodCtrl &get_flood() { return _flood; }
+
     inline int64_t get_object_id() const { return _object_id; }
     inline void set_object_id(int64_t oid) { _object_id = oid; }
 
@@ -174,6 +215,25 @@ public:
     void get_stat(size_t &schunk, size_t &rchunk, size_t &smem, size_t &rmem,
                   size_t &spending, size_t &rpending);
 
+    /**
+     * 回收空闲的收发缓冲区，见Buffer::shrink
+     * @return 回收的缓冲区数量
+     */
+    int32_t shrink_buffer();
+
+    /**
+     * 暂停或恢复读取数据，用于内存不足时的流量控制
+     * @param pause 是否暂停
+     * @return 状态是否有变化
+     */
+    bool pause_read(bool pause);
+
+    /// 缓冲区溢出时是否可以直接断开连接(一般是客户端连接)
+    bool is_overflow_kill() const
+    {
+        return _w && (_w->_mask & EVIO::M_OVERFLOW_KILL);
+    }
+
 private:
     /**
      * 处理socket关闭后续工作
@@ -183,6 +243,8 @@ private:
     void listen_cb();
     void command_cb();
     void connect_cb();
+    /// 发送缓冲区溢出时，根据设置断开连接或者等待数据发送
+    void on_send_overflow();
 
 protected:
     int32_t _conn_id;
@@ -198,4 +260,7 @@ private:
     class Packet *_packet;
 
     Codec::CodecType _codec_ty;
+    int32_t _compress; // 数据超过此长度才压缩，0表示不压缩
+
+    FloodCtrl _flood; // 客户端发包的流量控制
 };
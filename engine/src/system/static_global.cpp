@@ -12,6 +12,7 @@ class LLog *StaticGlobal::_async_log          = nullptr;
 class ThreadMgr *StaticGlobal::_thread_mgr    = nullptr;
 class LNetworkMgr *StaticGlobal::_network_mgr = nullptr;
 Buffer::ChunkPool *StaticGlobal::_buffer_chunk_pool = nullptr;
+Buffer::CtxPool *StaticGlobal::_buffer_ctx_pool     = nullptr;
 
 // initializer最高等级初始化，在main函数之前，适合设置一些全局锁等
 class StaticGlobal::initializer StaticGlobal::_initializer;
@@ -71,6 +72,7 @@ void StaticGlobal::initialize()
     _ssl_mgr     = new class SSLMgr();
     _network_mgr = new class LNetworkMgr();
     _buffer_chunk_pool = new Buffer::ChunkPool("buffer_chunk");
+    _buffer_ctx_pool   = new Buffer::CtxPool();
 
     _async_log->set_thread_name(STD_FMT("global_async_log"));
     _async_log->AsyncLog::start(1000000);
@@ -96,6 +98,7 @@ void StaticGlobal::uninitialize()
     _network_mgr->clear();
 
     delete _buffer_chunk_pool;
+    delete _buffer_ctx_pool;
     delete _network_mgr;
     delete _ssl_mgr;
     delete _codec_mgr;
@@ -66,6 +66,10 @@ public:
     {
         return _buffer_chunk_pool;
     }
+    static Buffer::CtxPool *buffer_ctx_pool()
+    {
+        return _buffer_ctx_pool;
+    }
 
 private:
     class initializer // 提供一个等级极高的初始化
@@ -85,6 +89,7 @@ private:
     static class ThreadMgr *_thread_mgr;
     static class LNetworkMgr *_network_mgr;
     static Buffer::ChunkPool *_buffer_chunk_pool;
+    static Buffer::CtxPool *_buffer_ctx_pool;
 
     static class initializer _initializer;
 };
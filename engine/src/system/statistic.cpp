@@ -110,6 +110,34 @@ void Statistic::add_rpc_count(const char *cmd, int32_t size, int64_t msec)
     if (-1 == pkt._min_size || size < pkt._min_size) pkt._min_size = size;
 }
 
+void Statistic::add_zip_count(int32_t type, int32_t cmd, size_t raw,
+                              size_t size)
+{
+    assert(type > SPT_NONE && type < SPT_MAXT);
+
+    PktCounter &pkt = _pkt_count[type][cmd];
+    pkt._zip_count += 1;
+    pkt._zip_raw += (int64_t)raw;
+    pkt._zip_size += (int64_t)size;
+}
+
+void Statistic::add_ws_deflate(bool inflate, size_t raw, size_t size,
+                               int64_t usec)
+{
+    DeflateCounter &counter = _ws_deflate[inflate ? 1 : 0];
+    counter._count += 1;
+    counter._raw += (int64_t)raw;
+    counter._size += (int64_t)size;
+    counter._usec += usec;
+}
+
+void Statistic::add_flood(int32_t cmd, bool kick)
+{
+    _flood._drop += 1;
+    _flood._cmd[cmd] += 1;
+    if (kick) _flood._kick += 1;
+}
+
 void Statistic::add_pkt_count(int32_t type, int32_t cmd, int32_t size,
                               int64_t msec)
 {
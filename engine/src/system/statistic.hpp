@@ -58,6 +58,11 @@
     {                                                 \
         G_STAT->add_pkt_count(type, cmd, size, msec); \
     } while (0)
+#define ZIP_STAT_ADD(type, cmd, raw, size)           \
+    do                                               \
+    {                                                \
+        G_STAT->add_zip_count(type, cmd, raw, size); \
+    } while (0)
 #define RPC_STAT_ADD(cmd, size, msec)           \
     do                                          \
     {                                           \
@@ -114,6 +119,9 @@ public:
         int64_t _count;
         int32_t _max_size;
         int32_t _min_size;
+        int64_t _zip_count; // 压缩的次数
+        int64_t _zip_raw;   // 压缩前的总大小
+        int64_t _zip_size;  // 压缩后的总大小
 
         PktCounter() { reset(); }
         inline void reset()
@@ -125,6 +133,10 @@ public:
             _count    = 0;
             _max_size = 0;
             _min_size = -1;
+
+            _zip_count = 0;
+            _zip_raw   = 0;
+            _zip_size  = 0;
         }
     };
 
@@ -146,6 +158,44 @@ public:
         time_t _time; // 时间戳，各个socket时间不一样，要分开统计
     };
 
+    // websocket压缩计数器
+    class DeflateCounter
+    {
+    public:
+        DeflateCounter() { reset(); }
+        inline void reset()
+        {
+            _count = 0;
+            _raw   = 0;
+            _size  = 0;
+            _usec  = 0;
+        }
+
+    public:
+        int64_t _count;
+        int64_t _raw;  // 未压缩的总大小
+        int64_t _size; // 压缩后的总大小
+        int64_t _usec; // 消耗的时间(微秒)
+    };
+
+    // 客户端流量控制计数器
+    class FloodCounter
+    {
+    public:
+        FloodCounter() { reset(); }
+        inline void reset()
+        {
+            _drop = 0;
+            _kick = 0;
+            _cmd.clear();
+        }
+
+    public:
+        int64_t _drop; // 丢弃的包数量
+        int64_t _kick; // 断开的连接数量
+        std::unordered_map<int32_t, int64_t> _cmd; // 各指令丢弃的包数量
+    };
+
     typedef std::unordered_map<int32_t, PktCounter> PktCounterType;
     typedef std::unordered_map<std::string, PktCounter> RPCCounterType;
 
@@ -176,6 +226,9 @@ public:
 
     void add_rpc_count(const char *cmd, int32_t size, int64_t msec);
     void add_pkt_count(int32_t type, int32_t cmd, int32_t size, int64_t msec);
+    void add_zip_count(int32_t type, int32_t cmd, size_t raw, size_t size);
+    void add_ws_deflate(bool inflate, size_t raw, size_t size, int64_t usec);
+    void add_flood(int32_t cmd, bool kick);
 
     inline void reset_lua_gc() { _lua_gc.reset(); }
 
@@ -185,6 +238,11 @@ public:
     {
         return _c_lua_obj;
     }
+    const Statistic::DeflateCounter *get_ws_deflate() const
+    {
+        return _ws_deflate;
+    }
+    const Statistic::FloodCounter &get_flood() const { return _flood; }
     const Statistic::TrafficCounter *get_total_traffic() const
     {
         return _total_traffic;
@@ -203,4 +261,6 @@ public:
     PktCounterType _pkt_count[SPT_MAXT]; // 发包时间、数量、大小统计
     SocketTrafficType _socket_traffic;   // 各个socket单独流量统计
     TrafficCounter _total_traffic[Socket::CT_MAX]; // socket总流量统计
+    DeflateCounter _ws_deflate[2]; // websocket压缩、解压统计
+    FloodCounter _flood; // 客户端流量控制统计
 };
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * 单生产者单消费者(single producer single consumer)的无锁环形队列
+ * 1. 只能有一个线程push，一个线程pop，否则需要外部加锁
+ * 2. 队列大小固定，push失败时由调用者处理溢出(如回退到加锁的队列)
+ * 3. _head和_tail分别只由一方修改，放在不同的cache line避免false sharing
+ * @tparam T 元素类型，需要可复制
+ * @tparam N 队列大小，必须是2的N次方
+ */
+template <class T, size_t N> class SPSCQueue final
+{
+    static_assert(N >= 2 && 0 == (N & (N - 1)), "N must be power of 2");
+
+public:
+    SPSCQueue()
+    {
+        _head.store(0, std::memory_order_relaxed);
+        _tail.store(0, std::memory_order_relaxed);
+
+        _head_cache = 0;
+        _tail_cache = 0;
+    }
+    ~SPSCQueue()                   = default;
+    SPSCQueue(const SPSCQueue &)   = delete;
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+    /**
+     * @brief 添加一个元素，仅生产者线程调用
+     * @param v 需要添加的元素
+     * @return 队列已满时返回false
+     */
+    bool push(const T &v)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail_cache >= N)
+        {
+            // 缓存的位置显示已满时才去读消费者的位置，减少cache line同步
+            _tail_cache = _tail.load(std::memory_order_acquire);
+            if (head - _tail_cache >= N) return false;
+        }
+
+        _buffer[head & MASK] = v;
+        _head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @brief 取出一个元素，仅消费者线程调用
+     * @param v 取出的元素
+     * @return 队列为空时返回false
+     */
+    bool pop(T &v)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head_cache)
+        {
+            _head_cache = _head.load(std::memory_order_acquire);
+            if (tail == _head_cache) return false;
+        }
+
+        v = _buffer[tail & MASK];
+        _tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /**
+     * @brief 遍历并修改队列中还未取出的元素，用于把已失效的元素置空
+     * 调用者必须是生产者线程，并且保证消费者此时不会pop(如持有消费者的锁)
+     * @param func 处理元素的函数
+     */
+    template <class F> void for_each(F &&func)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t tail = _tail.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) func(_buffer[tail & MASK]);
+    }
+
+    /// 队列是否为空，仅用于消费者判断
+    bool empty() const
+    {
+        return _tail.load(std::memory_order_relaxed)
+               == _head.load(std::memory_order_acquire);
+    }
+
+private:
+    static const size_t MASK       = N - 1;
+    static const size_t CACHE_LINE = 64;
+
+    alignas(CACHE_LINE) std::atomic<size_t> _head; ///< 生产者写入的位置
+    size_t _tail_cache; ///< 生产者缓存的消费者位置
+    alignas(CACHE_LINE) std::atomic<size_t> _tail; ///< 消费者读取的位置
+    size_t _head_cache; ///< 消费者缓存的生产者位置
+    alignas(CACHE_LINE) T _buffer[N];
+};
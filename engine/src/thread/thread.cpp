@@ -80,7 +80,7 @@ void Thread::sig_handler(int32_t signum)
     // 由于这里信号使用很少，未生效可以多次发
     if (old) return;
 
-    StaticGlobal::ev()->wake(true);
+    StaticGlobal::ev()->wake();
 }
 
 void Thread::signal(int32_t sig, int32_t action)
@@ -204,7 +204,9 @@ void Thread::spawn(int32_t us)
 
 void Thread::wakeup_main(int32_t status)
 {
+    // 必须先设置_main_ev，再设置线程管理器的标记，主线程则按相反的顺序检测
     _main_ev |= status;
+    StaticGlobal::thread_mgr()->mark_main_event();
 
-    StaticGlobal::ev()->wake(true);
+    StaticGlobal::ev()->wake();
 }
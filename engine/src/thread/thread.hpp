@@ -136,10 +136,14 @@ void child()
 socketpair、condition_variable问题都不大。但当子线程返回数据给主线程时，主线程是多任务的，
 可能处理于epoll_wait，无法用condition_variable来唤醒。
 
-旧版本(pthread版本)使用socketpair来唤醒主线程。现在使用std::thread后，由于socketpair不是
-C++标准的内容，改用busy wait的方式，即主线程每5ms查询一次子线程的数据。
-
-改用busy wait后，空载CPU会上涨1%左右
+旧版本(pthread版本)使用socketpair来唤醒主线程。后来使用std::thread后，由于socketpair不是
+C++标准的内容，改用busy wait的方式，即主线程每5ms查询一次子线程的数据，空载CPU会上涨1%左右。
+
+现在主线程不再直接等待epoll，而是在EV::loop中用condition_variable等待(linux下即futex)，
+io线程、数据库线程、信号统一通过EV::wake唤醒主线程，不再需要busy wait：
+1. 子线程调用wakeup_main，先设置自己的_main_ev，再设置ThreadMgr的标记，最后EV::wake
+2. EV::wake通过_has_job合并唤醒，主线程处理之前多次唤醒只会notify一次
+3. 主线程被唤醒后，ThreadMgr::main_routine检测到标记才遍历子线程处理数据
 */
 
 #include <mutex>
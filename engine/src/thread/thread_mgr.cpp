@@ -1,6 +1,9 @@
 #include "thread_mgr.hpp"
 
-ThreadMgr::ThreadMgr() {}
+ThreadMgr::ThreadMgr()
+{
+    _main_ev = false;
+}
 
 ThreadMgr::~ThreadMgr() {}
 
@@ -36,13 +39,23 @@ void ThreadMgr::stop(const Thread *exclude)
     _threads.clear();
 }
 
-void ThreadMgr::main_routine()
+int32_t ThreadMgr::main_routine()
 {
+    // 先清除标记再检测各线程，检测期间子线程设置的数据会在下一次处理
+    if (!_main_ev.exchange(false)) return 0;
+
+    int32_t count = 0;
     for (auto thread : _threads)
     {
         int32_t ev = thread->main_event_once();
-        if (ev) thread->main_routine(ev);
+        if (ev)
+        {
+            ++count;
+            thread->main_routine(ev);
+        }
     }
+
+    return count;
 }
 
 const char *ThreadMgr::who_is_busy(size_t &finished, size_t &unfinished, bool skip)
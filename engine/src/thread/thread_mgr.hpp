@@ -15,8 +15,17 @@ public:
     /// 停止所有线程
     void stop(const Thread *exclude = nullptr);
 
-    /// 主线程定时处理子线程的数据
-    void main_routine();
+    /**
+     * @brief 主线程处理子线程的数据，没有子线程唤醒过主线程时直接返回
+     * @return 本次处理了数据的子线程数量
+     */
+    int32_t main_routine();
+
+    /// 标记有子线程的数据需要主线程处理，由子线程调用
+    void mark_main_event()
+    {
+        _main_ev = true;
+    }
 
     /// 查找当前繁忙的子线程
     const char *who_is_busy(size_t &finished, size_t &unfinished,
@@ -25,5 +34,7 @@ public:
     const std::vector<Thread *> &get_threads() const { return _threads; }
 
 private:
+    /// 是否有子线程的数据需要主线程处理，避免每次主循环都遍历所有线程
+    std::atomic<bool> _main_ev;
     std::vector<Thread *> _threads;
 };
@@ -54,7 +54,7 @@ function Chat.world_chat(player, pkt)
     rpkt.context = pkt.context
     rpkt.channel = CHAT.CHL_PRIVATE
 
-    SrvMgr.clt_multicast(2, {}, CHAT.DOCHAT, rpkt)
+    SrvMgr.clt_channel_cast(CHANNEL.WORLD, CHAT.DOCHAT, rpkt)
 end
 
 channel_func[Chat.CHL_WORLD] = Chat.world_chat
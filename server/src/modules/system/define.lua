@@ -29,6 +29,13 @@ MAX_SYS_MAIL = 500
 SRV_ALIVE_INTERVAL = 5
 SRV_ALIVE_TIMES = 5
 
+-- 客户端连接空闲超时(秒)，超过这个时间没收到任何数据则由底层断开，0表示不检测
+CLT_IDLE_TIMEOUT = 180
+
+-- 客户端每秒允许发送的包数量及允许突发的数量，超出则由底层断开，0表示不限制
+CLT_FLOOD_RATE = 100
+CLT_FLOOD_BURST = 300
+
 -- 接入平台
 PLATFORM = {[999] = "test"}
 
@@ -39,6 +46,14 @@ UNIQUEID = {
 -- 自定义客户端广播方式
 CLTCAST = {
     PIDS = 1, -- 按pid广播，这个在C++底层直接处理
-    WORLD = 2, -- 全服广播，但仅限于已Enter World的玩家
+    CHANNEL = 2, -- 按频道广播，频道成员在网关的C++底层维护
     LEVEL = 3 -- 按等级筛选玩家
 }
+
+-- 广播频道，帮派、队伍等需要区分具体id的频道，id = 类型 << 24 | 具体id
+CHANNEL = {
+    WORLD = 1, -- 全服广播，但仅限于已Enter World的玩家
+    GUILD = 2, -- 帮派
+    SCENE = 3, -- 场景
+    TEAM = 4 -- 队伍
+}
@@ -1,7 +1,15 @@
 -- 错误码定义，方便出问题时查找问题
+-- 错误码范围为0~0x7FFF，最高位(0x8000)在开启了数据包压缩的连接上用作压缩标识
+-- (见引擎中的PKT_COMPRESS)，超出范围的错误码在这些连接上会发送失败
 local E = {
     OK = 0, -- 成功，无错误
     UNDEFINE = 1 -- 未定义，如果出错了，又不关心是什么错，可以用这个
 }
 
+local MAX_ERRNO = 0x7FFF
+for name, e in pairs(E) do
+    assert(math.type(e) == "integer" and e >= 0 and e <= MAX_ERRNO,
+        string.format("errno %s = %s out of range [0, 0x7FFF]", name, e))
+end
+
 return E
@@ -10,7 +10,10 @@ local this = global_storage("CltMgr", {
 -- 主动关闭客户端连接(只关闭连接，不处理其他帐号下线逻辑)
 function CltMgr.clt_close(clt_conn)
     this.clt_conn[clt_conn.conn_id] = nil
-    if clt_conn.pid then this.clt[clt_conn.pid] = nil end
+    if clt_conn.pid then
+        this.clt[clt_conn.pid] = nil
+        network_mgr:channel_quit(clt_conn.pid)
+    end
 
     clt_conn:close()
 end
@@ -33,6 +36,25 @@ function CltMgr.bind_role(pid, clt_conn)
 
     clt_conn:bind_role(pid)
     this.clt[pid] = clt_conn
+
+    -- 进入游戏后加入世界频道
+    network_mgr:channel_join(CHANNEL.WORLD, pid)
+end
+
+-- 加入广播频道
+function CltMgr.channel_join(channel_id, pid)
+    network_mgr:channel_join(channel_id, pid)
+end
+
+-- 离开广播频道
+function CltMgr.channel_leave(channel_id, pid)
+    network_mgr:channel_leave(channel_id, pid)
+end
+
+-- 广播到频道内的所有客户端(仅网关可用)
+function CltMgr.channel_cast(channel_id, cmd, pkt, ecode)
+    return network_mgr:clt_channel_cast(channel_id, network_mgr.CDT_PROTOBUF,
+                                        cmd.i, ecode or 0, pkt)
 end
 
 -- 获取客户端连接
@@ -63,6 +85,7 @@ function CltMgr.clt_conn_del(conn_id)
     -- 如果已经登录，通知其他服玩家下线
     if conn.pid then
         this.clt[conn.pid] = nil
+        network_mgr:channel_quit(conn.pid)
         local pkt = {pid = conn.pid}
         SrvMgr.send_world_pkt(SYS.PLAYER_OFFLINE, pkt)
     end
@@ -78,17 +101,11 @@ end
 
 -- 此函数必须返回一个value为玩家id的table
 -- CLTCAST定义在define.lua
+-- 按频道广播(CLTCAST.CHANNEL)在C++底层处理，不会回调到这里
 function clt_multicast_new(mask, ...)
-    if mask == CLTCAST.WORLD then
-        local pid_list = {}
-        for pid in pairs(this.clt) do
-            table.insert(pid_list, pid)
-        end
-        return pid_list
-        -- elseif mask == CLTCAST.LEVEL then
-    else
-        eprint("clt_multicast_new unknow mask", mask)
-    end
+    -- if mask == CLTCAST.LEVEL then
+    -- end
+    eprint("clt_multicast_new unknow mask", mask)
 end
 
 local function on_app_start(check)
@@ -118,6 +135,12 @@ local function on_app_start(check)
     local ip = g_app_setting.cip
     local port = g_app_setting.cport
 
+    -- 客户端的心跳检测由底层io线程处理，超时断开时conn_del会收到ETIMEDOUT
+    network_mgr:set_idle_timeout(network_mgr.CT_SCCN, CLT_IDLE_TIMEOUT * 1000)
+    -- 客户端刷包由底层在解码前处理，不占用脚本的时间，统计见statistic.dump的flood
+    network_mgr:set_flood_limit(
+        CLT_FLOOD_RATE, CLT_FLOOD_BURST, network_mgr.FA_KICK)
+
     -- 监听客户端连接
     this.clt_listen_conn = ScConn()
     local ok, msg = this.clt_listen_conn:listen(ip, port)
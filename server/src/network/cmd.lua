@@ -98,16 +98,17 @@ local function load_schema(schema_type, path, priority, suffix)
     -- SC数据包则需要在各个进程设置到C++，这样就能在所有进程发协议给客户端
     for _, m in pairs(Cmd.CS) do
         for _, mm in pairs(m) do
+            local mask = mm.view and network_mgr.MK_VIEW or 0
             if mm.s then
                 local package, object = split_schema(mm.s)
-                network_mgr:set_sc_cmd(mm.i, package, object, 0, 0)
+                network_mgr:set_sc_cmd(mm.i, package, object, mask, 0)
             end
 
             -- 注册客户端发往服务器的指令配置（机器人会用到）
             -- 服务端用的话是在注册回调时根据服务器session自动分发
             if mm.c and Cmd.USE_CS_CMD then
                 local package, object = split_schema(mm.c)
-                network_mgr:set_cs_cmd(mm.i, package, object, 0, 0)
+                network_mgr:set_cs_cmd(mm.i, package, object, mask, 0)
             end
         end
     end
@@ -140,6 +141,8 @@ function Cmd.last_cmd()
 end
 
 -- 注册客户端协议回调
+-- 协议定义中指定了view = true时，使用flatbuffers的协议解码为只读视图，字段在访问时
+-- 才解析，适用于很大但只读取少数字段的协议。视图只在回调中有效，不能保存
 -- @param noauth 处理此协议时，不要求该链接可信
 function Cmd.reg(cmd, handler, noauth)
     local i = cmd.i
@@ -152,7 +155,8 @@ function Cmd.reg(cmd, handler, noauth)
     }
 
     local package, object = split_schema(cmd.c)
-    network_mgr:set_cs_cmd(i, package, object, 0, SESSION)
+    local mask = cmd.view and network_mgr.MK_VIEW or 0
+    network_mgr:set_cs_cmd(i, package, object, mask, SESSION)
 end
 
 -- 注册客户端协议回调，回调时第一个参数为player对象，仅在world进程有效
@@ -90,7 +90,11 @@ function Conn:set_conn_param()
             action = 1, -- over_action，1 表示缓冲区溢出后断开
             chunk_size = 8192, -- 单个缓冲区大小
             send_chunk_max = 128, -- 发送缓冲区数量
-            recv_chunk_max = 8 -- 接收缓冲区数
+            recv_chunk_max = 8, -- 接收缓冲区数
+            compress = 0, -- 数据超过此长度才压缩，0表示不压缩，双方必须一致
+            batch = false, -- 同一帧内发往客户端的包合并发送，客户端必须支持
+            -- websocket的permessage-deflate压缩，握手时协商
+            ws_deflate = {window_bits = 15, mem_limit = 128 * 1024}
         }
     ]]
 
@@ -114,6 +118,30 @@ function Conn:set_conn_param()
 
     network_mgr:set_buffer_params(
         conn_id, send_chunk_max, recv_chunk_max, action)
+
+    if param.compress and param.compress > 0 then
+        network_mgr:set_conn_compress(conn_id, param.compress)
+    end
+
+    if param.batch then network_mgr:set_conn_batch(conn_id, true) end
+
+    local ws_deflate = param.ws_deflate
+    if ws_deflate then
+        network_mgr:set_conn_deflate(conn_id,
+            ws_deflate.window_bits or 15, ws_deflate.mem_limit or 0)
+    end
+end
+
+-- 开启数据包压缩，与客户端的连接需要在登录时协商好再调用
+-- @param threshold 数据超过此长度才压缩，0表示不压缩
+function Conn:set_compress(threshold)
+    network_mgr:set_conn_compress(self.conn_id, threshold)
+end
+
+-- 开启或关闭合并发送，同一帧内发往客户端的数据包合并成一个容器包
+-- 与客户端的连接需要在登录时协商好再调用
+function Conn:set_batch(on)
+    network_mgr:set_conn_batch(self.conn_id, on)
 end
 
 -- 根据连接id获取对象
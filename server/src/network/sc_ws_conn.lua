@@ -14,7 +14,9 @@ ScWsConn.default_param = {
     pkt = network_mgr.PT_WSSTREAM, -- 打包类型
     action = 1, -- over_action，1 表示缓冲区溢出后断开
     send_chunk_max = 128, -- 发送缓冲区数量
-    recv_chunk_max = 8 -- 接收缓冲区数
+    recv_chunk_max = 8, -- 接收缓冲区数
+    -- permessage-deflate压缩，客户端不支持时不压缩
+    ws_deflate = {window_bits = 15, mem_limit = 128 * 1024}
 }
 
 local MASK = WsConn.WS_FINAL_FRAME | WsConn.WS_OP_BINARY
@@ -121,6 +121,21 @@ function SrvMgr.clt_multicast(mask, args_list, cmd, pkt, ecode)
                                      ecode or 0, pkt)
 end
 
+-- 非网关向频道内的客户端广播，由网关转发
+-- @channel_id:频道id，频道成员在网关维护，见CltMgr.channel_join
+function SrvMgr.clt_channel_cast(channel_id, cmd, pkt, ecode)
+    local srv_conn = this.srv[GSE]
+    return network_mgr:ssc_multicast(srv_conn.conn_id, CLTCAST.CHANNEL,
+                                     {channel_id}, network_mgr.CDT_PROTOBUF,
+                                     cmd.i, ecode or 0, pkt)
+end
+
+-- 预先编码发往客户端的数据包，同一帧内把同一个包发给多个客户端时使用
+-- 返回的句柄可以代替pkt传给send_pkt、clt_multicast等，本帧结束后失效，不要保存
+function SrvMgr.encode_clt_pkt(cmd, pkt)
+    return network_mgr:encode_packet(network_mgr.CDT_PROTOBUF, cmd.i, pkt)
+end
+
 -- 客户端广播(直接发给客户端，仅网关可用)
 -- @conn_list: 客户端conn_id列表
 function SrvMgr.raw_clt_multicast(conn_list, cmd, pkt, ecode)
@@ -14,7 +14,8 @@ SsConn.default_param = {
     pkt = network_mgr.PT_STREAM, -- 打包类型
     action = 2, -- over_action，2 表示缓冲区满后进入自旋来发送数据
     send_chunk_max = 1024, -- 发送缓冲区chunk数量，单个chunk8k，见C++ buffer.h定义
-    recv_chunk_max = 1024 -- 接收缓冲区chunk数量
+    recv_chunk_max = 1024, -- 接收缓冲区chunk数量
+    compress = 4096 -- 数据超过4k才压缩
 }
 
 function SsConn:__init(conn_id)
@@ -9,12 +9,16 @@ local handshake_clt = 'GET %s HTTP/1.1\r\n\z
     Host: %s\r\n\z
     Sec-WebSocket-Key: %s\r\n\z
     Upgrade: websocket\r\n\z
-    Sec-WebSocket-Version: 13\r\n\r\n'
+    Sec-WebSocket-Version: 13\r\n%s\r\n'
 
 local handshake_srv = 'HTTP/1.1 101 WebSocket Protocol Handshake\r\n\z
     Connection: Upgrade\r\n\z
     Upgrade: WebSocket\r\n\z
-    Sec-WebSocket-Accept: %s\r\n\r\n'
+    Sec-WebSocket-Accept: %s\r\n%s\r\n'
+
+-- permessage-deflate扩展(RFC 7692)，窗口大小由服务器根据内存上限决定
+local deflate_offer = "Sec-WebSocket-Extensions: \z
+    permessage-deflate; client_max_window_bits\r\n"
 
 local ws_magic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
 
@@ -56,16 +60,25 @@ WsConn.default_param = {
     action = 1, -- over_action，1 表示缓冲区溢出后断开
     send_chunk_max = 128, -- 发送缓冲区数量
     recv_chunk_max = 8 -- 接收缓冲区数
+    -- 开启permessage-deflate压缩，mem_limit为每个连接压缩上下文的内存上限
+    -- ws_deflate = {window_bits = 15, mem_limit = 128 * 1024}
 }
 
 -- 处理websocket握手
-function WsConn:handshake_new(sec_websocket_key, sec_websocket_accept)
+-- @param sec_websocket_ext 服务器同意使用的扩展，需要回复给客户端
+function WsConn:handshake_new(sec_websocket_key, sec_websocket_accept,
+                              sec_websocket_ext)
     if sec_websocket_key then
         -- 服务器收到客户端的握手请求
         local sha1 = util.sha1_raw(sec_websocket_key, ws_magic)
         local base64 = util.base64(sha1)
+        local ext = ""
+        if sec_websocket_ext then
+            ext = string.format("Sec-WebSocket-Extensions: %s\r\n",
+                                sec_websocket_ext)
+        end
         network_mgr:send_raw_packet(self.conn_id,
-                                    string.format(handshake_srv, base64))
+                                    string.format(handshake_srv, base64, ext))
     else
         -- 客户端收到服务器返回的握手请求
         local sha1 = util.sha1_raw(self.ws_key, ws_magic)
@@ -95,8 +108,9 @@ function WsConn:send_handshake(url)
     self.ws_key = util.base64(r_val)
 
     local host = HttpConn:fmt_host(self.host, self.port, self.ssl)
+    local ext = self.default_param.ws_deflate and deflate_offer or ""
     network_mgr:send_raw_packet(self.conn_id, string.format(
-        handshake_clt, url or default_url, host, self.ws_key))
+        handshake_clt, url or default_url, host, self.ws_key, ext))
 end
 
 -- io建立成功，开始websocket握手
@@ -37,6 +37,10 @@ t_describe("flatbuffers test", function()
         LITE = {
             s = "system.TestLite", c = "system.TestLite", i = 2
         },
+        -- 解码为只读视图的包
+        VIEW = {
+            s = "system.TestBase", c = "system.TestBase", i = 3, view = true
+        },
     }
 
     -- https://stackoverflow.com/questions/63821960/lua-odd-min-integer-number
@@ -147,6 +151,49 @@ t_describe("flatbuffers test", function()
 
         t_async()
     end)
+    t_it("flatbuffers view", function()
+        local view = nil
+        Cmd.reg(TEST.VIEW, function(pkt)
+            t_equal(type(pkt), "userdata")
+            t_equal(pkt.i1, base_pkt.i1)
+            t_equal(pkt.i642, base_pkt.i642)
+            t_equal(pkt.b1, base_pkt.b1)
+            t_equal(pkt.s2, base_pkt.s2)
+            t_equal(pkt.by2, base_pkt.by2)
+            t_equal(pkt.msg1.ui2, base_pkt.msg1.ui2)
+            t_equal(#pkt.i_list, #base_pkt.i_list)
+            t_equal(pkt.i_list[8], base_pkt.i_list[8])
+            t_equal(pkt.i_list[9], nil)
+            t_equal(#pkt.msg_list, #base_pkt.msg_list)
+            t_equal(pkt.msg_list[3].s2, base_pkt.msg_list[3].s2)
+            t_equal(pkt.not_exist, nil)
+
+            local msg1 = {}
+            for k, v in pairs(pkt.msg1) do msg1[k] = v end
+            t_equal(msg1, base_pkt.msg1)
+
+            -- 回调中解码其他数据包，不能使当前的视图失效
+            local CDT = network_mgr.CDT_FLATBUF
+            local raw = network_mgr:encode_raw_packet(CDT, TEST.LITE.i, lite_pkt)
+            t_equal(network_mgr:decode_raw_packet(CDT, TEST.LITE.i, raw), lite_pkt)
+            t_equal(pkt.i1, base_pkt.i1)
+            t_equal(pkt.msg1.ui2, base_pkt.msg1.ui2)
+
+            view = pkt
+            srv_conn:send_pkt(TEST.VIEW, base_pkt)
+        end, true)
+        clt_conn.on_cmd = function(self, cmd, e, pkt)
+            t_equal(cmd, TEST.VIEW.i)
+            t_equal(pkt.d1, base_pkt.d1)
+            -- 视图只在回调中有效，服务端的回调已经结束
+            t_equal(pcall(function() return view.i1 end), false)
+            t_done()
+        end
+
+        clt_conn:send_pkt(TEST.VIEW, base_pkt)
+
+        t_async()
+    end)
     t_it(string.format("flatbuffers perf test %d", PERF_TIMES), function()
         local count = 0
         Cmd.reg(TEST.LITE, function(pkt)
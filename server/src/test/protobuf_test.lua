@@ -53,6 +53,13 @@ t_describe("protobuf test", function()
         LITE = {
             s = "system.TestLite", c = "system.TestLite", i = 2
         },
+        -- 编码计划与pbc对比测试用的包
+        PLAN = {
+            s = "test.TestPlan", c = "test.TestPlan", i = 3
+        },
+        PLAN_LITE = {
+            s = "test.TestPlanLite", c = "test.TestPlanLite", i = 4
+        },
     }
 
     -- https://stackoverflow.com/questions/63821960/lua-odd-min-integer-number
@@ -166,6 +173,162 @@ t_describe("protobuf test", function()
 
         t_async()
     end)
+    t_it("protobuf plan vs pbc", function()
+        local CDT = network_mgr.CDT_PROTOBUF
+
+        -- 分别用编码计划、pbc编码，pbc的字段顺序取决于table的遍历顺序，因此每个
+        -- 用例只包含一个字段(嵌套的message中也只有一个字段)，按字节对比
+        local function encode(cmd, pkt, plan)
+            network_mgr:set_protobuf_plan(plan)
+            local ok, buff = pcall(network_mgr.encode_raw_packet, network_mgr,
+                CDT, cmd.i, pkt)
+            network_mgr:set_protobuf_plan(true)
+            assert(ok, buff)
+            return buff
+        end
+        local function decode(cmd, buff, plan)
+            network_mgr:set_protobuf_plan(plan)
+            local ok, pkt = pcall(network_mgr.decode_raw_packet, network_mgr,
+                CDT, cmd.i, buff)
+            network_mgr:set_protobuf_plan(true)
+            assert(ok, pkt)
+            return pkt
+        end
+
+        local large_packed = {}
+        for i = 1, 20 do large_packed[i] = -i end
+
+        local cases = {
+            {d = 1.5}, {d = -99999999999999.55555}, {f = 0.5}, {f = -2.25},
+            {i32 = 1}, {i32 = -1},
+            {i32 = 2147483647}, {i32 = -2147483648},
+            {i64 = -1}, {i64 = math.maxinteger}, {i64 = math.mininteger},
+            {u32 = 1}, {u32 = 4294967295},
+            {u64 = -1}, {u64 = math.maxinteger},
+            {s32 = -1}, {s32 = 2147483647}, {s32 = -2147483648},
+            {s64 = -1}, {s64 = math.maxinteger}, {s64 = math.mininteger},
+            {fx32 = 4294967295}, {fx64 = -1}, {fx64 = math.maxinteger},
+            {sfx32 = 2147483647}, {sfx64 = -1}, {sfx64 = math.mininteger},
+            {b = true},
+            {s = "str"}, {s = string.rep("s", 300)}, {by = "\0\1\2\255"},
+            {e = 1}, {e = 100000},
+            -- 嵌套message，空的message也要写入
+            {sub = {}}, {sub = {i32 = -1}},
+            {sub = {subs = {{s = "a"}, {}, {subs = {{i32 = 1}}}}}},
+            -- repeated，packed
+            {r_i32 = {0, 1, -1, 2147483647}}, {p_i32 = {0, 1, -1, 300}},
+            {r_s64 = {0, -1, math.mininteger}},
+            {p_s64 = {0, -1, math.maxinteger}},
+            {p_d = {0.5, -1.5, 0}}, {p_fx32 = {0, 4294967295}},
+            {r_e = {0, 1, 100000}}, {p_e = {1, 0}},
+            {r_s = {"", "a"}}, {r_sub = {{i32 = 1}, {}, {s = "b"}}},
+            {p_b = {true, false}}, {r_i32 = {}}, {p_i32 = {}},
+            -- packed数组超过127字节，长度需要多个字节
+            {p_i32 = large_packed},
+            -- 不等于默认值的要写入
+            {def_i32 = 0}, {def_i64 = 0}, {def_d = 0}, {def_s = ""},
+            {def_e = 0}, {def_b = false},
+            -- 字段号较大
+            {big_id = 1},
+        }
+        -- 等于默认值的都不写入
+        local defaults = {
+            {i32 = 0}, {s = ""}, {b = false}, {e = 0}, {d = 0},
+            {def_i32 = 5}, {def_i64 = -7}, {def_d = 1.5}, {def_s = "def"},
+            {def_e = 1}, {def_b = true},
+        }
+
+        for _, pkt in pairs(cases) do
+            local plan_buff = encode(TEST.PLAN, pkt, true)
+            local pbc_buff = encode(TEST.PLAN, pkt, false)
+            t_equal(plan_buff, pbc_buff)
+
+            -- 解码结果也要一致，枚举都解码为名字
+            t_equal(decode(TEST.PLAN, pbc_buff, true),
+                decode(TEST.PLAN, plan_buff, false))
+        end
+        -- sfixed32在pbc中解码为无符号数，负数只对比编码结果
+        t_equal(encode(TEST.PLAN, {sfx32 = -1}, true),
+            encode(TEST.PLAN, {sfx32 = -1}, false))
+        for _, pkt in pairs(defaults) do
+            t_equal(encode(TEST.PLAN, pkt, true), "")
+            t_equal(encode(TEST.PLAN, pkt, false), "")
+        end
+
+        -- 所有字段一起编码，只是顺序不同，长度必须一致
+        local full = {}
+        for _, pkt in pairs(cases) do
+            for k, v in pairs(pkt) do full[k] = v end
+        end
+        local plan_buff = encode(TEST.PLAN, full, true)
+        local pbc_buff = encode(TEST.PLAN, full, false)
+        t_equal(#plan_buff, #pbc_buff)
+        t_equal(decode(TEST.PLAN, plan_buff, true),
+            decode(TEST.PLAN, pbc_buff, false))
+
+        -- 未定义的字段跳过
+        local lite = {i32 = full.i32, sub = full.sub}
+        local plan_lite = decode(TEST.PLAN_LITE, plan_buff, true)
+        t_equal(plan_lite, decode(TEST.PLAN_LITE, plan_buff, false))
+        t_equal(plan_lite, decode(TEST.PLAN_LITE, pbc_buff, true))
+        t_equal(plan_lite.i32, lite.i32)
+        t_equal(plan_lite.sub, lite.sub)
+    end)
+    t_it("protobuf batch", function()
+        local BATCH_TIMES = 64
+        local count = 0
+
+        Cmd.reg(TEST.BASE, function(pkt)
+            -- 同一帧内发送的包合并成容器包，base_pkt较大，会有放不下的情况
+            srv_conn:set_batch(true)
+            srv_conn:send_pkt(TEST.BASE, pkt)
+            for i = 1, BATCH_TIMES do
+                local one = table.copy(lite_pkt)
+                one.i3 = i
+                srv_conn:send_pkt(TEST.LITE, one)
+            end
+        end, true)
+        clt_conn.on_cmd = function(self, cmd, e, pkt)
+            if 0 == count then
+                t_equal(cmd, TEST.BASE.i)
+                t_equal(pkt, base_pkt)
+            else
+                -- 拆分后的顺序必须和发送时一致
+                t_equal(cmd, TEST.LITE.i)
+                t_equal(pkt.i3, count)
+            end
+            count = count + 1
+            if count > BATCH_TIMES then
+                srv_conn:set_batch(false)
+                t_done()
+            end
+        end
+
+        clt_conn:send_pkt(TEST.BASE, base_pkt)
+
+        t_async()
+    end)
+    t_it("protobuf encoded packet", function()
+        local SEND_TIMES = 8
+        local count = 0
+
+        Cmd.reg(TEST.BASE, function(pkt)
+            -- 只编码一次，多次发送
+            local handle = network_mgr:encode_packet(network_mgr.CDT_PROTOBUF,
+                                                     TEST.BASE.i, pkt)
+            for _ = 1, SEND_TIMES do srv_conn:send_pkt(TEST.BASE, handle) end
+        end, true)
+        clt_conn.on_cmd = function(self, cmd, e, pkt)
+            t_equal(cmd, TEST.BASE.i)
+            t_equal(pkt, base_pkt)
+            count = count + 1
+            if count >= SEND_TIMES then t_done() end
+        end
+
+        clt_conn:send_pkt(TEST.BASE, base_pkt)
+
+        t_async()
+    end)
     t_it(string.format("protobuf performance test %d", PERF_TIMES), function()
         local count = 0
         Cmd.reg(TEST.LITE, function(pkt)
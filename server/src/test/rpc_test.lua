@@ -10,6 +10,112 @@ local listen_conn = nil
 
 -- /////////////////////////////////////////////////////////////////////////////
 
+local util = require "engine.util"
+
+-- rpc的包头，见s2s_header：_length _cmd(编码版本) _errno _packet _codec _owner
+local LUABIN_VERSION = 2
+local SPT_RPCS = 4
+local function pack_rpc_raw(version, body)
+    return string.pack("<I2I2I2I2I2i4", 14 + #body, version, 0, SPT_RPCS, 0, 0)
+        .. body
+end
+
+t_describe("luabin test", function()
+    local encode = util.luabin_encode
+    local decode = util.luabin_decode
+
+    t_it("luabin v2 format", function()
+        -- 第一个字节为变量数量
+        t_equal(encode(false, nil, false, true), "\3\0\1\2")
+        -- 0~127只占1字节
+        t_equal(encode(false, 0), "\1\x80")
+        t_equal(encode(false, 127), "\1\xFF")
+        -- 其他整数为LT_INT + zigzag varint
+        t_equal(encode(false, 128), "\1\4\x80\2")
+        t_equal(encode(false, -1), "\1\4\1")
+        t_equal(encode(false, -64), "\1\4\x7F")
+        t_equal(encode(false, -65), "\1\4\x81\1")
+        t_equal(encode(false, math.maxinteger),
+            "\1\4" .. string.rep("\xFE", 1) .. string.rep("\xFF", 8) .. "\1")
+        t_equal(encode(false, math.mininteger),
+            "\1\4" .. string.rep("\xFF", 9) .. "\1")
+        t_equal(encode(false, 1.5), "\1\3" .. string.pack("=d", 1.5))
+        t_equal(encode(false, "ab"), "\1\5\2ab")
+        -- table：数组数量 + hash数量 + 数组 + key value
+        t_equal(encode(false, {1, a = 2}), "\1\6\1\1\x81\5\1a\x82")
+
+        -- 字典：第一次出现为KEY_DEF(编号 + 长度 + 内容)，之后为KEY_REF(编号)
+        t_equal(encode(true, {{a = 1}, {a = 2}}),
+            "\1\6\2\0\6\0\1\7\0\1a\x81\6\0\1\8\0\x82")
+        -- 超过64字节的key不放到字典
+        local long_key = string.rep("k", 65)
+        t_equal(encode(true, {[long_key] = 1}),
+            "\1\6\0\1\5\x41" .. long_key .. "\x81")
+    end)
+
+    t_it("luabin round trip", function()
+        local values = {
+            0, 1, 127, 128, -1, -63, -64, -65, 255, 256, 65535, -65536,
+            0x7FFFFFFF, -0x80000000, math.maxinteger, math.mininteger,
+            math.maxinteger - 1, math.mininteger + 1,
+            0.5, -0.5, 1e300, -1e-300, math.huge, -math.huge,
+            "", "str", string.rep("s", 200), true, false,
+        }
+        for _, v in pairs(values) do
+            local got = decode(encode(false, v))
+            t_equal(got, v)
+            t_equal(math.type(got), math.type(v))
+        end
+
+        local tbl = {
+            1, nil, 3, "str",
+            a = {b = {c = {d = {e = -1}}}},
+            [-1] = math.mininteger,
+            [0.5] = 0.5,
+            [false] = true,
+            [math.maxinteger] = math.maxinteger,
+        }
+        -- hash部分超过127个时，数量需要多个字节
+        local large = {}
+        for i = 1, 300 do large["k" .. i] = i end
+
+        for _, dict in pairs({false, true}) do
+            local p1, p2, p3, p4 = decode(encode(dict, tbl, large, nil, tbl),
+                dict)
+            t_equal(p1, tbl)
+            t_equal(p2, large)
+            t_equal(p3, nil)
+            t_equal(p4, tbl)
+        end
+
+        -- 字典满(4096)后的key按普通字符串编码
+        local many = {}
+        for i = 1, 5000 do many["key_" .. i] = i end
+        t_equal(decode(encode(true, many, many), true), many)
+    end)
+
+    t_it("luabin decode error", function()
+        -- 数据不完整
+        t_equal(pcall(decode, ""), false)
+        t_equal(pcall(decode, "\2\x80"), false)
+        t_equal(pcall(decode, "\1\4\xFF"), false)
+        t_equal(pcall(decode, "\1\5\9ab"), false)
+        t_equal(pcall(decode, "\1\6\9\0"), false)
+        -- nhash * 2溢出后不能绕过长度检测
+        t_equal(pcall(decode,
+            "\1\6\1\x80\x80\x80\x80\x80\x80\x80\x80\x80\1\x81"), false)
+        -- 没有字典时不能出现字典key
+        t_equal(pcall(decode, "\1\6\0\1\7\0\1a\x81"), false)
+        -- 编号不连续、引用不存在的编号
+        t_equal(pcall(decode, "\1\6\0\1\7\1\1a\x81", true), false)
+        t_equal(pcall(decode, "\1\6\0\1\8\0\x81", true), false)
+        -- nil不能作key
+        t_equal(pcall(decode, "\1\6\0\1\0\x81"), false)
+        -- 不支持的类型
+        t_equal(pcall(encode, false, print), false)
+    end)
+end)
+
 t_describe("rpc test", function()
     local local_host = "::1"
     local local_port = 1099
@@ -133,6 +239,31 @@ t_describe("rpc test", function()
         Rpc.proxy(rpc_empty_reponse).conn_call(
             clt_conn, rpc_query, table.unpack(params))
     end)
+    t_it("rpc large packet test", function()
+        t_async(2000)
+
+        -- 超过64k的包使用扩展长度包头，不需要在脚本分段发送
+        local large = {}
+        for i = 1, 2000 do
+            large[i] = {id = i, name = string.rep("n", 100)}
+        end
+
+        local rpc_large_query = function(pkt)
+            t_equal(pkt, large)
+            return pkt
+        end
+        local rpc_large_response = function(pkt)
+            t_equal(Rpc.last_error(), 0)
+            t_equal(pkt, large)
+            t_done()
+        end
+
+        name_func("rpc_large_query", rpc_large_query)
+        name_func("rpc_large_response", rpc_large_response)
+
+        Rpc.proxy(rpc_large_response).conn_call(
+            clt_conn, rpc_large_query, large)
+    end)
     t_it(string.format("rpc performance test %d", PERF_TIMES), function()
         t_async(5000)
 
@@ -184,6 +315,67 @@ t_describe("rpc test", function()
         end
     )
 
+    t_it("rpc dict test", function()
+        t_async(5000)
+
+        -- 字典是跨数据包的，同样的key后续只发编号
+        local pkt = {id = 1, name = "n", attr = {hp = 100, mp = -1}}
+        local many = {}
+        for i = 1, 5000 do many["dict_key_" .. i] = i end
+
+        local rpc_dict_query = function(...)
+            return ...
+        end
+        local count = 0
+        local rpc_dict_response = function(p1, p2)
+            t_equal(Rpc.last_error(), 0)
+            t_equal(p1, pkt)
+            t_equal(p2, many)
+            count = count + 1
+            if count == 3 then t_done() end
+        end
+
+        name_func("rpc_dict_query", rpc_dict_query)
+        name_func("rpc_dict_response", rpc_dict_response)
+
+        -- 编码失败时，已经添加到字典的key需要回滚，不然后面引用的编号对端没有
+        local bad = {rollback_key = 1, [print] = 1}
+        t_equal(pcall(Rpc.conn_call, clt_conn, rpc_dict_query, bad), false)
+        pkt.rollback_key = 1
+
+        for _ = 1, 3 do
+            Rpc.proxy(rpc_dict_response).conn_call(
+                clt_conn, rpc_dict_query, pkt, many)
+        end
+    end)
+
+    t_it("rpc desync test", function()
+        t_async(2000)
+
+        -- 版本不一致或者字典无法对齐时，对端直接断开连接
+        local bodys = {
+            pack_rpc_raw(0, util.luabin_encode(false, "rpc_query")),
+            pack_rpc_raw(LUABIN_VERSION, "\2\5\9rpc_query\8\9"),
+        }
+
+        local closed = 0
+        local old_srv_conn = srv_conn
+        for _, body in pairs(bodys) do
+            local conn = SsConn()
+            conn:connect(local_host, local_port)
+            conn.on_connected = function(self)
+                network_mgr:send_raw_packet(self.conn_id, body)
+            end
+            conn.on_disconnected = function()
+                closed = closed + 1
+                if closed == #bodys then
+                    srv_conn = old_srv_conn
+                    t_done()
+                end
+            end
+        end
+    end)
+
     t_after(function()
         srv_conn:close()
         clt_conn:close()
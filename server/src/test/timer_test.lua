@@ -32,6 +32,66 @@ t_describe("timer test", function()
         Timer.interval(after, msec, times, timer_interval_test)
     end)
 
+    -- 时间轮的精度和二叉堆一样是1毫秒
+    t_it("timer wheel interval test", function()
+        local after = 300
+        local msec = 23
+        local times = 6
+
+        local next_ms = ev:ms_time() + after
+
+        t_async(10000)
+        local timer_wheel_test = function()
+            local val = math.abs(ev:ms_time() - next_ms)
+            if val > 1 then
+                t_print("timer wheel precision = " .. val)
+                t_assert(false)
+            end
+
+            times = times - 1
+            next_ms = next_ms + msec
+            if times <= 0 then t_done() end
+        end
+
+        name_func("timer_wheel_test", timer_wheel_test)
+        ev:set_timer_wheel(true)
+        Timer.interval(after, msec, times, timer_wheel_test)
+        ev:set_timer_wheel(false)
+    end)
+
+    t_it("timer batch test", function()
+        local after = 50
+        local msec = 10
+        local times = 5
+        local count = 20 -- 多个定时器同时超时，应该在同一批次回调
+
+        local next_ms = ev:ms_time() + after
+
+        t_async(10000)
+        Timer.set_batch(true)
+
+        local fired = 0
+        local timer_batch_test = function()
+            local val = math.abs(ev:ms_time() - next_ms)
+            if val > 1 then
+                t_print("timer batch precision = " .. val)
+                t_assert(false)
+            end
+
+            fired = fired + 1
+            if 0 == fired % count then next_ms = next_ms + msec end
+            if fired >= count * times then
+                Timer.set_batch(false)
+                t_done()
+            end
+        end
+
+        name_func("timer_batch_test", timer_batch_test)
+        for _ = 1, count do
+            Timer.interval(after, msec, times, timer_batch_test)
+        end
+    end)
+
     -- periodic的精度是1秒
     t_it("timer periodic test", function()
         local after = 3
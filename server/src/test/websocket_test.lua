@@ -22,6 +22,7 @@ t_describe("websocket test", function()
 
     local local_port = 8083
     local local_port_s = 8084
+    local local_port_d = 8085
     local local_host = "::1"
     if IPV4 then local_host = "127.0.0.1" end
 
@@ -274,4 +275,66 @@ t_describe("websocket test", function()
         end
 
     end)
+
+    t_it("websocket deflate local", function()
+        t_async(5000)
+
+        -- 开启permessage-deflate，并且限制内存，测试窗口协商
+        local deflate_param = table.copy(ws_default_param)
+        deflate_param.ws_deflate = {window_bits = 15, mem_limit = 64 * 1024}
+
+        local pkt_idx = 0
+        local pkt_body = {
+            "MServer deflate hello",
+            string.rep("MServer deflate large packet ", 1024),
+            "MServer deflate hello",
+            "Hello",
+        }
+        -- RFC 7692 section 7.2.3.1中压缩后分成两个帧的"Hello"。引擎发送时不会
+        -- 把压缩的消息分片，只能直接发送帧数据
+        local fragmented = "\x41\x03\xf2\x48\xcd\x80\x04\xc9\xc9\x07\x00"
+        local function send(self, idx)
+            if idx == #pkt_body then
+                network_mgr:send_raw_packet(self.conn_id, fragmented)
+            else
+                WsConn.send_pkt(self, pkt_body[idx])
+            end
+        end
+
+        local srv_conn
+        local listen_conn
+
+        listen_conn = ScWsConn()
+        listen_conn.default_param = deflate_param
+        listen_conn:listen(local_host, local_port_d)
+        listen_conn.on_accepted = function(self)
+            srv_conn = self
+        end
+        listen_conn.on_cmd = function(self, cmd_body)
+            WsConn.send_pkt(self, cmd_body)
+        end
+        listen_conn.on_disconnected = function() end
+
+        local conn = CsWsConn()
+        conn.default_param = deflate_param
+        conn:connect(local_host, local_port_d)
+
+        conn.on_disconnected = function() end
+        conn.on_connected = function(self)
+            send(self, 1)
+        end
+        conn.on_cmd = function(self, cmd_body)
+            pkt_idx = pkt_idx + 1
+            t_equal(cmd_body, pkt_body[pkt_idx])
+
+            if pkt_body[pkt_idx + 1] then
+                send(self, pkt_idx + 1)
+            else
+                t_done()
+                conn:close()
+                srv_conn:close()
+                listen_conn:close()
+            end
+        end
+    end)
 end)
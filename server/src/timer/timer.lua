@@ -22,6 +22,7 @@ local LIMIT = require "global.limits"
 local this = global_storage("Timer", {
     timer = {},
     next_id = 0,
+    batch = false, -- 是否批量回调
 })
 
 local min_timer = {} -- 分钟级定时器回调
@@ -152,6 +153,13 @@ function Timer.periodic(after, sec, times, func, ...)
     return timer_id
 end
 
+-- 设置定时器是否批量回调
+-- 开启后，C++每帧只回调一次timer_event_batch，适用于定时器数量很多的进程
+function Timer.set_batch(batch)
+    this.batch = batch and true or false
+    ev:set_timer_batch(this.batch)
+end
+
 --[[
     C++ 统一回调这个函数，根据timer_id区分
 ]]
@@ -171,4 +179,29 @@ function timer_event(timer_id)
     return timer.cb()
 end
 
+--[[
+    批量模式下C++回调这个函数，ids为本帧所有超时的定时器id，只有前n个有效
+    同一批次中，前面的回调可能会删除后面的定时器，这时直接跳过
+]]
+function timer_event_batch(ids, n)
+    local timer_map = this.timer
+    for i = 1, n do
+        local timer_id = ids[i]
+        local timer = timer_map[timer_id]
+        if timer then
+            local times = timer.times
+            if times > 0 then -- -1表示无限次数循环
+                timer.ts = timer.ts + 1
+                if timer.ts >= times then Timer.stop(timer_id) end
+            end
+
+            -- 单个定时器出错不能影响同一批次的其他定时器
+            xpcall(timer.cb, __G__TRACKBACK)
+        end
+    end
+end
+
+-- C++缓存了timer_event_batch函数，热更后需要重新设置
+if this.batch then ev:set_timer_batch(true) end
+
 return Timer
@@ -4,6 +4,7 @@
 # sh make.sh llhttp 只编译llhttp组件
 # sh make.sh release 编译release版
 # sh make.sh debug 编译debug版
+# sh make.sh bench 编译性能测试程序并用ctest执行一次冒烟测试
 # sh make.sh 什么参数都不加，执行增量编译
 
 # TODO 可以用realpath取绝对路径，但是那样的话cmake的日志也是绝对路径，太难看了
@@ -18,6 +19,8 @@ do_make()
 		cmake $ENGINE_DIR -DCMAKE_BUILD_TYPE=Release
 	elif [ "$cmake_option" = "debug" ]; then
 		cmake $ENGINE_DIR -DCMAKE_BUILD_TYPE=Debug
+	elif [ "$cmake_option" = "bench" ]; then
+		cmake $ENGINE_DIR -DBUILD_BENCH=ON
 	elif [ "$cmake_option" = "cmake" ]; then
 		# 删除文件后，要重新执行cmake。或者每次都执行cmake？
 		cmake $ENGINE_DIR
@@ -35,7 +38,11 @@ do_make()
 		touch $ENGINE_DIR/src/lua_cpplib/lstate.cpp
 	fi
 
-	make $make_option
+	make $make_option || return 1
+
+	if [ "$cmake_option" = "bench" ]; then
+		ctest --output-on-failure
+	fi
 }
 
 